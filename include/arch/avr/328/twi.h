@@ -123,5 +123,45 @@
 	
 #define I2C_CALC_TWBR(__freq, __pres) \
 (F_CPU - (16*__freq)) / (2*__pres*__freq)
+
+/**
+ * \def I2C_CLOCK
+ * \brief Pack a prescaler and bit rate into an I2C clock setting.
+ * \param __pres Prescaler in hardware format (I2C_PRES_1 .. I2C_PRES_64).
+ * \param __twbr Value of the TWBR register.
+ * \see i2c_shared_info::clock
+ */
+#define I2C_CLOCK(__pres, __twbr) ((((__pres) & B11) << 8) | ((__twbr) & 0xFF))
+
+/**
+ * \def I2C_CLOCK_TWBR
+ * \brief TWBR value of frequency \p __freq with prescaler \p __pres, 0 if \p __freq is too high.
+ */
+#define I2C_CLOCK_TWBR(__freq, __pres) \
+	((F_CPU/(__freq) > 16) ? (F_CPU/(__freq) - 16) / (2*(__pres)) : 0)
+
+/**
+ * \def I2C_CLOCK_HZ
+ * \brief Calculate the clock setting of a frequency at compile time.
+ * \param __freq Frequency in hertz, must be a constant expression.
+ * 
+ * The smallest prescaler which fits the bit rate in TWBR is selected. Frequencies which are too
+ * low for prescaler 64 are clamped to TWBR 255, the slowest clock, just like
+ * atmega_i2c_calc_twbr does at run time.
+ */
+#define I2C_CLOCK_HZ(__freq) \
+	((I2C_CLOCK_TWBR(__freq, 1) <= 255) ? \
+		I2C_CLOCK(I2C_PRES_1, I2C_CLOCK_TWBR(__freq, 1)) : \
+	(I2C_CLOCK_TWBR(__freq, 4) <= 255) ? \
+		I2C_CLOCK(I2C_PRES_4, I2C_CLOCK_TWBR(__freq, 4)) : \
+	(I2C_CLOCK_TWBR(__freq, 16) <= 255) ? \
+		I2C_CLOCK(I2C_PRES_16, I2C_CLOCK_TWBR(__freq, 16)) : \
+	(I2C_CLOCK_TWBR(__freq, 64) <= 255) ? \
+		I2C_CLOCK(I2C_PRES_64, I2C_CLOCK_TWBR(__freq, 64)) : \
+		I2C_CLOCK(I2C_PRES_64, 255))
+
+#define I2C_CLOCK_100K I2C_CLOCK_HZ(100000UL) //!< Standard mode clock setting.
+#define I2C_CLOCK_400K I2C_CLOCK_HZ(400000UL) //!< Fast mode clock setting.
+#define I2C_CLOCK_1M I2C_CLOCK_HZ(1000000UL) //!< Fast mode plus clock setting.
 #endif
 #endif
\ No newline at end of file
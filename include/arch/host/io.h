@@ -0,0 +1,73 @@
+/*
+ *  BermudaOS - Host I/O
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file include/arch/host/io.h Host I/O.
+ *
+ * The host port switches threads cooperatively. Interrupts are simulated by BermudaHostTick,
+ * which is only called while the main thread waits, so a critical section never has to mask
+ * anything.
+ */
+
+#ifndef __HOST_IO_H
+#define __HOST_IO_H
+
+#include <bermuda.h>
+
+/**
+ * \brief Enter IO safe state.
+ */
+#define BermudaEnterCritical() do { } while(0)
+
+/**
+ * \brief Leave IO safe state.
+ */
+#define BermudaExitCritical() do { } while(0)
+
+#define enter_crit() BermudaEnterCritical()
+#define exit_crit() BermudaExitCritical()
+
+/**
+ * \brief No operation.
+ */
+#define nop() __asm__ __volatile__("nop")
+
+/**
+ * \brief Convert milli seconds to system ticks, the simulated tick is one milli second.
+ */
+#define BermudaTimerMillisToTicks(ms) ((unsigned long)(ms))
+
+/**
+ * \brief Program memory string, the host has a single address space.
+ */
+#define PSTR(s) (s)
+
+/**
+ * \brief Set up the standard streams.
+ * \see BermudaHostInit
+ */
+#define setup_std_streams()
+
+__DECL
+extern unsigned long BermudaTimerGetSysTick();
+extern void BermudaHostInit(void);
+extern void BermudaHostTick(void);
+extern unsigned long BermudaHostIdleTicks(void);
+__DECL_END
+
+#endif /* __HOST_IO_H */
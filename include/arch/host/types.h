@@ -0,0 +1,58 @@
+/*
+ *  BermudaOS - Host types
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file include/arch/host/types.h Host types.
+ *
+ * The host port is built against the BermudaOS headers only, so the types are taken from the
+ * compiler instead of the host C library.
+ */
+
+#ifndef __ARCH_HOST_TYPES_H_
+#define __ARCH_HOST_TYPES_H_
+
+/*
+ * Let stddef.h use the compiler builtins, host ABIs pass variable arguments in registers.
+ */
+#define __GNUCLIKE_BUILTIN_VARARGS
+#define __GNUCLIKE_BUILTIN_STDARG
+
+#include <bermuda.h>
+
+#define __byte_swap2(val) \
+	((((val) & 0xff) << 8) |        \
+	(((val) & 0xff00) >> 8))
+
+#define __byte_swap4(val)			\
+	((((val) & 0xff) << 24) |			\
+	(((val) & 0xff00) << 8) |		\
+	(((val) & 0xff0000) >> 8) |	\
+	(((val) & 0xff000000) >> 24))
+
+typedef __UINT64_TYPE__ uint64_t;
+typedef __UINT32_TYPE__ uint32_t;
+typedef __UINT16_TYPE__ uint16_t;
+typedef __UINT8_TYPE__ uint8_t;
+typedef __UINTPTR_TYPE__ uptr;
+typedef __SIZE_TYPE__ size_t;
+typedef long long time_t;
+typedef __INT32_TYPE__ int32_t;
+
+typedef uint32_t __32be;
+typedef uint16_t __16be;
+#endif /* __ARCH_HOST_TYPES_H_ */
@@ -24,5 +24,7 @@
 #if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega328__)
         #include <arch/avr/io.h>
         #include <arch/avr/timer.h>
+#elif defined(__HOST__)
+        #include <arch/host/io.h>
 #endif
 #endif
\ No newline at end of file
@@ -21,6 +21,8 @@
 
 #ifdef __AVR__
 #include <arch/avr/types.h>
+#elif defined(__HOST__)
+#include <arch/host/types.h>
 #endif
 
 #endif /* __ARCHTYPES_H_ */
\ No newline at end of file
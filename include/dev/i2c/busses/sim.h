@@ -0,0 +1,170 @@
+/*
+ *  BermudaOS - I2C bus simulator
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file include/dev/i2c/busses/sim.h I2C bus simulator header.
+ */
+
+#ifndef __I2C_SIM_H
+#define __I2C_SIM_H
+
+#include <stdlib.h>
+
+#include <dev/i2c/i2c.h>
+#include <sys/events/mutex.h>
+
+/**
+ * \addtogroup i2c-sim
+ * @{
+ */
+
+/**
+ * \brief Simulated slave device.
+ *
+ * A slave model implements the bus conditions it is interested in. Hooks which are set to
+ * <i>NULL</i> are acknowledged (or read as 0xFF) by the bus.
+ */
+struct i2c_sim_slave
+{
+	struct i2c_sim_slave *next; //!< Next slave on the bus.
+	uint8_t sla; //!< Slave address (with the R/W bit cleared).
+	void *data; //!< Model data.
+
+	/**
+	 * \brief Address phase.
+	 * \param slave The addressed slave.
+	 * \param read TRUE if the master requested a read.
+	 * \return 0 to acknowledge the address, -1 to NACK it, I2C_SIM_HOLD to hold SCL low.
+	 */
+	int (*start)(struct i2c_sim_slave *slave, bool read);
+
+	/**
+	 * \brief Byte written by the master.
+	 * \param slave The addressed slave.
+	 * \param data Written byte.
+	 * \return 0 to acknowledge the byte, -1 to NACK it.
+	 */
+	int (*write)(struct i2c_sim_slave *slave, uint8_t data);
+
+	/**
+	 * \brief Byte read by the master.
+	 * \param slave The addressed slave.
+	 * \param ack TRUE if the master will acknowledge the byte (i.e. it is not the last byte).
+	 * \return The byte to put on the bus.
+	 */
+	uint8_t (*read)(struct i2c_sim_slave *slave, bool ack);
+
+	/**
+	 * \brief Stop condition.
+	 * \param slave Slave which was addressed last.
+	 */
+	void (*stop)(struct i2c_sim_slave *slave);
+};
+
+/**
+ * \brief Simulated bus statistics.
+ */
+struct i2c_sim_stats
+{
+	unsigned long msgs; //!< Amount of transfered messages.
+	unsigned long bytes; //!< Amount of transfered data bytes.
+	unsigned long starts; //!< Amount of (repeated) start conditions.
+	unsigned long stops; //!< Amount of stop conditions.
+	unsigned long nacks; //!< Amount of not acknowledged address and data bytes.
+	unsigned long callbacks; //!< Amount of transfers stopped at a call back message.
+	unsigned long clocks; //!< SCL periods used, 9 for each address and data byte.
+};
+
+/**
+ * \brief Simulated I2C bus.
+ */
+struct i2c_sim_bus
+{
+	struct i2c_adapter *adapter; //!< Adapter backed by this bus.
+	struct i2c_sim_slave *slaves; //!< Attached slave models.
+	struct i2c_sim_slave *active; //!< Slave addressed since the last stop condition.
+	struct i2c_sim_stats stats; //!< Bus statistics.
+	uint32_t freq; //!< SCL frequency of the last master transfer.
+	bool held; //!< SCL is held low by a slave until the bus is recovered.
+
+	uint8_t sla; //!< Slave address of the adapter, set it before attaching a register file.
+	struct i2c_regfile *regfile; //!< Register file served at \p sla.
+	struct i2c_sim_slave regfile_slave; //!< Slave interface of the adapter.
+
+#ifdef __EVENTS__
+	MUTEX mutex; //!< Bus mutex.
+#endif
+	volatile void *master_queue; //!< Master waiting queue.
+	volatile void *slave_queue; //!< Slave waiting queue.
+};
+
+/**
+ * \brief Returned by i2c_sim_slave::start to hold SCL low.
+ *
+ * The message does not complete, a synchronous transfer times out after I2C_MASTER_TMO and the
+ * bus is recovered. The message is left in the master queue, like a bus driver would.
+ */
+#define I2C_SIM_HOLD 1
+
+/**
+ * \brief Page size of the 24C02 model.
+ */
+#define I2C_SIM_24C02_PAGE 8
+
+/**
+ * \brief Simulated 24C02 serial EEPROM.
+ * \see i2c_sim_24c02_init
+ */
+struct i2c_sim_24c02
+{
+	struct i2c_sim_slave slave; //!< Bus interface.
+	uint8_t mem[256]; //!< EEPROM array.
+	uint8_t ptr; //!< Internal address pointer.
+	uint8_t page[I2C_SIM_24C02_PAGE]; //!< Page write buffer.
+	uint8_t page_base; //!< First address of the page being written.
+	uint8_t page_mask; //!< Bytes of the page buffer which have been written.
+	bool addr_phase; //!< The next written byte is the word address.
+	uint8_t twr_polls; //!< Address polls to NACK after a write cycle has started.
+	uint8_t busy; //!< Remaining address polls of the current write cycle.
+};
+
+__DECL
+extern int i2c_sim_init(struct i2c_sim_bus *bus, struct i2c_adapter *adapter, char *fname);
+extern void i2c_sim_add_slave(struct i2c_sim_bus *bus, struct i2c_sim_slave *slave);
+extern void i2c_sim_remove_slave(struct i2c_sim_bus *bus, struct i2c_sim_slave *slave);
+extern void i2c_sim_24c02_init(struct i2c_sim_24c02 *eeprom, uint8_t sla, uint8_t twr_polls);
+__DECL_END
+
+/**
+ * \brief Reset the statistics of a simulated bus.
+ * \param bus Simulated bus.
+ */
+static inline void i2c_sim_reset_stats(struct i2c_sim_bus *bus)
+{
+	bus->stats.msgs = 0;
+	bus->stats.bytes = 0;
+	bus->stats.starts = 0;
+	bus->stats.stops = 0;
+	bus->stats.nacks = 0;
+	bus->stats.callbacks = 0;
+	bus->stats.clocks = 0;
+}
+
+// @}
+
+#endif /* __I2C_SIM_H */
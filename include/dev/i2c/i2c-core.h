@@ -43,6 +43,7 @@
 #define I2C_MSG_SENT_STOP_FLAG_SHIFT 4 //!< Shift value of I2C_MSG_SENT_STOP_FLAG
 #define I2C_MSG_SENT_REP_START_FLAG_SHIFT 5 //!< Shift value of I2C_MSG_SENT_REP_START_FLAG
 #define I2C_MSG_DONE_FLAG_SHIFT 6 //!< Shift value of I2C_MSG_DONE_FLAG.
+#define I2C_MSG_ACK_POLL_FLAG_SHIFT 7 //!< Shift value of I2C_MSG_ACK_POLL_FLAG.
 
 /**
  * \brief Defines that the application should be called after transmission.
@@ -82,6 +83,16 @@
  */
 #define I2C_MSG_DONE_FLAG BIT(I2C_MSG_DONE_FLAG_SHIFT)
 
+/**
+ * \brief Poll the slave address until it is acknowledged.
+ * \see I2C_ACK_POLL_TMO
+ * 
+ * Devices in an internal write cycle (e.g. EEPROMs) do not acknowledge their address. When this
+ * bit is set, the start condition and address are repeated until the slave acknowledges or
+ * I2C_ACK_POLL_TMO milli seconds have passed. Only used for master messages.
+ */
+#define I2C_MSG_ACK_POLL_FLAG BIT(I2C_MSG_ACK_POLL_FLAG_SHIFT)
+
 /*
  * Message feature masks
  */
@@ -126,6 +137,11 @@
  */
 #define I2C_MSG_DONE_MASK BIT(I2C_MSG_DONE_FLAG_SHIFT)
 
+/**
+ * \brief Poll the slave address until it is acknowledged.
+ */
+#define I2C_MSG_ACK_POLL_MASK BIT(I2C_MSG_ACK_POLL_FLAG_SHIFT)
+
 /**
  * \brief I2C message features mask.
  * 
@@ -133,7 +149,8 @@
  */
 #define I2C_MSG_FEATURES_MASK (I2C_MSG_CALL_BACK_FLAG | I2C_MSG_MASTER_MSG_MASK |   \
                               I2C_MSG_SLAVE_MSG_FLAG | I2C_MSG_TRANSMIT_MSG_FLAG |  \
-                              I2C_MSG_SENT_STOP_FLAG | I2C_MSG_SENT_REP_START_FLAG)
+                              I2C_MSG_SENT_STOP_FLAG | I2C_MSG_SENT_REP_START_FLAG | \
+                              I2C_MSG_ACK_POLL_FLAG)
                               
 
 /**
@@ -143,6 +160,65 @@
  * When this bit is set, the message holds a receive buffer.
  */
 #define I2C_MSG_READ BIT(0)
+
+/**
+ * \brief Segment of a precompiled transaction.
+ * \see I2C_SEG_WRITE I2C_SEG_READ I2C_TRANSACTION
+ */
+struct i2c_segment
+{
+	i2c_features_t features; //!< Message features of the segment.
+	size_t length; //!< Amount of bytes to transfer.
+};
+
+/**
+ * \brief Precompiled master transaction.
+ * \see i2c_queue_transaction i2cdev_transfer
+ * 
+ * A transaction describes the messages which are sent between a start and a stop condition. All
+ * message features are resolved when the descriptor is built, usually at compile time:
+\code{.c}
+static const struct i2c_segment eeprom_read_segs[] = {
+	I2C_SEG_WRITE(1),
+	I2C_SEG_READ_STOP(1),
+};
+static const struct i2c_transaction eeprom_read = I2C_TRANSACTION(eeprom_read_segs);
+\endcode
+ */
+struct i2c_transaction
+{
+	const struct i2c_segment *segs; //!< Segments of the transaction.
+	uint8_t num; //!< Amount of segments.
+};
+
+/**
+ * \brief Master transmit segment followed by a repeated start.
+ * \param __len Amount of bytes to write.
+ */
+#define I2C_SEG_WRITE(__len) { I2C_MSG_MASTER_MSG_FLAG | I2C_MSG_TRANSMIT_MSG_FLAG | \
+								I2C_MSG_SENT_REP_START_FLAG, __len }
+/**
+ * \brief Master transmit segment followed by a stop condition.
+ * \param __len Amount of bytes to write.
+ */
+#define I2C_SEG_WRITE_STOP(__len) { I2C_MSG_MASTER_MSG_FLAG | I2C_MSG_TRANSMIT_MSG_FLAG | \
+									I2C_MSG_SENT_STOP_FLAG, __len }
+/**
+ * \brief Master receive segment followed by a repeated start.
+ * \param __len Amount of bytes to read.
+ */
+#define I2C_SEG_READ(__len) { I2C_MSG_MASTER_MSG_FLAG | I2C_MSG_SENT_REP_START_FLAG, __len }
+/**
+ * \brief Master receive segment followed by a stop condition.
+ * \param __len Amount of bytes to read.
+ */
+#define I2C_SEG_READ_STOP(__len) { I2C_MSG_MASTER_MSG_FLAG | I2C_MSG_SENT_STOP_FLAG, __len }
+
+/**
+ * \brief Static initialiser of a transaction.
+ * \param __segs Array of struct i2c_segment.
+ */
+#define I2C_TRANSACTION(__segs) { __segs, sizeof(__segs) / sizeof((__segs)[0]) }
 //@}
 
 __DECL
@@ -156,8 +232,28 @@ __DECL
 extern int i2c_init_adapter(struct i2c_adapter *adapter, char *fname);
 extern void i2c_cleanup_client_msgs(struct i2c_client *client);
 extern int i2c_flush_client(struct i2c_client *client);
+extern int i2c_submit(struct i2c_client *client, struct i2c_xfer *xfer);
+extern int i2c_xfer_wait(struct i2c_xfer *xfer, unsigned int tmo);
+extern void i2c_xfer_msg_done(struct i2c_message *msg, bool error);
 extern int i2c_write_client(struct i2c_client *client, const void *data, size_t size, 
 							i2c_features_t flags);
+extern int i2c_writev_client(struct i2c_client *client, const struct i2c_iovec *iov,
+							 uint8_t iovcnt, i2c_features_t flags);
+extern int i2c_queue_transaction(struct i2c_client *client, const struct i2c_transaction *t,
+								 void *const *buffs, i2c_features_t flags);
+extern int i2c_queue_transactionv(struct i2c_client *client, const struct i2c_transaction *t,
+								  const struct i2c_iovec *iov, uint8_t iovcnt,
+								  i2c_features_t flags);
+extern int i2c_attach_regfile(struct i2c_adapter *adapter, struct i2c_regfile *rf);
+extern int i2c_detach_regfile(struct i2c_adapter *adapter);
+extern int i2c_set_retries(struct i2c_client *client, uint8_t retries, unsigned int backoff);
+
+#ifdef I2C_STATS
+extern void i2c_adapter_get_stats(struct i2c_adapter *adapter, struct i2c_stats *stats);
+extern void i2c_client_get_stats(struct i2c_client *client, struct i2c_stats *stats);
+extern void i2c_adapter_reset_stats(struct i2c_adapter *adapter);
+extern void i2c_client_reset_stats(struct i2c_client *client);
+#endif
 
 #ifdef I2C_DBG
 extern int i2cdbg_test_queue_processor(struct i2c_client *client);
@@ -22,52 +22,165 @@
 #include <dev/i2c.h>
 #include <dev/i2c-core.h>
 
+#ifdef I2C_STATS
+#include <arch/io.h>
+#endif
+
+__DECL
+/*
+ * I2C-MSG functions
+ */
+extern void i2c_queue_init(struct i2c_msg_queue *queue);
+extern int i2c_queue_push(struct i2c_msg_queue *queue, struct i2c_message *msg);
+extern int i2c_queue_push_front(struct i2c_msg_queue *queue, struct i2c_message *msg);
+extern struct i2c_message *i2c_queue_pop(struct i2c_msg_queue *queue);
+extern void i2c_queue_abort_all(struct i2c_msg_queue *queue);
+
+/**
+ * \brief Convert a queue offset into a slot number.
+ * \param queue Message queue.
+ * \param offset Offset relative to the head of \p queue.
+ */
+static inline uint8_t i2c_queue_slot(struct i2c_msg_queue *queue, uint8_t offset)
+{
+	unsigned int slot = queue->head + offset;
+	
+	if(slot >= I2C_MSG_POOL_SIZE) {
+		slot -= I2C_MSG_POOL_SIZE;
+	}
+	return (uint8_t)slot;
+}
+
+/**
+ * \brief Retrieve the length of an I2C message queue.
+ * \param queue The queue to retrieve the length from.
+ * \return The amount of queued messages, including completed messages which are not retired yet.
+ */
+static inline uint8_t i2c_queue_length(struct i2c_msg_queue *queue)
+{
+	return queue->length;
+}
+
+/**
+ * \brief Get the pending message of a queue.
+ * \param queue Message queue.
+ * \return The first message which is not done yet.
+ * \retval NULL if all messages are done.
+ */
+static inline struct i2c_message *i2c_queue_pending(struct i2c_msg_queue *queue)
+{
+	if(queue->done < queue->length) {
+		return queue->msgs[i2c_queue_slot(queue, queue->done)];
+	}
+	return NULL;
+}
+
+#if defined(I2C_STATS) || defined(__DOXYGEN__)
+/**
+ * \brief Account a finished message.
+ * \param stats Statistics to update.
+ * \param msg The finished message.
+ * \param error Set to TRUE if the message failed.
+ * \see i2c_stats::latency
+ */
+static inline void i2c_stats_msg_done(struct i2c_stats *stats, struct i2c_message *msg, bool error)
+{
+	uint16_t latency;
+	uint8_t bucket = 0;
+	size_t i;
+	
+	if(error) {
+		stats->errors++;
+		return;
+	}
+	
+	stats->msgs++;
+	stats->bytes += msg->length;
+	for(i = 0; i < msg->iovcnt; i++) {
+		stats->bytes += msg->iov[i].length;
+	}
+	
+	latency = (uint16_t)BermudaTimerGetSysTick() - msg->stamp;
+	while(latency && bucket < I2C_STATS_BUCKETS - 1) {
+		latency >>= 1;
+		bucket++;
+	}
+	stats->latency[bucket]++;
+}
+
+/**
+ * \brief Account a queued message.
+ * \param queue Queue the message has been added to.
+ * \param msg The queued message.
+ */
+static inline void i2c_stats_msg_queued(struct i2c_msg_queue *queue, struct i2c_message *msg)
+{
+	msg->stamp = (uint16_t)BermudaTimerGetSysTick();
+	if(queue->stats && queue->length > queue->stats->queue_hwm) {
+		queue->stats->queue_hwm = queue->length;
+	}
+}
+#endif
+
 /**
- * \brief Iterate through an I2C vector.
- * \param __vec The vector to iterate through.
- * \param __it name of the iterator.
+ * \brief Finish the pending message of a queue.
+ * \param queue Message queue.
+ * \param error Set to TRUE if the message failed.
+ * \see i2c_queue_complete i2c_queue_abort
  */
-#define i2c_vector_foreach(__vec, __it) \
-size_t __it; \
-for(__it = 0; __it < (__vec)->length; (__it)++)
+static inline struct i2c_message *__i2c_queue_finish(struct i2c_msg_queue *queue, bool error)
+{
+	struct i2c_message *msg = i2c_queue_pending(queue);
+	
+	if(msg) {
+		msg->features |= I2C_MSG_DONE_FLAG;
+		queue->done++;
+#ifdef I2C_STATS
+		i2c_stats_msg_done(queue->stats, msg, error);
+		if(msg->stats) {
+			i2c_stats_msg_done(msg->stats, msg, error);
+		}
+#endif
+		if(msg->xfer) {
+			i2c_xfer_msg_done(msg, error);
+		}
+	}
+	return msg;
+}
 
 /**
- * \brief Iterate through an I2C vector reversed.
- * \param __vec The vector (pointer) to iterate through.
- * \param __it The symbol name of the iterator.
+ * \brief Complete the pending message of a queue.
+ * \param queue Message queue.
+ * \return The completed message.
+ * \retval NULL if there is no pending message.
  * 
- * Iterate through the list using the symbel name given by \p __it. It starts at 
- * i2c_msg_vector::length - 1 (the last entry) and decreses by one every iteration until 0 has been
- * reached.
+ * The message is masked with I2C_MSG_DONE_FLAG and will be retired by the core layer.
  */
-#define i2c_vector_foreach_reverse(__vec, __it) \
-size_t __it; \
-for(__it = (__vec)->length - 1; __it >= 0; (__it)--)
+static inline struct i2c_message *i2c_queue_complete(struct i2c_msg_queue *queue)
+{
+	return __i2c_queue_finish(queue, FALSE);
+}
 
-__DECL
-/*
- * I2C-MSG functions
+/**
+ * \brief Complete the pending message of a queue with an error.
+ * \param queue Message queue.
+ * \return The aborted message.
+ * \retval NULL if there is no pending message.
+ * \see i2c_queue_complete
  */
-extern int i2c_create_msg_vector(struct i2c_adapter *adapter);
-extern int i2c_vector_add(struct i2c_adapter *adapter, struct i2c_message *msg, bool master);
-extern struct i2c_message *i2c_vector_get(struct i2c_adapter *adapter, size_t index);
-extern struct i2c_message *i2c_vector_delete_at(struct i2c_adapter *adapter, size_t size);
-extern struct i2c_message *i2c_vector_delete_msg(struct i2c_adapter *adapter, 
-													 struct i2c_message *msg);
-extern int i2c_vector_error(struct i2c_adapter *adapter, int error);
-extern int i2c_vector_erase(struct i2c_adapter *adapter);
-extern int i2c_vector_insert_at(struct i2c_adapter *adapter, struct i2c_message *msg, size_t index);
-extern size_t i2c_vector_locate(struct i2c_adapter *adapter, struct i2c_message *id);
-extern void i2c_vector_reshape(struct i2c_adapter *adapter);
+static inline struct i2c_message *i2c_queue_abort(struct i2c_msg_queue *queue)
+{
+	return __i2c_queue_finish(queue, TRUE);
+}
 
 /**
- * \brief Retrieve the length of the vector on an I2C adapter.
- * \param adapter The I2C adapter to retrieve the vector length from.
- * \return The vector length.
+ * \brief Select the master or slave queue of an adapter.
+ * \param adapter I2C adapter.
+ * \param master TRUE to select the master queue, FALSE to select the slave queue.
  */
-static inline size_t i2c_vector_length(struct i2c_adapter *adapter)
+static inline struct i2c_msg_queue *i2c_adapter_queue(struct i2c_adapter *adapter, bool master)
 {
-	return adapter->msg_vector.length;
+	return master ? &adapter->master_msgs : &adapter->slave_msgs;
 }
 
 /**
@@ -82,41 +195,88 @@ static inline bool i2c_msg_is_master(struct i2c_message *msg)
 }
 
 /**
- * \brief Locate the first valid slave message.
- * \param adapter i2c_adapter holding the messages.
- * \param index Index is used to store the first index of the message.
+ * \brief Get the total data length of a message.
+ * \param msg Message to measure.
+ * \return The length of i2c_message::buff plus the length of all segments.
  */
-static inline bool i2c_first_slave_msg(struct i2c_adapter *adapter, size_t *index)
+static inline size_t i2c_msg_length(struct i2c_message *msg)
 {
-	struct i2c_message *msg;
-	i2c_vector_foreach(&adapter->msg_vector, i) {
-		msg = i2c_vector_get(adapter, i);
-		if(!i2c_msg_is_master(msg) && (i2c_msg_features(msg) & I2C_MSG_DONE_FLAG) == 0) {
-			*index = i;
-			return TRUE;
-		}
+	size_t length = msg->length;
+	uint8_t i;
+	
+	for(i = 0; i < msg->iovcnt; i++) {
+		length += msg->iov[i].length;
 	}
-	return FALSE;
+	return length;
 }
 
 /**
- * \brief Locate the first master message.
- * \param adapter i2c_adapter holding the messages.
- * \param index Index to set the index of the first master message.
- * \retval TRUE If there is a valid master message found.
- * \retval FALSE If no valid master message is found.
+ * \brief Start a slave transaction on a register file.
+ * \param rf Register file.
+ * \param write TRUE if the master will write to the register file.
+ * \note Called by the bus driver.
  */
-static inline bool i2c_first_master_msg(struct i2c_adapter *adapter, size_t *index)
+static inline void i2c_regfile_start(struct i2c_regfile *rf, bool write)
 {
-	struct i2c_message *msg;
-	i2c_vector_foreach(&adapter->msg_vector, i) {
-		msg = i2c_vector_get(adapter, i);
-		if(i2c_msg_is_master(msg) && (i2c_msg_features(msg) & I2C_MSG_DONE_FLAG) == 0) {
-			*index = i;
-			return TRUE;
-		}
+	rf->addr_phase = write;
+	rf->changed = 0;
+}
+
+/**
+ * \brief Write a byte received from the master to a register file.
+ * \param rf Register file.
+ * \param data Received byte.
+ * \note Called by the bus driver.
+ */
+static inline void i2c_regfile_write(struct i2c_regfile *rf, uint8_t data)
+{
+	uint8_t mask = (rf->wmask) ? rf->wmask[rf->ptr] : 0xFF;
+	
+	if(rf->addr_phase) {
+		rf->addr_phase = FALSE;
+		rf->ptr = (data < rf->size) ? data : 0;
+		rf->first = rf->ptr;
+		return;
+	}
+	
+	rf->regs[rf->ptr] = (rf->regs[rf->ptr] & ~mask) | (data & mask);
+	if(rf->changed < rf->size) {
+		rf->changed++;
+	}
+	if(++rf->ptr >= rf->size) {
+		rf->ptr = 0;
+	}
+}
+
+/**
+ * \brief Read the next byte of a register file.
+ * \param rf Register file.
+ * \return The byte to send to the master.
+ * \note Called by the bus driver.
+ */
+static inline uint8_t i2c_regfile_read(struct i2c_regfile *rf)
+{
+	uint8_t data = rf->regs[rf->ptr];
+	
+	if(++rf->ptr >= rf->size) {
+		rf->ptr = 0;
+	}
+	return data;
+}
+
+/**
+ * \brief End a slave transaction on a register file.
+ * \param rf Register file.
+ * \note Called by the bus driver when the transaction has been stopped.
+ * 
+ * Notifies the application when registers have been written.
+ */
+static inline void i2c_regfile_stop(struct i2c_regfile *rf)
+{
+	if(rf->changed && rf->notify) {
+		rf->notify(rf, rf->first, rf->changed);
 	}
-	return FALSE;
+	rf->changed = 0;
 }
 __DECL_END
 
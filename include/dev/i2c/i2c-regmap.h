@@ -0,0 +1,120 @@
+/*
+ *  BermudaOS - I2C register map
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file include/dev/i2c/i2c-regmap.h I2C register map header.
+ */
+
+#ifndef __I2C_REGMAP_H
+#define __I2C_REGMAP_H
+
+#include <stdlib.h>
+
+#include <dev/i2c/i2c.h>
+
+/**
+ * \addtogroup i2c-regmap
+ * @{
+ */
+
+#ifndef I2C_REGMAP_SYNC_RUNS
+/**
+ * \brief Maximum amount of register runs written back in one transaction.
+ * \note Each run uses one message of the adapter pool.
+ * \see i2c_regmap_sync
+ */
+#define I2C_REGMAP_SYNC_RUNS 4
+#endif
+
+/**
+ * \brief Inclusive range of registers.
+ */
+struct i2c_regmap_range
+{
+	uint8_t first; //!< First register of the range.
+	uint8_t last; //!< Last register of the range.
+};
+
+/**
+ * \brief Static description of a register map.
+ */
+struct i2c_regmap_config
+{
+	uint8_t max_reg; //!< Highest register address of the device.
+
+	/**
+	 * \brief Volatile registers.
+	 *
+	 * Volatile registers (e.g. status registers) are changed by the device itself. They are
+	 * never cached, every access goes to the bus.
+	 */
+	const struct i2c_regmap_range *volatile_ranges;
+	uint8_t num_volatile; //!< Amount of ranges in \p volatile_ranges.
+
+	/**
+	 * \brief Register address auto increment.
+	 *
+	 * Set to TRUE if the device increments its register address after every byte. Consecutive
+	 * dirty registers are then written back in one burst.
+	 */
+	bool auto_increment;
+};
+
+/**
+ * \brief Register map of an I2C device.
+ * \see i2c_regmap_init
+ */
+struct i2c_regmap
+{
+	struct i2c_client *client; //!< Client of the device.
+	const struct i2c_regmap_config *config; //!< Map description.
+
+	uint8_t *cache; //!< Register values.
+	uint8_t *valid; //!< Bitmap of registers which have a value in the cache.
+	uint8_t *dirty; //!< Bitmap of registers which have not been written to the device yet.
+	bool cache_only; //!< Writes only update the cache while set.
+};
+
+__DECL
+extern int i2c_regmap_init(struct i2c_regmap *map, struct i2c_client *client,
+						   const struct i2c_regmap_config *config);
+extern void i2c_regmap_destroy(struct i2c_regmap *map);
+extern int i2c_regmap_read(struct i2c_regmap *map, uint8_t reg, uint8_t *val);
+extern int i2c_regmap_write(struct i2c_regmap *map, uint8_t reg, uint8_t val);
+extern int i2c_regmap_update_bits(struct i2c_regmap *map, uint8_t reg, uint8_t mask, uint8_t val);
+extern int i2c_regmap_sync(struct i2c_regmap *map);
+extern void i2c_regmap_invalidate(struct i2c_regmap *map);
+__DECL_END
+
+/**
+ * \brief Enable or disable cache only mode.
+ * \param map Register map.
+ * \param enable TRUE to enable cache only mode.
+ * \see i2c_regmap_sync
+ *
+ * In cache only mode writes to cacheable registers only update the cache. They are written to
+ * the device by i2c_regmap_sync.
+ */
+static inline void i2c_regmap_cache_only(struct i2c_regmap *map, bool enable)
+{
+	map->cache_only = enable;
+}
+
+// @}
+
+#endif /* __I2C_REGMAP_H */
@@ -34,6 +34,8 @@
 
 struct i2c_adapter; // forward declaration
 struct i2c_client;
+struct i2c_xfer;
+struct i2c_transaction;
 
 /**
  * \addtogroup i2c-core
@@ -45,6 +47,12 @@ struct i2c_client;
  */
 typedef uint8_t i2c_features_t;
 
+/**
+ * \brief Bus specific clock setting.
+ * \see i2c_adapter::clock
+ */
+typedef uint16_t i2c_clock_t;
+
 /**
  * \brief Definition of the I2C action type.
  */
@@ -95,18 +103,186 @@ typedef uint8_t i2c_action_t;
  */
 #define I2C_SLAVE_SUPPORT BIT(I2C_SLAVE_SUPPORT_SHIFT)
 
+#ifndef I2C_MSG_POOL_SIZE
+/**
+ * \brief Amount of messages (and queue nodes) in the pool of each adapter.
+ * \see i2c_adapter::pool
+ */
+#define I2C_MSG_POOL_SIZE 8
+#endif
+
+#ifndef I2C_ACK_POLL_TMO
+/**
+ * \brief Time in milli seconds during which the address of a message is polled.
+ * \see I2C_MSG_ACK_POLL_FLAG
+ * 
+ * Bounded by time instead of by the amount of polls, since a poll takes less time at a higher
+ * bus clock. It should cover the longest internal write cycle of the devices on the bus.
+ */
+#define I2C_ACK_POLL_TMO 10
+#endif
+
+#if defined(I2C_STATS) || defined(__DOXYGEN__)
+#ifndef I2C_STATS_BUCKETS
+/**
+ * \brief Amount of buckets in the latency histogram.
+ * \see i2c_stats::latency
+ */
+#define I2C_STATS_BUCKETS 8
+#endif
+
+/**
+ * \brief I2C bus statistics.
+ * \see i2c_adapter_get_stats i2c_client_get_stats
+ */
+struct i2c_stats
+{
+	uint32_t bytes; //!< Amount of transfered data bytes.
+	uint16_t msgs; //!< Amount of completed messages.
+	uint16_t xfers; //!< Amount of started transactions.
+	uint16_t errors; //!< Amount of failed messages.
+	uint16_t nacks; //!< Amount of not acknowledged addresses and data bytes.
+	uint16_t arb_lost; //!< Amount of lost arbitrations.
+	uint16_t master_tmo; //!< Amount of master transfers which timed out.
+	uint16_t slave_tmo; //!< Amount of slave listens which timed out.
+	uint16_t retries; //!< Amount of retried master transfers.
+	uint8_t queue_hwm; //!< Highest amount of messages in one adapter queue.
+	
+	/**
+	 * \brief Submit to complete latency histogram.
+	 * 
+	 * Bucket 0 counts messages completed within the system tick they were queued in, bucket
+	 * <i>n</i> counts latencies of 2<sup>n-1</sup> up to 2<sup>n</sup> - 1 ticks. The last bucket
+	 * also counts all longer latencies.
+	 */
+	uint16_t latency[I2C_STATS_BUCKETS];
+};
+
+/**
+ * \brief Increase a statistics counter of an adapter.
+ * \param __adapter I2C adapter.
+ * \param __field Field of struct i2c_stats.
+ */
+#define i2c_adapter_stats_inc(__adapter, __field) ((__adapter)->stats.__field++)
+#else
+#define i2c_adapter_stats_inc(__adapter, __field)
+#endif
+
+/**
+ * \brief I2C buffer segment.
+ * \see i2c_writev_client
+ */
+struct i2c_iovec
+{
+	uint8_t *buff; //!< Segment buffer.
+	size_t length; //!< Segment length.
+};
+
+/**
+ * \brief Master message saved for a retry.
+ * \see i2c_set_retries
+ */
+struct i2c_retry_msg
+{
+	void *buff; //!< Message buffer.
+	size_t length; //!< Message length.
+	const struct i2c_iovec *iov; //!< Segments which follow \p buff.
+	uint8_t iovcnt; //!< Amount of segments in \p iov.
+	i2c_features_t features; //!< Message features.
+};
+
+/**
+ * \brief Slave register file.
+ * \see i2c_attach_regfile
+ * 
+ * Memory which is served by the bus driver to all masters addressing the adapter. The first byte
+ * of a master write sets the register pointer, the following bytes are written to the registers.
+ * A master read returns the registers starting at the register pointer. The pointer is
+ * incremented after every byte and wraps at the end of the file.
+ */
+struct i2c_regfile
+{
+	uint8_t *regs; //!< Register memory.
+	uint16_t size; //!< Amount of registers in \p regs, at most 256.
+	/**
+	 * \brief Writable bits of every register.
+	 * 
+	 * Bits which are cleared in the mask of a register can't be changed by a master, a mask of
+	 * 0 makes a register read-only. Set to <i>NULL</i> to make all registers writable.
+	 */
+	const uint8_t *wmask;
+	
+	/**
+	 * \brief Change notification.
+	 * \param rf The register file.
+	 * \param first First register written by the master.
+	 * \param num Amount of registers written by the master.
+	 * \note Optional, called from ISR context after the stop condition of a master write.
+	 */
+	void (*notify)(struct i2c_regfile *rf, uint8_t first, uint8_t num);
+	void *data; //!< Application data.
+	
+	uint8_t ptr; //!< Register pointer.
+	bool addr_phase; //!< The next received byte is the register pointer.
+	uint8_t first; //!< First register written in the current transaction.
+	uint8_t changed; //!< Amount of registers written in the current transaction.
+};
+
 /**
  * \brief Structure which defines the data to be transfered in the next transaction.
+ * 
+ * The data of a message is \p buff, followed by the \p iovcnt segments in \p iov. The bus
+ * driver transfers all segments as one message, without repeated starts in between.
  */
 struct i2c_message
 {
 	uint8_t *buff; //!< Message buffer.
 	size_t length; //!< Message length.
+	const struct i2c_iovec *iov; //!< Segments which follow \p buff.
+	uint8_t iovcnt; //!< Amount of segments in \p iov.
 	uint16_t addr; //!< Slave address.
 	
 	i2c_features_t features; //!< I2C message features.
+	struct i2c_xfer *xfer; //!< Asynchronous transfer this message belongs to.
+#ifdef I2C_STATS
+	struct i2c_stats *stats; //!< Statistics of the client which owns the message.
+	uint16_t stamp; //!< System tick at which the message was queued.
+#endif
 } __attribute__((packed));
 
+/**
+ * \brief Value of i2c_xfer::status while the transfer is in progress.
+ */
+#define I2C_XFER_PENDING 1
+
+/**
+ * \brief Asynchronous transfer handle.
+ * \see i2c_submit i2c_xfer_wait
+ * 
+ * The handle is owned by the caller of i2c_submit and must stay valid until the transfer has
+ * completed.
+ */
+struct i2c_xfer
+{
+	/**
+	 * \brief Transfer status.
+	 * 
+	 * I2C_XFER_PENDING while the transfer is in progress, 0 when all messages have been
+	 * transfered and -1 when at least one message failed.
+	 */
+	volatile int status;
+	volatile uint8_t remaining; //!< Amount of messages which are not completed yet.
+	volatile void *queue; //!< Threads waiting for completion.
+	
+	/**
+	 * \brief Completion call back.
+	 * \param xfer The completed transfer.
+	 * \warning Called from the bus ISR, so it must not block.
+	 */
+	void (*complete)(struct i2c_xfer *xfer);
+	void *data; //!< Call back data.
+};
+
 /**
  * \brief Structure shared by all from a certain client.
  */
@@ -117,7 +293,8 @@ struct i2c_shared_info
 	struct i2c_adapter *adapter; //!< The I2C adapter.
 	FILE *socket; //!< I/O socket.
 	char *transmission_layout; //!< I2C transmission layout.
-	uint32_t freq;
+	uint32_t freq; //!< Bus frequency in hertz.
+	i2c_clock_t clock; //!< Clock setting of \p freq, resolved when the client is initialised.
 	
 	/**
 	 * \brief Call back function which can be called after a buffer has been sent by the driver.
@@ -132,6 +309,18 @@ struct i2c_shared_info
 						   struct i2c_message *newmsg);
 	
 	i2c_features_t features; //!< Feature option flags.
+	uint8_t retries; //!< Amount of retries of a failed master transfer.
+	unsigned int backoff; //!< Delay before the first retry in milli seconds.
+	/**
+	 * \brief Messages of the transfer which is being retried.
+	 * 
+	 * I2C_MSG_POOL_SIZE entries, allocated by i2c_set_retries so they don't take up space on the
+	 * stack of the calling thread.
+	 */
+	struct i2c_retry_msg *retry_msgs;
+#ifdef I2C_STATS
+	struct i2c_stats stats; //!< Client statistics.
+#endif
 	
 	/**
 	 * \brief Core layer mutex.
@@ -156,9 +345,23 @@ struct i2c_client {
 } __attribute__((packed));
 
 /**
- * \brief Message vector structure.
+ * \brief Fixed capacity I2C message queue.
+ * 
+ * Ring of message pointers. Messages are transfered in the order they are pushed. Completed
+ * messages stay at the head of the queue until the core layer retires them, the first message
+ * which is not done yet is the pending message.
+ * \see i2c_queue_pending i2c_queue_complete i2c_queue_pop
  */
-struct i2c_msg_vector;
+struct i2c_msg_queue
+{
+	struct i2c_message *volatile msgs[I2C_MSG_POOL_SIZE]; //!< Message ring.
+	volatile uint8_t head; //!< Slot of the oldest message.
+	volatile uint8_t length; //!< Amount of queued messages.
+	volatile uint8_t done; //!< Amount of completed messages at the head.
+#ifdef I2C_STATS
+	struct i2c_stats *stats; //!< Statistics of the adapter owning the queue.
+#endif
+};
 
 struct i2c_adapter {
 	struct device *dev; //!< Adapter device.
@@ -170,17 +373,26 @@ struct i2c_adapter {
 	 */
 	volatile uint8_t error;
 	
+	struct i2c_msg_queue master_msgs; //!< Queued master messages.
+	struct i2c_msg_queue slave_msgs; //!< Queued slave messages.
+#ifdef I2C_STATS
+	struct i2c_stats stats; //!< Adapter statistics.
+#endif
+
 	/**
-	 * \var msg_vector
-	 * \brief Message vector (dynamic array), to list all messages for transmission.
-	 * The messages are sorted by master/slave (master messages first, then slave messages).
+	 * \var pool
+	 * \brief Message and queue node pool.
+	 * 
+	 * The core layer allocates messages and client queue nodes from this pool, so transfers
+	 * never use the general heap.
 	 */
-	struct i2c_msg_vector
+	struct i2c_msg_pool
 	{
-		size_t length, //!< Length of the vector.
-		       limit;  //!< Maximum value \p length may reach.
-		struct i2c_message *volatile*data; //!< The data array.
-	} msg_vector;
+		struct i2c_message msgs[I2C_MSG_POOL_SIZE]; //!< Message storage.
+		struct linkedlist nodes[I2C_MSG_POOL_SIZE]; //!< Queue node storage.
+		struct linkedlist *free_nodes; //!< List of free queue nodes.
+		uint8_t map[(I2C_MSG_POOL_SIZE+7)/8]; //!< Message allocation bitmap.
+	} pool;
 
 #ifdef __THREADS__
 	/* mutex is provided by the device */
@@ -193,33 +405,72 @@ struct i2c_adapter {
 	/**
 	 * \brief Transfer hook implemented by the bus driver.
 	 * \param adapter The bus adapter.
-	 * \param index On return \p index must point to the last index transfered.
-	 * \param freq The frequency to operate on.
-	 * \return The current message index.
+	 * \param clock Clock setting to operate on.
+	 * \param master Set to TRUE to transfer the master queue, FALSE to listen for the slave queue.
+	 * \return Transfer status.
+	 * \retval 0 The transfer stopped at a call back message, which is the pending message of the
+	 *           queue.
+	 * \retval 1 The transfer has completed.
+	 * \retval <0 An error has occurred.
 	 * 
 	 * A hook which <b>must</b> be implemented by the adapter to initialise a transfer.
 	 */
-	int (*xfer)(struct i2c_adapter *adapter, uint32_t freq, bool master, size_t *index);
+	int (*xfer)(struct i2c_adapter *adapter, i2c_clock_t clock, bool master);
+	
+	/**
+	 * \brief Start processing the master queue without waiting for completion.
+	 * \param adapter The bus adapter.
+	 * \param clock Clock setting to operate on, ignored if the bus is busy already.
+	 * \return 0 on success, a negative error code otherwise.
+	 * \note Optional, asynchronous transfers are only supported when this hook is set.
+	 * \see i2c_submit
+	 * 
+	 * The driver has to transfer all queued master messages back-to-back using repeated starts.
+	 */
+	int (*start)(struct i2c_adapter *adapter, i2c_clock_t clock);
+	
+	/**
+	 * \brief Translate a frequency into a clock setting.
+	 * \param adapter The bus adapter.
+	 * \param freq Frequency in hertz.
+	 * \return The clock setting which is passed to i2c_adapter::xfer and i2c_adapter::start.
+	 * \note Optional, the clock setting is 0 when this hook is not set.
+	 * 
+	 * Called once when a client is initialised, so the transfer hooks only have to load the
+	 * setting into the bus registers.
+	 */
+	i2c_clock_t (*clock)(struct i2c_adapter *adapter, uint32_t freq);
 	
 	/**
 	 * \brief Resume transmission after a call back.
 	 * \param adapter Adapter to resume.
-	 * \param index On return \p index must point to the last index transfered.
-	 * \note The message which has been set by the call back must be inserted IN THE FRONT of the
-	 *       message vector.
-	 * \return The current message index.
+	 * \param master Queue holding the message which has been set by the call back.
+	 * \note The message which has been set by the call back is pushed IN THE FRONT of its queue.
+	 * \return Transfer status, see i2c_adapter::xfer.
 	 */
-	int (*resume)(struct i2c_adapter *adapter, size_t *index);
+	int (*resume)(struct i2c_adapter *adapter, bool master);
 	
 	/**
-	 * \brief Update the driver message index.
-	 * \param diff The index diff.
+	 * \brief Update the driver message pointers.
 	 * \note The driver is required to implement this function pointer.
 	 * 
-	 * This pointer is called when a master transfer is done. There is no point calling when after
-	 * a slave transmission, since the deletion of slave buffers doesn't affect the array order.
+	 * This pointer is called after the core layer has retired completed messages from the
+	 * queues.
+	 */
+	void (*update)(struct i2c_adapter *adapter);
+	
+	/**
+	 * \brief Attach a slave register file.
+	 * \param adapter The bus adapter.
+	 * \param rf Register file to serve, <i>NULL</i> to detach the current register file.
+	 * \return 0 on success, a negative error code otherwise.
+	 * \note Optional, register files are only supported when this hook is set.
+	 * \see i2c_attach_regfile
+	 * 
+	 * The driver serves slave requests from \p rf while no slave message is queued, and keeps
+	 * listening for its slave address after every transfer.
 	 */
-	void (*update)(struct i2c_adapter *adapter, long diff);
+	int (*attach)(struct i2c_adapter *adapter, struct i2c_regfile *rf);
 };
 
 #include <dev/i2c-core.h>
@@ -231,6 +482,11 @@ extern int i2cdev_flush(FILE *stream);
 extern int i2cdev_close(FILE *stream);
 extern int i2cdev_socket(struct i2c_client *client, uint16_t flags);
 extern int i2cdev_listen(int fd, void *buff, size_t size);
+extern int i2cdev_writev(int fd, const struct i2c_iovec *iov, uint8_t iovcnt);
+extern int i2cdev_transfer(int fd, const struct i2c_transaction *t, void *const *buffs);
+extern int i2cdev_transferv(int fd, const struct i2c_transaction *t, const struct i2c_iovec *iov,
+							uint8_t iovcnt);
+extern int i2cdev_submit(int fd, struct i2c_xfer *xfer);
 extern void i2cdev_error(int fd);
 extern struct i2c_client *i2c_alloc_client(struct i2c_adapter *adapter, uint16_t sla, uint32_t hz);
 extern void i2c_init_client(struct i2c_client *client, struct i2c_adapter *adapter, 
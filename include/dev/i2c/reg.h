@@ -80,6 +80,24 @@
 #define I2CDEV_CALL_BACK 0x400
 #define I2CDEV_CALL_BACK_SHIFT 10 //!< I2CDEV_CALL_BACK shift.
 
+/**
+ * \brief Acknowledge polling flag.
+ * 
+ * All master messages added when I2CDEV_ACK_POLL is set will poll the slave address until it is
+ * acknowledged.
+ * \see I2C_MSG_ACK_POLL_FLAG
+ */
+#define I2CDEV_ACK_POLL 0x800
+
+/**
+ * \brief Bus recovery control code.
+ * 
+ * Passed to the <i>ctrl</i> function of an adapter device to free a bus which is held by a
+ * slave. SCL is clocked (up to nine times) until the slave releases SDA, after which a stop
+ * condition is generated.
+ */
+#define I2C_RECOVER 0x80
+
 /**
  * \brief I2C address read bit.
  * 
@@ -0,0 +1,199 @@
+/*
+ *  BermudaOS - SPI bus simulator
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file include/dev/spi/busses/sim.h SPI bus simulator header.
+ */
+
+#ifndef __SPI_SIM_H
+#define __SPI_SIM_H
+
+#include <stdlib.h>
+
+#include <dev/spi.h>
+#include <sys/virt_timer.h>
+#include <sys/events/mutex.h>
+
+/**
+ * \addtogroup spi-sim
+ * @{
+ */
+
+/**
+ * \brief Simulated SPI chip.
+ *
+ * A chip is attached to a chip select pin. Hooks which are set to <i>NULL</i> are ignored, a chip
+ * without an exchange hook shifts out 0xFF.
+ */
+struct spi_sim_slave
+{
+	struct spi_sim_slave *next; //!< Next chip on the bus.
+	reg8_t cs; //!< Chip select register.
+	uint8_t cspin; //!< Chip select pin.
+	void *data; //!< Model data.
+
+	/**
+	 * \brief Chip select asserted.
+	 * \param slave The selected chip.
+	 */
+	void (*select)(struct spi_sim_slave *slave);
+
+	/**
+	 * \brief Exchange one byte.
+	 * \param slave The selected chip.
+	 * \param mosi Byte shifted out by the master.
+	 * \return Byte shifted in by the master.
+	 */
+	uint8_t (*exchange)(struct spi_sim_slave *slave, uint8_t mosi);
+
+	/**
+	 * \brief Chip select released.
+	 * \param slave The selected chip.
+	 */
+	void (*deselect)(struct spi_sim_slave *slave);
+};
+
+/**
+ * \brief Simulated bus statistics.
+ *
+ * The time a polling driver spends waiting for SPIF equals <i>clocks / freq</i> seconds. An
+ * interrupt driven transfer hands that time to other threads, except for <i>irqs</i> times the
+ * cost of the transfer complete interrupt.
+ */
+struct spi_sim_stats
+{
+	unsigned long xfers; //!< Amount of chip selects.
+	unsigned long bytes; //!< Amount of exchanged bytes.
+	unsigned long irqs; //!< Amount of transfer complete interrupts.
+	unsigned long polls; //!< Amount of bytes exchanged by a polling transfer.
+	unsigned long clocks; //!< SCK periods, 8 for each byte.
+};
+
+/**
+ * \brief Simulated SPI bus.
+ */
+struct spi_sim_bus
+{
+	struct spi_adapter *adapter; //!< Adapter backed by this bus.
+	struct spi_sim_slave *slaves; //!< Attached chips.
+	struct spi_sim_slave *active; //!< Selected chip.
+	struct spi_sim_stats stats; //!< Bus statistics.
+	uint32_t freq; //!< SCK frequency of the last transfer.
+	VTIMER *timer; //!< Transfer complete interrupt, <i>NULL</i> when the bus is idle.
+	uint8_t tx; //!< Byte which is being shifted out by an interrupt driven transfer.
+
+#ifdef __EVENTS__
+	MUTEX mutex; //!< Bus mutex.
+#endif
+};
+
+/**
+ * \brief Size of the 23K256 model in bytes.
+ */
+#define SPI_SIM_23K256_SIZE 0x8000
+
+/**
+ * \brief Page size of the 23K256 model.
+ */
+#define SPI_SIM_23K256_PAGE 32
+
+/**
+ * \brief Simulated 23K256 serial SRAM.
+ * \see spi_sim_23k256_init
+ */
+struct spi_sim_23k256
+{
+	struct spi_sim_slave slave; //!< Bus interface.
+	uint8_t mem[SPI_SIM_23K256_SIZE]; //!< SRAM array.
+	uint8_t status; //!< Status register.
+	uint8_t opcode; //!< Instruction of the current chip select window.
+	uint8_t phase; //!< Amount of bytes received in the current chip select window.
+	uint16_t addr; //!< Internal address pointer.
+	bool done; //!< The single byte of a byte mode access has been transferred.
+};
+
+/**
+ * \brief Page size of the SPI flash model.
+ */
+#define SPI_SIM_FLASH_PAGE 256
+
+/**
+ * \brief Sector (smallest erase unit) size of the SPI flash model.
+ */
+#define SPI_SIM_FLASH_SECTOR 4096
+
+/**
+ * \brief Simulated SPI NOR flash.
+ * \see spi_sim_flash_init
+ */
+struct spi_sim_flash
+{
+	struct spi_sim_slave slave; //!< Bus interface.
+	uint8_t *mem; //!< Flash array.
+	uint32_t size; //!< Size of spi_sim_flash::mem, a multiple of SPI_SIM_FLASH_SECTOR.
+	uint8_t id[3]; //!< JEDEC manufacturer, memory type and capacity.
+	uint8_t status; //!< Status register.
+	uint8_t opcode; //!< Instruction of the current chip select window.
+	uint8_t phase; //!< Amount of bytes received in the current chip select window.
+	uint32_t addr; //!< Internal address pointer.
+	bool pending; //!< A program or erase cycle starts when the chip is deselected.
+	uint8_t busy_polls; //!< Status reads during which a program or erase cycle is busy.
+	uint8_t busy; //!< Remaining status reads of the current cycle.
+};
+
+__DECL
+extern void spi_sim_init(struct spi_sim_bus *bus, struct spi_adapter *adapter, char *name);
+extern void spi_sim_add_slave(struct spi_sim_bus *bus, struct spi_sim_slave *slave);
+extern void spi_sim_remove_slave(struct spi_sim_bus *bus, struct spi_sim_slave *slave);
+extern void spi_sim_23k256_init(struct spi_sim_23k256 *ram, reg8_t cs, uint8_t cspin);
+extern void spi_sim_flash_init(struct spi_sim_flash *flash, reg8_t cs, uint8_t cspin,
+							   uint8_t *mem, uint32_t size, uint8_t busy_polls);
+__DECL_END
+
+/**
+ * \brief Reset the statistics of a simulated bus.
+ * \param bus Simulated bus.
+ */
+static inline void spi_sim_reset_stats(struct spi_sim_bus *bus)
+{
+	bus->stats.xfers = 0;
+	bus->stats.bytes = 0;
+	bus->stats.irqs = 0;
+	bus->stats.polls = 0;
+	bus->stats.clocks = 0;
+}
+
+/**
+ * \brief Time the simulated bus has been clocking.
+ * \param bus Simulated bus.
+ * \return Bus time in micro seconds at spi_sim_bus::freq, 0 if no transfer has been done.
+ *
+ * Divide spi_sim_stats::bytes by this value to get the achieved throughput in MB/s.
+ */
+static inline unsigned long spi_sim_bus_time(struct spi_sim_bus *bus)
+{
+	if(!bus->freq) {
+		return 0;
+	}
+
+	return (unsigned long)((bus->stats.clocks * 1000000ULL) / bus->freq);
+}
+
+// @}
+
+#endif /* __SPI_SIM_H */
@@ -25,10 +25,26 @@
 #include <dev/dev.h>
 #include <dev/spi.h>
 
+#include <sys/events/event.h>
+
 __DECL
 extern int spi_set_buff(struct spi_client *client, void *buff, size_t size);
+extern int spi_set_tx(struct spi_client *client, const void *tx, size_t size);
+extern int spi_set_rx(struct spi_client *client, void *rx, size_t size);
 extern int spi_flush_client(struct spi_client *client);
+extern int spi_flush_message(struct spi_client *client, struct spi_message *msg);
+#ifdef __THREADS__
+extern int spi_xfer_begin(struct spi_client *client);
+extern int spi_xfer_queue(struct spi_client *client, const void *tx, void *rx, size_t size);
+extern int spi_xfer_end(struct spi_client *client);
+#endif
 extern void spi_init_adapter(struct spi_adapter *adapter, char *name);
+extern struct spi_client *spi_open(struct spi_adapter *adapter, reg8_t reg, uint8_t cs,
+								   uint32_t freq, uint16_t flags);
+extern int spi_transfer(struct spi_client *client, const void *tx, void *rx, size_t len);
+extern int spi_close(struct spi_client *client);
+extern int spi_bus_lock(struct spi_client *client);
+extern int spi_bus_unlock(struct spi_client *client);
 extern struct spi_client *spi_alloc_client(struct spi_adapter *adapter, reg8_t reg, uint8_t cs,
 										   uint32_t freq);
 extern void spi_init_adapter(struct spi_adapter *adapter, char *name);
@@ -45,6 +61,107 @@ static inline bool spi_client_is_master(struct spi_client *client)
 	
 	return ((stream->flags & SPI_MASTER) != 0);
 }
+
+/**
+ * \brief Initialize an SPI message.
+ * \param msg Message to initialize.
+ * \param segments Array of segments.
+ * \param num Amount of segments in \p segments.
+ */
+static inline void spi_message_init(struct spi_message *msg, struct spi_segment *segments,
+									size_t num)
+{
+	msg->segments = segments;
+	msg->num = num;
+}
+
+/**
+ * \brief Fill an SPI message segment.
+ * \param seg Segment to fill.
+ * \param tx Transmit buffer, <i>NULL</i> to transmit 0xFF.
+ * \param rx Receive buffer, <i>NULL</i> to discard the received bytes.
+ * \param length Length of the segment.
+ * \param cs_change Set to TRUE to deselect the chip after this segment.
+ * \note \p tx and \p rx may point to the same buffer.
+ */
+static inline void spi_segment_set(struct spi_segment *seg, const void *tx, void *rx,
+								   size_t length, bool cs_change)
+{
+	seg->tx = tx;
+	seg->rx = rx;
+	seg->length = length;
+	seg->cs_change = cs_change;
+}
+
+/**
+ * \brief Check whether an adapter supports interrupt driven transfers.
+ * \param adapter SPI bus adapter.
+ * \see spi_adapter::select
+ */
+static inline bool spi_adapter_irq_driven(struct spi_adapter *adapter)
+{
+	return adapter->select && adapter->start && adapter->deselect;
+}
+
+/**
+ * \brief Get a byte to transmit.
+ * \param adapter SPI bus adapter.
+ * \param idx Index in the transfer.
+ * \return The byte at \p idx of spi_adapter::tx, 0xFF if there is no transmit buffer.
+ */
+static inline uint8_t spi_adapter_tx(struct spi_adapter *adapter, size_t idx)
+{
+	return (adapter->tx) ? adapter->tx[idx] : 0xFF;
+}
+
+/**
+ * \brief Store a received byte.
+ * \param adapter SPI bus adapter.
+ * \param idx Index in the transfer.
+ * \param rx Received byte, discarded if there is no receive buffer.
+ */
+static inline void spi_adapter_rx(struct spi_adapter *adapter, size_t idx, uint8_t rx)
+{
+	if(adapter->rx) {
+		adapter->rx[idx] = rx;
+	}
+}
+
+/**
+ * \brief Exchange the next byte of an interrupt driven transfer.
+ * \param adapter SPI bus adapter.
+ * \param rx Byte received while the last byte was transmitted.
+ * \param tx Will be set to the next byte to transmit.
+ * \return TRUE if \p tx has to be transmitted, FALSE if the transfer has completed.
+ * \note Called by the bus driver from ISR context.
+ * 
+ * \p rx is stored in the current receive buffer. When the current buffers are done, the buffers
+ * queued by spi_xfer_queue are continued with immediately, so the bus doesn't go idle between
+ * two buffers.
+ */
+static inline bool spi_adapter_exchange(struct spi_adapter *adapter, uint8_t rx, uint8_t *tx)
+{
+	spi_adapter_rx(adapter, adapter->index, rx);
+	adapter->index++;
+	
+	if(adapter->index >= adapter->length) {
+		if(!adapter->next_length) {
+			adapter->busy = FALSE;
+			BermudaEventSignalFromISR(event(&adapter->queue));
+			return FALSE;
+		}
+		
+		adapter->tx = adapter->next_tx;
+		adapter->rx = adapter->next_rx;
+		adapter->length = adapter->next_length;
+		adapter->index = 0;
+		adapter->next_length = 0;
+		BermudaEventSignalFromISR(event(&adapter->queue));
+	}
+	
+	*tx = spi_adapter_tx(adapter, adapter->index);
+	return TRUE;
+}
 __DECL_END
 
 #endif
\ No newline at end of file
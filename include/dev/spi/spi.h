@@ -54,6 +54,11 @@ typedef uint8_t spi_features_t;
  */
 #define SPI_1MHZ 10000000
 
+/**
+ * \brief Time-out of SPI bus operations in milli seconds.
+ */
+#define SPI_TMO 500
+
 /**
  * \brief Shared info structure
  */
@@ -62,21 +67,106 @@ struct spi_shared_info
 	reg8_t cs; //!< Chip select register.
 	uint8_t cspin; //! Chip select pin.
 	uint32_t freq; //!< Operation frequency.
+	uint8_t cfg; //!< Bus configuration of the chip.
+	bool cs_keep; //!< Leave the chip selected after spi_adapter::xfer.
 } __attribute__((packed));
 
+/**
+ * \brief Segment of an SPI message.
+ * \see spi_message
+ */
+struct spi_segment
+{
+	const void *tx; //!< Transmit buffer, <i>NULL</i> to transmit 0xFF.
+	void *rx; //!< Receive buffer, <i>NULL</i> to discard the received bytes.
+	size_t length; //!< Length of the transfer.
+	
+	/**
+	 * \brief Chip select change.
+	 * 
+	 * When set, the chip is deselected after this segment and selected again before the next
+	 * segment. The chip is always deselected after the last segment.
+	 */
+	bool cs_change;
+};
+
+/**
+ * \brief SPI message.
+ * 
+ * A message is a list of segments which are exchanged under a single adapter lock. By default
+ * the chip stays selected for the entire message, so a command and its payload can be sent from
+ * different buffers.
+ * 
+ * \see spi_flush_message
+ */
+struct spi_message
+{
+	struct spi_segment *segments; //!< Array of segments.
+	size_t num; //!< Amount of segments in spi_message::segments.
+};
+
 /**
  * \brief SPI bus adapter.
  */
 struct spi_adapter
 {
 	struct device *dev; //!< I/O device.
-	bool busy; //!< Busy flag.
+	volatile bool busy; //!< Busy flag.
 	uint8_t error; //!< Bus error field.
 	spi_features_t features; //!< Bus features.
+	void *data; //!< Private data pointer.
+	struct spi_client *owner; //!< Client holding the bus lock, see spi_bus_lock.
 	int (*xfer)(struct spi_adapter*, struct spi_shared_info*);
 	
-	volatile uint8_t *buff; //!< I/O buffer.
+	/**
+	 * \brief Compute the bus configuration for a clock frequency.
+	 * \param adapter The bus adapter.
+	 * \param freq Requested clock frequency.
+	 * \return Driver specific configuration, passed in spi_shared_info::cfg.
+	 * \note Optional.
+	 * 
+	 * Called once when a client is allocated, so the drivers don't have to compute the clock
+	 * prescaler on every transfer.
+	 */
+	uint8_t (*config)(struct spi_adapter *adapter, uint32_t freq);
+	
+	/**
+	 * \brief Select a chip for an interrupt driven transfer.
+	 * \param adapter The bus adapter.
+	 * \param info Chip select and clock of the transfer.
+	 * \note Optional, interrupt driven transfers are only used when spi_adapter::select,
+	 *       spi_adapter::start and spi_adapter::deselect are set.
+	 * \see spi_xfer_begin
+	 */
+	void (*select)(struct spi_adapter *adapter, struct spi_shared_info *info);
+	
+	/**
+	 * \brief Start shifting spi_adapter::tx.
+	 * \param adapter The bus adapter.
+	 * \note Called with interrupts disabled.
+	 * 
+	 * The driver transmits the first byte of the transfer. Every following byte is handled from
+	 * the transfer complete interrupt using spi_adapter_exchange.
+	 */
+	void (*start)(struct spi_adapter *adapter);
+	
+	/**
+	 * \brief Deselect the chip after an interrupt driven transfer.
+	 * \param adapter The bus adapter.
+	 * \param info Chip select and clock of the transfer.
+	 * 
+	 * Also stops the transfer when it has not completed (i.e. it has timed out).
+	 */
+	void (*deselect)(struct spi_adapter *adapter, struct spi_shared_info *info);
+	
+	const uint8_t *volatile tx; //!< Transmit buffer, <i>NULL</i> to transmit 0xFF.
+	uint8_t *volatile rx; //!< Receive buffer, <i>NULL</i> to discard the received bytes.
 	size_t length; //!< Length of TX and RX.
+	volatile size_t index; //!< Index of the byte which is being shifted.
+	const uint8_t *volatile next_tx; //!< Transmit buffer which is shifted after spi_adapter::tx.
+	uint8_t *volatile next_rx; //!< Receive buffer of spi_adapter::next_tx.
+	volatile size_t next_length; //!< Length of the next buffers, 0 if nothing is queued.
+	volatile void *queue; //!< Threads waiting for the interrupt driven transfer.
 } __attribute__((packed));
 
 /**
@@ -89,9 +179,11 @@ struct spi_client
 	reg8_t cs; //!< Chip select register.
 	uint8_t cspin; //! Chip select pin.
 	uint32_t freq; //!< Operation frequency.
+	uint8_t cfg; //!< Bus configuration, computed by spi_adapter::config.
 	
 	FILE *stream; //!< I/O file.
-	uint8_t *buff; //!< I/O buffer.
+	const uint8_t *tx; //!< Transmit buffer.
+	uint8_t *rx; //!< Receive buffer.
 	size_t length; //!< Length of tx and rx.
 } __attribute__((packed));
 
@@ -35,8 +35,25 @@
 
 #define SCL_FRQ_24C02 100000UL //! SCL frequency of 100.0KHz
 
+/**
+ * \brief Size of the EEPROM array in bytes.
+ */
+#define SIZE_24C02 256
+
+#ifndef PAGE_24C02
+/**
+ * \brief Page size of the EEPROM.
+ * \note The 24C01 and 24C02 have 8 byte pages, the 24C04, 24C08 and 24C16 have 16 byte pages.
+ * 
+ * A page write can not cross a page boundary, the address wraps within the page.
+ */
+#define PAGE_24C02 8
+#endif
+
 extern void Bermuda24c02Init(struct i2c_client *iicc);
 extern int Bermuda24c02WriteByte(unsigned char addr, unsigned char data);
 extern unsigned char Bermuda24c02ReadByte(unsigned char addr);
+extern int Bermuda24c02Write(unsigned char addr, const void *buf, size_t len);
+extern int Bermuda24c02Read(unsigned char addr, void *buf, size_t len);
 
 #endif /* __24C02EEPROM_H */
\ No newline at end of file
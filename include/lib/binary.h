@@ -23,7 +23,7 @@
 #include <stdlib.h>
 
 #define neg(__x) (~__x)
-#define BIT(x) (1<<x)
+#define BIT(x) (1<<(x))
 #define _BV(x) BIT(x)
 
 /**
@@ -65,8 +65,9 @@ typedef struct linkedlist
  * protects against the removal of items.
  */
 #define foreach_safe(__list, __c, __tmp) \
-                                for(__c = (__list), __tmp = (__list)->next; __c != NULL && \
-                                __c != __tmp; __c = (__tmp), __tmp = (__c)->next)
+                                for(__c = (__list), __tmp = (__c) ? (__c)->next : NULL; \
+                                __c != NULL && __c != __tmp; \
+                                __c = (__tmp), __tmp = (__c) ? (__c)->next : NULL)
                                 
                                 
 #define ForEachpp(lpp, lp) \
@@ -0,0 +1,184 @@
+/*
+ *  BermudaOS - Ring buffer library
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file ringbuff.h */
+
+#ifndef __RINGBUFF_H
+#define __RINGBUFF_H
+
+#include <stdlib.h>
+
+#include <bermuda.h>
+
+#ifdef __EVENTS__
+#include <sys/events/event.h>
+#endif
+
+/**
+ * \addtogroup ringbuff
+ * @{
+ */
+
+/**
+ * \def RINGBUFF_MAX_LENGTH
+ * \brief Maximum amount of elements in a ring buffer.
+ *
+ * The indexes are 8-bit, free running counters. This keeps every index access
+ * atomic on 8-bit CPU's, but limits the length to 128 elements.
+ */
+#define RINGBUFF_MAX_LENGTH 128
+
+/**
+ * \def ringbuff_barrier
+ * \brief Memory barrier between the index and the data accesses.
+ *
+ * Both sides need it twice: after reading the index of the other side (so the data is not
+ * accessed before the index says it may be) and before publishing their own index (so the
+ * other side does not see the index before the data access is done).
+ */
+#ifdef __AVR__
+#define ringbuff_barrier() __asm__ __volatile__("" ::: "memory")
+#else
+#define ringbuff_barrier() __sync_synchronize()
+#endif
+
+/**
+ * \brief Single producer, single consumer ring buffer.
+ *
+ * The producer only writes <i>head</i>, the consumer only writes <i>tail</i>.
+ * Because of this, one ISR and one thread can use the buffer without critical
+ * sections.
+ */
+struct ringbuff
+{
+	uint8_t *buff; //!< Element storage.
+	volatile uint8_t head; //!< Producer index.
+	volatile uint8_t tail; //!< Consumer index.
+	uint8_t mask; //!< Length - 1.
+	uint8_t elsize; //!< Size of one element.
+#ifdef __EVENTS__
+	volatile void *queue; //!< Data event queue.
+#endif
+};
+
+__DECL
+extern int ringbuff_init(struct ringbuff *rb, void *buff, size_t elsize, size_t length);
+extern int ringbuff_push(struct ringbuff *rb, const void *elem);
+extern int ringbuff_pop(struct ringbuff *rb, void *elem);
+extern size_t ringbuff_write(struct ringbuff *rb, const void *src, size_t num);
+extern size_t ringbuff_read(struct ringbuff *rb, void *dst, size_t num);
+#ifdef __EVENTS__
+extern int ringbuff_wait(struct ringbuff *rb, unsigned int tmo);
+#endif
+__DECL_END
+
+/**
+ * \brief Get the amount of elements in the buffer.
+ * \param rb Ring buffer.
+ */
+static inline uint8_t ringbuff_count(struct ringbuff *rb)
+{
+	return (uint8_t)(rb->head - rb->tail);
+}
+
+/**
+ * \brief Get the amount of free element slots.
+ * \param rb Ring buffer.
+ */
+static inline uint8_t ringbuff_space(struct ringbuff *rb)
+{
+	return (uint8_t)(rb->mask + 1 - ringbuff_count(rb));
+}
+
+/**
+ * \brief Check if the buffer is empty.
+ * \param rb Ring buffer.
+ */
+static inline bool ringbuff_empty(struct ringbuff *rb)
+{
+	return rb->head == rb->tail;
+}
+
+/**
+ * \brief Push a single byte into a byte ring buffer.
+ * \param rb Ring buffer with an element size of 1.
+ * \param c Byte to push.
+ * \return 0 on success, -1 when the buffer is full.
+ * \note Producer side only.
+ */
+static inline int ringbuff_putc(struct ringbuff *rb, uint8_t c)
+{
+	uint8_t head = rb->head;
+
+	if((uint8_t)(head - rb->tail) > rb->mask) {
+		return -1;
+	}
+
+	ringbuff_barrier();
+	rb->buff[head & rb->mask] = c;
+	ringbuff_barrier();
+	rb->head = head + 1;
+	return 0;
+}
+
+/**
+ * \brief Pop a single byte from a byte ring buffer.
+ * \param rb Ring buffer with an element size of 1.
+ * \return The popped byte, or -1 when the buffer is empty.
+ * \note Consumer side only.
+ */
+static inline int ringbuff_getc(struct ringbuff *rb)
+{
+	uint8_t tail = rb->tail;
+	uint8_t c;
+
+	if(tail == rb->head) {
+		return -1;
+	}
+
+	ringbuff_barrier();
+	c = rb->buff[tail & rb->mask];
+	ringbuff_barrier();
+	rb->tail = tail + 1;
+	return c;
+}
+
+#ifdef __EVENTS__
+/**
+ * \brief Notify the consumer of new data.
+ * \param rb Ring buffer.
+ * \note Call from thread context.
+ */
+static inline void ringbuff_notify(struct ringbuff *rb)
+{
+	BermudaEventSignal(event(&rb->queue));
+}
+
+/**
+ * \brief Notify the consumer of new data from an ISR.
+ * \param rb Ring buffer.
+ */
+static inline void ringbuff_notify_from_isr(struct ringbuff *rb)
+{
+	BermudaEventSignalFromISR(event(&rb->queue));
+}
+#endif
+
+// @}
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ *  BermudaOS - SPI RAM cache
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file include/lib/spiram-cache.h SPI RAM cache header.
+ */
+
+#ifndef __SPIRAM_CACHE_H
+#define __SPIRAM_CACHE_H
+
+#include <stdlib.h>
+
+#include <lib/spiram.h>
+
+/**
+ * \addtogroup spiram-cache
+ * @{
+ */
+
+#ifndef SPIRAM_CACHE_LINE
+/**
+ * \brief Size of a cache line in bytes.
+ * \note Must be a power of two.
+ */
+#define SPIRAM_CACHE_LINE 32
+#endif
+
+#ifndef SPIRAM_CACHE_SETS
+/**
+ * \brief Amount of sets in the cache.
+ * \note Must be a power of two.
+ */
+#define SPIRAM_CACHE_SETS 4
+#endif
+
+#ifndef SPIRAM_CACHE_WAYS
+/**
+ * \brief Amount of lines in each set.
+ */
+#define SPIRAM_CACHE_WAYS 2
+#endif
+
+/**
+ * \brief Address in the SPI RAM.
+ * \see SPIRAM_SIZE
+ */
+typedef uint16_t spiram_ptr;
+
+/**
+ * \brief Cache statistics.
+ */
+struct spiram_cache_stats
+{
+	unsigned long hits; //!< Accesses served from the cache.
+	unsigned long misses; //!< Accesses which had to load a line.
+	unsigned long writebacks; //!< Dirty lines written to the SPI RAM.
+};
+
+__DECL
+extern void spiram_cache_init(void);
+extern int spiram_ptr_read(spiram_ptr ptr, void *buff, size_t len);
+extern int spiram_ptr_write(spiram_ptr ptr, const void *buff, size_t len);
+extern int spiram_cache_flush(void);
+extern void spiram_cache_invalidate(void);
+extern void spiram_cache_get_stats(struct spiram_cache_stats *stats);
+__DECL_END
+
+/**
+ * \brief Read a byte from the SPI RAM.
+ * \param ptr Address to read.
+ * \return The byte at \p ptr, 0xFF if it could not be read.
+ */
+static inline uint8_t spiram_ptr_get(spiram_ptr ptr)
+{
+	uint8_t byte = 0xFF;
+
+	spiram_ptr_read(ptr, &byte, 1);
+	return byte;
+}
+
+/**
+ * \brief Write a byte to the SPI RAM.
+ * \param ptr Address to write.
+ * \param byte Byte to write.
+ * \return Error code.
+ */
+static inline int spiram_ptr_set(spiram_ptr ptr, uint8_t byte)
+{
+	return spiram_ptr_write(ptr, &byte, 1);
+}
+
+// @}
+
+#endif /* __SPIRAM_CACHE_H */
@@ -19,6 +19,7 @@
 //! \file include/lib/spiram.h 23KXXX definitions.
 
 #ifndef __SPIRAM_H
+#define __SPIRAM_H
 
 #include <stdlib.h>
 #include <dev/spi.h>
@@ -68,6 +69,14 @@
  */
 #define BERMUDA_SPIRAM_READ_BYTE_SEQ_LEN  4
 
+/**
+ * \def SPIRAM_SIZE
+ * \brief Size of the SPI RAM in bytes.
+ * 
+ * Sequential transfers wrap around to address 0 at the end of the memory.
+ */
+#define SPIRAM_SIZE 0x8000
+
 /**
  * \typedef spiram_t
  * \brief SPIRAM mode.
@@ -84,8 +93,10 @@ typedef enum
 __DECL
 
 extern void spiram_init(struct spi_adapter *adapter, reg8_t port, uint8_t cs);
-extern int spiram_write_byte(const unsigned int address, unsigned char byte);
+extern int spiram_write_byte(const uint16_t address, uint8_t byte);
 extern uint8_t spiram_read_byte(unsigned int address);
+extern int spiram_read(uint16_t address, void *buff, size_t len);
+extern int spiram_write(uint16_t address, const void *buff, size_t len);
 __DECL_END
 
 #endif /* __SPIRAM_H */
\ No newline at end of file
@@ -158,6 +158,11 @@ extern int vfprintf_P(FILE *stream, const char *fmt, va_list ap);
 extern int write_P(int fd, const void *data, size_t size);
 extern int fprintf_P(FILE *stream, const char *fmt, ...);
 extern int logmsg_P(FILE *stream, const char *origin, const char *fmt, ...);
+#else
+#define printf_P printf
+#define fprintf_P fprintf
+#define vfprintf_P vfprintf
+extern int logmsg_P(FILE *stream, const char *origin, const char *fmt, ...);
 #endif
 extern int vfprintf(FILE *stream, const char *fmt, va_list ap);
 
@@ -0,0 +1,86 @@
+/*
+ *  BermudaOS - Event flags
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file flags.h */
+
+#ifndef __EVENT_FLAGS_H
+#define __EVENT_FLAGS_H
+
+#include <bermuda.h>
+
+#include <sys/thread.h>
+#include <sys/events/event.h>
+
+//! \addtogroup event_flags
+// @{
+
+/**
+ * \def EVENT_FLAGS_ANY
+ * \brief Wait until any of the requested flags is set.
+ */
+#define EVENT_FLAGS_ANY 0
+
+/**
+ * \def EVENT_FLAGS_ALL
+ * \brief Wait until all of the requested flags are set.
+ */
+#define EVENT_FLAGS_ALL 1
+
+/**
+ * \def EVENT_FLAGS_CLEAR
+ * \brief Clear the matched flags when the wait returns.
+ */
+#define EVENT_FLAGS_CLEAR 2
+
+/**
+ * \brief Event flag group.
+ *
+ * A group of 8 event flags. Threads can wait for any or all of a set of flags,
+ * so a single thread is able to wait for several event sources.
+ */
+struct event_flags
+{
+	volatile unsigned char flags; //!< Current flag state.
+	volatile THREAD *queue; //!< Threads waiting for a flag change.
+};
+
+/**
+ * \typedef EVENT_FLAGS
+ * \brief Event flag group type.
+ * \see struct event_flags
+ */
+typedef struct event_flags EVENT_FLAGS;
+
+__DECL
+#ifdef __EVENTS__
+extern void BermudaEventFlagsInit(EVENT_FLAGS *ef);
+extern void BermudaEventFlagsSet(EVENT_FLAGS *ef, unsigned char mask);
+extern void BermudaEventFlagsSetFromISR(EVENT_FLAGS *ef, unsigned char mask);
+extern void BermudaEventFlagsClear(EVENT_FLAGS *ef, unsigned char mask);
+extern int BermudaEventFlagsWait(EVENT_FLAGS *ef, unsigned char mask,
+								 unsigned char options, unsigned int tmo);
+#endif
+__DECL_END
+
+#define event_flags_set(ef, m) BermudaEventFlagsSet(ef, m)
+#define event_flags_set_from_isr(ef, m) BermudaEventFlagsSetFromISR(ef, m)
+#define event_flags_clear(ef, m) BermudaEventFlagsClear(ef, m)
+#define event_flags_wait(ef, m, o, tmo) BermudaEventFlagsWait(ef, m, o, tmo)
+
+// @}
+#endif
@@ -0,0 +1,78 @@
+/*
+ *  BermudaOS - Message queues
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file mqueue.h */
+
+#ifndef __MQUEUE_H
+#define __MQUEUE_H
+
+#include <bermuda.h>
+
+#include <sys/thread.h>
+#include <sys/events/event.h>
+
+//! \addtogroup mqueues
+// @{
+
+/**
+ * \brief Message queue.
+ *
+ * Fixed size FIFO of message pointers. Only the pointer is queued, the
+ * ownership of the message moves from the sender to the receiver.
+ */
+struct mqueue
+{
+	void **slots; //!< Message slots.
+	unsigned char size; //!< Amount of slots.
+	volatile unsigned char count; //!< Amount of queued messages.
+	volatile unsigned char head; //!< Next slot to write.
+	volatile unsigned char tail; //!< Next slot to read.
+	volatile THREAD *rqueue; //!< Threads waiting for a message.
+	volatile THREAD *squeue; //!< Threads waiting for a free slot.
+};
+
+/**
+ * \typedef MQUEUE
+ * \brief Message queue type.
+ * \see struct mqueue
+ */
+typedef struct mqueue MQUEUE;
+
+/**
+ * \def MQUEUE_INITIALIZER
+ * \brief Static initialiser of a message queue.
+ * \param buff Array of <i>len</i> void pointers.
+ * \param len Amount of slots.
+ */
+#define MQUEUE_INITIALIZER(buff, len) { buff, len, 0, 0, 0, NULL, NULL }
+
+__DECL
+#ifdef __EVENTS__
+extern void BermudaMqueueInit(MQUEUE *mq, void **slots, unsigned char size);
+extern int BermudaMqueueSend(MQUEUE *mq, void *msg, unsigned int tmo);
+extern int BermudaMqueuePostFromISR(MQUEUE *mq, void *msg);
+extern void *BermudaMqueueReceive(MQUEUE *mq, unsigned int tmo);
+#endif
+__DECL_END
+
+#define mq_send(mq, msg, tmo) BermudaMqueueSend(mq, msg, tmo)
+#define mq_post_from_isr(mq, msg) BermudaMqueuePostFromISR(mq, msg)
+#define mq_receive(mq, tmo) BermudaMqueueReceive(mq, tmo)
+
+// @}
+#endif
@@ -0,0 +1,116 @@
+/*
+ *  BermudaOS - Mutexes
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file mutex.h */
+
+#ifndef __MUTEX_H
+#define __MUTEX_H
+
+#include <bermuda.h>
+
+#include <sys/thread.h>
+#include <sys/events/event.h>
+
+//! \addtogroup mutexes
+// @{
+
+/**
+ * \brief Blocking, owner tracked mutex.
+ *
+ * The owner may lock the mutex recursively.
+ */
+struct mutex
+{
+	THREAD *volatile owner; //!< Thread holding the lock.
+	volatile unsigned char depth; //!< Recursive lock depth.
+	volatile THREAD *queue; //!< Threads waiting for the lock.
+};
+
+/**
+ * \typedef MUTEX
+ * \brief Mutex type.
+ * \see struct mutex
+ */
+typedef struct mutex MUTEX;
+
+/**
+ * \def MUTEX_INITIALIZER
+ * \brief Static initialiser for an unlocked mutex.
+ */
+#define MUTEX_INITIALIZER { NULL, 0, NULL }
+
+__DECL
+#ifdef __EVENTS__
+extern void BermudaMutexInit(MUTEX *mutex);
+extern int BermudaMutexLockSlow(MUTEX *mutex, unsigned int tmo);
+extern int BermudaMutexUnlockSlow(MUTEX *mutex);
+#endif
+__DECL_END
+
+#ifdef __EVENTS__
+/**
+ * \brief Lock a mutex.
+ * \param mutex Mutex to lock.
+ * \param tmo Time-out in milli seconds, EVENT_WAIT_INFINITE to wait forever.
+ * \return 0 when the lock is taken, -1 on time-out.
+ *
+ * Threads are scheduled cooperatively and mutexes are never used from an ISR,
+ * so the uncontended case does not need a critical section or a scheduler
+ * call.
+ */
+static inline int BermudaMutexLock(MUTEX *mutex, unsigned int tmo)
+{
+	if(mutex->owner == NULL) {
+		mutex->owner = BermudaCurrentThread;
+		return 0;
+	}
+
+	return BermudaMutexLockSlow(mutex, tmo);
+}
+
+/**
+ * \brief Unlock a mutex.
+ * \param mutex Mutex to unlock.
+ * \return 0 on success, -1 if the current thread is not the owner.
+ */
+static inline int BermudaMutexUnlock(MUTEX *mutex)
+{
+	if(mutex->owner == BermudaCurrentThread && !mutex->depth &&
+		mutex->queue == NULL) {
+		mutex->owner = NULL;
+		return 0;
+	}
+
+	return BermudaMutexUnlockSlow(mutex);
+}
+
+/**
+ * \brief Check if a mutex is locked.
+ * \param mutex Mutex to check.
+ */
+static inline bool BermudaMutexIsLocked(MUTEX *mutex)
+{
+	return mutex->owner != NULL;
+}
+#endif
+
+#define mutex_lock(m, tmo) BermudaMutexLock(m, tmo)
+#define mutex_unlock(m) BermudaMutexUnlock(m)
+
+// @}
+#endif
@@ -0,0 +1,75 @@
+/*
+ *  BermudaOS - Reader/writer locks
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file rwlock.h */
+
+#ifndef __RWLOCK_H
+#define __RWLOCK_H
+
+#include <bermuda.h>
+
+#include <sys/thread.h>
+#include <sys/events/event.h>
+
+//! \addtogroup rwlocks
+// @{
+
+/**
+ * \brief Reader/writer lock.
+ *
+ * Multiple readers or a single writer can hold the lock. Waiting writers take
+ * precedence over new readers.
+ */
+struct rwlock
+{
+	volatile unsigned char readers; //!< Amount of readers holding the lock.
+	THREAD *volatile writer; //!< Writer holding the lock.
+	volatile THREAD *rqueue; //!< Waiting readers.
+	volatile THREAD *wqueue; //!< Waiting writers.
+};
+
+/**
+ * \typedef RWLOCK
+ * \brief Reader/writer lock type.
+ * \see struct rwlock
+ */
+typedef struct rwlock RWLOCK;
+
+/**
+ * \def RWLOCK_INITIALIZER
+ * \brief Static initialiser for an unlocked reader/writer lock.
+ */
+#define RWLOCK_INITIALIZER { 0, NULL, NULL, NULL }
+
+__DECL
+#ifdef __EVENTS__
+extern void BermudaRwLockInit(RWLOCK *lock);
+extern int BermudaRwLockRead(RWLOCK *lock, unsigned int tmo);
+extern int BermudaRwLockWrite(RWLOCK *lock, unsigned int tmo);
+extern void BermudaRwUnlockRead(RWLOCK *lock);
+extern int BermudaRwUnlockWrite(RWLOCK *lock);
+#endif
+__DECL_END
+
+#define read_lock(l, tmo) BermudaRwLockRead(l, tmo)
+#define read_unlock(l) BermudaRwUnlockRead(l)
+#define write_lock(l, tmo) BermudaRwLockWrite(l, tmo)
+#define write_unlock(l) BermudaRwUnlockWrite(l)
+
+// @}
+#endif
@@ -0,0 +1,70 @@
+/*
+ *  BermudaOS - Counting semaphores
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file sem.h */
+
+#ifndef __SEM_H
+#define __SEM_H
+
+#include <bermuda.h>
+
+#include <sys/thread.h>
+#include <sys/events/event.h>
+
+//! \addtogroup semaphores
+// @{
+
+/**
+ * \brief Counting semaphore.
+ */
+struct semaphore
+{
+	volatile unsigned short count; //!< Available tokens.
+	volatile THREAD *queue; //!< Threads waiting for a token.
+};
+
+/**
+ * \typedef SEMAPHORE
+ * \brief Counting semaphore type.
+ * \see struct semaphore
+ */
+typedef struct semaphore SEMAPHORE;
+
+/**
+ * \def SEMAPHORE_INITIALIZER
+ * \brief Static initialiser for a semaphore.
+ * \param cnt Initial amount of tokens.
+ */
+#define SEMAPHORE_INITIALIZER(cnt) { cnt, NULL }
+
+__DECL
+#ifdef __EVENTS__
+extern void BermudaSemInit(SEMAPHORE *sem, unsigned short count);
+extern int BermudaSemWait(SEMAPHORE *sem, unsigned int tmo);
+extern int BermudaSemTryWait(SEMAPHORE *sem);
+extern void BermudaSemSignal(SEMAPHORE *sem);
+extern void BermudaSemSignalFromISR(SEMAPHORE *sem);
+#endif
+__DECL_END
+
+#define sem_wait(s, tmo) BermudaSemWait(s, tmo)
+#define sem_signal(s) BermudaSemSignal(s)
+#define sem_signal_from_isr(s) BermudaSemSignalFromISR(s)
+
+// @}
+#endif
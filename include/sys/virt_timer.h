@@ -83,6 +83,15 @@ struct _vtimer
          */
         unsigned long ticks;
         
+        /**
+         * \brief Timer flags.
+         * \see BERMUDA_TIMER_INLINE
+         * \see BERMUDA_TIMER_DEFERRED
+         * 
+         * Execution flags of the timer.
+         */
+        unsigned char flags;
+        
 } __PACK__;
 
 /**
@@ -104,6 +113,25 @@ typedef struct _vtimer VTIMER;
  */
 #define BERMUDA_PERIODIC 0
 
+/**
+ * \def BERMUDA_TIMER_INLINE
+ * \brief Inline timer.
+ * 
+ * When the timer thread is enabled, timers carrying this flag will still have
+ * their call-back executed directly by BermudaTimerProcess. Use this only for
+ * short, latency critical call-backs (e.g. kernel time-outs).
+ */
+#define BERMUDA_TIMER_INLINE 2
+
+/**
+ * \def BERMUDA_TIMER_DEFERRED
+ * \brief Deferred state flag.
+ * \private
+ * 
+ * Set while an expired timer is queued for the timer thread.
+ */
+#define BERMUDA_TIMER_DEFERRED 0x80
+
 /**
  * \def BermudaTimerDelete(t)
  * \brief Mark a timer as done.
@@ -136,4 +164,4 @@ PRIVATE WEAK void BermudaTimerAdd(VTIMER *timer);
 
 // @}
 
-#endif /* __VTIMER_H */
\ No newline at end of file
+#endif /* __VTIMER_H */
\ No newline at end of file
@@ -0,0 +1,403 @@
+/*
+ *  BermudaOS - Host port
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file src/arch/host/port.c Host port.
+ *
+ * \addtogroup host Host port
+ * \brief Run the portable parts of BermudaOS as a host program.
+ *
+ * The host port is used by the programs run with <i>make check</i>. The calling program is the
+ * main thread and time is simulated: the system tick only advances while that thread waits in
+ * BermudaEventWait or BermudaThreadSleep. Every tick runs BermudaTimerProcess, which takes the
+ * place of the timer interrupt, so simulated devices raise their interrupts from virtual timers.
+ * An event which is never signaled times out after exactly <i>tmo</i> simulated ticks.
+ *
+ * Threads created with BermudaThreadCreate, such as the timer thread, run as coroutines. After
+ * every tick, and when the main thread yields, each of them runs until it waits, sleeps or yields
+ * again. Those threads never advance the tick themselves.
+ *
+ * The ticks which pass while the thread is blocked are counted by BermudaHostIdleTicks. On a
+ * target those ticks are available to other threads, so they measure the CPU time an interrupt
+ * driven driver frees compared to a polling one.
+ *
+ * \code{.c}
+int main(void)
+{
+	BermudaHostInit();
+	i2c_sim_init(&sim_bus, &sim_adapter, "I2C_SIM");
+	...
+}
+\endcode
+ * @{
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <ucontext.h>
+
+#include <arch/io.h>
+
+#include <sys/thread.h>
+#include <sys/virt_timer.h>
+#include <sys/events/event.h>
+
+/*
+ * Provided by the host C library.
+ */
+extern int putchar(int c);
+
+/**
+ * \brief Maximum amount of threads created with BermudaThreadCreate.
+ */
+#define HOST_THREADS 4
+
+/**
+ * \brief Stack size of a created thread.
+ *
+ * The stack passed to BermudaThreadCreate is sized for the target, the host uses its own.
+ */
+#define HOST_STACK_SIZE 0x10000
+
+/**
+ * \brief Host context of a created thread.
+ */
+struct host_context
+{
+	THREAD *thread; //!< Thread information.
+	thread_handle_t handle; //!< Thread function, <i>NULL</i> after it returned.
+	void *arg; //!< Argument of <i>handle</i>.
+	ucontext_t context; //!< Saved host context.
+	unsigned char stack[HOST_STACK_SIZE]; //!< Host stack.
+};
+
+static int host_putc(int c, FILE *stream);
+static void host_schedule(void);
+static void host_switch(void);
+static void host_thread_start(void);
+
+/**
+ * \brief The thread running the host program.
+ */
+static THREAD host_thread;
+
+/**
+ * \brief The currently running thread, always host_thread.
+ */
+THREAD *BermudaCurrentThread = &host_thread;
+
+/**
+ * \brief Threads created with BermudaThreadCreate.
+ */
+static struct host_context host_contexts[HOST_THREADS];
+
+/**
+ * \brief Amount of entries used in host_contexts.
+ */
+static unsigned char host_thread_count = 0;
+
+/**
+ * \brief Created thread which is running, <i>NULL</i> while the main thread runs.
+ */
+static struct host_context *host_running = NULL;
+
+/**
+ * \brief Context of the main thread while a created thread runs.
+ */
+static ucontext_t host_main_context;
+
+/**
+ * \brief Simulated system tick.
+ */
+static volatile unsigned long host_sys_tick = 0;
+
+/**
+ * \brief Simulated ticks during which the thread was blocked.
+ */
+static unsigned long host_idle_ticks = 0;
+
+/**
+ * \brief Heap of the host program.
+ */
+static unsigned char host_heap[MEM];
+
+/**
+ * \brief Standard output, written to the standard output of the host program.
+ */
+static FDEV_SETUP_STREAM(host_stdout, NULL, NULL, &host_putc, NULL, NULL, "stdout",
+						 _FDEV_SETUP_WRITE, NULL);
+
+/**
+ * \brief Initialize the host port.
+ * \note Has to be called before any other BermudaOS function.
+ *
+ * Sets up the heap and the standard output stream.
+ */
+PUBLIC void BermudaHostInit(void)
+{
+	host_thread.name = "main";
+	BermudaHeapInitBlock(host_heap, sizeof(host_heap));
+	stdout = &host_stdout;
+	stderr = &host_stdout;
+}
+
+/**
+ * \brief Simulated timer interrupt.
+ *
+ * Advances the system tick by one milli second, processes the virtual timers and runs the
+ * created threads.
+ */
+PUBLIC void BermudaHostTick(void)
+{
+	host_sys_tick++;
+	BermudaTimerProcess();
+	host_schedule();
+}
+
+/**
+ * \brief Get the idle time.
+ * \return Amount of simulated milli seconds the thread has been blocked in BermudaEventWait or
+ *         BermudaThreadSleep.
+ */
+PUBLIC unsigned long BermudaHostIdleTicks(void)
+{
+	return host_idle_ticks;
+}
+
+/**
+ * \brief Get the system tick.
+ * \return Amount of simulated milli seconds since start up.
+ */
+PUBLIC unsigned long BermudaTimerGetSysTick()
+{
+	return host_sys_tick;
+}
+
+/**
+ * \brief Wait for an event.
+ * \param tqpp Event queue.
+ * \param tmo Time-out in milli seconds, EVENT_WAIT_INFINITE to wait forever.
+ * \return 0 when the event is posted, -1 on time-out.
+ * \note An infinite wait on an event which is never signaled does not return.
+ */
+PUBLIC int BermudaEventWait(volatile THREAD **tqpp, unsigned int tmo)
+{
+	unsigned long start = host_sys_tick;
+
+	while(*tqpp != SIGNALED) {
+		if(tmo && host_sys_tick - start >= tmo) {
+			return -1;
+		}
+
+		if(host_running) {
+			host_switch();
+		} else {
+			host_idle_ticks++;
+			BermudaHostTick();
+		}
+	}
+
+	*tqpp = NULL;
+	return 0;
+}
+
+/**
+ * \brief Wait for the next event.
+ * \param tqpp Event queue.
+ * \param tmo Time-out in milli seconds.
+ * \return 0 when the event is posted, -1 on time-out.
+ *
+ * A pending signal is discarded.
+ */
+PUBLIC int BermudaEventWaitNext(volatile THREAD **tqpp, unsigned int tmo)
+{
+	if(tqpp == NULL) {
+		return -1;
+	}
+
+	*tqpp = NULL;
+	return BermudaEventWait(tqpp, tmo);
+}
+
+/**
+ * \brief Post an event.
+ * \param tqpp Event queue.
+ * \return 0 on success, -1 if the queue was already signaled.
+ *
+ * The only thread never waits in a queue, so posting an event always leaves it signaled.
+ */
+PUBLIC int BermudaEventSignalRaw(THREAD *volatile*tqpp)
+{
+	if(*tqpp == SIGNALED) {
+		return -1;
+	}
+
+	*tqpp = SIGNALED;
+	return 0;
+}
+
+/**
+ * \brief Post an event.
+ * \param tqpp Event queue.
+ * \see BermudaEventSignalRaw
+ */
+PUBLIC int BermudaEventSignal(volatile THREAD **tqpp)
+{
+	return BermudaEventSignalRaw((THREAD*volatile*)tqpp);
+}
+
+/**
+ * \brief Post an event from an ISR.
+ * \param tqpp Event queue.
+ */
+PUBLIC void BermudaEventSignalFromISR(volatile THREAD **tqpp)
+{
+	*tqpp = SIGNALED;
+}
+
+/**
+ * \brief Sleep for the given amount of milli seconds.
+ * \param ms Amount of simulated milli seconds to sleep.
+ */
+PUBLIC void BermudaThreadSleep(unsigned int ms)
+{
+	unsigned long start = host_sys_tick;
+
+	while(host_sys_tick - start < ms) {
+		if(host_running) {
+			host_switch();
+		} else {
+			host_idle_ticks++;
+			BermudaHostTick();
+		}
+	}
+}
+
+/**
+ * \brief Yield the CPU.
+ *
+ * The main thread runs the created threads, a created thread returns to the main thread.
+ */
+PUBLIC void BermudaThreadYield()
+{
+	if(host_running) {
+		host_switch();
+	} else {
+		host_schedule();
+	}
+}
+
+/**
+ * \brief Create a new thread.
+ * \param t Thread information.
+ * \param name Name of the thread.
+ * \param handle Thread function.
+ * \param arg Argument of <i>handle</i>.
+ * \param stack_size Size of <i>stack</i>.
+ * \param stack Target stack, not used by the host.
+ * \param prio Priority, threads are run in order of creation.
+ * \note At most HOST_THREADS threads can be created.
+ *
+ * The thread starts after the next tick, or when the main thread yields.
+ */
+PUBLIC void BermudaThreadCreate(THREAD *t, char *name, thread_handle_t handle, void *arg,
+								unsigned short stack_size, void *stack, unsigned char prio)
+{
+	struct host_context *ctx;
+
+	if(host_thread_count >= HOST_THREADS) {
+		return;
+	}
+
+	ctx = &host_contexts[host_thread_count++];
+	t->name = name;
+	t->param = arg;
+	t->stack = stack;
+	t->stack_size = stack_size;
+	t->prio = prio;
+
+	ctx->thread = t;
+	ctx->handle = handle;
+	ctx->arg = arg;
+	getcontext(&ctx->context);
+	ctx->context.uc_stack.ss_sp = ctx->stack;
+	ctx->context.uc_stack.ss_size = sizeof(ctx->stack);
+	ctx->context.uc_link = &host_main_context;
+	makecontext(&ctx->context, &host_thread_start, 0);
+}
+
+/**
+ * \brief Run the created threads.
+ *
+ * Every thread runs until it waits, sleeps, yields or returns. Has no effect when it is called
+ * by a created thread.
+ */
+static void host_schedule(void)
+{
+	struct host_context *ctx;
+	unsigned char i;
+
+	if(host_running) {
+		return;
+	}
+
+	for(i = 0; i < host_thread_count; i++) {
+		ctx = &host_contexts[i];
+		if(ctx->handle == NULL) {
+			continue;
+		}
+
+		host_running = ctx;
+		BermudaCurrentThread = ctx->thread;
+		swapcontext(&host_main_context, &ctx->context);
+		host_running = NULL;
+		BermudaCurrentThread = &host_thread;
+	}
+}
+
+/**
+ * \brief Return from the running created thread to the main thread.
+ */
+static void host_switch(void)
+{
+	swapcontext(&host_running->context, &host_main_context);
+}
+
+/**
+ * \brief Entry point of a created thread.
+ *
+ * When the thread function returns, the thread is not run again and the context links back to
+ * the main thread.
+ */
+static void host_thread_start(void)
+{
+	host_running->handle(host_running->arg);
+	host_running->handle = NULL;
+}
+
+/**
+ * \brief Write a character to the host standard output.
+ * \param c Character to write.
+ * \param stream Output stream.
+ */
+static int host_putc(int c, FILE *stream)
+{
+	return putchar(c);
+}
+
+// @}
@@ -24,6 +24,7 @@
 
 #include <sys/thread.h>
 #include <sys/events/event.h>
+#include <sys/events/mutex.h>
 
 #include <dev/dev.h>
 
@@ -129,7 +130,7 @@ PUBLIC int BermudaDeviceAlloc(DEVICE *dev, unsigned int tmo)
 	int rc = -1;
 	if(dev != NULL) {
 #ifdef __EVENTS__
-		rc = BermudaEventWait((volatile THREAD**)dev->mutex, tmo);
+		rc = BermudaMutexLock((MUTEX*)dev->mutex, tmo);
 #else
 		rc = 0;
 #endif
@@ -151,7 +152,7 @@ PUBLIC int BermudaDeviceRelease(DEVICE *dev)
 	int rc = -1;
 	if(NULL != dev) {
 #ifdef __EVENTS__
-		rc = BermudaEventSignal((volatile THREAD**)dev->mutex);
+		rc = BermudaMutexUnlock((MUTEX*)dev->mutex);
 #else
 		rc = 0;
 #endif
@@ -168,17 +169,11 @@ PUBLIC int BermudaDeviceRelease(DEVICE *dev)
  */
 PUBLIC int BermudaDeviceIsLocked( DEVICE *dev )
 {
-	int rc = 1;
-	volatile void *lock;
-
-	BermudaEnterCritical();
-	lock = *((volatile void**)dev->mutex);
-	BermudaExitCritical();
-
-	if(lock == SIGNALED) {
-		rc = 0;
-	}
-	return rc;
+#ifdef __EVENTS__
+	return BermudaMutexIsLocked((MUTEX*)dev->mutex) ? 1 : 0;
+#else
+	return 0;
+#endif
 }
 
 /**
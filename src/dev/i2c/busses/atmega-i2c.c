@@ -30,7 +30,9 @@
 #include <dev/i2c/busses/atmega.h>
 
 #include <sys/thread.h>
+#include <sys/virt_timer.h>
 #include <sys/events/event.h>
+#include <sys/events/mutex.h>
 
 #include <fs/vfile.h>
 
@@ -41,16 +43,23 @@
 
 /* static functions */
 static void atmega_i2c_ioctl(struct device *dev, int cfg, void *data);
+static void atmega_i2c_recover(struct atmega_i2c_priv *priv);
 static unsigned char atmega_i2c_calc_twbr(uint32_t freq, unsigned char pres);
 static unsigned char atmega_i2c_calc_prescaler(uint32_t frq);
 
-static int i2c_init_transfer(struct i2c_adapter *adap, uint32_t freq, bool master, size_t *index);
-static int i2c_resume_transfer(struct i2c_adapter *adapter, size_t *index);
-static int i2c_master_transfer(struct i2c_adapter *adapter, uint32_t);
-static int atmega_i2c_slave_listen(struct i2c_adapter *adapter, size_t *index);
-static void atmega_i2c_update(struct i2c_adapter *adapter, long diff);
+static int i2c_init_transfer(struct i2c_adapter *adap, i2c_clock_t clock, bool master);
+static int i2c_resume_transfer(struct i2c_adapter *adapter, bool master);
+static int i2c_master_transfer(struct i2c_adapter *adapter, i2c_clock_t clock);
+static int i2c_async_transfer(struct i2c_adapter *adapter, i2c_clock_t clock);
+static i2c_clock_t atmega_i2c_clock(struct i2c_adapter *adapter, uint32_t freq);
+static void atmega_i2c_start_master(struct i2c_adapter *adapter, i2c_clock_t clock);
+static void atmega_i2c_master_done(struct i2c_adapter *adapter, bool error);
+static int atmega_i2c_slave_listen(struct i2c_adapter *adapter);
+static void atmega_i2c_update(struct i2c_adapter *adapter);
 static void atmega_i2c_update_from_isr(struct i2c_adapter *adapter);
 static void atmega_i2c_slave_buff_end(struct i2c_adapter *adapter);
+static int atmega_i2c_attach(struct i2c_adapter *adapter, struct i2c_regfile *rf);
+static void atmega_i2c_regfile_end(struct i2c_adapter *adapter);
 
 #ifdef I2C_DBG
 static void atmega_i2c_dbg(struct i2c_adapter *adapter);
@@ -79,7 +88,7 @@ static struct atmega_i2c_priv i2c_c0 = {
 /**
  * \brief I2C bus 0 mutex.
  */
-static volatile void *bus_c0_mutex = SIGNALED;
+static MUTEX bus_c0_mutex = MUTEX_INITIALIZER;
 /**
  * \brief I2C bus 0 master queue.
  */
@@ -100,12 +109,48 @@ struct i2c_adapter *atmega_i2c_busses[ATMEGA_BUSSES];
  */
 static volatile size_t buffer_index = 0;
 
+/**
+ * \brief Master segment which is currently transfered.
+ * \see atmega_i2c_seg_avail
+ */
+static uint8_t *master_seg_buff = NULL;
+/**
+ * \brief Length of the current master segment.
+ */
+static size_t master_seg_length = 0;
+/**
+ * \brief Master segments which have not been started yet.
+ */
+static const struct i2c_iovec *master_seg_next = NULL;
+/**
+ * \brief Amount of segments in master_seg_next.
+ */
+static uint8_t master_seg_left = 0;
+
+/**
+ * \brief Set while the address of the current master message is being polled.
+ * \see I2C_MSG_ACK_POLL_FLAG
+ */
+static bool ack_polling = FALSE;
+/**
+ * \brief System tick of the first address poll of the current master message.
+ * \see I2C_ACK_POLL_TMO
+ */
+static uint16_t ack_poll_start = 0;
+/**
+ * \brief Set when a message of the synchronous master transfer has failed.
+ * 
+ * Asynchronous transfers keep their state in their own i2c_xfer, so they never touch this flag.
+ */
+static volatile bool master_failed = FALSE;
+
 /**
  * \brief Master message which is currently configured for transfer.
  */
 static volatile struct i2c_message *master_msg = NULL;
 /**
- * \brief Master message which is sent/received last by the controller.
+ * \brief Message of the synchronous master transfer which is sent/received last by the controller.
+ * \see master_failed
  */
 static volatile struct i2c_message *last_master_msg = NULL;
 /**
@@ -116,6 +161,20 @@ static volatile struct i2c_message *slave_msg = NULL;
  * \brief Last used slave message.
  */
 static volatile struct i2c_message *last_slave_msg = NULL;
+/**
+ * \brief Register file which is served when no slave message is set.
+ * \see atmega_i2c_attach
+ */
+static struct i2c_regfile *volatile slave_regfile = NULL;
+
+/**
+ * \brief Check whether the bus should listen for its slave address.
+ * \return TRUE if a slave message or a register file is available.
+ */
+static inline bool atmega_i2c_listening(void)
+{
+	return slave_msg != NULL || slave_regfile != NULL;
+}
 
 /**
  * \brief Intialize an I2C bus.
@@ -149,8 +208,11 @@ PUBLIC void atmega_i2c_c0_hw_init(uint8_t sla, struct i2c_adapter *adapter)
 	adapter->data = (void*)&i2c_c0;
 	adapter->features = I2C_MASTER_SUPPORT | I2C_SLAVE_SUPPORT;
 	adapter->xfer = &i2c_init_transfer;
+	adapter->start = &i2c_async_transfer;
+	adapter->clock = &atmega_i2c_clock;
 	adapter->resume = &i2c_resume_transfer;
 	adapter->update = &atmega_i2c_update;
+	adapter->attach = &atmega_i2c_attach;
 	adapter->busy = FALSE;
 	adapter->error = FALSE;
 
@@ -215,9 +277,15 @@ static unsigned char atmega_i2c_calc_twbr(uint32_t freq, unsigned char pres)
 		return 0xFF;
 	}
 	
+	if(freq >= F_CPU/16) {
+		return 0;
+	}
 	twbr = I2C_CALC_TWBR(freq, prescaler);
+	if(twbr > 0xFF) {
+		return 0xFF;
+	}
 	
-	return twbr & 0xFF;
+	return twbr;
 }
 
 /**
@@ -233,22 +301,42 @@ static unsigned char atmega_i2c_calc_twbr(uint32_t freq, unsigned char pres)
  */
 static unsigned char atmega_i2c_calc_prescaler(uint32_t frq)
 {
-	unsigned char ret = 0;
-	
-	if(frq > I2C_FRQ(255,1)) {
-		ret = B0;
-	}
-	else if(frq > I2C_FRQ(255,4) && frq < I2C_FRQ(1,4)) {
-		ret = B11;
-	}
-	else if(frq > I2C_FRQ(255,16) && frq < I2C_FRQ(1,16)) {
-		ret = B10;
-	}
-	else if(frq > I2C_FRQ(255,64) && frq < I2C_FRQ(1,64)) {
-		ret = B1;
+	if(frq >= I2C_FRQ(255,1)) {
+		return I2C_PRES_1;
+	} else if(frq >= I2C_FRQ(255,4)) {
+		return I2C_PRES_4;
+	} else if(frq >= I2C_FRQ(255,16)) {
+		return I2C_PRES_16;
+	} else {
+		return I2C_PRES_64;
 	}
+}
 
-	return ret;
+/**
+ * \brief Translate a frequency into a clock setting.
+ * \param adapter Bus adapter.
+ * \param freq Desired frequency.
+ * \return The prescaler and TWBR value packed with I2C_CLOCK.
+ * \see i2c_adapter::clock
+ * 
+ * The standard frequencies are looked up in the compile time table, other frequencies are
+ * calculated.
+ */
+static i2c_clock_t atmega_i2c_clock(struct i2c_adapter *adapter, uint32_t freq)
+{
+	unsigned char pres;
+	
+	switch(freq) {
+		case 100000UL:
+			return I2C_CLOCK_100K;
+		case 400000UL:
+			return I2C_CLOCK_400K;
+		case 1000000UL:
+			return I2C_CLOCK_1M;
+		default:
+			pres = atmega_i2c_calc_prescaler(freq);
+			return I2C_CLOCK(pres, atmega_i2c_calc_twbr(freq, pres));
+	}
 }
 
 /**
@@ -314,81 +402,137 @@ static void atmega_i2c_ioctl(struct device *dev, int cfg, void *data)
 			atmega_i2c_reg_write(priv->twcr, &reg);
 			break;
 			
+		case I2C_RECOVER:
+			atmega_i2c_recover(priv);
+			atmega_i2c_ioctl(dev, (atmega_i2c_listening()) ? I2C_LISTEN : I2C_NACK, NULL);
+			break;
+			
 		default:
 			break;
 	}
 	return;
 }
 
+/**
+ * \brief Free a bus which is held by a slave.
+ * \param priv Private bus data.
+ * \see I2C_RECOVER
+ * 
+ * A slave which lost track of a transfer (e.g. after a reset of the master) keeps SDA low while
+ * it is waiting for the remaining clock pulses of its byte. The TWI is disconnected from the pins
+ * and SCL is clocked by hand until SDA is released, at most nine times. A start and stop
+ * condition reset the state machines of all slaves. The TWI is left disabled, I2C_RECOVER enables
+ * it again and keeps answering the slave address while a slave buffer or register file is set.
+ */
+static void atmega_i2c_recover(struct atmega_i2c_priv *priv)
+{
+	uint8_t reg = 0, port, i;
+	
+	atmega_i2c_reg_write(priv->twcr, &reg);
+	port = I2C_PORT & (BIT(SCL) | BIT(SDA));
+	I2C_DDR &= ~(BIT(SCL) | BIT(SDA));
+	I2C_PORT &= ~(BIT(SCL) | BIT(SDA)); /* a pin is driven low by making it an output */
+	
+	for(i = 0; i < 9 && (I2C_PIN & BIT(SDA)) == 0; i++) {
+		I2C_DDR |= BIT(SCL);
+		BermudaDelay_us(5);
+		I2C_DDR &= ~BIT(SCL);
+		BermudaDelay_us(5);
+	}
+	
+	I2C_DDR |= BIT(SDA);
+	BermudaDelay_us(5);
+	I2C_DDR &= ~BIT(SDA);
+	BermudaDelay_us(5);
+	
+	I2C_PORT |= port;
+}
+
 /**
  * \brief Initiate an I2C transfer.
  * \param adapter Bus adapter.
- * \param freq Operating frequency.
- * \param master 
- * \note \p freq will only be used if a master transfer is being initiated.
+ * \param clock Clock setting, see atmega_i2c_clock.
+ * \param master Set to TRUE for a master transfer, FALSE to listen as slave.
+ * \note \p clock will only be used if a master transfer is being initiated.
+ * \see i2c_adapter::xfer
  */
-static int i2c_init_transfer(struct i2c_adapter *adapter, uint32_t freq, bool master, size_t *index)
+static int i2c_init_transfer(struct i2c_adapter *adapter, i2c_clock_t clock, bool master)
 {
-	struct i2c_message *msg;
 	int rc;
 	
 	adapter->error = FALSE;
 	if(master) {
-		rc = i2c_master_transfer(adapter, freq);
-		if(rc == 0) {
-			BermudaEnterCritical();
-			*index = i2c_vector_locate(adapter, (void*)last_master_msg);
-			msg = (struct i2c_message*)last_master_msg;
-			BermudaExitCritical();
-			if((msg->features & I2C_MSG_CALL_BACK_MASK) != 0) {
-				if(rc != 0) {
-					adapter->dev->ctrl(adapter->dev, I2C_RELEASE | I2C_ACK, NULL);
-					msg->features |= I2C_MSG_DONE_FLAG;
-					adapter->busy = FALSE;
-				}
-			} else {
-				rc = 1;
-			}
+		rc = i2c_master_transfer(adapter, clock);
+		if(rc == 0 && (last_master_msg->features & I2C_MSG_CALL_BACK_MASK) == 0) {
+			rc = 1;
 		}
 	} else {
 		/* slave msg */
-		rc = atmega_i2c_slave_listen(adapter, index);
+		rc = atmega_i2c_slave_listen(adapter);
 	}
 	return rc;
 }
 
 /**
- * \brief Initialize a master transfer.
+ * \brief Start the master queue if the bus is idle.
  * \param adapter Bus adapter.
- * \param Desired frequency.
+ * \param clock Clock setting, see atmega_i2c_clock.
  *
- * This function will set call atmega_i2c_update to set master_msg and slave_msg (if the bus
- * is not busy yet).
+ * This function will call atmega_i2c_update to set master_msg and slave_msg. If the bus is busy,
+ * the ISR will pick up the queued master messages after the current message.
  */
-static int i2c_master_transfer(struct i2c_adapter *adapter, uint32_t freq)
+static void atmega_i2c_start_master(struct i2c_adapter *adapter, i2c_clock_t clock)
 {
-	int rc = -1;
-	uint8_t pres = atmega_i2c_calc_prescaler(freq);
-	uint8_t twbr = atmega_i2c_calc_twbr(freq, pres);
-	
-	TWBR = twbr;
-	TWSR &= ~B11;
-	TWSR |= pres & B11;
-	
 	if(!adapter->busy) {
+		TWBR = clock & 0xFF;
+		TWSR = (clock >> 8) & B11;
+		
 		if((TWSR & I2C_NOINFO) == I2C_NOINFO) {
-			atmega_i2c_update(adapter, 0); /* will be called by the ISR if the bus is busy */
-			if(slave_msg) {
+			atmega_i2c_update(adapter); /* will be called by the ISR if the bus is busy */
+			ack_polling = FALSE;
+			if(atmega_i2c_listening()) {
 				adapter->dev->ctrl(adapter->dev, I2C_START | I2C_ACK, NULL);
 			} else {
 				adapter->dev->ctrl(adapter->dev, I2C_START | I2C_NACK, NULL);
 			}
 		}
-		
 	}
+}
+
+/**
+ * \brief Start an asynchronous master transfer.
+ * \param adapter Bus adapter.
+ * \param clock Clock setting, see atmega_i2c_clock.
+ * \see i2c_adapter::start
+ */
+static int i2c_async_transfer(struct i2c_adapter *adapter, i2c_clock_t clock)
+{
+	atmega_i2c_start_master(adapter, clock);
+	return 0;
+}
+
+/**
+ * \brief Initialize a master transfer.
+ * \param adapter Bus adapter.
+ * \param clock Clock setting, see atmega_i2c_clock.
+ *
+ * Starts the master queue and waits until the last synchronous message has been transfered.
+ */
+static int i2c_master_transfer(struct i2c_adapter *adapter, i2c_clock_t clock)
+{
+	int rc = -1;
+	
+	last_master_msg = NULL;
+	master_failed = FALSE;
+	atmega_i2c_start_master(adapter, clock);
 	rc = BermudaEventWaitNext(event(adapter->master_queue), I2C_MASTER_TMO); /* wait for completion */
+	if(rc == -1) {
+		i2c_adapter_stats_inc(adapter, master_tmo);
+		adapter->dev->ctrl(adapter->dev, I2C_RECOVER, NULL);
+		adapter->busy = FALSE;
+	}
 	
-	if(!last_master_msg) {
+	if(!last_master_msg || master_failed) {
 		rc = -1;
 	}
 	return rc;
@@ -397,15 +541,15 @@ static int i2c_master_transfer(struct i2c_adapter *adapter, uint32_t freq)
 /**
  * \brief Setup the slave buffers.
  * \param adapter Bus adapter.
- * \param index Index of the first slave message.
+ * \see i2c_adapter::xfer
  */
-static int atmega_i2c_slave_listen(struct i2c_adapter *adapter, size_t *index)
+static int atmega_i2c_slave_listen(struct i2c_adapter *adapter)
 {
 	int rc = 0;
 	
 	if(!adapter->busy) {
 		if((TWSR & I2C_NOINFO) == I2C_NOINFO) {
-			atmega_i2c_update(adapter, 0); /* Will be called by the ISR if the bus is busy. */
+			atmega_i2c_update(adapter); /* Will be called by the ISR if the bus is busy. */
 			if(master_msg) {
 				adapter->dev->ctrl(adapter->dev, I2C_START | I2C_ACK, NULL);
 			} else {
@@ -416,20 +560,23 @@ static int atmega_i2c_slave_listen(struct i2c_adapter *adapter, size_t *index)
 	
 	if(BermudaEventWaitNext(event(adapter->slave_queue), I2C_SLAVE_TMO) == -1) {
 		rc = -1;
+		i2c_adapter_stats_inc(adapter, slave_tmo);
+		BermudaEnterCritical();
 		if(slave_msg) {
 			last_slave_msg = slave_msg;
-			slave_msg->features |= I2C_MSG_DONE_FLAG;
+			i2c_queue_complete(&adapter->slave_msgs);
 			if((i2c_msg_features((void*)slave_msg) & I2C_MSG_CALL_BACK_MASK) != 0) {
 				adapter->busy = FALSE;
 				adapter->dev->ctrl(adapter->dev, I2C_RELEASE | I2C_ACK, NULL);
 			}
 		}
+		BermudaExitCritical();
 	}
 	
-	if(last_slave_msg) {
-		*index = i2c_vector_locate(adapter, (void*)last_slave_msg);
-	} else {
+	if(!last_slave_msg) {
 		rc = -DEV_NULL;
+	} else if(rc == 0 && (last_slave_msg->features & I2C_MSG_CALL_BACK_MASK) == 0) {
+		rc = 1;
 	}
 	
 	return rc;
@@ -438,36 +585,40 @@ static int atmega_i2c_slave_listen(struct i2c_adapter *adapter, size_t *index)
 /**
  * \brief Resume transmission after a call back.
  * \param adapter Bus adapter.
- * \param index Pointer to the index of the inserted message.
+ * \param master Queue holding the message set by the call back.
  * \see i2c_adapter::resume
  * 
- * In case of master message, master_msg will be set to the message located at \code *index \endcode
- * If the message at \p *index is a slave message, slave_msg will be set to \p *index.
+ * In case of master message, master_msg will be set to the pending message of the master queue.
+ * Otherwise slave_msg will be set to the pending message of the slave queue.
  */
-static int i2c_resume_transfer(struct i2c_adapter *adapter, size_t *index)
+static int i2c_resume_transfer(struct i2c_adapter *adapter, bool master)
 {
 	struct i2c_message *msg;
 	int rc = 1;
 	adapter->error = FALSE;
 	
-	msg = i2c_vector_get(adapter, *index);
-	if((i2c_msg_features(msg) & I2C_MSG_MASTER_MSG_MASK) != 0) {
-		master_msg = msg;
+	if(master) {
+		master_msg = i2c_queue_pending(&adapter->master_msgs);
+		master_failed = FALSE;
+		ack_polling = FALSE;
 		adapter->dev->ctrl(adapter->dev, I2C_START | I2C_NACK, NULL);
 		if((rc = BermudaEventWaitNext(event(adapter->master_queue), I2C_MASTER_TMO)) < 0) {
+			i2c_adapter_stats_inc(adapter, master_tmo);
+			adapter->dev->ctrl(adapter->dev, I2C_RECOVER, NULL);
 			if(master_msg) {
 				last_master_msg = master_msg;
 			}
 			adapter->error = TRUE;
 		}
-		*index = i2c_vector_locate(adapter, (void*)last_master_msg);
 		if(last_master_msg) {
 			msg = (struct i2c_message*)last_master_msg;
 			if((msg->features & I2C_MSG_CALL_BACK_MASK) != 0) {
 				if(rc != 0) {
 					adapter->busy = FALSE;
 					adapter->dev->ctrl(adapter->dev, I2C_RELEASE | I2C_ACK, NULL);
-					msg->features |= I2C_MSG_DONE_FLAG;
+					BermudaEnterCritical();
+					i2c_queue_complete(&adapter->master_msgs);
+					BermudaExitCritical();
 				}
 			} else {
 				rc = 1;
@@ -475,59 +626,101 @@ static int i2c_resume_transfer(struct i2c_adapter *adapter, size_t *index)
 		} else {
 			rc = -DEV_NULL;
 		}
+		
+		if(rc >= 0 && master_failed) {
+			rc = -1;
+		}
 	} else {
 		/* slave msg */
-		slave_msg = msg;
+		slave_msg = i2c_queue_pending(&adapter->slave_msgs);
 		adapter->dev->ctrl(adapter->dev, I2C_RELEASE | I2C_ACK, NULL);
 		if((rc = BermudaEventWaitNext(event(adapter->slave_queue), I2C_SLAVE_TMO)) < 0) {
 			rc = -1;
+			i2c_adapter_stats_inc(adapter, slave_tmo);
+			BermudaEnterCritical();
 			if(slave_msg) {
 				last_slave_msg = slave_msg;
 			}
 			msg = (struct i2c_message*)last_slave_msg;
 			if(msg) {
-				msg->features |= I2C_MSG_DONE_FLAG;
+				i2c_queue_complete(&adapter->slave_msgs);
 				if((i2c_msg_features(msg) & I2C_MSG_CALL_BACK_MASK) != 0) {
 					adapter->busy = FALSE;
 					adapter->dev->ctrl(adapter->dev, I2C_RELEASE | I2C_ACK, NULL);
 				}
 			}
+			BermudaExitCritical();
 		}
 		if(!last_slave_msg) {
 			rc = -1;
+		} else if(rc == 0 && (last_slave_msg->features & I2C_MSG_CALL_BACK_MASK) == 0) {
+			rc = 1;
 		}
-		*index = i2c_vector_locate(adapter, (void*)last_slave_msg);
 	}
 	
 	return rc;
 }
 
 /**
- * \brief Update the bus message index.
- * \param diff The index diff.
+ * \brief Update the bus message pointers.
+ * \param adapter Bus adapter.
  * \see i2c_adapter::update i2c_update
  */
-static void atmega_i2c_update(struct i2c_adapter *adapter, long diff)
+static void atmega_i2c_update(struct i2c_adapter *adapter)
 {
-	size_t index = 0;
-	
 	if(adapter->busy) {
 		return;
 	}
 	
 	BermudaEnterCritical();
-	if(i2c_first_master_msg(adapter, &index)) {
-		master_msg = i2c_vector_get(adapter, index);
-	} else {
-		master_msg = NULL;
+	atmega_i2c_update_from_isr(adapter);
+	BermudaExitCritical();
+}
+
+/**
+ * \brief Attach a slave register file.
+ * \param adapter Bus adapter.
+ * \param rf Register file, <i>NULL</i> to detach.
+ * \see i2c_adapter::attach
+ * 
+ * An idle bus starts (or stops) listening for its slave address right away. Otherwise the ISR
+ * picks up the register file at the end of the current transfer.
+ */
+static int atmega_i2c_attach(struct i2c_adapter *adapter, struct i2c_regfile *rf)
+{
+	BermudaEnterCritical();
+	slave_regfile = rf;
+	if(!adapter->busy && (TWSR & I2C_NOINFO) == I2C_NOINFO) {
+		if(atmega_i2c_listening()) {
+			adapter->dev->ctrl(adapter->dev, I2C_LISTEN, NULL);
+		} else {
+			adapter->dev->ctrl(adapter->dev, I2C_NACK, NULL);
+		}
 	}
+	BermudaExitCritical();
+	return 0;
+}
+
+/**
+ * \brief End of a register file transaction.
+ * \param adapter The bus adapter.
+ * \note Called from the ISR.
+ * 
+ * Notifies the application of changed registers and continues with the queued master messages,
+ * or keeps listening for the next request.
+ */
+static void atmega_i2c_regfile_end(struct i2c_adapter *adapter)
+{
+	struct device *dev = adapter->dev;
 	
-	if(i2c_first_slave_msg(adapter, &index)) {
-		slave_msg = i2c_vector_get(adapter, index);
+	i2c_regfile_stop(slave_regfile);
+	adapter->busy = FALSE;
+	atmega_i2c_update_from_isr(adapter);
+	if(master_msg) {
+		dev->ctrl(dev, I2C_START | I2C_ACK, NULL);
 	} else {
-		slave_msg = NULL;
+		dev->ctrl(dev, I2C_LISTEN, NULL);
 	}
-	BermudaExitCritical();
 }
 
 /**
@@ -537,18 +730,60 @@ static void atmega_i2c_update(struct i2c_adapter *adapter, long diff)
  */
 static void atmega_i2c_update_from_isr(struct i2c_adapter *adapter)
 {
-	size_t index = 0;
+	master_msg = i2c_queue_pending(&adapter->master_msgs);
+	slave_msg = i2c_queue_pending(&adapter->slave_msgs);
+}
+
+/**
+ * \brief End of a master message.
+ * \param adapter The bus adapter doing the transmission.
+ * \param error Set to TRUE if the message was not acknowledged.
+ * \note Called from the ISR.
+ * 
+ * Completes the current master message and continues with the next queued master message using
+ * a repeated start, so queued transfers are sent back-to-back. When a message fails, the remaining
+ * messages of the same transfer are aborted. Threads doing a synchronous transfer are woken up
+ * after their last message.
+ */
+static void atmega_i2c_master_done(struct i2c_adapter *adapter, bool error)
+{
+	struct device *dev = adapter->dev;
+	struct i2c_message *msg;
+	struct i2c_xfer *xfer = NULL;
 	
-	if(i2c_first_master_msg(adapter, &index)) {
-		master_msg = i2c_vector_get(adapter, index);
-	} else {
-		master_msg = NULL;
+	ack_polling = FALSE;
+	if(master_msg) {
+		xfer = master_msg->xfer;
+		if(!xfer) {
+			last_master_msg = master_msg;
+		}
+		if(error) {
+			if(!xfer) {
+				master_failed = TRUE;
+			}
+			do {
+				i2c_queue_abort(&adapter->master_msgs);
+				msg = i2c_queue_pending(&adapter->master_msgs);
+			} while(msg && msg->xfer == xfer);
+		} else {
+			i2c_queue_complete(&adapter->master_msgs);
+		}
 	}
 	
-	if(i2c_first_slave_msg(adapter, &index)) {
-		slave_msg = i2c_vector_get(adapter, index);
+	atmega_i2c_update_from_isr(adapter);
+	if(master_msg) {
+		dev->ctrl(dev, I2C_START | I2C_ACK, NULL);
 	} else {
-		slave_msg = NULL;
+		adapter->busy = FALSE;
+		if(atmega_i2c_listening()) {
+			dev->ctrl(dev, I2C_STOP | I2C_LISTEN, NULL);
+		} else {
+			dev->ctrl(dev, I2C_STOP | I2C_NACK, NULL);
+		}
+	}
+	
+	if(!xfer && (!master_msg || master_msg->xfer)) {
+		event_signal_from_isr(event(adapter->master_queue));
 	}
 }
 
@@ -570,6 +805,8 @@ static void atmega_i2c_slave_buff_end(struct i2c_adapter *adapter)
 		atmega_i2c_update_from_isr(adapter);
 		if(master_msg) {
 			dev->ctrl(dev, I2C_START | I2C_NACK, NULL);
+		} else if(slave_regfile) {
+			dev->ctrl(dev, I2C_LISTEN, NULL);
 		} else {
 			dev->ctrl(dev, I2C_NACK, NULL);
 		}
@@ -586,8 +823,7 @@ static void atmega_i2c_slave_buff_end(struct i2c_adapter *adapter)
 		dev->ctrl(dev, I2C_BLOCK, NULL);
 		adapter->error = 0;
 	} else {
-		features |= I2C_MSG_DONE_FLAG;
-		i2c_msg_set_features((void*)slave_msg, features);
+		i2c_queue_complete(&adapter->slave_msgs);
 		atmega_i2c_update_from_isr(adapter);
 		if(slave_msg) {
 			dev->ctrl(dev, I2C_LISTEN, NULL);
@@ -597,25 +833,94 @@ static void atmega_i2c_slave_buff_end(struct i2c_adapter *adapter)
 			adapter->busy = FALSE;
 		} else {
 			event_signal_from_isr(event(adapter->slave_queue));
-			dev->ctrl(dev, I2C_NACK, NULL);
+			if(slave_regfile) {
+				dev->ctrl(dev, I2C_LISTEN, NULL);
+			} else {
+				dev->ctrl(dev, I2C_NACK, NULL);
+			}
 			adapter->busy = FALSE;
 		}
 	}
 }
 
-#ifdef I2C_DBG
-static void atmega_i2c_dbg(struct i2c_adapter *adapter)
+/**
+ * \brief Start walking the segments of the master message.
+ * \param msg Message which will be transfered.
+ */
+static inline void atmega_i2c_seg_init(volatile struct i2c_message *msg)
 {
-	struct i2c_message *msg;
-	i2c_features_t features;
+	buffer_index = 0;
+	master_seg_buff = msg->buff;
+	master_seg_length = msg->length;
+	master_seg_next = msg->iov;
+	master_seg_left = msg->iovcnt;
+}
+
+/**
+ * \brief Check if a byte of the master message is left.
+ * \return TRUE if <i>master_seg_buff[buffer_index]</i> is a valid byte of the message.
+ * 
+ * Moves on to the next segment when the current one is finished. Empty segments are skipped.
+ */
+static inline bool atmega_i2c_seg_avail(void)
+{
+	while(buffer_index >= master_seg_length) {
+		if(!master_seg_left) {
+			return FALSE;
+		}
+		
+		master_seg_buff = master_seg_next->buff;
+		master_seg_length = master_seg_next->length;
+		master_seg_next++;
+		master_seg_left--;
+		buffer_index = 0;
+	}
+	return TRUE;
+}
+
+/**
+ * \brief Check if more than one byte of the master message is left.
+ * 
+ * Used by the master receiver to decide whether the next byte has to be acknowledged.
+ */
+static inline bool atmega_i2c_seg_more(void)
+{
+	size_t left;
+	uint8_t i;
+	
+	if(!atmega_i2c_seg_avail()) {
+		return FALSE;
+	}
+	
+	left = master_seg_length - buffer_index;
+	for(i = 0; i < master_seg_left && left < 2; i++) {
+		left += master_seg_next[i].length;
+	}
+	return left > 1;
+}
+
+/**
+ * \brief Check if the address of the current master message may be polled again.
+ * \return TRUE if the first poll of the message has been done less than I2C_ACK_POLL_TMO milli
+ *         seconds ago.
+ * \note Called from the ISR.
+ */
+static inline bool atmega_i2c_ack_poll(void)
+{
+	uint16_t now = (uint16_t)BermudaTimerGetSysTick();
 	
-	i2c_vector_foreach(&adapter->msg_vector, i) {
-		msg = i2c_vector_get(adapter, i);
-		features = i2c_msg_features(msg);
-		features |= I2C_MSG_DONE_FLAG;
-		msg->features = features;
-		master_msg_index++;
+	if(!ack_polling) {
+		ack_polling = TRUE;
+		ack_poll_start = now;
 	}
+	return (uint16_t)(now - ack_poll_start) < I2C_ACK_POLL_TMO;
+}
+
+#ifdef I2C_DBG
+static void atmega_i2c_dbg(struct i2c_adapter *adapter)
+{
+	i2c_queue_abort_all(&adapter->master_msgs);
+	i2c_queue_abort_all(&adapter->slave_msgs);
 }
 #endif
 
@@ -632,7 +937,7 @@ SIGNAL(TWI_STC_vect)
 		 */
 		case I2C_MASTER_START:
 		case I2C_MASTER_REP_START:
-			buffer_index = 0;
+			atmega_i2c_seg_init(master_msg);
 			adapter->busy = TRUE;
 			adapter->error = FALSE;
 			TWDR = master_msg->addr;
@@ -642,62 +947,43 @@ SIGNAL(TWI_STC_vect)
 		case I2C_MT_SLA_ACK:
 		case I2C_MT_DATA_ACK:
 			if(master_msg) {
-				if(buffer_index < master_msg->length) {
-					TWDR = master_msg->buff[buffer_index];
+				if(atmega_i2c_seg_avail()) {
+					TWDR = master_seg_buff[buffer_index];
 					buffer_index++;
 					dev->ctrl(dev, I2C_ACK, NULL);
 					break;
 				}
 				
-				last_master_msg = master_msg;
 				if((master_msg->features & I2C_MSG_CALL_BACK_MASK) != 0) {
+					last_master_msg = master_msg;
 					event_signal_from_isr(event(adapter->master_queue));
 					dev->ctrl(dev, I2C_BLOCK, NULL);
 					break;
 				}
-				
-				master_msg->features |= I2C_MSG_DONE_FLAG;
 			}
 			
-			last_master_msg = master_msg;
-			atmega_i2c_update_from_isr(adapter);
-			
-			if(master_msg) {
-				dev->ctrl(dev, I2C_START | I2C_ACK, NULL);
-				break;
-			} else if(slave_msg) {
-				adapter->busy = FALSE;
-				dev->ctrl(dev, I2C_STOP | I2C_LISTEN, NULL);
-				event_signal_from_isr(event(adapter->master_queue));
-				break;
-			} else {
-				adapter->busy = FALSE;
-				dev->ctrl(dev, I2C_STOP | I2C_NACK, NULL);
-				event_signal_from_isr(event(adapter->master_queue));
-				break;
-			}
+			atmega_i2c_master_done(adapter, FALSE);
+			break;
 			
 		case I2C_MT_SLA_NACK:
-		case I2C_MT_DATA_NACK:
 		case I2C_MR_SLA_NACK:
-			if(master_msg) {
-				master_msg->features |= I2C_MSG_DONE_FLAG;
+			/*
+			 * Devices in a write cycle don't acknowledge their address, poll them using a
+			 * repeated start.
+			 */
+			if(master_msg && (master_msg->features & I2C_MSG_ACK_POLL_MASK) != 0 && 
+				atmega_i2c_ack_poll()) {
+				TWCR = BIT(TWINT) | BIT(TWEN) | BIT(TWIE) | (twcr & BIT(TWEA)) | BIT(TWSTA);
+				break;
 			}
 			
-			last_master_msg = master_msg;
-			adapter->busy = FALSE;
-			
-			atmega_i2c_update_from_isr(adapter);
-			event_signal_from_isr(event(adapter->master_queue));
-			
-			if(slave_msg) {
-				dev->ctrl(dev, I2C_STOP | I2C_LISTEN, NULL);
-			} else {
-				dev->ctrl(dev, I2C_STOP | I2C_NACK, NULL);
-			}
+		case I2C_MT_DATA_NACK:
+			i2c_adapter_stats_inc(adapter, nacks);
+			atmega_i2c_master_done(adapter, TRUE);
 			break;
 
 		case I2C_MASTER_ARB_LOST:
+			i2c_adapter_stats_inc(adapter, arb_lost);
 			adapter->busy = FALSE;
 			TWCR = BIT(TWINT) | BIT(TWEN) | BIT(TWIE) | (twcr & BIT(TWEA)) | BIT(TWSTA);
 			break;
@@ -707,8 +993,8 @@ SIGNAL(TWI_STC_vect)
 		 */
 		case I2C_MR_DATA_ACK:
 			if(master_msg) {
-				if(buffer_index < master_msg->length) {
-					master_msg->buff[buffer_index] = TWDR;
+				if(atmega_i2c_seg_avail()) {
+					master_seg_buff[buffer_index] = TWDR;
 					buffer_index++;
 				} else {
 					dev->ctrl(dev, I2C_NACK, NULL);
@@ -718,7 +1004,7 @@ SIGNAL(TWI_STC_vect)
 			
 		case I2C_MR_SLA_ACK:
 			if(master_msg) {
-				if((buffer_index+1) < master_msg->length) {
+				if(atmega_i2c_seg_more()) {
 					dev->ctrl(dev, I2C_ACK, NULL);
 				} else {
 					dev->ctrl(dev, I2C_NACK, NULL);
@@ -730,35 +1016,25 @@ SIGNAL(TWI_STC_vect)
 			
 		case I2C_MR_DATA_NACK:
 			if(master_msg) {
-				if(buffer_index < master_msg->length) {
-					master_msg->buff[buffer_index] = TWDR;
+				if(atmega_i2c_seg_avail()) {
+					master_seg_buff[buffer_index] = TWDR;
 				}
 				
-				last_master_msg = master_msg;
 				if((master_msg->features & I2C_MSG_CALL_BACK_MASK) != 0) {
+					last_master_msg = master_msg;
 					event_signal_from_isr(event(adapter->master_queue));
 					dev->ctrl(dev, I2C_BLOCK, NULL);
 					break;
 				}
-				master_msg->features |= I2C_MSG_DONE_FLAG;
 			}
 			
-			last_master_msg = master_msg;
-			atmega_i2c_update_from_isr(adapter);
-			if(master_msg) {
-				dev->ctrl(dev, I2C_START | I2C_ACK, NULL);
-				break;
-			} else if(slave_msg) {
-				dev->ctrl(dev, I2C_STOP | I2C_LISTEN, NULL);
-			} else {
-				dev->ctrl(dev, I2C_STOP | I2C_NACK, NULL);
-			}
-			adapter->busy = FALSE;
-			event_signal_from_isr(event(adapter->master_queue));
+			atmega_i2c_master_done(adapter, FALSE);
 			break;
 		
 		case I2C_SR_GC_ARB_LOST:
 		case I2C_SR_SLAW_ARB_LOST:
+			i2c_adapter_stats_inc(adapter, arb_lost);
+			
 		case I2C_SR_SLAW_ACK:
 		case I2C_SR_GC_ACK:
 			buffer_index = 0;
@@ -772,6 +1048,10 @@ SIGNAL(TWI_STC_vect)
 				} else {
 					dev->ctrl(dev, I2C_NACK, NULL);
 				}
+			} else if(slave_regfile) {
+				i2c_regfile_start(slave_regfile, TRUE);
+				adapter->busy = TRUE;
+				dev->ctrl(dev, I2C_ACK, NULL);
 			} else {
 				dev->ctrl(dev, I2C_NACK, NULL);
 			}
@@ -780,7 +1060,12 @@ SIGNAL(TWI_STC_vect)
 		case I2C_SR_SLAW_DATA_ACK:
 		case I2C_SR_GC_DATA_ACK:
 			if(!slave_msg) {
-				dev->ctrl(dev, I2C_NACK, NULL);
+				if(slave_regfile) {
+					i2c_regfile_write(slave_regfile, TWDR);
+					dev->ctrl(dev, I2C_ACK, NULL);
+				} else {
+					dev->ctrl(dev, I2C_NACK, NULL);
+				}
 				break;
 			}
 			
@@ -802,19 +1087,24 @@ SIGNAL(TWI_STC_vect)
 			break;
 			
 		case I2C_SR_STOP:
+			if(!slave_msg && slave_regfile) {
+				atmega_i2c_regfile_end(adapter);
+				break;
+			}
+			
 			if(*(adapter->slave_queue) == NULL || *(adapter->slave_queue) == SIGNALED) {
 				if(slave_msg) {
 					slave_msg->features &= ~I2C_MSG_CALL_BACK_MASK;
+					i2c_queue_complete(&adapter->slave_msgs);
 				}
 				atmega_i2c_update_from_isr(adapter);
 				if(master_msg) {
 					dev->ctrl(dev, I2C_START | I2C_NACK, NULL);
+				} else if(slave_regfile) {
+					dev->ctrl(dev, I2C_LISTEN, NULL);
 				} else {
 					dev->ctrl(dev, I2C_NACK, NULL);
 				}
-				if(slave_msg) {
-					slave_msg->features |= I2C_MSG_DONE_FLAG;
-				}
 				last_slave_msg = NULL;
 				adapter->busy = FALSE;
 				adapter->error = FALSE;
@@ -824,11 +1114,22 @@ SIGNAL(TWI_STC_vect)
 			break;
 		
 		case I2C_ST_ARB_LOST:
+			i2c_adapter_stats_inc(adapter, arb_lost);
+			
 		case I2C_ST_SLAR_ACK:
 			adapter->busy = TRUE;
 			buffer_index = 0;
+			if(!slave_msg && slave_regfile) {
+				i2c_regfile_start(slave_regfile, FALSE);
+			}
 			
 		case I2C_ST_DATA_ACK:
+			if(!slave_msg && slave_regfile) {
+				TWDR = i2c_regfile_read(slave_regfile);
+				dev->ctrl(dev, I2C_ACK, NULL);
+				break;
+			}
+			
 			if(slave_msg) {
 				if(slave_msg->length && buffer_index < slave_msg->length) {
 					TWDR = slave_msg->buff[buffer_index];
@@ -848,11 +1149,16 @@ SIGNAL(TWI_STC_vect)
 			
 		case I2C_ST_DATA_NACK:
 		case I2C_ST_LAST_DATA_ACK:
+			if(!slave_msg && slave_regfile) {
+				atmega_i2c_regfile_end(adapter);
+				break;
+			}
 			atmega_i2c_slave_buff_end(adapter);
 			break;
 			
 		default:
 			dev->ctrl(dev, I2C_STOP | I2C_NACK, NULL);
+			i2c_queue_abort_all(&adapter->master_msgs);
 			last_master_msg = NULL;
 			last_slave_msg = NULL;
 			event_signal_from_isr(event(adapter->slave_queue));
@@ -35,6 +35,10 @@
 #define SCL 5
 #define SDA 4
 
+#define I2C_PORT BermudaGetPORTC() //!< Port register of the I2C pins.
+#define I2C_DDR  BermudaGetDDRC()  //!< Data direction register of the I2C pins.
+#define I2C_PIN  BermudaGetPINC()  //!< Input register of the I2C pins.
+
 /* I2C device I/O control features */
 /**
  * \brief Sent the start condition.
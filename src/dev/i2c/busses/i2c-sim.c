@@ -0,0 +1,518 @@
+/*
+ *  BermudaOS - I2C bus simulator
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file src/dev/i2c/busses/i2c-sim.c I2C bus simulator.
+ *
+ * \addtogroup i2c-sim I2C bus simulator
+ * \brief Software I2C adapter.
+ *
+ * The simulator implements the i2c_adapter hooks without any hardware. Master messages are
+ * transfered synchronously to slave models attached to the bus, so the core layer, the I2C device
+ * layer and drivers like the 24C02 library can be run without a physical bus. The bus keeps
+ * statistics of the generated bus conditions.
+ *
+ * \code{.c}
+static struct i2c_adapter sim_adapter;
+static struct i2c_sim_bus sim_bus;
+static struct i2c_sim_24c02 sim_eeprom;
+
+i2c_sim_init(&sim_bus, &sim_adapter, "I2C_SIM");
+i2c_sim_24c02_init(&sim_eeprom, BASE_SLA_24C02, 0);
+i2c_sim_add_slave(&sim_bus, &sim_eeprom.slave);
+\endcode
+ *
+ * Only master transfers are supported. A register file (see i2c_attach_regfile) is served by the
+ * slave interface of the bus at i2c_sim_bus::sla, which is addressed like any other slave model.
+ * A client of the same adapter then takes the role of the remote master.
+ * @{
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <dev/dev.h>
+#include <dev/error.h>
+#include <dev/i2c/i2c.h>
+#include <dev/i2c/reg.h>
+#include <dev/i2c/i2c-core.h>
+#include <dev/i2c/i2c-msg.h>
+#include <dev/i2c/busses/sim.h>
+
+#include <sys/thread.h>
+#include <sys/events/event.h>
+#include <sys/events/mutex.h>
+
+static void i2c_sim_ioctl(struct device *dev, int cfg, void *data);
+static int i2c_sim_xfer(struct i2c_adapter *adapter, i2c_clock_t clock, bool master);
+static int i2c_sim_start(struct i2c_adapter *adapter, i2c_clock_t clock);
+static i2c_clock_t i2c_sim_clock(struct i2c_adapter *adapter, uint32_t freq);
+static int i2c_sim_resume(struct i2c_adapter *adapter, bool master);
+static void i2c_sim_update(struct i2c_adapter *adapter);
+static int i2c_sim_run(struct i2c_sim_bus *bus);
+static int i2c_sim_run_sync(struct i2c_sim_bus *bus);
+static int i2c_sim_transfer_msg(struct i2c_sim_bus *bus, struct i2c_message *msg);
+static void i2c_sim_stop(struct i2c_sim_bus *bus);
+static int i2c_sim_attach(struct i2c_adapter *adapter, struct i2c_regfile *rf);
+static int i2c_sim_regfile_start(struct i2c_sim_slave *slave, bool read);
+static int i2c_sim_regfile_write(struct i2c_sim_slave *slave, uint8_t data);
+static uint8_t i2c_sim_regfile_read(struct i2c_sim_slave *slave, bool ack);
+static void i2c_sim_regfile_stop(struct i2c_sim_slave *slave);
+
+/**
+ * \brief Initialize a simulated bus.
+ * \param bus Bus to initialize.
+ * \param adapter Adapter which will be backed by \p bus.
+ * \param fname Device name of the adapter.
+ * \return Error code.
+ * \retval 0 on success.
+ * \retval -1 if the adapter could not be initialized.
+ */
+PUBLIC int i2c_sim_init(struct i2c_sim_bus *bus, struct i2c_adapter *adapter, char *fname)
+{
+	int rc = i2c_init_adapter(adapter, fname);
+
+	if(rc < 0) {
+		return rc;
+	}
+
+	bus->adapter = adapter;
+	bus->slaves = NULL;
+	bus->active = NULL;
+	bus->freq = 0;
+	bus->held = FALSE;
+	bus->sla = 0;
+	bus->regfile = NULL;
+	bus->regfile_slave.data = bus;
+	bus->regfile_slave.start = &i2c_sim_regfile_start;
+	bus->regfile_slave.write = &i2c_sim_regfile_write;
+	bus->regfile_slave.read = &i2c_sim_regfile_read;
+	bus->regfile_slave.stop = &i2c_sim_regfile_stop;
+	bus->master_queue = SIGNALED;
+	bus->slave_queue = SIGNALED;
+	i2c_sim_reset_stats(bus);
+
+#ifdef __EVENTS__
+	BermudaMutexInit(&bus->mutex);
+	adapter->dev->mutex = &bus->mutex;
+#endif
+	adapter->dev->ctrl = &i2c_sim_ioctl;
+	adapter->master_queue = &bus->master_queue;
+	adapter->slave_queue = &bus->slave_queue;
+
+	adapter->data = bus;
+	adapter->features = I2C_MASTER_SUPPORT | I2C_SLAVE_SUPPORT;
+	adapter->xfer = &i2c_sim_xfer;
+	adapter->start = &i2c_sim_start;
+	adapter->clock = &i2c_sim_clock;
+	adapter->resume = &i2c_sim_resume;
+	adapter->update = &i2c_sim_update;
+	adapter->attach = &i2c_sim_attach;
+	adapter->busy = FALSE;
+	adapter->error = FALSE;
+	return 0;
+}
+
+/**
+ * \brief Attach a slave model to a simulated bus.
+ * \param bus Simulated bus.
+ * \param slave Slave to attach.
+ */
+PUBLIC void i2c_sim_add_slave(struct i2c_sim_bus *bus, struct i2c_sim_slave *slave)
+{
+	slave->next = bus->slaves;
+	bus->slaves = slave;
+}
+
+/**
+ * \brief Detach a slave model from a simulated bus.
+ * \param bus Simulated bus.
+ * \param slave Slave to detach.
+ */
+PUBLIC void i2c_sim_remove_slave(struct i2c_sim_bus *bus, struct i2c_sim_slave *slave)
+{
+	struct i2c_sim_slave **spp;
+
+	for(spp = &bus->slaves; *spp; spp = &(*spp)->next) {
+		if(*spp == slave) {
+			*spp = slave->next;
+			break;
+		}
+	}
+
+	if(bus->active == slave) {
+		bus->active = NULL;
+	}
+}
+
+/**
+ * \brief Simulated bus controller.
+ * \param dev Bus device.
+ * \param cfg Config options.
+ * \param data Configuration data.
+ * \note The simulated bus has no registers, only I2C_RECOVER is supported. It releases SCL and
+ *       generates a stop condition.
+ */
+static void i2c_sim_ioctl(struct device *dev, int cfg, void *data)
+{
+	struct i2c_adapter *adapter = dev->ioctl;
+	struct i2c_sim_bus *bus = adapter->data;
+	
+	if(cfg == I2C_RECOVER) {
+		bus->held = FALSE;
+		i2c_sim_stop(bus);
+		adapter->busy = FALSE;
+	}
+}
+
+/**
+ * \brief Translate a frequency into a clock setting.
+ * \param adapter Bus adapter.
+ * \param freq Frequency in hertz.
+ * \return The frequency in kilohertz.
+ * \see i2c_adapter::clock
+ */
+static i2c_clock_t i2c_sim_clock(struct i2c_adapter *adapter, uint32_t freq)
+{
+	return freq / 1000UL;
+}
+
+/**
+ * \brief Initiate a simulated transfer.
+ * \param adapter Bus adapter.
+ * \param clock Clock setting, see i2c_sim_clock.
+ * \param master Must be TRUE, slave transfers are not supported.
+ * \see i2c_adapter::xfer
+ */
+static int i2c_sim_xfer(struct i2c_adapter *adapter, i2c_clock_t clock, bool master)
+{
+	struct i2c_sim_bus *bus = adapter->data;
+
+	if(!master) {
+		return -DEV_ERROR;
+	}
+
+	/*
+	 * A bus which is still held after a call back has been abandoned by the core layer.
+	 */
+	if(adapter->busy) {
+		bus->held = FALSE;
+		i2c_sim_stop(bus);
+		adapter->busy = FALSE;
+	}
+
+	bus->freq = clock * 1000UL;
+	adapter->error = FALSE;
+	return i2c_sim_run_sync(bus);
+}
+
+/**
+ * \brief Start an asynchronous transfer.
+ * \param adapter Bus adapter.
+ * \param clock Clock setting, see i2c_sim_clock.
+ * \see i2c_adapter::start
+ * 
+ * The simulated bus is synchronous, so the transfer has completed when this function returns,
+ * unless a slave holds SCL low.
+ */
+static int i2c_sim_start(struct i2c_adapter *adapter, i2c_clock_t clock)
+{
+	struct i2c_sim_bus *bus = adapter->data;
+
+	if(!adapter->busy) {
+		bus->freq = clock * 1000UL;
+		i2c_sim_run(bus);
+	}
+	return 0;
+}
+
+/**
+ * \brief Resume a simulated transfer after a call back.
+ * \param adapter Bus adapter.
+ * \param master Queue holding the message set by the call back.
+ * \see i2c_adapter::resume
+ */
+static int i2c_sim_resume(struct i2c_adapter *adapter, bool master)
+{
+	if(!master) {
+		return -DEV_ERROR;
+	}
+
+	adapter->error = FALSE;
+	return i2c_sim_run_sync(adapter->data);
+}
+
+/**
+ * \brief Update the driver message pointers.
+ * \param adapter Bus adapter.
+ * \note The simulator doesn't cache any messages, so there is nothing to update.
+ * \see i2c_adapter::update
+ */
+static void i2c_sim_update(struct i2c_adapter *adapter)
+{
+	return;
+}
+
+/**
+ * \brief Attach a slave register file.
+ * \param adapter Bus adapter.
+ * \param rf Register file, <i>NULL</i> to detach.
+ * \see i2c_adapter::attach
+ *
+ * The slave interface of the bus is added to the bus at i2c_sim_bus::sla while a register file is
+ * attached.
+ */
+static int i2c_sim_attach(struct i2c_adapter *adapter, struct i2c_regfile *rf)
+{
+	struct i2c_sim_bus *bus = adapter->data;
+
+	if(bus->regfile) {
+		i2c_sim_remove_slave(bus, &bus->regfile_slave);
+	}
+
+	bus->regfile = rf;
+	if(rf) {
+		bus->regfile_slave.sla = bus->sla;
+		i2c_sim_add_slave(bus, &bus->regfile_slave);
+	}
+	return 0;
+}
+
+/**
+ * \brief Address phase of the slave interface.
+ * \param slave Slave interface of the bus.
+ * \param read TRUE if the master requested a read.
+ * \return 0, the address is always acknowledged.
+ *
+ * Like a stop condition, a repeated start ends the previous transaction on the register file.
+ */
+static int i2c_sim_regfile_start(struct i2c_sim_slave *slave, bool read)
+{
+	struct i2c_sim_bus *bus = slave->data;
+
+	i2c_regfile_stop(bus->regfile);
+	i2c_regfile_start(bus->regfile, !read);
+	return 0;
+}
+
+/**
+ * \brief Byte written to the register file.
+ * \param slave Slave interface of the bus.
+ * \param data Written byte.
+ * \return 0, every byte is acknowledged.
+ */
+static int i2c_sim_regfile_write(struct i2c_sim_slave *slave, uint8_t data)
+{
+	struct i2c_sim_bus *bus = slave->data;
+
+	i2c_regfile_write(bus->regfile, data);
+	return 0;
+}
+
+/**
+ * \brief Byte read from the register file.
+ * \param slave Slave interface of the bus.
+ * \param ack TRUE if the master will acknowledge the byte.
+ * \return The register at the register pointer.
+ */
+static uint8_t i2c_sim_regfile_read(struct i2c_sim_slave *slave, bool ack)
+{
+	struct i2c_sim_bus *bus = slave->data;
+
+	return i2c_regfile_read(bus->regfile);
+}
+
+/**
+ * \brief Stop condition on the slave interface.
+ * \param slave Slave interface of the bus.
+ */
+static void i2c_sim_regfile_stop(struct i2c_sim_slave *slave)
+{
+	struct i2c_sim_bus *bus = slave->data;
+
+	i2c_regfile_stop(bus->regfile);
+}
+
+/**
+ * \brief Transfer all pending master messages.
+ * \param bus Simulated bus.
+ * \return Transfer status, see i2c_adapter::xfer.
+ *
+ * The transfer stops at the first call back message. The bus is held until the transfer is
+ * resumed, so the message set by the call back is sent after a repeated start. When a message
+ * fails, the remaining messages of the same transfer are aborted and the bus continues with the
+ * next transfer. When a slave holds SCL low, the bus stays busy and the message stays pending.
+ */
+static int i2c_sim_run(struct i2c_sim_bus *bus)
+{
+	struct i2c_adapter *adapter = bus->adapter;
+	struct i2c_message *msg;
+	struct i2c_xfer *xfer;
+	int rc = 1;
+
+	adapter->busy = TRUE;
+	while((msg = i2c_queue_pending(&adapter->master_msgs)) != NULL) {
+		if(i2c_sim_transfer_msg(bus, msg)) {
+			if(bus->held) {
+				return -1;
+			}
+
+			xfer = msg->xfer;
+			do {
+				i2c_queue_abort(&adapter->master_msgs);
+				msg = i2c_queue_pending(&adapter->master_msgs);
+			} while(msg && msg->xfer == xfer);
+			i2c_sim_stop(bus);
+			adapter->error = TRUE;
+			if(!xfer) {
+				rc = -1;
+			}
+			continue;
+		}
+		bus->stats.msgs++;
+
+		if((i2c_msg_features(msg) & I2C_MSG_CALL_BACK_MASK) != 0) {
+			bus->stats.callbacks++;
+			return 0;
+		}
+
+		i2c_queue_complete(&adapter->master_msgs);
+		if((i2c_msg_features(msg) & I2C_MSG_SENT_STOP_MASK) != 0) {
+			i2c_sim_stop(bus);
+		}
+	}
+
+	if(bus->active) {
+		i2c_sim_stop(bus);
+	}
+	adapter->busy = FALSE;
+	return rc;
+}
+
+/**
+ * \brief Transfer the pending master messages for a synchronous transfer.
+ * \param bus Simulated bus.
+ * \return Transfer status, see i2c_adapter::xfer.
+ *
+ * When a slave holds SCL low, the transfer does not complete. Like a bus driver, the caller
+ * waits for I2C_MASTER_TMO milli seconds and recovers the bus.
+ */
+static int i2c_sim_run_sync(struct i2c_sim_bus *bus)
+{
+	struct i2c_adapter *adapter = bus->adapter;
+	int rc = i2c_sim_run(bus);
+
+	if(bus->held) {
+		if(BermudaEventWaitNext(event(adapter->master_queue), I2C_MASTER_TMO) == -1) {
+			i2c_adapter_stats_inc(adapter, master_tmo);
+		}
+		adapter->dev->ctrl(adapter->dev, I2C_RECOVER, NULL);
+		rc = -1;
+	}
+	return rc;
+}
+
+/**
+ * \brief Transfer one message.
+ * \param bus Simulated bus.
+ * \param msg Message to transfer.
+ * \return 0 on success, -1 if the address or a data byte is not acknowledged or if SCL is held.
+ * 
+ * The segments of \p msg are transfered back to back, like a single buffer. The address is
+ * repeated when it is not acknowledged and \p msg has I2C_MSG_ACK_POLL_FLAG set, until the polls
+ * have taken I2C_ACK_POLL_TMO milli seconds of bus time.
+ */
+static int i2c_sim_transfer_msg(struct i2c_sim_bus *bus, struct i2c_message *msg)
+{
+	struct i2c_sim_slave *slave;
+	bool read = (msg->addr & I2C_READ_BIT) != 0;
+	const struct i2c_iovec *iov = msg->iov;
+	uint8_t *buff = msg->buff, segs = msg->iovcnt;
+	size_t i, length = msg->length, left = i2c_msg_length(msg);
+	unsigned long poll_clocks = 0;
+	int rc;
+
+	for(slave = bus->slaves; slave; slave = slave->next) {
+		if(slave->sla == (msg->addr & ~I2C_READ_BIT)) {
+			break;
+		}
+	}
+
+	bus->active = slave;
+	while(1) {
+		bus->stats.starts++;
+		bus->stats.clocks += 9;
+		if(slave) {
+			rc = (slave->start) ? slave->start(slave, read) : 0;
+			if(rc == I2C_SIM_HOLD) {
+				bus->held = TRUE;
+				return -1;
+			} else if(rc == 0) {
+				break;
+			}
+		}
+		
+		if((i2c_msg_features(msg) & I2C_MSG_ACK_POLL_MASK) == 0 ||
+			poll_clocks >= I2C_ACK_POLL_TMO * (bus->freq / 1000UL)) {
+			bus->stats.nacks++;
+			i2c_adapter_stats_inc(bus->adapter, nacks);
+			return -1;
+		}
+		poll_clocks += 9;
+	}
+
+	while(1) {
+		for(i = 0; i < length; i++) {
+			left--;
+			bus->stats.clocks += 9;
+			bus->stats.bytes++;
+			if(read) {
+				buff[i] = (slave->read) ? slave->read(slave, left != 0) : 0xFF;
+			} else if(slave->write && slave->write(slave, buff[i])) {
+				bus->stats.nacks++;
+				i2c_adapter_stats_inc(bus->adapter, nacks);
+				return -1;
+			}
+		}
+		
+		if(!segs) {
+			return 0;
+		}
+		buff = iov->buff;
+		length = iov->length;
+		iov++;
+		segs--;
+	}
+}
+
+/**
+ * \brief Generate a stop condition.
+ * \param bus Simulated bus.
+ */
+static void i2c_sim_stop(struct i2c_sim_bus *bus)
+{
+	struct i2c_sim_slave *slave = bus->active;
+
+	if(slave && slave->stop) {
+		slave->stop(slave);
+	}
+	bus->active = NULL;
+	bus->stats.stops++;
+}
+
+// @}
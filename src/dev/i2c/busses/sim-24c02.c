@@ -0,0 +1,155 @@
+/*
+ *  BermudaOS - Simulated 24C02 EEPROM
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file src/dev/i2c/busses/sim-24c02.c Simulated 24C02 EEPROM.
+ *
+ * \addtogroup i2c-sim
+ * @{
+ *
+ * The 24C02 model behaves like the real chip:
+ * - the first byte of a write sets the word address;
+ * - written bytes are latched in an 8 byte page buffer, the address wraps within the page;
+ * - the page is programmed on the stop condition, after which the address is not acknowledged
+ *   for i2c_sim_24c02::twr_polls attempts (acknowledge polling);
+ * - reads are sequential and wrap at the end of the array.
+ */
+
+#include <stdlib.h>
+
+#include <lib/binary.h>
+
+#include <dev/i2c/i2c.h>
+#include <dev/i2c/busses/sim.h>
+
+static int sim_24c02_start(struct i2c_sim_slave *slave, bool read);
+static int sim_24c02_write(struct i2c_sim_slave *slave, uint8_t data);
+static uint8_t sim_24c02_read(struct i2c_sim_slave *slave, bool ack);
+static void sim_24c02_stop(struct i2c_sim_slave *slave);
+
+/**
+ * \brief Initialize a simulated 24C02.
+ * \param eeprom EEPROM model to initialize.
+ * \param sla Slave address (e.g. BASE_SLA_24C02).
+ * \param twr_polls Amount of address polls which are not acknowledged after a page write.
+ * \note The array is erased to 0xFF.
+ */
+PUBLIC void i2c_sim_24c02_init(struct i2c_sim_24c02 *eeprom, uint8_t sla, uint8_t twr_polls)
+{
+	size_t i;
+
+	for(i = 0; i < sizeof(eeprom->mem); i++) {
+		eeprom->mem[i] = 0xFF;
+	}
+
+	eeprom->ptr = 0;
+	eeprom->page_base = 0;
+	eeprom->page_mask = 0;
+	eeprom->addr_phase = FALSE;
+	eeprom->twr_polls = twr_polls;
+	eeprom->busy = 0;
+
+	eeprom->slave.next = NULL;
+	eeprom->slave.sla = sla;
+	eeprom->slave.data = eeprom;
+	eeprom->slave.start = &sim_24c02_start;
+	eeprom->slave.write = &sim_24c02_write;
+	eeprom->slave.read = &sim_24c02_read;
+	eeprom->slave.stop = &sim_24c02_stop;
+}
+
+/**
+ * \brief Address phase of the 24C02.
+ * \param slave 24C02 bus interface.
+ * \param read TRUE for a read request.
+ *
+ * A (repeated) start aborts a page write which has not been finished by a stop condition.
+ */
+static int sim_24c02_start(struct i2c_sim_slave *slave, bool read)
+{
+	struct i2c_sim_24c02 *eeprom = slave->data;
+
+	if(eeprom->busy) {
+		eeprom->busy--;
+		return -1;
+	}
+
+	eeprom->page_mask = 0;
+	eeprom->addr_phase = !read;
+	return 0;
+}
+
+/**
+ * \brief Write a byte to the 24C02.
+ * \param slave 24C02 bus interface.
+ * \param data Written byte.
+ */
+static int sim_24c02_write(struct i2c_sim_slave *slave, uint8_t data)
+{
+	struct i2c_sim_24c02 *eeprom = slave->data;
+	uint8_t offset;
+
+	if(eeprom->addr_phase) {
+		eeprom->ptr = data;
+		eeprom->addr_phase = FALSE;
+		return 0;
+	}
+
+	offset = eeprom->ptr & (I2C_SIM_24C02_PAGE - 1);
+	eeprom->page_base = eeprom->ptr & ~(I2C_SIM_24C02_PAGE - 1);
+	eeprom->page[offset] = data;
+	eeprom->page_mask |= BIT(offset);
+	eeprom->ptr = eeprom->page_base | ((offset + 1) & (I2C_SIM_24C02_PAGE - 1));
+	return 0;
+}
+
+/**
+ * \brief Read a byte from the 24C02.
+ * \param slave 24C02 bus interface.
+ * \param ack Not used, the address pointer is increased after every byte.
+ */
+static uint8_t sim_24c02_read(struct i2c_sim_slave *slave, bool ack)
+{
+	struct i2c_sim_24c02 *eeprom = slave->data;
+
+	return eeprom->mem[eeprom->ptr++];
+}
+
+/**
+ * \brief Stop condition, program the page buffer.
+ * \param slave 24C02 bus interface.
+ */
+static void sim_24c02_stop(struct i2c_sim_slave *slave)
+{
+	struct i2c_sim_24c02 *eeprom = slave->data;
+	uint8_t i;
+
+	if(!eeprom->page_mask) {
+		return;
+	}
+
+	for(i = 0; i < I2C_SIM_24C02_PAGE; i++) {
+		if(eeprom->page_mask & BIT(i)) {
+			eeprom->mem[eeprom->page_base + i] = eeprom->page[i];
+		}
+	}
+	eeprom->page_mask = 0;
+	eeprom->busy = eeprom->twr_polls;
+}
+
+// @}
@@ -30,9 +30,10 @@
  * \section busf Bus interface
  * The core module provides an interface for device drivers through some function calls in the
  * i2c_adapter structure (i2c_adapter::xfer i2c_adapter::resume and i2c_adapter::update). These
- * functions control the core layer using their return values and the index set. The core layer
- * will stop processing when either the return value is non zero or when the index has reached its
- * maximum length. As long as both conditions are met, i2c_adapter::resume will be called.
+ * functions control the core layer using their return values. When zero is returned the transfer
+ * stopped at a call back message, which is the pending message of the master or slave queue. The
+ * core layer handles the call back, pushes the new message in front of its queue and calls
+ * i2c_adapter::resume. Processing stops as soon as a non zero value is returned.
  * 
  * Call-back messages should NEVER be masked with I2C_MSG_DONE_FLAG too soon, since they may be
  * deleted by some other thread. The core layer will mask these messages.
@@ -41,6 +42,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <dev/dev.h>
 #include <dev/error.h>
@@ -55,6 +57,7 @@
 
 #include <sys/thread.h>
 #include <sys/epl.h>
+#include <sys/events/event.h>
 
 #include <arch/twi.h>
 #include <arch/io.h>
@@ -69,14 +72,23 @@
  * Static functions.
  */
 static void __i2c_init_client(struct i2c_client *client, uint16_t sla, uint32_t hz);
-static inline int i2c_cleanup_adapter_msgs(struct i2c_adapter *adapter, bool master);
+static inline size_t i2c_cleanup_adapter_msgs(struct i2c_adapter *adapter, bool master);
 static int i2c_add_entry(struct i2c_client *client, struct i2c_message *msg);
-static size_t i2c_cleanup_adapter(struct i2c_adapter *adapter, bool master);
+static int __i2c_write_client(struct i2c_client *client, const void *data, size_t size,
+							  const struct i2c_iovec *iov, uint8_t iovcnt, i2c_features_t flags);
+
+/* message pool */
+static void i2c_init_pool(struct i2c_adapter *adapter);
+static struct i2c_message *i2c_msg_alloc(struct i2c_adapter *adapter);
+static void i2c_msg_free(struct i2c_adapter *adapter, struct i2c_message *msg);
+static struct linkedlist *i2c_node_alloc(struct i2c_adapter *adapter);
+static void i2c_node_free(struct i2c_adapter *adapter, struct linkedlist *node);
 
 /* transmission funcs */
 static int i2c_start_xfer(struct i2c_client *client);
+static int i2c_retry_xfer(struct i2c_client *client);
 static inline int __i2c_start_xfer(struct i2c_adapter *adapter, struct i2c_shared_info *info);
-static size_t i2c_update(struct i2c_adapter *client, bool master);
+static void i2c_update(struct i2c_adapter *adapter, bool master);
 static inline void i2c_master_tmo(struct i2c_adapter *adapter);
 static inline void i2c_slave_tmo(struct i2c_adapter *adapter);
 
@@ -85,6 +97,10 @@ static inline void i2c_slave_tmo(struct i2c_adapter *adapter);
 static int i2c_lock_adapter(struct i2c_adapter *adapter, struct i2c_shared_info *info);
 static int i2c_release_adapter(struct i2c_adapter *adapter, struct i2c_shared_info *info);
 
+#ifdef I2C_STATS
+static void i2c_stats_clear(struct i2c_stats *stats);
+#endif
+
 /**
  * \brief Initializes the given adapter.
  * \param adapter Adapter to initialize.
@@ -108,9 +124,112 @@ PUBLIC int i2c_init_adapter(struct i2c_adapter *adapter, char *fname)
 	adapter->error = 0;
 	adapter->features = 0;
 	adapter->busy = false;
+	adapter->start = NULL;
+	adapter->clock = NULL;
+	adapter->attach = NULL;
+	i2c_queue_init(&adapter->master_msgs);
+	i2c_queue_init(&adapter->slave_msgs);
+	i2c_init_pool(adapter);
+#ifdef I2C_STATS
+	i2c_stats_clear(&adapter->stats);
+	adapter->master_msgs.stats = &adapter->stats;
+	adapter->slave_msgs.stats = &adapter->stats;
+#endif
 	return rc;
 }
 
+/**
+ * \brief Initialize the message pool of an adapter.
+ * \param adapter Adapter to initialize the pool for.
+ * \see i2c_adapter::pool
+ */
+static void i2c_init_pool(struct i2c_adapter *adapter)
+{
+	struct i2c_msg_pool *pool = &adapter->pool;
+	size_t i;
+	
+	pool->free_nodes = NULL;
+	for(i = 0; i < I2C_MSG_POOL_SIZE; i++) {
+		pool->nodes[i].next = pool->free_nodes;
+		pool->free_nodes = &pool->nodes[i];
+	}
+	for(i = 0; i < sizeof(pool->map); i++) {
+		pool->map[i] = 0;
+	}
+}
+
+/**
+ * \brief Allocate a message from the adapter pool.
+ * \param adapter Adapter owning the pool.
+ * \return The allocated message.
+ * \retval NULL if the pool is exhausted.
+ */
+static struct i2c_message *i2c_msg_alloc(struct i2c_adapter *adapter)
+{
+	struct i2c_msg_pool *pool = &adapter->pool;
+	size_t i;
+	
+	for(i = 0; i < I2C_MSG_POOL_SIZE; i++) {
+		if((pool->map[i >> 3] & BIT(i & 7)) == 0) {
+			pool->map[i >> 3] |= BIT(i & 7);
+			pool->msgs[i].xfer = NULL;
+			pool->msgs[i].iov = NULL;
+			pool->msgs[i].iovcnt = 0;
+#ifdef I2C_STATS
+			pool->msgs[i].stats = NULL;
+#endif
+			return &pool->msgs[i];
+		}
+	}
+	
+	logmsg_P(I2C_CORE_LOG, PSTR("Message pool of adapter (0x%p) exhausted.\n"), adapter);
+	return NULL;
+}
+
+/**
+ * \brief Return a message to the adapter pool.
+ * \param adapter Adapter owning the pool.
+ * \param msg Message to free.
+ */
+static void i2c_msg_free(struct i2c_adapter *adapter, struct i2c_message *msg)
+{
+	struct i2c_msg_pool *pool = &adapter->pool;
+	size_t i = msg - &pool->msgs[0];
+	
+	if(msg >= &pool->msgs[0] && i < I2C_MSG_POOL_SIZE) {
+		pool->map[i >> 3] &= ~BIT(i & 7);
+	}
+}
+
+/**
+ * \brief Allocate a queue node from the adapter pool.
+ * \param adapter Adapter owning the pool.
+ * \return The allocated node.
+ * \retval NULL if the pool is exhausted.
+ */
+static struct linkedlist *i2c_node_alloc(struct i2c_adapter *adapter)
+{
+	struct linkedlist *node = adapter->pool.free_nodes;
+	
+	if(node) {
+		adapter->pool.free_nodes = node->next;
+		node->next = NULL;
+	}
+	return node;
+}
+
+/**
+ * \brief Return a queue node to the adapter pool.
+ * \param adapter Adapter owning the pool.
+ * \param node Node to free.
+ */
+static void i2c_node_free(struct i2c_adapter *adapter, struct linkedlist *node)
+{
+	node->data = NULL;
+	node->next = adapter->pool.free_nodes;
+	adapter->pool.free_nodes = node;
+}
+
 /**
  * \brief Lock the adapter.
  * \param adapter Adapter to lock.
@@ -163,14 +282,170 @@ static int i2c_release_adapter(struct i2c_adapter *adapter, struct i2c_shared_in
 PUBLIC int i2c_write_client(struct i2c_client *client, const void *data, size_t size, 
 							i2c_features_t flags)
 {
-	struct i2c_message *msg = malloc(sizeof(*msg));
+	return __i2c_write_client(client, data, size, NULL, 0, flags);
+}
+
+/**
+ * \brief Write a scattered buffer to the client.
+ * \param client I2C client to write to.
+ * \param iov Buffer segments.
+ * \param iovcnt Amount of segments in \p iov.
+ * \param flags Flags describing the message.
+ * \see i2c_write_client
+ * 
+ * All segments are transfered as one message, so a register address and its payload can be
+ * written without copying them into one buffer. \p iov is not copied and must stay valid until
+ * the message has been transfered. Segments are only supported for master messages.
+ */
+PUBLIC int i2c_writev_client(struct i2c_client *client, const struct i2c_iovec *iov,
+							 uint8_t iovcnt, i2c_features_t flags)
+{
+	if(!iovcnt || (flags & I2C_MSG_MASTER_MSG_MASK) == 0) {
+		return -1;
+	}
+	
+	return __i2c_write_client(client, iov->buff, iov->length, iov+1, iovcnt-1, flags);
+}
+
+/**
+ * \brief Queue a precompiled transaction on a client.
+ * \param client I2C client to write to.
+ * \param t Transaction descriptor.
+ * \param buffs One buffer for every segment of \p t.
+ * \param flags Extra message flags (i.e. I2C_MSG_CALL_BACK_FLAG), added to every segment.
+ * \return 0 on success, -1 if the messages could not be allocated. All messages of the client are
+ *         dropped in that case.
+ * \see i2c_flush_client i2c_submit
+ * 
+ * All messages of the transaction are added in one call. The features of every message are
+ * taken from the descriptor as is, so the transmission layout of the client is not used.
+ */
+PUBLIC int i2c_queue_transaction(struct i2c_client *client, const struct i2c_transaction *t,
+								 void *const *buffs, i2c_features_t flags)
+{
+	const struct i2c_segment *seg = t->segs;
+	uint8_t i;
+	
+	if(t->num > I2C_MSG_POOL_SIZE) {
+		return -1;
+	}
+	
+	for(i = 0; i < t->num; i++, seg++) {
+		if(__i2c_write_client(client, buffs[i], seg->length, NULL, 0, seg->features | flags)) {
+			i2c_cleanup_client_msgs(client);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * \brief Queue a precompiled scatter-gather transaction on a client.
+ * \param client I2C client to write to.
+ * \param t Transaction descriptor.
+ * \param iov \p iovcnt buffer segments for every segment of \p t.
+ * \param iovcnt Amount of buffer segments per message.
+ * \param flags Extra message flags (i.e. I2C_MSG_CALL_BACK_FLAG), added to every segment.
+ * \return 0 on success, -1 if the messages could not be allocated. All messages of the client are
+ *         dropped in that case.
+ * \see i2c_queue_transaction i2c_writev_client
+ * 
+ * Message <i>i</i> of the transaction is made of <i>iov[i*iovcnt]</i> up to and including
+ * <i>iov[i*iovcnt + iovcnt - 1]</i>, so the lengths are taken from \p iov and i2c_segment::length
+ * is not used. \p iov must stay valid until the messages have been transfered.
+ */
+PUBLIC int i2c_queue_transactionv(struct i2c_client *client, const struct i2c_transaction *t,
+								  const struct i2c_iovec *iov, uint8_t iovcnt, i2c_features_t flags)
+{
+	const struct i2c_segment *seg = t->segs;
+	uint8_t i;
+	
+	if(!iovcnt || t->num > I2C_MSG_POOL_SIZE) {
+		return -1;
+	}
+	
+	for(i = 0; i < t->num; i++, seg++, iov += iovcnt) {
+		if(__i2c_write_client(client, iov->buff, iov->length, iov+1, iovcnt-1,
+							  seg->features | flags)) {
+			i2c_cleanup_client_msgs(client);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * \brief Serve a register file as slave.
+ * \param adapter Adapter which should serve \p rf.
+ * \param rf Register file, <i>NULL</i> to detach the current register file.
+ * \return Error code.
+ * \retval -DEV_OK on success.
+ * \retval -DEV_ERROR if the adapter doesn't support register files.
+ * \see i2c_detach_regfile i2c_adapter::attach
+ * 
+ * Masters can read and write \p rf while it is attached, without a thread posting slave buffers
+ * for every transaction. Slave messages queued by clients take precedence over the register file.
+ */
+PUBLIC int i2c_attach_regfile(struct i2c_adapter *adapter, struct i2c_regfile *rf)
+{
+	int rc;
+	
+	if(!adapter->attach || (i2c_adapter_features(adapter) & I2C_SLAVE_SUPPORT) == 0) {
+		return -DEV_ERROR;
+	}
+	
+	if(rf) {
+		rf->ptr = 0;
+		rf->addr_phase = FALSE;
+		rf->changed = 0;
+	}
+	
+	if(adapter->dev->alloc(adapter->dev, I2C_MASTER_TMO) != 0) {
+		return -DEV_INTERNAL;
+	}
+	rc = adapter->attach(adapter, rf);
+	adapter->dev->release(adapter->dev);
+	return rc;
+}
+
+/**
+ * \brief Stop serving the register file of an adapter.
+ * \param adapter I2C adapter.
+ * \see i2c_attach_regfile
+ */
+PUBLIC int i2c_detach_regfile(struct i2c_adapter *adapter)
+{
+	return i2c_attach_regfile(adapter, NULL);
+}
+
+/**
+ * \brief Allocate a message and add it to the client.
+ * \param client I2C client to write to.
+ * \param data First buffer.
+ * \param size Size of \p data.
+ * \param iov Segments which follow \p data.
+ * \param iovcnt Amount of segments in \p iov.
+ * \param flags Message flags.
+ */
+static int __i2c_write_client(struct i2c_client *client, const void *data, size_t size,
+							  const struct i2c_iovec *iov, uint8_t iovcnt, i2c_features_t flags)
+{
+	struct i2c_message *msg = i2c_msg_alloc(client->adapter);
 	
 	if(msg) {
 		msg->buff = (void*)data;
 		msg->length = size;
+		msg->iov = iov;
+		msg->iovcnt = iovcnt;
 		msg->features = flags;
 		msg->addr = client->sla;
-		return i2c_add_entry(client, msg);
+#ifdef I2C_STATS
+		msg->stats = &i2c_shinfo(client)->stats;
+#endif
+		if(i2c_add_entry(client, msg) == 0) {
+			return 0;
+		}
+		i2c_msg_free(client->adapter, msg);
 	}
 	return -1;
 }
@@ -189,30 +464,188 @@ PUBLIC int i2c_flush_client(struct i2c_client *client)
 }
 
 /**
- * \brief Remove all messages from the adapter.
- * \param client I2C client which adapters messages have to be deleted.
- * \param master If set to true, not only slave messages will be deleted, but master messages too.
- * \warning The adapter must be locked before it is safe to use this function.
+ * \brief Submit the messages of a client without waiting for completion.
+ * \param client Client whose messages should be transfered.
+ * \param xfer Transfer handle.
+ * \return Error code.
+ * \retval -DEV_OK if the transfer has been queued.
+ * \retval -DEV_ERROR if the adapter doesn't support asynchronous transfers or if the client has
+ *                    no valid master messages.
+ * \retval -DEV_INTERNAL if the adapter could not be locked.
+ * \retval -DEV_OUTOFBOUNDS if the master queue of the adapter can't hold the transfer. The
+ *                          messages are deleted.
+ * \see i2c_xfer_wait
+ * 
+ * All master messages which have been added to \p client are queued on the adapter as one
+ * transfer and the adapter is started if it is idle. The buffers of the messages and \p xfer
+ * must stay valid until the transfer has completed. Completion is reported through
+ * i2c_xfer::complete (from ISR context) and by waking up the threads waiting in i2c_xfer_wait.
+ * Call back messages are not supported, the call back flag is ignored.
  */
-static inline int i2c_cleanup_adapter_msgs(struct i2c_adapter *adapter, bool master)
+PUBLIC int i2c_submit(struct i2c_client *client, struct i2c_xfer *xfer)
 {
+	struct i2c_adapter *adapter = client->adapter;
+	struct i2c_shared_info *sh_info = i2c_shinfo(client);
+	struct linkedlist *node, *n_node;
 	struct i2c_message *msg;
+	i2c_features_t features;
+	uint8_t num = 0;
+	int rc;
 	
-	size_t i = i2c_vector_length(adapter) -1;
-	for(; i >= 0; i--) {
-		msg = i2c_vector_get(adapter, i);
-		if((i2c_msg_is_master(msg) && master) || (!i2c_msg_is_master(msg) && !master)) {
-			if((i2c_msg_features(msg) & I2C_MSG_DONE_MASK) != 0) {
-				i2c_vector_delete_at(adapter, i);
-				free(msg);
-			}
+	if(!adapter->start || (i2c_adapter_features(adapter) & I2C_MASTER_SUPPORT) == 0) {
+		return -DEV_ERROR;
+	}
+	
+	if(adapter->dev->alloc(adapter->dev, I2C_MASTER_TMO) != 0) {
+		return -DEV_INTERNAL;
+	}
+	
+	/*
+	 * Synchronous messages of a timed out transfer would be sent in front of this transfer, while
+	 * their buffers may be gone already.
+	 */
+	if(!adapter->busy) {
+		i2c_master_tmo(adapter);
+	} else {
+		i2c_cleanup_adapter_msgs(adapter, TRUE);
+	}
+	
+	foreach_safe(sh_info->msgs, node, n_node) {
+		msg = (struct i2c_message*)node->data;
+		features = i2c_msg_features(msg);
+		if((features & I2C_MSG_MASTER_MSG_MASK) == 0) {
+			logmsg_P(I2C_CORE_LOG, PSTR("Msg (0x%p) not compliant with adapter (0x%p).\n"), 
+						msg, adapter);
+			i2c_set_error(sh_info);
+			linkedlist_delete_node(&sh_info->msgs, node);
+			i2c_msg_free(adapter, msg);
+			i2c_node_free(adapter, node);
+			continue;
+		}
+		
+		features &= ~I2C_MSG_CALL_BACK_FLAG;
+		if((features & I2C_MSG_TRANSMIT_MSG_FLAG) == 0) {
+			msg->addr |= I2C_READ_BIT;
+		}
+		i2c_msg_set_features(msg, features);
+		msg->xfer = xfer;
+		num++;
+	}
+	
+	if(!num) {
+		adapter->dev->release(adapter->dev);
+		return -DEV_ERROR;
+	}
+	
+	xfer->status = I2C_XFER_PENDING;
+	xfer->remaining = num;
+	xfer->queue = NULL;
+	
+	/*
+	 * Queue all messages at once, the ISR may be processing the queue already. The transfer is
+	 * queued entirely or not at all.
+	 */
+	BermudaEnterCritical();
+	if(I2C_MSG_POOL_SIZE - i2c_queue_length(&adapter->master_msgs) < num) {
+		BermudaExitCritical();
+		xfer->status = -1;
+		i2c_set_error(sh_info);
+		i2c_cleanup_client_msgs(client);
+		adapter->dev->release(adapter->dev);
+		return -DEV_OUTOFBOUNDS;
+	}
+	
+	foreach_safe(sh_info->msgs, node, n_node) {
+		linkedlist_delete_node(&sh_info->msgs, node);
+		i2c_queue_push(&adapter->master_msgs, (struct i2c_message*)node->data);
+		i2c_node_free(adapter, node);
+	}
+	BermudaExitCritical();
+#ifdef I2C_STATS
+	adapter->stats.xfers++;
+	sh_info->stats.xfers++;
+#endif
+	
+	rc = adapter->start(adapter, sh_info->clock);
+	adapter->dev->release(adapter->dev);
+	return rc;
+}
+
+/**
+ * \brief Wait for an asynchronous transfer to complete.
+ * \param xfer Transfer handle.
+ * \param tmo Time-out in milli seconds, EVENT_WAIT_INFINITE to wait forever.
+ * \return The transfer status.
+ * \retval 0 if all messages have been transfered.
+ * \retval -1 if a message failed or if the time-out expired.
+ * \see i2c_submit
+ */
+PUBLIC int i2c_xfer_wait(struct i2c_xfer *xfer, unsigned int tmo)
+{
+	if(xfer->status == I2C_XFER_PENDING) {
+		/*
+		 * A transfer completing before this thread starts waiting leaves the queue SIGNALED.
+		 */
+		if(BermudaEventWait(event(&xfer->queue), tmo) == -1) {
+			return -1;
+		}
+	}
+	
+	return (xfer->status == 0) ? 0 : -1;
+}
+
+/**
+ * \brief Account the completion of a message of an asynchronous transfer.
+ * \param msg Completed message.
+ * \param error Set to TRUE if \p msg failed.
+ * \note Called from ISR context, or with interrupts disabled.
+ * \see i2c_queue_complete i2c_queue_abort
+ */
+PUBLIC void i2c_xfer_msg_done(struct i2c_message *msg, bool error)
+{
+	struct i2c_xfer *xfer = msg->xfer;
+	
+	msg->xfer = NULL;
+	if(error) {
+		xfer->status = -1;
+	}
+	
+	if(--xfer->remaining == 0) {
+		if(xfer->status == I2C_XFER_PENDING) {
+			xfer->status = 0;
+		}
+		if(xfer->complete) {
+			xfer->complete(xfer);
 		}
-		if(i == 0) {
+		BermudaEventSignalFromISR(event(&xfer->queue));
+	}
+}
+
+/**
+ * \brief Retire all completed messages from an adapter queue.
+ * \param adapter I2C adapter holding the messages.
+ * \param master If set to true the master queue is cleaned up, the slave queue otherwise.
+ * \return The amount of retired messages.
+ * \warning The adapter must be locked before it is safe to use this function.
+ */
+static inline size_t i2c_cleanup_adapter_msgs(struct i2c_adapter *adapter, bool master)
+{
+	struct i2c_msg_queue *queue = i2c_adapter_queue(adapter, master);
+	struct i2c_message *msg;
+	size_t num = 0;
+	
+	while(1) {
+		BermudaEnterCritical();
+		msg = i2c_queue_pop(queue);
+		BermudaExitCritical();
+		
+		if(!msg) {
 			break;
 		}
+		i2c_msg_free(adapter, msg);
+		num++;
 	}
-	i2c_vector_reshape(adapter);
-	return 0;
+	return num;
 }
 
 /**
@@ -223,47 +656,31 @@ static inline int i2c_cleanup_adapter_msgs(struct i2c_adapter *adapter, bool mas
  */
 static inline void i2c_slave_tmo(struct i2c_adapter *adapter)
 {
-	size_t index = 0, length = i2c_vector_length(adapter);
-	struct i2c_message *msg;
-	
-	if(i2c_first_slave_msg(adapter, &index)) {
-		for(; index < length; index++) {
-			msg = i2c_vector_get(adapter, index);
-			msg->features |= I2C_MSG_DONE_FLAG;
-		}
-		i2c_cleanup_adapter_msgs(adapter, FALSE);
-	}
-	
+	BermudaEnterCritical();
+	i2c_queue_abort_all(&adapter->slave_msgs);
+	BermudaExitCritical();
+	i2c_cleanup_adapter_msgs(adapter, FALSE);
 }
 
 /**
  * \brief Master message time-out.
  * \param adapter Bus adapter.
  * 
- * A new master transmission has been initiated. This function is responsible for deleting
- * all old master messages.
+ * A new master transmission is initiated on an idle bus. Synchronous messages which are still
+ * pending belong to an earlier transmission which has timed out, so they are aborted and retired.
+ * Messages of asynchronous transfers (i2c_message::xfer is set) are left alone, the bus may just
+ * not have started them yet.
  */
 static inline void i2c_master_tmo(struct i2c_adapter *adapter)
 {
-	size_t index = 0;
 	struct i2c_message *msg;
-	size_t diff = i2c_vector_length(adapter);
-	int32_t s_diff;
 	
-	if(i2c_first_master_msg(adapter, &index)) {
-		for(; index < i2c_vector_length(adapter); index++) {
-			msg = i2c_vector_get(adapter, index);
-			if((i2c_msg_features(msg) & I2C_MSG_SLAVE_MSG_MASK) != 0) {
-				break;
-			}
-			msg->features |= I2C_MSG_DONE_FLAG;
-		}
+	BermudaEnterCritical();
+	while((msg = i2c_queue_pending(&adapter->master_msgs)) != NULL && msg->xfer == NULL) {
+		i2c_queue_abort(&adapter->master_msgs);
 	}
-	i2c_cleanup_adapter_msgs(adapter, TRUE);
-	diff -= i2c_vector_length(adapter);
-	s_diff = (int32_t)diff;
-	s_diff *= -1;
-	adapter->update(adapter, s_diff);
+	BermudaExitCritical();
+	i2c_update(adapter, TRUE);
 }
 
 /**
@@ -279,27 +696,77 @@ static int i2c_start_xfer(struct i2c_client *client)
 	if(client) {
 		if((stream->flags & I2C_MASTER) == 0) {
 			i2c_slave_tmo(client->adapter);
+		} else if(i2c_shinfo(client)->retries) {
+			return i2c_retry_xfer(client);
 		}
 		return __i2c_start_xfer(client->adapter, i2c_shinfo(client));
 	}
 	return -1;
 }
 
-#if 0
-static void i2c_print_vector(struct i2c_adapter *adapter)
+/**
+ * \brief Transfer the master messages of a client, retrying a failed transfer.
+ * \param client Client whom requests the transmission.
+ * \see i2c_set_retries
+ * 
+ * The messages are given back to the pool by __i2c_start_xfer, so they are saved in
+ * i2c_shared_info::retry_msgs before the first attempt and queued again before every retry. The
+ * delay between two attempts starts at i2c_shared_info::backoff and doubles after every retry.
+ * Transfers with call back messages are tried only once, since the call back may have changed
+ * the messages.
+ */
+static int i2c_retry_xfer(struct i2c_client *client)
 {
-	if(adapter->msg_vector.length < 7) {
-		return;
-	}
+	struct i2c_shared_info *sh_info = i2c_shinfo(client);
+	struct i2c_retry_msg *msgs = sh_info->retry_msgs;
 	struct i2c_message *msg;
-	printf("--\n");
-	i2c_vector_foreach(&adapter->msg_vector, i) {
-		msg = i2c_vector_get(adapter, i);
-		printf("M: %X Tx: %X\n", neg(msg->features) & I2C_MSG_MASTER_MSG_MASK,
-			   msg->features & I2C_MSG_TRANSMIT_MSG_MASK);
+	struct linkedlist *node;
+	unsigned int delay = sh_info->backoff;
+	uint8_t i, num = 0, tries;
+	int rc;
+	
+	foreach(sh_info->msgs, node) {
+		msg = (struct i2c_message*)node->data;
+		if(!msgs || num == I2C_MSG_POOL_SIZE ||
+			(i2c_msg_features(msg) & I2C_MSG_CALL_BACK_MASK) != 0) {
+			return __i2c_start_xfer(client->adapter, sh_info);
+		}
+		msgs[num].buff = msg->buff;
+		msgs[num].length = msg->length;
+		msgs[num].iov = msg->iov;
+		msgs[num].iovcnt = msg->iovcnt;
+		msgs[num].features = i2c_msg_features(msg);
+		num++;
 	}
-}
+	
+	for(tries = 0; ; tries++) {
+		rc = __i2c_start_xfer(client->adapter, sh_info);
+		if(rc == -DEV_OK || tries == sh_info->retries) {
+			break;
+		}
+		
+		i2c_adapter_stats_inc(client->adapter, retries);
+#ifdef I2C_STATS
+		sh_info->stats.retries++;
 #endif
+		i2c_cleanup_client_msgs(client);
+		if(delay) {
+			BermudaThreadSleep(delay);
+			if(delay < (((unsigned int)~0) >> 1)) {
+				delay <<= 1;
+			}
+		}
+		
+		for(i = 0; i < num; i++) {
+			if(__i2c_write_client(client, msgs[i].buff, msgs[i].length, msgs[i].iov,
+								  msgs[i].iovcnt, msgs[i].features)) {
+				i2c_cleanup_client_msgs(client);
+				return rc;
+			}
+		}
+	}
+	return rc;
+}
 
 #if defined(I2C_MSG_LIST) || defined(__DOXYGEN__)
 /**
@@ -315,7 +782,7 @@ static int i2c_add_entry(struct i2c_client *client, struct i2c_message *msg)
 	int rc = -1;
 	
 
-	node = malloc(sizeof(*node));
+	node = i2c_node_alloc(client->adapter);
 	if(node) {
 		if(i2c_msg_features(msg)) {
 			features = (i2c_msg_features(msg) & I2C_MSG_SENT_STOP_FLAG) ? 
@@ -363,7 +830,7 @@ static int i2c_add_entry(struct i2c_client *client, struct i2c_message *msg)
  * - \f$ s_{x} \f$ defines the bus mask (if x = m it is the master mask and if x = s it is 
  *   the slave mask);\n
  * 
- * When the output of is one the message will be added to the vector on the adapter, if not (i.e.
+ * When the output of is one the message will be added to the queue on the adapter, if not (i.e.
  * the output is zero), the message will be disposed.
  * 
  * \see I2C_MSG_CHECK
@@ -372,23 +839,27 @@ static inline int __i2c_start_xfer(struct i2c_adapter *adapter, struct i2c_share
 {
 	auto bool i2c_check_msg(register i2c_features_t msg, register i2c_features_t bus);
 	struct i2c_message *msg, *newmsg;
+	struct i2c_msg_queue *queue;
 	struct linkedlist *node, *n_node;
 	i2c_features_t msg_features, bus_features;
 	FILE *stream;
-	size_t index, length;
 	int rc = -DEV_INTERNAL;
-	bool master;
+	bool master, cb_master;
 	
 	stream = sh_info->socket;
 	master = (stream->flags & I2C_MASTER) ? TRUE : FALSE;
+	queue = i2c_adapter_queue(adapter, master);
 		
 	if(i2c_lock_adapter(adapter, sh_info) == 0) {
+#ifdef I2C_STATS
+		adapter->stats.xfers++;
+		sh_info->stats.xfers++;
+#endif
 		if(master && !adapter->busy) {
 			i2c_master_tmo(adapter);
 		}
 		bus_features = i2c_adapter_features(adapter) & (I2C_MASTER_SUPPORT | 
 														I2C_SLAVE_SUPPORT);
-		index = i2c_vector_length(adapter);
 		foreach_safe(sh_info->msgs, node, n_node) {
 			msg = (struct i2c_message*)node->data;
 			msg_features = i2c_msg_features(msg);
@@ -402,19 +873,13 @@ static inline int __i2c_start_xfer(struct i2c_adapter *adapter, struct i2c_share
 					msg->addr |= I2C_READ_BIT;
 				}
 				i2c_msg_set_features(msg, msg_features);
-				i2c_disable_irq();
-				rc = i2c_vector_add(adapter, msg, master);
-				i2c_restore_irq();
-				free(node);
+				BermudaEnterCritical();
+				rc = i2c_queue_push(queue, msg);
+				BermudaExitCritical();
+				i2c_node_free(adapter, node);
 				if(rc) {
-					if(i2c_vector_error(adapter, rc) == 0) {
-						i2c_disable_irq();
-						rc = i2c_vector_add(adapter, msg, master);
-						i2c_restore_irq();
-						continue;
-					}
 					i2c_set_error(sh_info);
-					free(msg);
+					i2c_msg_free(adapter, msg);
 					rc = -DEV_INTERNAL;
 					break;
 				}
@@ -423,75 +888,82 @@ static inline int __i2c_start_xfer(struct i2c_adapter *adapter, struct i2c_share
 							msg, adapter);
 				i2c_set_error(sh_info);
 				linkedlist_delete_node(&sh_info->msgs, node);
-				free(msg);
-				free(node);
+				i2c_msg_free(adapter, msg);
+				i2c_node_free(adapter, node);
 				rc = -DEV_INTERNAL;
 			}
 		}
 		if(rc < 0) {
 			goto err;
 		} else {
-			index = (index != 0) ? index-1 : index;
-			rc = adapter->xfer(adapter, sh_info->freq, master, &index);
+			rc = adapter->xfer(adapter, sh_info->clock, master);
 		}
 		
-		if(!rc && index != -1) {
-			do {
-				bus_features = i2c_adapter_features(adapter);
-				msg = i2c_vector_get(adapter, index);
-				if(i2c_msg_features(msg) & I2C_MSG_CALL_BACK_FLAG) {
-					newmsg = malloc(sizeof(*newmsg));
-					if(!newmsg) {
-						rc = -DEV_NULL;
-						break;
-					}
-					rc = sh_info->shared_callback(sh_info, msg, newmsg);
-					msg_features = i2c_msg_features(newmsg);
-					bus_features &= I2C_MASTER_SUPPORT | I2C_SLAVE_SUPPORT;
-					if(i2c_check_msg(msg_features, bus_features)) {
-						newmsg->addr = msg->addr & ~I2C_READ_BIT;
-						if((msg_features & I2C_MSG_TRANSMIT_MSG_MASK) == 0) {
-							newmsg->addr |= I2C_READ_BIT;
-						}
-						msg_features &= ~I2C_MSG_DONE_MASK;
-						msg->features |= I2C_MSG_DONE_FLAG;
-						i2c_msg_set_features(newmsg, msg_features);
-						if(rc) {
-							newmsg->buff = NULL;
-							newmsg->length = 0;
-						}
-						index++;
-						rc = i2c_vector_insert_at(adapter, newmsg, index);
-						if(rc) {
-							if(i2c_vector_error(adapter, rc) == 0) {
-								rc = i2c_vector_insert_at(adapter, newmsg, index);
-								goto loop_continue;
-							}
-							i2c_set_error(sh_info);
-							free(newmsg);
-							rc = -DEV_INTERNAL;
-							break;
-						}
-					} else {
-						logmsg_P(I2C_CORE_LOG, PSTR("Msg (0x%p) not compliant with adapter "
-													"(0x%p).\n"), newmsg, adapter);
-						i2c_set_error(sh_info);
-						free(newmsg);
-						rc = -DEV_INTERNAL;
-						break;
-					}
-				}
-				
-				loop_continue:
-				index -= (index > 0) ? i2c_update(adapter, master) : 0;
-				length = i2c_vector_length(adapter);
-				if(index < length && rc == 0) {
-					rc = adapter->resume(adapter, &index);
-					if(index == -1) {
-						break;
-					}
-				}
-			} while(index < length && rc == 0);
+		cb_master = master;
+		while(rc == 0) {
+			queue = i2c_adapter_queue(adapter, cb_master);
+			msg = i2c_queue_pending(queue);
+			if(!msg || (i2c_msg_features(msg) & I2C_MSG_CALL_BACK_FLAG) == 0) {
+				break;
+			}
+			
+			newmsg = i2c_msg_alloc(adapter);
+			if(!newmsg) {
+				rc = -DEV_NULL;
+				break;
+			}
+			rc = sh_info->shared_callback(sh_info, msg, newmsg);
+			msg_features = i2c_msg_features(newmsg);
+			bus_features = i2c_adapter_features(adapter) & (I2C_MASTER_SUPPORT | 
+															I2C_SLAVE_SUPPORT);
+			if(!i2c_check_msg(msg_features, bus_features)) {
+				logmsg_P(I2C_CORE_LOG, PSTR("Msg (0x%p) not compliant with adapter "
+											"(0x%p).\n"), newmsg, adapter);
+				i2c_set_error(sh_info);
+				i2c_msg_free(adapter, newmsg);
+				rc = -DEV_INTERNAL;
+				break;
+			}
+			
+			newmsg->addr = msg->addr & ~I2C_READ_BIT;
+#ifdef I2C_STATS
+			newmsg->stats = msg->stats;
+#endif
+			if((msg_features & I2C_MSG_TRANSMIT_MSG_MASK) == 0) {
+				newmsg->addr |= I2C_READ_BIT;
+			}
+			msg_features &= ~I2C_MSG_DONE_MASK;
+			i2c_msg_set_features(newmsg, msg_features);
+			if(rc) {
+				newmsg->buff = NULL;
+				newmsg->length = 0;
+				newmsg->iovcnt = 0;
+			}
+			
+			/*
+			 * Retire the call back message, so the new message can take its place in front of
+			 * the queue.
+			 */
+			BermudaEnterCritical();
+			i2c_queue_complete(queue);
+			BermudaExitCritical();
+			i2c_update(adapter, cb_master);
+			
+			cb_master = i2c_msg_is_master(newmsg);
+			BermudaEnterCritical();
+			rc = i2c_queue_push_front(i2c_adapter_queue(adapter, cb_master), newmsg);
+			BermudaExitCritical();
+			if(rc) {
+				i2c_set_error(sh_info);
+				i2c_msg_free(adapter, newmsg);
+				rc = -DEV_INTERNAL;
+				break;
+			}
+			rc = adapter->resume(adapter, cb_master);
+		}
+		
+		if(cb_master != master) {
+			i2c_update(adapter, cb_master);
 		}
 		i2c_update(adapter, master);
 		i2c_release_adapter(adapter, sh_info);
@@ -513,42 +985,16 @@ static inline int __i2c_start_xfer(struct i2c_adapter *adapter, struct i2c_share
 /**
  * \brief Update the I2C adapter after a transfer.
  * \param adapter I2C bus adapter.
+ * \param master Set to TRUE to update the master queue, FALSE for the slave queue.
  * \see i2c_adapter::update __i2c_start_xfer
- * \return Length diff.
  * 
- * The I2C vector will be updated and all redudant messages will be deleted. The update function
- * of the bus will also be called.
+ * All completed messages are retired from the queue. The update function of the bus will also be
+ * called.
  */
-static size_t i2c_update(struct i2c_adapter *adapter, bool master)
-{
-	int32_t s_diff;
-	size_t diff;
-	
-	diff = i2c_cleanup_adapter(adapter, master);
-	s_diff = (int32_t)diff;
-	s_diff *= -1;
-	
-	if(master) {
-		adapter->update(adapter, s_diff);
-	} else {
-		adapter->update(adapter, 0);
-	}
-	
-	return diff;
-}
-
-static size_t i2c_cleanup_adapter(struct i2c_adapter *adapter, bool master)
+static void i2c_update(struct i2c_adapter *adapter, bool master)
 {
-	size_t diff = i2c_vector_length(adapter);
-	
-	if(master) {
-		i2c_cleanup_adapter_msgs(adapter, TRUE);
-	} else {
-		i2c_cleanup_adapter_msgs(adapter, FALSE);
-	}
-	
-	diff -= i2c_vector_length(adapter);
-	return diff;
+	i2c_cleanup_adapter_msgs(adapter, master);
+	adapter->update(adapter);
 }
 
 /**
@@ -562,9 +1008,41 @@ PUBLIC void i2c_cleanup_client_msgs(struct i2c_client *client)
 	
 	foreach_safe(shinfo->msgs, node, n_node) {
 		linkedlist_delete_node(&shinfo->msgs, node);
-		free((void*)node->data);
-		free(node);
+		i2c_msg_free(client->adapter, (struct i2c_message*)node->data);
+		i2c_node_free(client->adapter, node);
+	}
+}
+
+/**
+ * \brief Configure automatic retries of master transfers.
+ * \param client Client to configure.
+ * \param retries Amount of times a failed transfer is repeated, 0 disables retrying.
+ * \param backoff Delay before the first retry in milli seconds.
+ * \return Error code.
+ * \retval -DEV_OK on success.
+ * \retval -DEV_NULL if there is not enough memory to save the messages of a transfer. Retrying
+ *                   stays disabled.
+ * \see i2c_flush_client
+ * 
+ * The delay is doubled after every retry. Transfers containing call back messages are not
+ * retried. The memory used to save the messages is allocated on the first call which enables
+ * retries.
+ */
+PUBLIC int i2c_set_retries(struct i2c_client *client, uint8_t retries, unsigned int backoff)
+{
+	struct i2c_shared_info *shinfo = i2c_shinfo(client);
+	
+	if(retries && !shinfo->retry_msgs) {
+		shinfo->retry_msgs = malloc(I2C_MSG_POOL_SIZE * sizeof(*shinfo->retry_msgs));
+		if(!shinfo->retry_msgs) {
+			shinfo->retries = 0;
+			return -DEV_NULL;
+		}
 	}
+	
+	shinfo->retries = retries;
+	shinfo->backoff = backoff;
+	return -DEV_OK;
 }
 
 /**
@@ -622,11 +1100,86 @@ static void __i2c_init_client(struct i2c_client *client, uint16_t sla, uint32_t
 	client->sla = sla;
 	
 	shinfo->freq = hz;
+	if(client->adapter && client->adapter->clock) {
+		shinfo->clock = client->adapter->clock(client->adapter, hz);
+	} else {
+		shinfo->clock = 0;
+	}
 	shinfo->msgs = NULL;
 	shinfo->features = 0;
+	shinfo->retries = 0;
+	shinfo->backoff = 0;
+	shinfo->retry_msgs = NULL;
+#ifdef I2C_STATS
+	i2c_stats_clear(&shinfo->stats);
+#endif
 	shinfo->mutex = SIGNALED;
 }
 
+#if defined(I2C_STATS) || defined(__DOXYGEN__)
+/**
+ * \brief Get the statistics of an adapter.
+ * \param adapter I2C adapter.
+ * \param stats Will be set to a snapshot of the adapter statistics.
+ * \note Only available when configured with --enable-i2c-stats.
+ */
+PUBLIC void i2c_adapter_get_stats(struct i2c_adapter *adapter, struct i2c_stats *stats)
+{
+	BermudaEnterCritical();
+	*stats = adapter->stats;
+	BermudaExitCritical();
+}
+
+/**
+ * \brief Get the statistics of a client.
+ * \param client I2C client.
+ * \param stats Will be set to a snapshot of the client statistics.
+ * \note The queue depth and bus condition counters are only kept per adapter.
+ */
+PUBLIC void i2c_client_get_stats(struct i2c_client *client, struct i2c_stats *stats)
+{
+	BermudaEnterCritical();
+	*stats = i2c_shinfo(client)->stats;
+	BermudaExitCritical();
+}
+
+/**
+ * \brief Clear a statistics block.
+ * \param stats Statistics to clear.
+ */
+static void i2c_stats_clear(struct i2c_stats *stats)
+{
+	uint8_t *p = (uint8_t*)stats;
+	size_t i;
+	
+	for(i = 0; i < sizeof(*stats); i++) {
+		p[i] = 0;
+	}
+}
+
+/**
+ * \brief Reset the statistics of an adapter.
+ * \param adapter I2C adapter.
+ */
+PUBLIC void i2c_adapter_reset_stats(struct i2c_adapter *adapter)
+{
+	BermudaEnterCritical();
+	i2c_stats_clear(&adapter->stats);
+	BermudaExitCritical();
+}
+
+/**
+ * \brief Reset the statistics of a client.
+ * \param client I2C client.
+ */
+PUBLIC void i2c_client_reset_stats(struct i2c_client *client)
+{
+	BermudaEnterCritical();
+	i2c_stats_clear(&i2c_shinfo(client)->stats);
+	BermudaExitCritical();
+}
+#endif
+
 /*
  * Debugging functions
  */
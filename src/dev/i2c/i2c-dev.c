@@ -97,6 +97,9 @@ for(;;) {
 #include <sys/epl.h>
 #include <sys/events/event.h>
 
+static i2c_features_t i2cdev_master_features(struct i2c_client *client, i2c_features_t features);
+static i2c_features_t i2cdev_transaction_flags(FILE *stream);
+
 /**
  * \brief Request an I2C I/O file.
  * \param client I2C driver client.
@@ -162,17 +165,11 @@ PUBLIC int i2cdev_write(FILE *file, const void *buff, size_t size)
 	struct i2c_client *client = file->data;
 	struct i2c_shared_info *info = i2c_shinfo(client);
 	i2c_features_t features;
-	char *layout;
 	
 	if(client) {
 		if((info->socket->flags & I2C_MASTER) != 0) {
-			layout = i2c_transmission_layout(client);
-			features = I2C_MSG_MASTER_MSG_FLAG | I2C_MSG_TRANSMIT_MSG_FLAG | 
-						I2C_MSG_SENT_REP_START_FLAG;
-			if(*(++layout) == '\0') {
-				features = (features & ~I2C_MSG_SENT_REP_START_FLAG) | I2C_MSG_SENT_STOP_FLAG;
-			}
-			i2c_set_transmission_layout(client, layout);
+			features = i2cdev_master_features(client, I2C_MSG_MASTER_MSG_FLAG | 
+														I2C_MSG_TRANSMIT_MSG_FLAG);
 		} else {
 			features = I2C_MSG_SLAVE_MSG_FLAG | I2C_MSG_TRANSMIT_MSG_FLAG;
 		}
@@ -202,16 +199,10 @@ PUBLIC int i2cdev_read(FILE *file, void *buff, size_t size)
 	struct i2c_client *client = file->data;
 	struct i2c_shared_info *info = i2c_shinfo(client);
 	i2c_features_t features;
-	char *layout;
 	
 	if(client) {
 		if((info->socket->flags & I2C_MASTER) != 0) {
-			layout = i2c_transmission_layout(client);
-			features = I2C_MSG_MASTER_MSG_FLAG | I2C_MSG_SENT_REP_START_FLAG;
-			if(*(++layout) == '\0') {
-				features = (features & ~I2C_MSG_SENT_REP_START_FLAG) | I2C_MSG_SENT_STOP_FLAG;
-			}
-			i2c_set_transmission_layout(client, layout);
+			features = i2cdev_master_features(client, I2C_MSG_MASTER_MSG_FLAG);
 		} else {
 			features = I2C_MSG_SLAVE_MSG_FLAG;
 		}
@@ -309,6 +300,171 @@ PUBLIC int i2cdev_listen(int fd, void *buff, size_t size)
 	return rc;
 }
 
+/**
+ * \brief Write a scattered buffer to an I2C master file.
+ * \param fd File descriptor of a master client.
+ * \param iov Buffer segments.
+ * \param iovcnt Amount of segments in \p iov.
+ * \return The amount of queued bytes, or -1 on error.
+ * \see i2c_writev_client
+ * 
+ * Works like write, but all segments are sent as one message. It uses one entry of the
+ * transmission layout. \p iov and the segment buffers must stay valid until the file is flushed.
+ */
+PUBLIC int i2cdev_writev(int fd, const struct i2c_iovec *iov, uint8_t iovcnt)
+{
+	FILE *stream = fdopen(fd);
+	struct i2c_client *client;
+	i2c_features_t features;
+	size_t size;
+	uint8_t i;
+	
+	if(stream == NULL || (stream->flags & I2C_MASTER) == 0 || !iovcnt) {
+		return -1;
+	}
+	
+	client = stream->data;
+	features = i2cdev_master_features(client, I2C_MSG_MASTER_MSG_FLAG | 
+												I2C_MSG_TRANSMIT_MSG_FLAG);
+	if((stream->flags & I2CDEV_CALL_BACK) != 0) {
+		features |= I2C_MSG_CALL_BACK_FLAG;
+	}
+	
+	for(i = 0, size = 0; i < iovcnt; i++) {
+		size += iov[i].length;
+	}
+	
+	if(i2c_writev_client(client, iov, iovcnt, features) == 0) {
+		return size;
+	} else {
+		return -1;
+	}
+}
+
+/**
+ * \brief Transfer a precompiled transaction.
+ * \param fd File descriptor of a master client.
+ * \param t Transaction descriptor.
+ * \param buffs One buffer for every segment of \p t.
+ * \return 0 on success, a negative value otherwise.
+ * \see i2c_queue_transaction
+ * 
+ * Replaces the sequence of setting a transmission layout, calling write and read for every
+ * message and flushing the file. Messages which were already written to the file are
+ * transfered first.
+ */
+PUBLIC int i2cdev_transfer(int fd, const struct i2c_transaction *t, void *const *buffs)
+{
+	FILE *stream = fdopen(fd);
+	
+	if(stream == NULL || (stream->flags & I2C_MASTER) == 0) {
+		return -1;
+	}
+	
+	if(i2c_queue_transaction(stream->data, t, buffs, i2cdev_transaction_flags(stream))) {
+		return -1;
+	}
+	return i2cdev_flush(stream);
+}
+
+/**
+ * \brief Transfer a precompiled scatter-gather transaction.
+ * \param fd File descriptor of a master client.
+ * \param t Transaction descriptor.
+ * \param iov \p iovcnt buffer segments for every segment of \p t.
+ * \param iovcnt Amount of buffer segments per message.
+ * \return 0 on success, a negative value otherwise.
+ * \see i2c_queue_transactionv i2cdev_transfer
+ * 
+ * Works like i2cdev_transfer, but every message is gathered from \p iovcnt segments of \p iov,
+ * e.g. a register address and its data.
+ */
+PUBLIC int i2cdev_transferv(int fd, const struct i2c_transaction *t, const struct i2c_iovec *iov,
+							uint8_t iovcnt)
+{
+	FILE *stream = fdopen(fd);
+	
+	if(stream == NULL || (stream->flags & I2C_MASTER) == 0) {
+		return -1;
+	}
+	
+	if(i2c_queue_transactionv(stream->data, t, iov, iovcnt, i2cdev_transaction_flags(stream))) {
+		return -1;
+	}
+	return i2cdev_flush(stream);
+}
+
+/**
+ * \brief Get the message flags of the file options.
+ * \param stream I2C file.
+ * \see i2cdev_transfer i2cdev_transferv
+ */
+static i2c_features_t i2cdev_transaction_flags(FILE *stream)
+{
+	i2c_features_t flags = 0;
+	
+	if((stream->flags & I2CDEV_CALL_BACK) != 0) {
+		flags = I2C_MSG_CALL_BACK_FLAG;
+	}
+	if((stream->flags & I2CDEV_ACK_POLL) != 0) {
+		flags |= I2C_MSG_ACK_POLL_FLAG;
+	}
+	return flags;
+}
+
+/**
+ * \brief Submit the messages of an I2C file without waiting for completion.
+ * \param fd File descriptor of a master client.
+ * \param xfer Transfer handle.
+ * \return 0 on success, a negative value otherwise.
+ * \see i2c_submit i2c_xfer_wait
+ * 
+ * Used instead of flush. The buffers passed to write and read must stay valid until \p xfer has
+ * completed, the file can be closed right away.
+ */
+PUBLIC int i2cdev_submit(int fd, struct i2c_xfer *xfer)
+{
+	FILE *stream = fdopen(fd);
+	struct i2c_client *client;
+	
+	if(stream == NULL || (stream->flags & I2C_MASTER) == 0) {
+		return -1;
+	}
+	
+	client = stream->data;
+	if(i2c_shinfo(client)->msgs) {
+		return i2c_submit(client, xfer);
+	} else {
+		return -1;
+	}
+}
+
+/**
+ * \brief Get the features of the next master message.
+ * \param client I2C client.
+ * \param features Direction features of the message.
+ * 
+ * Consumes one entry of the transmission layout. The last entry of the layout is ended with a
+ * stop condition, all others with a repeated start. The address is polled when the file has
+ * I2CDEV_ACK_POLL set.
+ */
+static i2c_features_t i2cdev_master_features(struct i2c_client *client, i2c_features_t features)
+{
+	char *layout = i2c_transmission_layout(client);
+	
+	if((i2c_shinfo(client)->socket->flags & I2CDEV_ACK_POLL) != 0) {
+		features |= I2C_MSG_ACK_POLL_FLAG;
+	}
+	
+	if(*(++layout) == '\0') {
+		features |= I2C_MSG_SENT_STOP_FLAG;
+	} else {
+		features |= I2C_MSG_SENT_REP_START_FLAG;
+	}
+	i2c_set_transmission_layout(client, layout);
+	return features;
+}
+
 /**
  * \brief Handle an I2C file I/O error.
  * \param fd File descriptor of the current transfer.
@@ -20,10 +20,13 @@
  * \file src/dev/i2c/i2c-msg.c I2C-MSG manager
  * \brief Manage I2C adapter messages.
  * 
- * I2C messages which are attatched to an adapter are managed using a vector. This file is a simple
- * implementation of a vector (i.e. dynamic array). The reason an adapter uses a vector is that
- * \verbatim vector_get(int index) \endverbatim is verry fast. This function is used allot by several
- * bus implementations.
+ * I2C messages which are attatched to an adapter are managed using two fixed size ring queues, one
+ * for master messages and one for slave messages. The bus driver only needs the pending message of
+ * a queue, which is found in constant time, and completing a message is a matter of increasing
+ * i2c_msg_queue::done. Adding and retiring messages doesn't move any other message.
+ * 
+ * The queues can hold I2C_MSG_POOL_SIZE messages, which is the amount of messages the adapter
+ * pool can supply, so they can't overflow as long as messages are allocated from the pool.
  * 
  * \addtogroup i2c-core
  * @{
@@ -42,405 +45,105 @@
 #include <sys/events/event.h>
 
 /**
- * \def DEFAULT_MSG_LIMIT
- * \brief Default amount of available entries in i2c_adapter::msg_vector.
- */
-#define DEFAULT_MSG_LIMIT 10
-
-/**
- * \def ENTRY_SIZE
- * \brief Size of one entry in i2c_adapter::msg_vector.
- */
-#define ENTRY_SIZE (sizeof(void*))
-
-/*
- * static funcs
- */
-static int i2c_vector_shift_left(struct i2c_msg_vector *vector, size_t index);
-static int i2c_vector_shift_right(struct i2c_msg_vector *vector, size_t index, size_t num);
-
-/**
- * \brief Allocate a new vector for adapter messages.
- * \param adapter Adapter to allocate a vector for.
- * \return Error code.
- * \retval -1 An error has occurred.
- * \retval 0 Allocation was successful.
- */
-PUBLIC int i2c_create_msg_vector(struct i2c_adapter *adapter)
-{
-	int rc = -DEV_NULL;
-	
-	adapter->msg_vector.data = malloc(sizeof(*(adapter->msg_vector.data))*DEFAULT_MSG_LIMIT);
-	
-	if(adapter->msg_vector.data) {
-		adapter->msg_vector.limit = DEFAULT_MSG_LIMIT;
-		adapter->msg_vector.length = 0;
-		rc = -DEV_OK;
-	}
-	return rc;
-}
-
-/**
- * \brief Delete a message from the adapter.
- * \param adapter I2C adapter to delete from.
- * \param index Index to delete at.
- * \return The deleted entry, if it exists.
- * \retval NULL When index is out of bounds
- * \retval i2c_message The message which was at index.
- * 
- * Delete the entry at \p index from \p adapter.
- */
-PUBLIC struct i2c_message *i2c_vector_delete_at(struct i2c_adapter *adapter, size_t index)
-{
-	struct i2c_message *tmp;
-	
-	if(!adapter->msg_vector.data) {
-		return PTR_ERROR(-DEV_NOINIT);
-	}
-	
-	if(index < adapter->msg_vector.length) {
-		tmp = adapter->msg_vector.data[index];
-		adapter->msg_vector.data[index] = NULL;
-		if(i2c_vector_shift_left(&adapter->msg_vector, index+1)) {
-			adapter->msg_vector.length -= 1;
-		}
-		
-		return tmp;
-	} else {
-		return NULL;
-	}
-}
-
-/**
- * \brief Return the message at <i>index</i>.
- * \param adapter The I2C adapter.
- * \param index Index to return.
- * \return The i2c_message at \p index. If \p index is out of bounds <i>NULL</i> is returned.
- * \retval NULL when an error has occurred.
- * \retval i2c_message when no error has occurred.
- */
-PUBLIC struct i2c_message *i2c_vector_get(struct i2c_adapter *adapter, size_t index)
-{
-	if(!adapter->msg_vector.data) {
-		return PTR_ERROR(-DEV_NOINIT);
-	}
-	if(index < adapter->msg_vector.length) {
-		return adapter->msg_vector.data[index];
-	} else {
-		return NULL;
-	}
-}
-
-/**
- * \brief Locate a message in an I2C vector.
- * \param adapter I2C adapter to locate the message in.
- * \param id Message to locate.
- * \return The message index. If the message is not found the return value will be 
- *         i2c_msg_vector::length + 1.
+ * \brief Initialize an I2C message queue.
+ * \param queue Queue to initialize.
  */
-PUBLIC size_t i2c_vector_locate(struct i2c_adapter *adapter, struct i2c_message *id)
+PUBLIC void i2c_queue_init(struct i2c_msg_queue *queue)
 {
-	struct i2c_msg_vector *vector = &adapter->msg_vector;
-	size_t ret;
-	
-	if(!id) {
-		return -1;
-	}
-	
-	for(ret = 0; ret < vector->length; ret++) {
-		if(vector->data[ret] == id) {
-			return ret;
-		} else {
-			continue;
-		}
-	}
-	
-	return vector->length + 1; /* return an impossible value */
+	queue->head = 0;
+	queue->length = 0;
+	queue->done = 0;
+#ifdef I2C_STATS
+	queue->stats = NULL;
+#endif
 }
 
 /**
- * \brief Add a new message to the adapter.
- * \param adapter The I2C adapter to add the message to.
+ * \brief Add a message to the tail of a queue.
+ * \param queue Queue to add the message to.
  * \param msg I2C message to add.
- * \param master Indicates whether \p msg is a master message or not.
  * \return Error code.
- * \retval 0 when no error has occurred.
- * \retval -1 when an error has occurred.
+ * \retval -DEV_OK when no error has occurred.
+ * \retval -DEV_OUTOFBOUNDS when the queue is full.
+ * \warning Must be called with the bus interrupt disabled.
  */
-PUBLIC int i2c_vector_add(struct i2c_adapter *adapter, struct i2c_message *msg, bool master)
+PUBLIC int i2c_queue_push(struct i2c_msg_queue *queue, struct i2c_message *msg)
 {
-	void *buff = (void*)adapter->msg_vector.data;
-	
-	if(!buff) {
-		return -DEV_NOINIT;
-	} else if(adapter->msg_vector.length > adapter->msg_vector.limit) {
+	if(queue->length >= I2C_MSG_POOL_SIZE) {
 		return -DEV_OUTOFBOUNDS;
 	}
 	
-	if(adapter->msg_vector.length == adapter->msg_vector.limit) {
-		buff = realloc(buff, (adapter->msg_vector.limit + DEFAULT_MSG_LIMIT)*ENTRY_SIZE);
-		if(buff) {
-			adapter->msg_vector.data = buff;
-			adapter->msg_vector.limit += DEFAULT_MSG_LIMIT;
-		} else {
-			return -DEV_NULL;
-		}
-	}
-
-	if(i2c_vector_length(adapter) == 0) {
-		adapter->msg_vector.data[0] = msg;
-		adapter->msg_vector.length += 1;
-		return 0;
-	}
-
-	if(master) {
-		size_t i = 0;
-		struct i2c_message *tmp;
-		for(; i <= adapter->msg_vector.length; i++) {
-			if(i == i2c_vector_length(adapter)) {
-				adapter->msg_vector.data[i] = msg;
-				adapter->msg_vector.length += 1;
-				break;
-			}
-			tmp = adapter->msg_vector.data[i];
-			if(!i2c_msg_is_master(tmp)) {
-				i2c_vector_shift_right(&adapter->msg_vector, i, 1);
-				adapter->msg_vector.data[i] = msg;
-				break;
-			}
-		}
-	} else {
-		adapter->msg_vector.data[adapter->msg_vector.length] = msg;
-		adapter->msg_vector.length += 1;
-	}
-	return 0;
-}
-
-/**
- * \brief Delete the given message from the adapter.
- * \param adapter I2C adapter to delete from.
- * \param msg Message object to delete.
- * \return The deleted message.
- * \retval msg if the message is found.
- * \retval NULL if the message is not found.
- */
-PUBLIC struct i2c_message *i2c_vector_delete_msg(struct i2c_adapter *adapter, 
-													 struct i2c_message *msg)
-{
-	size_t i;
-	
-	if(!adapter->msg_vector.data) {
-		return PTR_ERROR(-DEV_NOINIT);
-	}
-	
-	for(i = 0; i < adapter->msg_vector.length; i++) {
-		if(adapter->msg_vector.data[i] == msg) {
-			adapter->msg_vector.data[i] = NULL;
-			if(i2c_vector_shift_left(&adapter->msg_vector, i+1)) {
-				adapter->msg_vector.length -= 1;
-			}
-			return msg;
-		}
-	}
-	
-	return NULL;
-}
-
-/**
- * \brief Erease the entire vector.
- * \param adapter Vector to erease.
- * \see i2c_create_msg_vector
- * 
- * The vector will actually be reset to its initial state, an empty vector with a limit of
- * 10 elements.
- */
-PUBLIC int i2c_vector_erase(struct i2c_adapter *adapter)
-{
-	free((void*)adapter->msg_vector.data);
-	return i2c_create_msg_vector(adapter);
-}
-
-/**
- * \brief An error has occurred, try to fix.
- * \param adapter The I2C adapter.
- * \param error The error code.
- * \return The new error code.
- * \retval 0 when fixed.
- * \retval error if no fix was made.
- * \see dev_error
- * 
- * Errors this function can fix:
-\verbatim
-		+********************+*********************************************************************+
-		| Error              | Solution                                                            |
-		+********************+*********************************************************************+
-		| DEV_NOINIT         | Create a new vector by calling i2c_create_msg_vector.               |
-		+********************+*********************************************************************+
-		| DEV_OUTOFBOUNDS    | Fix the boundries of the vector by exapanding i2c_msg_vector::limit.|
-		+********************+*********************************************************************+
-\endverbatim
- */
-PUBLIC int i2c_vector_error(struct i2c_adapter *adapter, int error)
-{
-	struct i2c_msg_vector *vector = &adapter->msg_vector;
-	
-	if(error == -DEV_NULL) {
-		return error;
-	} else {
-		error *= -1;
-		switch(error) {
-			case DEV_NOINIT:
-				error = i2c_create_msg_vector(adapter);
-				break;
-				
-			case DEV_OUTOFBOUNDS:
-				vector->data = realloc((void*)vector->data, (vector->length+1) * ENTRY_SIZE);
-				if(vector->data) {
-					vector->limit = vector->length+1;
-					error = -DEV_OK;
-				} else {
-					error = -DEV_NULL;
-				}
-				break;
-				
-			default:
-				error = -DEV_ERROR;
-				break;
-		}
-		return error;
-	}
+	queue->msgs[i2c_queue_slot(queue, queue->length)] = msg;
+	queue->length++;
+#ifdef I2C_STATS
+	i2c_stats_msg_queued(queue, msg);
+#endif
+	return -DEV_OK;
 }
 
 /**
- * \brief Insert one entry in the i2c_adapter.
- * \param adapter I2C adapter to insert into.
- * \param msg Message to insert.
- * \param index Index to insert at.
- * \return An error code.
- * \retval -DEV_OK on success.
- * \retval !-DEV_OK on error.
+ * \brief Add a message in front of all pending messages.
+ * \param queue Queue to add the message to.
+ * \param msg I2C message to add.
+ * \return Error code.
+ * \retval -DEV_OK when no error has occurred.
+ * \retval -DEV_OUTOFBOUNDS when the queue is full.
+ * \retval -DEV_ERROR when \p queue still holds completed messages.
+ * \warning Must be called with the bus interrupt disabled.
  * 
- * This function will insert \p msg in \p adapter at location \p index.
+ * The message becomes the pending message of \p queue. Completed messages have to be retired
+ * using i2c_queue_pop first.
  */
-PUBLIC int i2c_vector_insert_at(struct i2c_adapter *adapter, struct i2c_message *msg, size_t index)
+PUBLIC int i2c_queue_push_front(struct i2c_msg_queue *queue, struct i2c_message *msg)
 {
-	int rc = -DEV_NULL;
-	
-	if(!adapter->msg_vector.data) {
-		return -DEV_NOINIT;
+	if(queue->length >= I2C_MSG_POOL_SIZE) {
+		return -DEV_OUTOFBOUNDS;
+	} else if(queue->done) {
+		return -DEV_ERROR;
 	}
 	
-	if((rc = i2c_vector_shift_right(&adapter->msg_vector, index, 1)) == -DEV_OK) {
-		adapter->msg_vector.data[index] = msg;
-		return rc;
-	} else {
-		return rc;
-	}
+	queue->head = (queue->head == 0) ? I2C_MSG_POOL_SIZE - 1 : queue->head - 1;
+	queue->msgs[queue->head] = msg;
+	queue->length++;
+#ifdef I2C_STATS
+	i2c_stats_msg_queued(queue, msg);
+#endif
+	return -DEV_OK;
 }
 
 /**
- * \brief Resize the message vector.
- * \param adapter i2c_adapter containing the i2c_msg_vector.
- * \see i2c_adapter::i2c_msg_vector DEFAULT_MSG_LIMIT
- * 
- * If i2c_adapter::i2c_msg_vector::length of the vector is smaller than 
- * i2c_adapter::i2c_msg_vector::length plus the DEFAULT_MSG_LIMIT, the limit is set to 
- * i2c_adapter::i2c_msg_vector::length + DEFAULT_MSG_LIMIT.
+ * \brief Retire the oldest completed message.
+ * \param queue Queue to retire from.
+ * \return The retired message.
+ * \retval NULL if there are no completed messages.
+ * \warning Must be called with the bus interrupt disabled.
  */
-PUBLIC void i2c_vector_reshape(struct i2c_adapter *adapter)
+PUBLIC struct i2c_message *i2c_queue_pop(struct i2c_msg_queue *queue)
 {
-	struct i2c_msg_vector *vector = &adapter->msg_vector;
-	size_t lim = vector->limit;
+	struct i2c_message *msg;
 	
-	if(lim == DEFAULT_MSG_LIMIT) {
-		return;
+	if(!queue->done) {
+		return NULL;
 	}
 	
-	if((vector->length + DEFAULT_MSG_LIMIT) < vector->length) {
-		vector->data = realloc((void*)vector->data, (vector->length+DEFAULT_MSG_LIMIT)*ENTRY_SIZE);
-		vector->limit = vector->length+DEFAULT_MSG_LIMIT;
-		return;
-	}
+	msg = queue->msgs[queue->head];
+	queue->msgs[queue->head] = NULL;
+	queue->head = i2c_queue_slot(queue, 1);
+	queue->length--;
+	queue->done--;
+	return msg;
 }
 
 /**
- * \brief Shift all elements to the right.
- * \param vector The vector to shift.
- * \param index Index to start shifting at.
- * \param num Amount of shifts.
- * \return Error code.
- * \retval 0 on success.
- * \retval !0 on error.
- * \note i2c_msg_vector::length is increased by one when successful.
- * \todo Add expansion.
- */
-static int i2c_vector_shift_right(struct i2c_msg_vector *vector, size_t index, size_t num)
-{
-	size_t last;
-	if((vector->length + num) >= vector->limit) {
-		vector->data = realloc((void*)vector->data, (vector->limit+num)*ENTRY_SIZE);
-		if(!vector->data) {
-			return -DEV_NULL;
-		} else {
-			vector->limit += num;
-		}
-	}
-
-	last = vector->length - 1;
-	for(; last >= index; last--) {
-		vector->data[last+num] = vector->data[last];
-		if(last == 0) {
-			/*
-			 * This check is necessary due to the unsignedness of last.
-			 */
-			break;
-		}
-	}
-	vector->length += num;
-	return -DEV_OK;
-}
-
-/**
- * \brief Shift array indexes to the left.
- * \param vector The vector to shift.
- * \param index Index to start shifting.
- * \note To start at the first element set \p index to 0 (i.e. \p index is zero-counting).
- * \note i2c_msg_vector::length is decreased by one.
- * All values starting from \p index will be shifted 1 space to the left. So consider the following
- * array:
- * \verbatim
-*+++++++++++*++++++++++++*+++++++++++*++++++++++++*+++++++++++*
-|     5      |     4     |      7     |     3     |     9     |
-*+++++++++++*++++++++++++*+++++++++++*++++++++++++*+++++++++++*
-\endverbatim
- * If i2c_vector_shift_left is called with:
- * \code{.c}
-i2c_vector_shift_left(vector, 2);
-\endcode
- * then the array will look like:
-\verbatim
-*+++++++++++*++++++++++++*+++++++++++*++++++++++++*
-|     5      |     7     |      3     |     9     |
-*+++++++++++*++++++++++++*+++++++++++*++++++++++++*
-\endverbatim
+ * \brief Abort all pending messages.
+ * \param queue Message queue.
+ * \see i2c_queue_abort
+ * 
+ * Used when a transfer has timed out, all messages will be retired by the next clean up.
  */
-static int i2c_vector_shift_left(struct i2c_msg_vector *vector, size_t index)
+PUBLIC void i2c_queue_abort_all(struct i2c_msg_queue *queue)
 {
-	if(index >= vector->length) {
-		return 1;
-	} else {
-		if(index == 0) {
-			vector->data[0] = vector->data[1];
-			index++;
-		}
-		if(index < vector->length) {
-			for(; index < vector->length; index++) {
-				vector->data[index-1] = vector->data[index];
-			}
-		}
-		vector->length -= 1;
-		return 0;
-	}
+	while(i2c_queue_abort(queue));
 }
 
 //@}
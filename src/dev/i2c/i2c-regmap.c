@@ -0,0 +1,404 @@
+/*
+ *  BermudaOS - I2C register map
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file src/dev/i2c/i2c-regmap.c I2C register map.
+ *
+ * \addtogroup i2c-regmap I2C register map
+ * \brief Register cache for I2C devices.
+ *
+ * Most I2C devices are accessed through 8-bit registers, which are selected by writing the
+ * register address followed by a data write or a repeated start and a read. A register map
+ * caches the values of these registers, so reading a configuration register or doing a
+ * read-modify-write doesn't need a bus transaction. Registers which are changed by the device
+ * itself are described as volatile and always bypass the cache.
+ *
+ * In cache only mode writes are collected in the cache and written back by i2c_regmap_sync. The
+ * dirty registers are then written in as few messages as possible, all in one transaction.
+ *
+ * \code{.c}
+static const struct i2c_regmap_range sensor_volatile[] = { { 0x00, 0x01 } };
+static const struct i2c_regmap_config sensor_regs = {
+	.max_reg = 0x1F,
+	.volatile_ranges = sensor_volatile,
+	.num_volatile = 1,
+	.auto_increment = TRUE,
+};
+static struct i2c_regmap sensor_map;
+
+i2c_regmap_init(&sensor_map, client, &sensor_regs);
+i2c_regmap_cache_only(&sensor_map, TRUE);
+i2c_regmap_update_bits(&sensor_map, 0x10, 0x0F, 0x05);
+i2c_regmap_write(&sensor_map, 0x11, 0x80);
+i2c_regmap_cache_only(&sensor_map, FALSE);
+i2c_regmap_sync(&sensor_map); // writes 0x10 and 0x11 in one burst
+\endcode
+ * @{
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <fs/vfile.h>
+
+#include <dev/dev.h>
+#include <dev/i2c/i2c.h>
+#include <dev/i2c/reg.h>
+#include <dev/i2c/i2c-core.h>
+#include <dev/i2c/i2c-regmap.h>
+
+static int i2c_regmap_bus_read(struct i2c_regmap *map, uint8_t reg, uint8_t *val);
+static int i2c_regmap_bus_write(struct i2c_regmap *map, struct i2c_iovec *iov, uint8_t runs);
+
+/**
+ * \brief Register read transaction: register address, repeated start and value.
+ */
+static const struct i2c_segment regmap_read_segs[] = {
+	I2C_SEG_WRITE(1),
+	I2C_SEG_READ_STOP(1),
+};
+
+static const struct i2c_transaction regmap_read = I2C_TRANSACTION(regmap_read_segs);
+
+/**
+ * \brief Register write segments: repeated starts between the runs and a stop after the last.
+ * \see i2c_regmap_bus_write
+ * 
+ * A sync of <i>n</i> runs uses the last <i>n</i> segments, the lengths are taken from the buffer
+ * segments of each run.
+ */
+static const struct i2c_segment regmap_write_segs[I2C_REGMAP_SYNC_RUNS] = {
+	[0 ... I2C_REGMAP_SYNC_RUNS-1] = I2C_SEG_WRITE(0),
+	[I2C_REGMAP_SYNC_RUNS-1] = I2C_SEG_WRITE_STOP(0),
+};
+
+/**
+ * \brief Test a register bit in a bitmap.
+ * \param map Bitmap.
+ * \param reg Register address.
+ */
+static inline bool i2c_regmap_test(uint8_t *map, uint8_t reg)
+{
+	return (map[reg >> 3] & BIT(reg & 7)) != 0;
+}
+
+/**
+ * \brief Set a register bit in a bitmap.
+ * \param map Bitmap.
+ * \param reg Register address.
+ */
+static inline void i2c_regmap_set(uint8_t *map, uint8_t reg)
+{
+	map[reg >> 3] |= BIT(reg & 7);
+}
+
+/**
+ * \brief Clear a register bit in a bitmap.
+ * \param map Bitmap.
+ * \param reg Register address.
+ */
+static inline void i2c_regmap_clear(uint8_t *map, uint8_t reg)
+{
+	map[reg >> 3] &= ~BIT(reg & 7);
+}
+
+/**
+ * \brief Get the size of the register bitmaps.
+ * \param map Register map.
+ */
+static inline size_t i2c_regmap_bitmap_size(struct i2c_regmap *map)
+{
+	return (map->config->max_reg >> 3) + 1;
+}
+
+/**
+ * \brief Check if a register is volatile.
+ * \param map Register map.
+ * \param reg Register address.
+ * \retval TRUE if \p reg may not be cached.
+ */
+static bool i2c_regmap_volatile(struct i2c_regmap *map, uint8_t reg)
+{
+	const struct i2c_regmap_config *config = map->config;
+	uint8_t i;
+
+	if(reg > config->max_reg) {
+		return TRUE;
+	}
+
+	for(i = 0; i < config->num_volatile; i++) {
+		if(reg >= config->volatile_ranges[i].first && reg <= config->volatile_ranges[i].last) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/**
+ * \brief Initialize a register map.
+ * \param map Map to initialize.
+ * \param client Client of the device.
+ * \param config Description of the registers, must stay valid while \p map is used.
+ * \return 0 on success, -1 if there is not enough memory for the cache.
+ *
+ * The cache starts empty, every cacheable register is read from the device on its first access.
+ */
+PUBLIC int i2c_regmap_init(struct i2c_regmap *map, struct i2c_client *client,
+						   const struct i2c_regmap_config *config)
+{
+	size_t bitmap;
+
+	map->client = client;
+	map->config = config;
+	map->cache_only = FALSE;
+
+	bitmap = i2c_regmap_bitmap_size(map);
+	map->cache = malloc(config->max_reg + 1 + 2*bitmap);
+	if(map->cache == NULL) {
+		return -1;
+	}
+
+	map->valid = map->cache + config->max_reg + 1;
+	map->dirty = map->valid + bitmap;
+	i2c_regmap_invalidate(map);
+	return 0;
+}
+
+/**
+ * \brief Free the cache of a register map.
+ * \param map Register map.
+ * \warning Registers which have not been synchronised are lost.
+ */
+PUBLIC void i2c_regmap_destroy(struct i2c_regmap *map)
+{
+	free(map->cache);
+	map->cache = NULL;
+}
+
+/**
+ * \brief Drop all cached register values.
+ * \param map Register map.
+ * \note Call this after the device has been reset. Dirty registers are dropped as well.
+ */
+PUBLIC void i2c_regmap_invalidate(struct i2c_regmap *map)
+{
+	size_t i, bitmap = i2c_regmap_bitmap_size(map);
+
+	for(i = 0; i < bitmap; i++) {
+		map->valid[i] = 0;
+		map->dirty[i] = 0;
+	}
+}
+
+/**
+ * \brief Read a register.
+ * \param map Register map.
+ * \param reg Register address.
+ * \param val Will be set to the register value.
+ * \return 0 on success, -1 if the bus transfer failed.
+ *
+ * Cached registers are read from the cache, the device is only accessed on a cache miss or if
+ * \p reg is volatile.
+ */
+PUBLIC int i2c_regmap_read(struct i2c_regmap *map, uint8_t reg, uint8_t *val)
+{
+	if(i2c_regmap_volatile(map, reg)) {
+		return i2c_regmap_bus_read(map, reg, val);
+	}
+
+	if(!i2c_regmap_test(map->valid, reg)) {
+		if(i2c_regmap_bus_read(map, reg, &map->cache[reg])) {
+			return -1;
+		}
+		i2c_regmap_set(map->valid, reg);
+	}
+
+	*val = map->cache[reg];
+	return 0;
+}
+
+/**
+ * \brief Write a register.
+ * \param map Register map.
+ * \param reg Register address.
+ * \param val Value to write.
+ * \return 0 on success, -1 if the bus transfer failed.
+ *
+ * Writing the value a cacheable register already holds doesn't access the bus. In cache only
+ * mode the register is marked dirty instead of written. If the write fails, the register stays
+ * dirty and will be retried by i2c_regmap_sync.
+ */
+PUBLIC int i2c_regmap_write(struct i2c_regmap *map, uint8_t reg, uint8_t val)
+{
+	struct i2c_iovec iov[2];
+	bool cached = !i2c_regmap_volatile(map, reg);
+
+	if(cached) {
+		if(i2c_regmap_test(map->valid, reg) && map->cache[reg] == val &&
+			(map->cache_only || !i2c_regmap_test(map->dirty, reg))) {
+			return 0;
+		}
+
+		map->cache[reg] = val;
+		i2c_regmap_set(map->valid, reg);
+		i2c_regmap_set(map->dirty, reg);
+		if(map->cache_only) {
+			return 0;
+		}
+	}
+
+	iov[0].buff = &reg;
+	iov[0].length = 1;
+	iov[1].buff = &val;
+	iov[1].length = 1;
+	if(i2c_regmap_bus_write(map, iov, 1)) {
+		return -1;
+	}
+
+	if(cached) {
+		i2c_regmap_clear(map->dirty, reg);
+	}
+	return 0;
+}
+
+/**
+ * \brief Read-modify-write a register.
+ * \param map Register map.
+ * \param reg Register address.
+ * \param mask Bits to change.
+ * \param val New value of the bits in \p mask.
+ * \return 0 on success, -1 if a bus transfer failed.
+ * \see i2c_regmap_write
+ */
+PUBLIC int i2c_regmap_update_bits(struct i2c_regmap *map, uint8_t reg, uint8_t mask, uint8_t val)
+{
+	uint8_t old;
+
+	if(i2c_regmap_read(map, reg, &old)) {
+		return -1;
+	}
+
+	return i2c_regmap_write(map, reg, (old & ~mask) | (val & mask));
+}
+
+/**
+ * \brief Write all dirty registers to the device.
+ * \param map Register map.
+ * \return 0 on success, -1 if a bus transfer failed.
+ *
+ * Dirty registers are written in runs. If the device auto increments its register address, a
+ * run covers consecutive dirty registers, otherwise every register is a run of its own. Up to
+ * I2C_REGMAP_SYNC_RUNS runs are written in one transaction, separated by repeated starts.
+ */
+PUBLIC int i2c_regmap_sync(struct i2c_regmap *map)
+{
+	struct i2c_iovec iov[2*I2C_REGMAP_SYNC_RUNS];
+	uint8_t regs[I2C_REGMAP_SYNC_RUNS];
+	unsigned int reg = 0, last, max = map->config->max_reg;
+	uint8_t runs, i;
+	size_t j;
+
+	while(reg <= max) {
+		for(runs = 0; reg <= max && runs < I2C_REGMAP_SYNC_RUNS; reg++) {
+			if(!i2c_regmap_test(map->dirty, reg)) {
+				continue;
+			}
+
+			last = reg;
+			if(map->config->auto_increment) {
+				while(last < max && i2c_regmap_test(map->dirty, last+1)) {
+					last++;
+				}
+			}
+
+			regs[runs] = reg;
+			iov[2*runs].buff = &regs[runs];
+			iov[2*runs].length = 1;
+			iov[2*runs+1].buff = &map->cache[reg];
+			iov[2*runs+1].length = last - reg + 1;
+			runs++;
+			reg = last;
+		}
+
+		if(!runs) {
+			break;
+		}
+
+		if(i2c_regmap_bus_write(map, iov, runs)) {
+			return -1;
+		}
+
+		for(i = 0; i < runs; i++) {
+			for(j = 0; j < iov[2*i+1].length; j++) {
+				i2c_regmap_clear(map->dirty, regs[i] + j);
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Read a register from the device.
+ * \param map Register map.
+ * \param reg Register address.
+ * \param val Read buffer.
+ */
+static int i2c_regmap_bus_read(struct i2c_regmap *map, uint8_t reg, uint8_t *val)
+{
+	void *buffs[] = { &reg, val };
+	int fd, rc;
+
+	fd = i2cdev_socket(map->client, _FDEV_SETUP_RW | I2C_MASTER);
+	if(fd < 0) {
+		return -1;
+	}
+
+	rc = i2cdev_transfer(fd, &regmap_read, buffs);
+	close(fd);
+
+	return (rc < 0) ? -1 : 0;
+}
+
+/**
+ * \brief Write register runs to the device.
+ * \param map Register map.
+ * \param iov Two segments per run: the register address followed by the data.
+ * \param runs Amount of runs in \p iov, at most I2C_REGMAP_SYNC_RUNS.
+ *
+ * All runs are written in one transaction.
+ */
+static int i2c_regmap_bus_write(struct i2c_regmap *map, struct i2c_iovec *iov, uint8_t runs)
+{
+	struct i2c_transaction write;
+	int fd, rc;
+
+	fd = i2cdev_socket(map->client, _FDEV_SETUP_RW | I2C_MASTER);
+	if(fd < 0) {
+		return -1;
+	}
+
+	write.segs = &regmap_write_segs[I2C_REGMAP_SYNC_RUNS - runs];
+	write.num = runs;
+	rc = i2cdev_transferv(fd, &write, iov, 2);
+	close(fd);
+
+	return (rc < 0) ? -1 : 0;
+}
+
+// @}
@@ -25,13 +25,26 @@
 #include <dev/spi-core.h>
 
 #include <arch/io.h>
+#include <arch/irq.h>
+
+#ifdef __THREADS__
+#include <sys/events/mutex.h>
+#endif
 
 /* static functions */
-static void atmega_spi_calc_freq(uint32_t hz);
+static uint8_t atmega_spi_config(struct spi_adapter *adapter, uint32_t hz);
+static inline void atmega_spi_set_config(uint8_t cfg);
 static int atmega_spi_transfer(struct spi_adapter *adapter, struct spi_shared_info *info);
+#ifdef __THREADS__
+static void atmega_spi_select(struct spi_adapter *adapter, struct spi_shared_info *info);
+static void atmega_spi_start(struct spi_adapter *adapter);
+static void atmega_spi_deselect(struct spi_adapter *adapter, struct spi_shared_info *info);
+#endif
 
 struct spi_adapter *atmega_spi_adapter;
-static volatile void *atmega_spi_dev_mutex = SIGNALED;
+#ifdef __THREADS__
+static MUTEX atmega_spi_dev_mutex = MUTEX_INITIALIZER;
+#endif
 
 #define SPI_DEV_NAME "ATMEGA_SPI"
 
@@ -42,9 +55,13 @@ PUBLIC void atmega_spi_init()
 	atmega_spi_adapter->features = SPI_MASTER_SUPPORT;
 	spi_init_adapter(atmega_spi_adapter, SPI_DEV_NAME);
 	atmega_spi_adapter->xfer = &atmega_spi_transfer;
+	atmega_spi_adapter->config = &atmega_spi_config;
 	
 #ifdef __THREADS__
 	atmega_spi_adapter->dev->mutex = &atmega_spi_dev_mutex;
+	atmega_spi_adapter->select = &atmega_spi_select;
+	atmega_spi_adapter->start = &atmega_spi_start;
+	atmega_spi_adapter->deselect = &atmega_spi_deselect;
 #endif
 	
 	/* Setup port configuration */
@@ -56,31 +73,101 @@ PUBLIC void atmega_spi_init()
 	SPCR |= SPI_ENABLE | SPI_MASTER_ENABLE;
 }
 
-static void atmega_spi_calc_freq(uint32_t hz)
+/**
+ * \brief Compute the SPCR prescaler bits of a clock frequency.
+ * \param adapter SPI bus adapter.
+ * \param hz Requested clock frequency.
+ * \return SPR0 and SPR1 bits for SPCR.
+ * \see spi_adapter::config
+ */
+static uint8_t atmega_spi_config(struct spi_adapter *adapter, uint32_t hz)
 {
-	SPCR &= ~(SPR0 | SPR1);
 	if(hz <= SPI_FRQ(128)) {
-		SPCR |= SPR0 | SPR1;
+		return SPR0 | SPR1;
 	} else if(hz <= SPI_FRQ(64)) {
-		SPCR |= SPR1;
+		return SPR1;
 	} else if(hz <= SPI_FRQ(16)) {
-		SPCR |= SPR0;
-	} /* else pres = 4 */
+		return SPR0;
+	}
+	
+	return 0; /* pres = 4 */
+}
+
+/**
+ * \brief Apply precomputed prescaler bits.
+ * \param cfg Bits computed by atmega_spi_config.
+ */
+static inline void atmega_spi_set_config(uint8_t cfg)
+{
+	SPCR = (SPCR & ~(SPR0 | SPR1)) | cfg;
 }
 
 static int atmega_spi_transfer(struct spi_adapter *adapter, struct spi_shared_info *info)
 {
 	size_t idx;
 	
-	atmega_spi_calc_freq(info->freq);
+	atmega_spi_set_config(info->cfg);
 	*(info->cs) &= ~info->cspin;
 	
 	for(idx = 0; idx < adapter->length; idx++) {
-		SPDR = adapter->buff[idx];
+		SPDR = spi_adapter_tx(adapter, idx);
 		while(!(SPSR & BIT(SPIF)));
-		adapter->buff[idx] = SPDR;
+		spi_adapter_rx(adapter, idx, SPDR);
 	}
 	
-	*(info->cs) |= info->cspin;
+	if(!info->cs_keep) {
+		*(info->cs) |= info->cspin;
+	}
 	return 0;
 }
+
+#ifdef __THREADS__
+/**
+ * \brief Select a chip for an interrupt driven transfer.
+ * \param adapter SPI bus adapter.
+ * \param info Transfer info.
+ * \see spi_adapter::select
+ */
+static void atmega_spi_select(struct spi_adapter *adapter, struct spi_shared_info *info)
+{
+	atmega_spi_set_config(info->cfg);
+	*(info->cs) &= ~info->cspin;
+}
+
+/**
+ * \brief Transmit the first byte of spi_adapter::tx.
+ * \param adapter SPI bus adapter.
+ * \see spi_adapter::start
+ * 
+ * The remaining bytes are transmitted by the transfer complete interrupt, the CPU is free while
+ * a byte is being shifted.
+ */
+static void atmega_spi_start(struct spi_adapter *adapter)
+{
+	SPCR |= SPI_IRQ_ENABLE;
+	SPDR = spi_adapter_tx(adapter, 0);
+}
+
+/**
+ * \brief Deselect the chip after an interrupt driven transfer.
+ * \param adapter SPI bus adapter.
+ * \param info Transfer info.
+ * \see spi_adapter::deselect
+ */
+static void atmega_spi_deselect(struct spi_adapter *adapter, struct spi_shared_info *info)
+{
+	SPCR &= ~SPI_IRQ_ENABLE;
+	*(info->cs) |= info->cspin;
+}
+
+#ifndef __DOXYGEN__
+SIGNAL(SPI_STC_vect)
+{
+	uint8_t tx;
+	
+	if(spi_adapter_exchange(atmega_spi_adapter, SPDR, &tx)) {
+		SPDR = tx;
+	}
+}
+#endif
+#endif
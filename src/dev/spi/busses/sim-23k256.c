@@ -0,0 +1,175 @@
+/*
+ *  BermudaOS - Simulated 23K256 SRAM
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file src/dev/spi/busses/sim-23k256.c Simulated 23K256 SRAM.
+ *
+ * \addtogroup spi-sim
+ * @{
+ *
+ * The 23K256 model implements the instructions used by lib/spiram.c:
+ * - READ (0x03) and WRITE (0x02) take a 16 bit address, the MSB is ignored;
+ * - RDSR (0x05) and WRSR (0x01) access the status register;
+ * - in byte mode only one data byte is transferred per chip select window, in page mode the
+ *   address wraps within the 32 byte page and in sequential mode it wraps at the end of the
+ *   array.
+ */
+
+#include <stdlib.h>
+
+#include <dev/spi.h>
+#include <dev/spi/busses/sim.h>
+
+#define SIM_23K256_READ 0x3
+#define SIM_23K256_WRITE 0x2
+#define SIM_23K256_RDSR 0x5
+#define SIM_23K256_WRSR 0x1
+
+#define SIM_23K256_MODE_MASK 0xC0
+#define SIM_23K256_MODE_PAGE 0x80
+#define SIM_23K256_MODE_SEQ 0x40
+
+static void sim_23k256_select(struct spi_sim_slave *slave);
+static uint8_t sim_23k256_exchange(struct spi_sim_slave *slave, uint8_t mosi);
+static void sim_23k256_next(struct spi_sim_23k256 *ram);
+
+/**
+ * \brief Initialize a simulated 23K256.
+ * \param ram SRAM model to initialize.
+ * \param cs Chip select register of the chip.
+ * \param cspin Chip select pin of the chip.
+ * \note The model starts in byte mode with a cleared array.
+ */
+PUBLIC void spi_sim_23k256_init(struct spi_sim_23k256 *ram, reg8_t cs, uint8_t cspin)
+{
+	size_t i;
+
+	for(i = 0; i < sizeof(ram->mem); i++) {
+		ram->mem[i] = 0;
+	}
+
+	ram->status = 0;
+	ram->opcode = 0;
+	ram->phase = 0;
+	ram->addr = 0;
+	ram->done = FALSE;
+
+	ram->slave.next = NULL;
+	ram->slave.cs = cs;
+	ram->slave.cspin = cspin;
+	ram->slave.data = ram;
+	ram->slave.select = &sim_23k256_select;
+	ram->slave.exchange = &sim_23k256_exchange;
+	ram->slave.deselect = NULL;
+}
+
+/**
+ * \brief Chip select, the next byte is an instruction.
+ * \param slave 23K256 bus interface.
+ */
+static void sim_23k256_select(struct spi_sim_slave *slave)
+{
+	struct spi_sim_23k256 *ram = slave->data;
+
+	ram->phase = 0;
+	ram->done = FALSE;
+}
+
+/**
+ * \brief Exchange a byte with the 23K256.
+ * \param slave 23K256 bus interface.
+ * \param mosi Byte received by the chip.
+ * \return Byte transmitted by the chip.
+ */
+static uint8_t sim_23k256_exchange(struct spi_sim_slave *slave, uint8_t mosi)
+{
+	struct spi_sim_23k256 *ram = slave->data;
+	uint8_t miso = 0xFF;
+
+	if(ram->phase == 0) {
+		ram->opcode = mosi;
+		ram->phase = (mosi == SIM_23K256_READ || mosi == SIM_23K256_WRITE) ? 1 : 3;
+		return miso;
+	}
+
+	if(ram->phase == 1) {
+		ram->addr = (mosi & 0x7F) << 8;
+		ram->phase++;
+		return miso;
+	}
+
+	if(ram->phase == 2) {
+		ram->addr |= mosi;
+		ram->phase++;
+		return miso;
+	}
+
+	switch(ram->opcode) {
+		case SIM_23K256_RDSR:
+			miso = ram->status;
+			break;
+
+		case SIM_23K256_WRSR:
+			ram->status = mosi;
+			ram->opcode = 0;
+			break;
+
+		case SIM_23K256_READ:
+			if(!ram->done) {
+				miso = ram->mem[ram->addr];
+				sim_23k256_next(ram);
+			}
+			break;
+
+		case SIM_23K256_WRITE:
+			if(!ram->done) {
+				ram->mem[ram->addr] = mosi;
+				sim_23k256_next(ram);
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	return miso;
+}
+
+/**
+ * \brief Advance the address pointer according to the mode in the status register.
+ * \param ram SRAM model.
+ */
+static void sim_23k256_next(struct spi_sim_23k256 *ram)
+{
+	switch(ram->status & SIM_23K256_MODE_MASK) {
+		case SIM_23K256_MODE_SEQ:
+			ram->addr = (ram->addr + 1) & (SPI_SIM_23K256_SIZE - 1);
+			break;
+
+		case SIM_23K256_MODE_PAGE:
+			ram->addr = (ram->addr & ~(SPI_SIM_23K256_PAGE - 1)) |
+						((ram->addr + 1) & (SPI_SIM_23K256_PAGE - 1));
+			break;
+
+		default:
+			ram->done = TRUE;
+			break;
+	}
+}
+
+// @}
@@ -0,0 +1,247 @@
+/*
+ *  BermudaOS - Simulated SPI NOR flash
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file src/dev/spi/busses/sim-spiflash.c Simulated SPI NOR flash.
+ *
+ * \addtogroup spi-sim
+ * @{
+ *
+ * The flash model implements the common 25-series instruction set with 24 bit addresses:
+ * - READ (0x03) reads sequentially and wraps at the end of the array;
+ * - WREN (0x06) and WRDI (0x04) set and clear the write enable latch;
+ * - PP (0x02) programs up to one page, the address wraps within the page and bits can only be
+ *   cleared;
+ * - SE (0x20) erases a 4 KiB sector and CE (0xC7) erases the entire array;
+ * - RDSR (0x05) reads the status register, RDID (0x9F) reads the JEDEC id.
+ *
+ * Program and erase instructions require the write enable latch and start when the chip is
+ * deselected. The chip is then busy (WIP set) for spi_sim_flash::busy_polls status reads and
+ * ignores every instruction except RDSR.
+ */
+
+#include <stdlib.h>
+
+#include <dev/spi.h>
+#include <dev/spi/busses/sim.h>
+
+#define SIM_FLASH_READ 0x03
+#define SIM_FLASH_PP 0x02
+#define SIM_FLASH_WREN 0x06
+#define SIM_FLASH_WRDI 0x04
+#define SIM_FLASH_RDSR 0x05
+#define SIM_FLASH_SE 0x20
+#define SIM_FLASH_CE 0xC7
+#define SIM_FLASH_RDID 0x9F
+
+#define SIM_FLASH_WIP 0x01
+#define SIM_FLASH_WEL 0x02
+
+/**
+ * \brief First data phase of an instruction with an address.
+ */
+#define SIM_FLASH_DATA 4
+
+static void sim_flash_select(struct spi_sim_slave *slave);
+static uint8_t sim_flash_exchange(struct spi_sim_slave *slave, uint8_t mosi);
+static void sim_flash_deselect(struct spi_sim_slave *slave);
+static void sim_flash_erase(struct spi_sim_flash *flash, uint32_t addr, uint32_t size);
+
+/**
+ * \brief Initialize a simulated SPI flash.
+ * \param flash Flash model to initialize.
+ * \param cs Chip select register of the chip.
+ * \param cspin Chip select pin of the chip.
+ * \param mem Flash array.
+ * \param size Size of \p mem, a multiple of SPI_SIM_FLASH_SECTOR.
+ * \param busy_polls Amount of status reads during which a program or erase cycle is busy.
+ * \note The array is erased to 0xFF.
+ */
+PUBLIC void spi_sim_flash_init(struct spi_sim_flash *flash, reg8_t cs, uint8_t cspin,
+							   uint8_t *mem, uint32_t size, uint8_t busy_polls)
+{
+	flash->mem = mem;
+	flash->size = size;
+	sim_flash_erase(flash, 0, size);
+
+	flash->id[0] = 0xEF;
+	flash->id[1] = 0x40;
+	flash->id[2] = 0;
+	while((1UL << flash->id[2]) < size) {
+		flash->id[2]++; /* capacity code is log2(size) */
+	}
+
+	flash->status = 0;
+	flash->opcode = 0;
+	flash->phase = 0;
+	flash->addr = 0;
+	flash->pending = FALSE;
+	flash->busy_polls = busy_polls;
+	flash->busy = 0;
+
+	flash->slave.next = NULL;
+	flash->slave.cs = cs;
+	flash->slave.cspin = cspin;
+	flash->slave.data = flash;
+	flash->slave.select = &sim_flash_select;
+	flash->slave.exchange = &sim_flash_exchange;
+	flash->slave.deselect = &sim_flash_deselect;
+}
+
+/**
+ * \brief Chip select, the next byte is an instruction.
+ * \param slave Flash bus interface.
+ */
+static void sim_flash_select(struct spi_sim_slave *slave)
+{
+	struct spi_sim_flash *flash = slave->data;
+
+	flash->phase = 0;
+	flash->pending = FALSE;
+}
+
+/**
+ * \brief Exchange a byte with the flash.
+ * \param slave Flash bus interface.
+ * \param mosi Byte received by the chip.
+ * \return Byte transmitted by the chip.
+ */
+static uint8_t sim_flash_exchange(struct spi_sim_slave *slave, uint8_t mosi)
+{
+	struct spi_sim_flash *flash = slave->data;
+	uint8_t miso = 0xFF;
+
+	if(flash->phase == 0) {
+		flash->phase++;
+		flash->opcode = mosi;
+		flash->addr = 0;
+
+		if(flash->busy && mosi != SIM_FLASH_RDSR) {
+			flash->opcode = 0;
+			return miso;
+		}
+
+		switch(mosi) {
+			case SIM_FLASH_WREN:
+				flash->status |= SIM_FLASH_WEL;
+				break;
+
+			case SIM_FLASH_WRDI:
+				flash->status &= ~SIM_FLASH_WEL;
+				break;
+
+			case SIM_FLASH_CE:
+				flash->pending = (flash->status & SIM_FLASH_WEL) != 0;
+				break;
+
+			default:
+				break;
+		}
+		return miso;
+	}
+
+	if(flash->phase < SIM_FLASH_DATA && (flash->opcode == SIM_FLASH_READ ||
+		flash->opcode == SIM_FLASH_PP || flash->opcode == SIM_FLASH_SE)) {
+		flash->addr = (flash->addr << 8) | mosi;
+		if(++flash->phase == SIM_FLASH_DATA) {
+			flash->addr %= flash->size;
+			if(flash->opcode == SIM_FLASH_SE) {
+				flash->pending = (flash->status & SIM_FLASH_WEL) != 0;
+			}
+		}
+		return miso;
+	}
+
+	switch(flash->opcode) {
+		case SIM_FLASH_RDSR:
+			miso = flash->status;
+			if(flash->busy && --flash->busy == 0) {
+				flash->status &= ~SIM_FLASH_WIP;
+			}
+			break;
+
+		case SIM_FLASH_RDID:
+			if(flash->addr < sizeof(flash->id)) {
+				miso = flash->id[flash->addr++];
+			}
+			break;
+
+		case SIM_FLASH_READ:
+			miso = flash->mem[flash->addr];
+			flash->addr = (flash->addr + 1) % flash->size;
+			break;
+
+		case SIM_FLASH_PP:
+			if(flash->status & SIM_FLASH_WEL) {
+				flash->mem[flash->addr] &= mosi;
+				flash->addr = (flash->addr & ~(SPI_SIM_FLASH_PAGE - 1UL)) |
+							  ((flash->addr + 1) & (SPI_SIM_FLASH_PAGE - 1));
+				flash->pending = TRUE;
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	return miso;
+}
+
+/**
+ * \brief Chip deselect, start a pending program or erase cycle.
+ * \param slave Flash bus interface.
+ */
+static void sim_flash_deselect(struct spi_sim_slave *slave)
+{
+	struct spi_sim_flash *flash = slave->data;
+
+	if(!flash->pending) {
+		return;
+	}
+
+	if(flash->opcode == SIM_FLASH_SE) {
+		sim_flash_erase(flash, flash->addr & ~(SPI_SIM_FLASH_SECTOR - 1UL),
+						SPI_SIM_FLASH_SECTOR);
+	} else if(flash->opcode == SIM_FLASH_CE) {
+		sim_flash_erase(flash, 0, flash->size);
+	}
+
+	flash->pending = FALSE;
+	flash->status &= ~SIM_FLASH_WEL;
+	flash->busy = flash->busy_polls;
+	if(flash->busy) {
+		flash->status |= SIM_FLASH_WIP;
+	}
+}
+
+/**
+ * \brief Erase a range of the flash array.
+ * \param flash Flash model.
+ * \param addr First address to erase.
+ * \param size Amount of bytes to erase.
+ */
+static void sim_flash_erase(struct spi_sim_flash *flash, uint32_t addr, uint32_t size)
+{
+	uint32_t i;
+
+	for(i = 0; i < size && addr + i < flash->size; i++) {
+		flash->mem[addr + i] = 0xFF;
+	}
+}
+
+// @}
@@ -0,0 +1,274 @@
+/*
+ *  BermudaOS - SPI bus simulator
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file src/dev/spi/busses/spi-sim.c SPI bus simulator.
+ *
+ * \addtogroup spi-sim SPI bus simulator
+ * \brief Software SPI adapter.
+ *
+ * The simulator implements the spi_adapter hooks without any hardware. Polling transfers exchange
+ * their bytes synchronously with the chip models attached to the bus. Interrupt driven transfers
+ * are clocked by a virtual timer, which takes the place of the transfer complete interrupt: every
+ * system tick it shifts the amount of bytes the bus clock allows and runs each of them through
+ * spi_adapter_exchange. The calling thread blocks in the core layer meanwhile, so the double
+ * buffering of the core layer and the CPU time it frees can be measured without a physical bus.
+ *
+ * \code{.c}
+static struct spi_adapter sim_adapter;
+static struct spi_sim_bus sim_bus;
+
+spi_sim_init(&sim_bus, &sim_adapter, "SPI_SIM");
+spi_sim_add_slave(&sim_bus, &chip);
+\endcode
+ * @{
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <dev/dev.h>
+#include <dev/error.h>
+#include <dev/spi.h>
+#include <dev/spi-core.h>
+#include <dev/spi/busses/sim.h>
+
+#include <sys/virt_timer.h>
+#include <sys/events/mutex.h>
+
+/**
+ * \brief System ticks per second.
+ */
+#define SPI_SIM_TICK_FREQ 1000UL
+
+static int spi_sim_xfer(struct spi_adapter *adapter, struct spi_shared_info *info);
+static void spi_sim_select(struct spi_adapter *adapter, struct spi_shared_info *info);
+static void spi_sim_start(struct spi_adapter *adapter);
+static void spi_sim_deselect(struct spi_adapter *adapter, struct spi_shared_info *info);
+static uint8_t spi_sim_exchange(struct spi_sim_bus *bus, uint8_t mosi);
+static void spi_sim_irq(VTIMER *timer, void *arg);
+static void spi_sim_stop(struct spi_sim_bus *bus);
+
+/**
+ * \brief Initialize a simulated bus.
+ * \param bus Bus to initialize.
+ * \param adapter Adapter which will be backed by \p bus.
+ * \param name Device name of the adapter.
+ */
+PUBLIC void spi_sim_init(struct spi_sim_bus *bus, struct spi_adapter *adapter, char *name)
+{
+	spi_init_adapter(adapter, name);
+
+	bus->adapter = adapter;
+	bus->slaves = NULL;
+	bus->active = NULL;
+	bus->freq = 0;
+	bus->timer = NULL;
+	bus->tx = 0xFF;
+	spi_sim_reset_stats(bus);
+
+#ifdef __EVENTS__
+	BermudaMutexInit(&bus->mutex);
+	adapter->dev->mutex = &bus->mutex;
+#endif
+	adapter->data = bus;
+	adapter->features = SPI_MASTER_SUPPORT;
+	adapter->xfer = &spi_sim_xfer;
+	adapter->select = &spi_sim_select;
+	adapter->start = &spi_sim_start;
+	adapter->deselect = &spi_sim_deselect;
+}
+
+/**
+ * \brief Attach a chip model to a simulated bus.
+ * \param bus Simulated bus.
+ * \param slave Chip to attach.
+ */
+PUBLIC void spi_sim_add_slave(struct spi_sim_bus *bus, struct spi_sim_slave *slave)
+{
+	slave->next = bus->slaves;
+	bus->slaves = slave;
+}
+
+/**
+ * \brief Detach a chip model from a simulated bus.
+ * \param bus Simulated bus.
+ * \param slave Chip to detach.
+ */
+PUBLIC void spi_sim_remove_slave(struct spi_sim_bus *bus, struct spi_sim_slave *slave)
+{
+	struct spi_sim_slave **spp;
+
+	for(spp = &bus->slaves; *spp; spp = &(*spp)->next) {
+		if(*spp == slave) {
+			*spp = slave->next;
+			break;
+		}
+	}
+
+	if(bus->active == slave) {
+		bus->active = NULL;
+	}
+}
+
+/**
+ * \brief Polling transfer.
+ * \param adapter Bus adapter.
+ * \param info Transfer info.
+ * \see spi_adapter::xfer
+ */
+static int spi_sim_xfer(struct spi_adapter *adapter, struct spi_shared_info *info)
+{
+	struct spi_sim_bus *bus = adapter->data;
+	size_t idx;
+
+	if(!bus->active) {
+		spi_sim_select(adapter, info);
+	}
+	
+	for(idx = 0; idx < adapter->length; idx++) {
+		spi_adapter_rx(adapter, idx, spi_sim_exchange(bus, spi_adapter_tx(adapter, idx)));
+		bus->stats.polls++;
+	}
+	
+	if(!info->cs_keep) {
+		spi_sim_deselect(adapter, info);
+	}
+	return 0;
+}
+
+/**
+ * \brief Select a chip model.
+ * \param adapter Bus adapter.
+ * \param info Transfer info.
+ * \see spi_adapter::select
+ */
+static void spi_sim_select(struct spi_adapter *adapter, struct spi_shared_info *info)
+{
+	struct spi_sim_bus *bus = adapter->data;
+	struct spi_sim_slave *slave;
+
+	for(slave = bus->slaves; slave; slave = slave->next) {
+		if(slave->cs == info->cs && slave->cspin == info->cspin) {
+			break;
+		}
+	}
+
+	bus->active = slave;
+	bus->freq = info->freq;
+	bus->stats.xfers++;
+	if(slave && slave->select) {
+		slave->select(slave);
+	}
+}
+
+/**
+ * \brief Start exchanging spi_adapter::tx and spi_adapter::rx.
+ * \param adapter Bus adapter.
+ * \see spi_adapter::start
+ *
+ * Loads the first byte and returns, the bytes are shifted by spi_sim_irq from the next system
+ * tick on.
+ */
+static void spi_sim_start(struct spi_adapter *adapter)
+{
+	struct spi_sim_bus *bus = adapter->data;
+
+	bus->tx = spi_adapter_tx(adapter, 0);
+	if(!bus->timer) {
+		bus->timer = BermudaTimerCreate(1, &spi_sim_irq, bus,
+										BERMUDA_PERIODIC | BERMUDA_TIMER_INLINE);
+	}
+}
+
+/**
+ * \brief Simulated transfer complete interrupt.
+ * \param timer Bus timer.
+ * \param arg The simulated bus.
+ *
+ * Exchanges the bytes which fit in one system tick at spi_sim_bus::freq, but at least one. The
+ * timer is stopped when the transfer has completed.
+ */
+static void spi_sim_irq(VTIMER *timer, void *arg)
+{
+	struct spi_sim_bus *bus = arg;
+	unsigned long bytes = bus->freq / (8 * SPI_SIM_TICK_FREQ);
+	uint8_t rx;
+
+	if(!bytes) {
+		bytes = 1;
+	}
+
+	do {
+		rx = spi_sim_exchange(bus, bus->tx);
+		bus->stats.irqs++;
+		if(!spi_adapter_exchange(bus->adapter, rx, &bus->tx)) {
+			spi_sim_stop(bus);
+			break;
+		}
+	} while(--bytes);
+}
+
+/**
+ * \brief Stop the transfer complete interrupt.
+ * \param bus Simulated bus.
+ */
+static void spi_sim_stop(struct spi_sim_bus *bus)
+{
+	if(bus->timer) {
+		BermudaTimerStop(bus->timer);
+		bus->timer = NULL;
+	}
+}
+
+/**
+ * \brief Deselect the chip model.
+ * \param adapter Bus adapter.
+ * \param info Transfer info.
+ * \see spi_adapter::deselect
+ *
+ * A transfer which is still running (i.e. it has timed out) is aborted.
+ */
+static void spi_sim_deselect(struct spi_adapter *adapter, struct spi_shared_info *info)
+{
+	struct spi_sim_bus *bus = adapter->data;
+	struct spi_sim_slave *slave = bus->active;
+
+	spi_sim_stop(bus);
+	if(slave && slave->deselect) {
+		slave->deselect(slave);
+	}
+	bus->active = NULL;
+}
+
+/**
+ * \brief Exchange one byte with the selected chip.
+ * \param bus Simulated bus.
+ * \param mosi Byte shifted out.
+ * \return Byte shifted in, 0xFF if no chip is selected.
+ */
+static uint8_t spi_sim_exchange(struct spi_sim_bus *bus, uint8_t mosi)
+{
+	struct spi_sim_slave *slave = bus->active;
+
+	bus->stats.bytes++;
+	bus->stats.clocks += 8;
+	return (slave && slave->exchange) ? slave->exchange(slave, mosi) : 0xFF;
+}
+
+// @}
@@ -24,9 +24,18 @@
 #include <dev/spi.h>
 #include <dev/spi-core.h>
 
+#include <arch/io.h>
+
+#include <sys/events/event.h>
+
 /* static functions */
-static inline int spi_unlock_adapter(struct spi_adapter *adapter, bool master);
-static inline int spi_lock_adapter(struct spi_adapter *adapter, bool master);
+static inline int spi_unlock_adapter(struct spi_client *client, bool master);
+static inline int spi_lock_adapter(struct spi_client *client, bool master);
+static inline void spi_client_info(struct spi_client *client, struct spi_shared_info *info);
+#ifdef __THREADS__
+static int spi_xfer_wait(struct spi_adapter *adapter);
+static int spi_flush_message_irq(struct spi_client *client, struct spi_message *msg);
+#endif
 
 /**
  * \brief Initialize a spi_adapter structure.
@@ -42,6 +51,14 @@ PUBLIC void spi_init_adapter(struct spi_adapter *adapter, char *name)
 	adapter->busy = FALSE;
 	adapter->features = 0;
 	adapter->error = 0;
+	adapter->data = NULL;
+	adapter->config = NULL;
+	adapter->owner = NULL;
+	adapter->select = NULL;
+	adapter->start = NULL;
+	adapter->deselect = NULL;
+	adapter->next_length = 0;
+	adapter->queue = SIGNALED;
 }
 
 /**
@@ -49,60 +66,332 @@ PUBLIC void spi_init_adapter(struct spi_adapter *adapter, char *name)
  * \param client Client requesting the transmission.
  * \param buff Buffer to set.
  * \param size The length of \p buff.
- * \param trans_type Set to SPI_TX when \p buff is a transmit buffer. When buff is a receive buffer
- *                   \p trans_type should be set to SPI_RX.
+ * 
+ * \p buff is used as transmit and receive buffer, the received bytes overwrite the transmitted
+ * bytes.
  */
 PUBLIC int spi_set_buff(struct spi_client *client, void *buff, size_t size)
 {
 	int rc = -DEV_OK;
 	
-	client->buff = buff;
+	client->tx = buff;
+	client->rx = buff;
 	client->length = size;
 	
 	return rc;
 }
 
+/**
+ * \brief Set the transmit buffer of the next transfer.
+ * \param client Client requesting the transmission.
+ * \param tx Transmit buffer, <i>NULL</i> to transmit 0xFF.
+ * \param size The length of the transfer.
+ */
+PUBLIC int spi_set_tx(struct spi_client *client, const void *tx, size_t size)
+{
+	client->tx = tx;
+	client->length = size;
+	return -DEV_OK;
+}
+
+/**
+ * \brief Set the receive buffer of the next transfer.
+ * \param client Client requesting the transmission.
+ * \param rx Receive buffer, <i>NULL</i> to discard the received bytes.
+ * \param size The length of the transfer.
+ */
+PUBLIC int spi_set_rx(struct spi_client *client, void *rx, size_t size)
+{
+	client->rx = rx;
+	client->length = size;
+	return -DEV_OK;
+}
+
 /**
  * \brief Flush the client to the bus.
  * \param client Client to flush.
  * \retval 0 on success.
  * \return Error code. Non zero if an error has occurred.
+ * 
+ * The buffers of the client are reset after the transfer.
  */
 PUBLIC int spi_flush_client(struct spi_client *client)
+{
+	struct spi_segment seg;
+	struct spi_message msg;
+	
+	spi_segment_set(&seg, client->tx, client->rx, client->length, FALSE);
+	spi_message_init(&msg, &seg, 1);
+	
+	client->tx = NULL;
+	client->rx = NULL;
+	return spi_flush_message(client, &msg);
+}
+
+/**
+ * \brief Exchange a multi segment message.
+ * \param client Client requesting the transfer.
+ * \param msg Message to exchange.
+ * \return Error code.
+ * \retval 0 on success.
+ * \see spi_message
+ * 
+ * The adapter is locked once for the entire message. The chip stays selected between two
+ * segments, unless spi_segment::cs_change of the preceding segment is set.
+ * 
+ * \code{.c}
+uint8_t cmd[3] = { RDDA, addr >> 8, addr & 0xFF };
+struct spi_segment seg[2];
+struct spi_message msg;
+
+spi_segment_set(&seg[0], cmd, NULL, sizeof(cmd), FALSE);
+spi_segment_set(&seg[1], NULL, data, len, FALSE);
+spi_message_init(&msg, seg, 2);
+spi_flush_message(client, &msg);
+\endcode
+ */
+PUBLIC int spi_flush_message(struct spi_client *client, struct spi_message *msg)
 {
 	struct spi_adapter *adapter = client->adapter;
 	struct spi_shared_info info;
+	struct spi_segment *seg;
+	size_t idx;
+	int rc;
+	
+	if(!msg->num) {
+		return -DEV_NULL;
+	}
+	
+#ifdef __THREADS__
+	if(spi_client_is_master(client) && spi_adapter_irq_driven(adapter)) {
+		return spi_flush_message_irq(client, msg);
+	}
+#endif
 	
+	if((rc = spi_lock_adapter(client, spi_client_is_master(client)) ) == 0) {
+		spi_client_info(client, &info);
+		
+		for(idx = 0; idx < msg->num && rc == 0; idx++) {
+			seg = &msg->segments[idx];
+			adapter->tx = seg->tx;
+			adapter->rx = seg->rx;
+			adapter->length = seg->length;
+			info.cs_keep = (idx + 1 < msg->num) && !seg->cs_change;
+			
+			rc = adapter->xfer(adapter, &info);
+		}
+		spi_unlock_adapter(client, spi_client_is_master(client));
+	}
+	return rc;
+}
+
+#if defined(__THREADS__) || defined(__DOXYGEN__)
+/**
+ * \brief Start an interrupt driven transfer.
+ * \param client Client requesting the transfer.
+ * \return Error code.
+ * \retval 0 on success.
+ * \see spi_xfer_queue spi_xfer_end
+ * 
+ * Locks the adapter and selects the chip of \p client. The chip stays selected until
+ * spi_xfer_end is called, so the buffers queued in between form a single transfer.
+ * 
+ * \code{.c}
+spi_xfer_begin(client);
+spi_xfer_queue(client, cmd, NULL, sizeof(cmd));
+while(more) {
+	fill(next); // the previous buffer is still being shifted
+	spi_xfer_queue(client, next, NULL, size);
+}
+spi_xfer_end(client);
+\endcode
+ */
+PUBLIC int spi_xfer_begin(struct spi_client *client)
+{
+	struct spi_adapter *adapter = client->adapter;
+	struct spi_shared_info info;
 	int rc;
-	if((rc = spi_lock_adapter(adapter, spi_client_is_master(client)) ) == 0) {
-		adapter->buff = client->buff;
-		adapter->length = client->length;
-		info.cs = client->cs;
-		info.freq = client->freq;
-		info.cspin = client->cspin;
+	
+	if(!spi_adapter_irq_driven(adapter)) {
+		return -DEV_ERROR;
+	}
+	
+	if((rc = spi_lock_adapter(client, TRUE)) == 0) {
+		spi_client_info(client, &info);
+		adapter->busy = FALSE;
+		adapter->next_length = 0;
+		adapter->select(adapter, &info);
+	}
+	return rc;
+}
+
+/**
+ * \brief Queue a buffer of an interrupt driven transfer.
+ * \param client Client which started the transfer.
+ * \param tx Transmit buffer, <i>NULL</i> to transmit 0xFF.
+ * \param rx Receive buffer, <i>NULL</i> to discard the received bytes.
+ * \param size Length of the buffers.
+ * \return Error code.
+ * \retval 0 on success.
+ * \retval -DEV_ERROR if the current buffer timed out, spi_xfer_end still has to be called.
+ * \see spi_xfer_begin
+ * 
+ * When the bus is idle, the buffer is started right away. Otherwise it is shifted directly
+ * after the current buffer. This function only blocks when a buffer is queued already, until the
+ * current buffer has been exchanged. \p tx and \p rx must stay valid until the next call to
+ * this function has returned, or until spi_xfer_end has returned.
+ */
+PUBLIC int spi_xfer_queue(struct spi_client *client, const void *tx, void *rx, size_t size)
+{
+	struct spi_adapter *adapter = client->adapter;
+	
+	if(!size) {
+		return -DEV_NULL;
+	}
+	
+	while(1) {
+		BermudaEnterCritical();
+		if(!adapter->busy) {
+			adapter->tx = tx;
+			adapter->rx = rx;
+			adapter->length = size;
+			adapter->index = 0;
+			adapter->busy = TRUE;
+			adapter->start(adapter);
+			break;
+		}
 		
-		rc = adapter->xfer(adapter, &info);
-		spi_unlock_adapter(adapter, spi_client_is_master(client));
+		if(!adapter->next_length) {
+			adapter->next_tx = tx;
+			adapter->next_rx = rx;
+			adapter->next_length = size;
+			break;
+		}
+		BermudaExitCritical();
+		
+		if(BermudaEventWait(event(&adapter->queue), SPI_TMO) == -1) {
+			return -DEV_ERROR;
+		}
 	}
+	BermudaExitCritical();
+	
+	return -DEV_OK;
+}
+
+/**
+ * \brief End an interrupt driven transfer.
+ * \param client Client which started the transfer.
+ * \return Error code.
+ * \retval 0 if all buffers have been exchanged.
+ * \see spi_xfer_begin
+ * 
+ * Waits for the queued buffers, deselects the chip and unlocks the adapter.
+ */
+PUBLIC int spi_xfer_end(struct spi_client *client)
+{
+	struct spi_adapter *adapter = client->adapter;
+	struct spi_shared_info info;
+	int rc;
+	
+	rc = spi_xfer_wait(adapter);
+	spi_client_info(client, &info);
+	adapter->deselect(adapter, &info);
+	
+	adapter->busy = FALSE;
+	adapter->next_length = 0;
+	spi_unlock_adapter(client, TRUE);
 	return rc;
 }
 
 /**
- * \brief Lock the adapter.
+ * \brief Exchange a multi segment message using an interrupt driven transfer.
+ * \param client Client requesting the transfer.
+ * \param msg Message to exchange.
+ * \return Error code.
+ * \see spi_flush_message
+ * 
+ * Consecutive segments are queued behind each other, so the bus doesn't go idle between them.
+ */
+static int spi_flush_message_irq(struct spi_client *client, struct spi_message *msg)
+{
+	struct spi_adapter *adapter = client->adapter;
+	struct spi_shared_info info;
+	struct spi_segment *seg;
+	size_t idx;
+	int rc, end;
+	
+	if((rc = spi_xfer_begin(client)) != 0) {
+		return rc;
+	}
+	
+	spi_client_info(client, &info);
+	for(idx = 0; idx < msg->num && rc == 0; idx++) {
+		seg = &msg->segments[idx];
+		if(seg->length) {
+			rc = spi_xfer_queue(client, seg->tx, seg->rx, seg->length);
+		}
+		
+		if(rc == 0 && seg->cs_change && idx + 1 < msg->num) {
+			rc = spi_xfer_wait(adapter);
+			adapter->deselect(adapter, &info);
+			adapter->select(adapter, &info);
+		}
+	}
+	
+	end = spi_xfer_end(client);
+	return (rc) ? rc : end;
+}
+
+/**
+ * \brief Wait until all queued buffers have been exchanged.
  * \param adapter SPI bus adapter.
+ * \return 0 on success, -DEV_ERROR if the transfer timed out.
+ */
+static int spi_xfer_wait(struct spi_adapter *adapter)
+{
+	while(adapter->busy) {
+		if(BermudaEventWait(event(&adapter->queue), SPI_TMO) == -1) {
+			return -DEV_ERROR;
+		}
+	}
+	return -DEV_OK;
+}
+#endif
+
+/**
+ * \brief Fill the shared info of a transfer.
+ * \param client Client requesting the transfer.
+ * \param info Shared info to fill.
+ */
+static inline void spi_client_info(struct spi_client *client, struct spi_shared_info *info)
+{
+	info->cs = client->cs;
+	info->freq = client->freq;
+	info->cspin = client->cspin;
+	info->cfg = client->cfg;
+	info->cs_keep = FALSE;
+}
+
+/**
+ * \brief Lock the adapter.
+ * \param client Client requesting the lock.
  * \param master Set to true for master transfers, false for slave transmissions.
  * \retval 0 on success.
  * \retval -1 on failure.
  * 
- * The adapter will only be blocked if a master transfer is done.
+ * The adapter will only be blocked if a master transfer is done. Nothing is done when \p client
+ * holds the bus lock already.
+ * 
+ * \see spi_bus_lock
  */
-static inline int spi_lock_adapter(struct spi_adapter *adapter, bool master)
+static inline int spi_lock_adapter(struct spi_client *client, bool master)
 {
+	struct spi_adapter *adapter = client->adapter;
 	struct device *dev = adapter->dev;
 	int rc;
 	
-	if(master) {
-		rc = dev->alloc(dev, 500);
+	if(master && adapter->owner != client) {
+		rc = dev->alloc(dev, SPI_TMO);
 	} else {
 		rc = 0;
 	}
@@ -112,19 +401,20 @@ static inline int spi_lock_adapter(struct spi_adapter *adapter, bool master)
 
 /**
  * \brief Unlock the adpater.
- * \param adapter SPI bus adapter.
+ * \param client Client which locked the adapter.
  * \param master Set to true for master transfers, false for slave transmissions.
  * \retval 0 on success.
  * \retval -1 on failure.
  * 
- * Unlock the bus adapter.
+ * Unlock the bus adapter. The adapter stays locked when \p client holds the bus lock.
  */
-static inline int spi_unlock_adapter(struct spi_adapter *adapter, bool master)
+static inline int spi_unlock_adapter(struct spi_client *client, bool master)
 {
+	struct spi_adapter *adapter = client->adapter;
 	struct device *dev = adapter->dev;
 	int rc;
 	
-	if(master) {
+	if(master && adapter->owner != client) {
 		rc = dev->release(dev);
 	} else {
 		rc = 0;
@@ -133,6 +423,124 @@ static inline int spi_unlock_adapter(struct spi_adapter *adapter, bool master)
 	return rc;
 }
 
+/**
+ * \brief Lock the bus for a series of transfers.
+ * \param client Client which wants to own the bus.
+ * \return Error code.
+ * \retval 0 on success.
+ * \retval -DEV_ERROR if \p client holds the lock already, or the lock timed out.
+ * \see spi_bus_unlock
+ * 
+ * Transfers of \p client don't lock and unlock the adapter while it holds the bus lock, so a
+ * burst (e.g. a read-modify-write sequence) can not be interleaved with transfers of other
+ * clients. The chip select is still controlled per transfer.
+ * 
+ * \code{.c}
+spi_bus_lock(client);
+spi_transfer(client, cmd, status, sizeof(cmd));
+spi_transfer(client, update, NULL, sizeof(update));
+spi_bus_unlock(client);
+\endcode
+ */
+PUBLIC int spi_bus_lock(struct spi_client *client)
+{
+	struct spi_adapter *adapter = client->adapter;
+	
+	if(adapter->owner == client || spi_lock_adapter(client, TRUE)) {
+		return -DEV_ERROR;
+	}
+	
+	adapter->owner = client;
+	return -DEV_OK;
+}
+
+/**
+ * \brief Release the bus lock.
+ * \param client Client which owns the bus.
+ * \return Error code.
+ * \retval 0 on success.
+ * \retval -DEV_ERROR if \p client doesn't hold the bus lock.
+ * \see spi_bus_lock
+ */
+PUBLIC int spi_bus_unlock(struct spi_client *client)
+{
+	struct spi_adapter *adapter = client->adapter;
+	
+	if(adapter->owner != client) {
+		return -DEV_ERROR;
+	}
+	
+	adapter->owner = NULL;
+	return spi_unlock_adapter(client, TRUE);
+}
+
+/**
+ * \brief Open a persistent SPI handle.
+ * \param adapter Bus adapter of the chip.
+ * \param reg I/O register which contains the chip select pin.
+ * \param cs Chip select pin.
+ * \param freq Clock frequency of the chip.
+ * \param flags I/O flags, e.g. <i>_FDEV_SETUP_RW | SPI_MASTER</i>.
+ * \return The handle, <i>NULL</i> on failure.
+ * \see spi_transfer spi_close
+ * 
+ * The handle owns a socket which stays open until spi_close is called, so a transfer doesn't
+ * have to allocate a stream.
+ */
+PUBLIC struct spi_client *spi_open(struct spi_adapter *adapter, reg8_t reg, uint8_t cs,
+								   uint32_t freq, uint16_t flags)
+{
+	struct spi_client *client = spi_alloc_client(adapter, reg, cs, freq);
+	
+	if(client && spidev_socket(client, flags) < 0) {
+		free(client);
+		client = NULL;
+	}
+	
+	return client;
+}
+
+/**
+ * \brief Exchange a buffer using a persistent handle.
+ * \param client Handle opened with spi_open.
+ * \param tx Transmit buffer, <i>NULL</i> to transmit 0xFF.
+ * \param rx Receive buffer, <i>NULL</i> to discard the received bytes.
+ * \param len Length of the transfer.
+ * \return Error code.
+ * \retval 0 on success.
+ */
+PUBLIC int spi_transfer(struct spi_client *client, const void *tx, void *rx, size_t len)
+{
+	struct spi_segment seg;
+	struct spi_message msg;
+	
+	spi_segment_set(&seg, tx, rx, len, FALSE);
+	spi_message_init(&msg, &seg, 1);
+	return spi_flush_message(client, &msg);
+}
+
+/**
+ * \brief Close a persistent handle.
+ * \param client Handle to close.
+ * \return Error code.
+ * \note \p client is freed.
+ */
+PUBLIC int spi_close(struct spi_client *client)
+{
+	int rc = -DEV_OK;
+	
+	if(client->adapter->owner == client) {
+		spi_bus_unlock(client);
+	}
+	
+	if(client->stream) {
+		rc = close(client->stream->fd);
+	}
+	
+	free(client);
+	return rc;
+}
+
 /**
  * \brief Allocate a new client.
  * \param reg I/O register which contains the chip select pin.
@@ -148,6 +556,11 @@ PUBLIC struct spi_client *spi_alloc_client(struct spi_adapter *adapter, reg8_t r
 		client->cspin = cs;
 		client->adapter = adapter;
 		client->freq = freq;
+		client->cfg = (adapter->config) ? adapter->config(adapter, freq) : 0;
+		client->stream = NULL;
+		client->tx = NULL;
+		client->rx = NULL;
+		client->length = 0;
 	}
 	
 	return client;
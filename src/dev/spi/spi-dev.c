@@ -87,7 +87,8 @@ PUBLIC int spidev_close(FILE *stream)
  * \param size Length op \p tx.
  * \see write
  *
- * Do not call directly, use write instead.
+ * When no read buffer is set, the received bytes are discarded. Do not call directly, use write
+ * instead.
  */
 PUBLIC int spidev_write(FILE *stream, const void *tx, size_t size)
 {
@@ -97,7 +98,7 @@ PUBLIC int spidev_write(FILE *stream, const void *tx, size_t size)
 	if(!size) {
 		rc = -DEV_NULL;
 	} else {
-		spi_set_buff(client, (void*)tx, size);
+		spi_set_tx(client, tx, size);
 		rc = -DEV_OK;
 	}
 	return rc;
@@ -109,6 +110,9 @@ PUBLIC int spidev_write(FILE *stream, const void *tx, size_t size)
  * \param rx Read buffer.
  * \param size Length of \p rx.
  * \see read
+ * 
+ * When no write buffer is set, 0xFF is transmitted. Use the same buffer for write and read to
+ * exchange it in place.
  */
 PUBLIC int spidev_read(FILE *stream, void *rx, size_t size)
 {
@@ -118,7 +122,7 @@ PUBLIC int spidev_read(FILE *stream, void *rx, size_t size)
 	if(!size) {
 		rc = -DEV_NULL;
 	} else {
-		spi_set_buff(client, rx, size);
+		spi_set_rx(client, rx, size);
 		rc = -DEV_OK;
 	}
 	
@@ -32,6 +32,34 @@
 
 static struct i2c_client *client;
 
+static int Bermuda24c02WritePage(int fd, unsigned char *addr, const void *buf, size_t len);
+
+/**
+ * \brief Segments of a byte write: word address and data.
+ */
+static const struct i2c_segment write_byte_segs[] = {
+	I2C_SEG_WRITE_STOP(2),
+};
+
+/**
+ * \brief Segments of a random read: word address, repeated start and data.
+ */
+static const struct i2c_segment read_byte_segs[] = {
+	I2C_SEG_WRITE(1),
+	I2C_SEG_READ_STOP(1),
+};
+
+/**
+ * \brief Segments of a page write: word address and data gathered into one message.
+ */
+static const struct i2c_segment write_page_segs[] = {
+	I2C_SEG_WRITE_STOP(0),
+};
+
+static const struct i2c_transaction write_byte = I2C_TRANSACTION(write_byte_segs);
+static const struct i2c_transaction read_byte = I2C_TRANSACTION(read_byte_segs);
+static const struct i2c_transaction write_page = I2C_TRANSACTION(write_page_segs);
+
 /**
  * \brief Initialize the 24C02 driver.
  * \param iicc The I2C client
@@ -49,14 +77,13 @@ PUBLIC int Bermuda24c02WriteByte(unsigned char addr, unsigned char data)
 {
 	int rc = -1, fd;
 	unsigned char tx[] = { addr, data };
+	void *buffs[] = { tx };
 	
 	fd = i2cdev_socket(client, _FDEV_SETUP_RW | I2C_MASTER);
 	if(fd < 0) {
 		return rc;
 	}
-	i2c_set_transmission_layout(client, "w");
-	write(fd, tx, 2);
-	rc = flush(fd);
+	rc = i2cdev_transfer(fd, &write_byte, buffs);
 	close(fd);
 
 	return rc;
@@ -66,6 +93,7 @@ PUBLIC unsigned char Bermuda24c02ReadByte(unsigned char addr)
 {
 	unsigned char tx = addr;
 	unsigned char rx = 0;
+	void *buffs[] = { &tx, &rx };
 	int fd;
 	
 	fd = i2cdev_socket(client, _FDEV_SETUP_RW | I2C_MASTER);
@@ -73,11 +101,120 @@ PUBLIC unsigned char Bermuda24c02ReadByte(unsigned char addr)
 		return 0xFF;
 	}
 	
-	i2c_set_transmission_layout(client, "wr");
-	write(fd, &tx, 1);
-	read(fd, &rx, 1);
-	flush(fd);
+	i2cdev_transfer(fd, &read_byte, buffs);
 	close(fd);
 
 	return rx;
 }
+
+/**
+ * \brief Write a block of data.
+ * \param addr Address of the first byte.
+ * \param buf Data to write.
+ * \param len Amount of bytes to write.
+ * \retval 0 on success.
+ * \retval -1 on error, or when the block doesn't fit in the EEPROM.
+ * \see PAGE_24C02
+ * 
+ * The block is split on page boundaries and every page is written in one transaction. Instead of
+ * waiting a fixed write cycle time, the slave address is polled until the EEPROM acknowledges
+ * it again. This function returns when the last page has been programmed.
+ */
+PUBLIC int Bermuda24c02Write(unsigned char addr, const void *buf, size_t len)
+{
+	const unsigned char *src = buf;
+	unsigned char word = addr;
+	size_t chunk;
+	int fd, rc = 0;
+	
+	if(!len || len > SIZE_24C02 - addr) {
+		return -1;
+	}
+	
+	fd = i2cdev_socket(client, _FDEV_SETUP_RW | I2C_MASTER | I2CDEV_ACK_POLL);
+	if(fd < 0) {
+		return -1;
+	}
+	
+	while(len && rc == 0) {
+		chunk = PAGE_24C02 - (word & (PAGE_24C02 - 1));
+		if(chunk > len) {
+			chunk = len;
+		}
+		
+		rc = Bermuda24c02WritePage(fd, &word, src, chunk);
+		word += chunk;
+		src += chunk;
+		len -= chunk;
+	}
+	
+	/* poll until the last page is programmed, writing only the word address is harmless */
+	if(rc == 0) {
+		rc = Bermuda24c02WritePage(fd, &word, NULL, 0);
+	}
+	close(fd);
+	
+	return rc;
+}
+
+/**
+ * \brief Sequential read.
+ * \param addr Address of the first byte.
+ * \param buf Buffer to read into.
+ * \param len Amount of bytes to read.
+ * \retval 0 on success.
+ * \retval -1 on error, or when the block doesn't fit in the EEPROM.
+ * 
+ * The entire block is read in one transaction. When the EEPROM is still in a write cycle, its
+ * address is polled until it is acknowledged.
+ */
+PUBLIC int Bermuda24c02Read(unsigned char addr, void *buf, size_t len)
+{
+	struct i2c_segment segs[] = {
+		I2C_SEG_WRITE(1),
+		I2C_SEG_READ_STOP(1),
+	};
+	struct i2c_transaction read_seq = { segs, 2 };
+	void *buffs[] = { &addr, buf };
+	int fd, rc;
+	
+	if(!len || len > SIZE_24C02 - addr) {
+		return -1;
+	}
+	segs[1].length = len;
+	
+	fd = i2cdev_socket(client, _FDEV_SETUP_RW | I2C_MASTER | I2CDEV_ACK_POLL);
+	if(fd < 0) {
+		return -1;
+	}
+	
+	rc = i2cdev_transfer(fd, &read_seq, buffs);
+	close(fd);
+	
+	return (rc < 0) ? -1 : 0;
+}
+
+/**
+ * \brief Write one page.
+ * \param fd Socket of the EEPROM client.
+ * \param addr Word address of the first byte.
+ * \param buf Data to write, <i>NULL</i> to only write the word address.
+ * \param len Length of \p buf, may not cross a page boundary.
+ * \return 0 on success, -1 on error.
+ * 
+ * The word address and the data are sent as one message, followed by a stop condition which
+ * starts the write cycle.
+ */
+static int Bermuda24c02WritePage(int fd, unsigned char *addr, const void *buf, size_t len)
+{
+	struct i2c_iovec iov[2];
+	int rc;
+	
+	iov[0].buff = addr;
+	iov[0].length = 1;
+	iov[1].buff = (uint8_t*)buf;
+	iov[1].length = len;
+	
+	rc = i2cdev_transferv(fd, &write_page, iov, 2);
+	return (rc < 0) ? -1 : 0;
+}
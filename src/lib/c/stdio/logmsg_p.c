@@ -19,7 +19,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#ifdef __AVR__
 #include <arch/avr/pgm.h>
+#else
+#include <arch/io.h>
+#endif
 
 PUBLIC int logmsg_P(FILE *stream, const char *origin, const char *fmt, ...)
 {
@@ -0,0 +1,213 @@
+/*
+ *  BermudaOS - Ring buffer library
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file ringbuff.c */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <bermuda.h>
+
+#include <lib/ringbuff.h>
+
+/**
+ * \addtogroup ringbuff Ring buffers
+ * \brief Lock-free single producer, single consumer ring buffers.
+ *
+ * A ring buffer can be used to hand data from an ISR to a thread (or the other
+ * way around) without disabling interrupts. There can only be one producer and
+ * one consumer per buffer.
+ * @{
+ */
+
+/**
+ * \brief Initialise a ring buffer.
+ * \param rb Ring buffer to initialise.
+ * \param buff Storage of at least <i>elsize</i> * <i>length</i> bytes.
+ * \param elsize Size of a single element.
+ * \param length Amount of elements. Must be a power of two and not larger
+ *               than RINGBUFF_MAX_LENGTH.
+ * \return 0 on success, -1 on invalid arguments.
+ */
+PUBLIC int ringbuff_init(struct ringbuff *rb, void *buff, size_t elsize, size_t length)
+{
+	if(!rb || !buff || !elsize || elsize > 0xFF || !length ||
+		length > RINGBUFF_MAX_LENGTH || (length & (length - 1)) != 0) {
+		return -1;
+	}
+
+	rb->buff = buff;
+	rb->elsize = elsize;
+	rb->mask = length - 1;
+	rb->head = 0;
+	rb->tail = 0;
+#ifdef __EVENTS__
+	rb->queue = SIGNALED;
+#endif
+	return 0;
+}
+
+/**
+ * \brief Push one element.
+ * \param rb Ring buffer.
+ * \param elem Element to copy into the buffer.
+ * \return 0 on success, -1 when the buffer is full.
+ * \note Producer side only.
+ */
+PUBLIC int ringbuff_push(struct ringbuff *rb, const void *elem)
+{
+	uint8_t head = rb->head;
+
+	if((uint8_t)(head - rb->tail) > rb->mask) {
+		return -1;
+	}
+
+	ringbuff_barrier();
+	memcpy(rb->buff + (size_t)(head & rb->mask) * rb->elsize, (void*)elem, rb->elsize);
+	ringbuff_barrier();
+	rb->head = head + 1;
+	return 0;
+}
+
+/**
+ * \brief Pop one element.
+ * \param rb Ring buffer.
+ * \param elem Location to copy the element to.
+ * \return 0 on success, -1 when the buffer is empty.
+ * \note Consumer side only.
+ */
+PUBLIC int ringbuff_pop(struct ringbuff *rb, void *elem)
+{
+	uint8_t tail = rb->tail;
+
+	if(tail == rb->head) {
+		return -1;
+	}
+
+	ringbuff_barrier();
+	memcpy(elem, rb->buff + (size_t)(tail & rb->mask) * rb->elsize, rb->elsize);
+	ringbuff_barrier();
+	rb->tail = tail + 1;
+	return 0;
+}
+
+/**
+ * \brief Push a block of elements.
+ * \param rb Ring buffer.
+ * \param src Elements to push.
+ * \param num Amount of elements in <i>src</i>.
+ * \return The amount of elements actually pushed.
+ * \note Producer side only.
+ *
+ * The elements are copied in at most two chunks and published with a single
+ * index update.
+ */
+PUBLIC size_t ringbuff_write(struct ringbuff *rb, const void *src, size_t num)
+{
+	uint8_t head = rb->head;
+	size_t space = rb->mask + 1 - (uint8_t)(head - rb->tail);
+	size_t idx, chunk;
+
+	if(num > space) {
+		num = space;
+	}
+	if(!num) {
+		return 0;
+	}
+
+	ringbuff_barrier();
+	idx = head & rb->mask;
+	chunk = rb->mask + 1 - idx;
+	if(chunk > num) {
+		chunk = num;
+	}
+
+	memcpy(rb->buff + idx * rb->elsize, (void*)src, chunk * rb->elsize);
+	if(num > chunk) {
+		memcpy(rb->buff, (uint8_t*)src + chunk * rb->elsize,
+			   (num - chunk) * rb->elsize);
+	}
+
+	ringbuff_barrier();
+	rb->head = head + num;
+	return num;
+}
+
+/**
+ * \brief Pop a block of elements.
+ * \param rb Ring buffer.
+ * \param dst Location to copy the elements to.
+ * \param num Maximum amount of elements to pop.
+ * \return The amount of elements actually popped.
+ * \note Consumer side only.
+ */
+PUBLIC size_t ringbuff_read(struct ringbuff *rb, void *dst, size_t num)
+{
+	uint8_t tail = rb->tail;
+	size_t count = (uint8_t)(rb->head - tail);
+	size_t idx, chunk;
+
+	if(num > count) {
+		num = count;
+	}
+	if(!num) {
+		return 0;
+	}
+
+	ringbuff_barrier();
+	idx = tail & rb->mask;
+	chunk = rb->mask + 1 - idx;
+	if(chunk > num) {
+		chunk = num;
+	}
+
+	memcpy(dst, rb->buff + idx * rb->elsize, chunk * rb->elsize);
+	if(num > chunk) {
+		memcpy((uint8_t*)dst + chunk * rb->elsize, rb->buff,
+			   (num - chunk) * rb->elsize);
+	}
+
+	ringbuff_barrier();
+	rb->tail = tail + num;
+	return num;
+}
+
+#ifdef __EVENTS__
+/**
+ * \brief Wait for data.
+ * \param rb Ring buffer.
+ * \param tmo Time-out in milli seconds.
+ * \return 0 when data is available, -1 on time-out.
+ * \see ringbuff_notify
+ * \see ringbuff_notify_from_isr
+ * \note Consumer side only. The producer has to notify the buffer after
+ *       pushing data.
+ */
+PUBLIC int ringbuff_wait(struct ringbuff *rb, unsigned int tmo)
+{
+	while(ringbuff_empty(rb)) {
+		if(BermudaEventWait(event(&rb->queue), tmo) == -1) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+#endif
+
+// @}
@@ -0,0 +1,340 @@
+/*
+ *  BermudaOS - SPI RAM cache
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file src/lib/spiram-cache.c SPI RAM cache.
+ *
+ * \addtogroup spiram-cache SPI RAM cache
+ * \brief Write back cache in front of the SPI RAM.
+ *
+ * The cache keeps SPIRAM_CACHE_SETS * SPIRAM_CACHE_WAYS lines of the SPI RAM in internal SRAM.
+ * A line is mapped to a set by its address, within a set the least recently used line is
+ * replaced. Writes only mark a line dirty, dirty lines are written to the SPI RAM when they are
+ * replaced or when spiram_cache_flush is called.
+ *
+ * \code{.c}
+spiram_ptr log = 0x1000;
+
+spiram_ptr_write(log, &entry, sizeof(entry));
+spiram_ptr_read(log, &entry, sizeof(entry));
+spiram_cache_flush();
+\endcode
+ * @{
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <dev/error.h>
+
+#include <lib/spiram.h>
+#include <lib/spiram-cache.h>
+
+#ifdef __EVENTS__
+#include <sys/events/mutex.h>
+#endif
+
+/**
+ * \brief Line contains data.
+ */
+#define SPIRAM_LINE_VALID 0x1
+
+/**
+ * \brief Line has been changed since it was loaded.
+ */
+#define SPIRAM_LINE_DIRTY 0x2
+
+/**
+ * \brief Cache line.
+ */
+struct spiram_cache_line
+{
+	spiram_ptr base; //!< SPI RAM address of spiram_cache_line::data.
+	uint8_t flags; //!< Line flags.
+	uint8_t age; //!< Position in the LRU order of the set, 0 is the most recently used.
+	uint8_t data[SPIRAM_CACHE_LINE]; //!< Cached data.
+};
+
+/**
+ * \brief Cache lines, indexed by set.
+ */
+static struct spiram_cache_line spiram_cache[SPIRAM_CACHE_SETS][SPIRAM_CACHE_WAYS];
+
+/**
+ * \brief Cache statistics.
+ */
+static struct spiram_cache_stats spiram_cache_stats;
+
+#ifdef __EVENTS__
+static MUTEX spiram_cache_mutex = MUTEX_INITIALIZER;
+#define spiram_cache_lock() BermudaMutexLock(&spiram_cache_mutex, EVENT_WAIT_INFINITE)
+#define spiram_cache_unlock() BermudaMutexUnlock(&spiram_cache_mutex)
+#else
+#define spiram_cache_lock()
+#define spiram_cache_unlock()
+#endif
+
+static int spiram_cache_load(spiram_ptr base, bool fill, struct spiram_cache_line **line);
+static int spiram_cache_writeback(struct spiram_cache_line *line);
+static void spiram_cache_touch(struct spiram_cache_line *set, struct spiram_cache_line *line);
+
+/**
+ * \brief Initialize the cache.
+ * \note The SPI RAM has to be initialized using spiram_init first.
+ *
+ * All lines are invalidated and the statistics are reset.
+ */
+PUBLIC void spiram_cache_init(void)
+{
+	spiram_cache_invalidate();
+	spiram_cache_stats.hits = 0;
+	spiram_cache_stats.misses = 0;
+	spiram_cache_stats.writebacks = 0;
+}
+
+/**
+ * \brief Read from the SPI RAM through the cache.
+ * \param ptr Address of the first byte.
+ * \param buff Buffer to read into.
+ * \param len Amount of bytes to read.
+ * \return Error code.
+ * \retval 0 on success.
+ *
+ * Addresses wrap around at SPIRAM_SIZE.
+ */
+PUBLIC int spiram_ptr_read(spiram_ptr ptr, void *buff, size_t len)
+{
+	struct spiram_cache_line *line;
+	uint8_t *dst = buff;
+	size_t offset, chunk;
+	int rc = -DEV_OK;
+
+	spiram_cache_lock();
+	while(len) {
+		ptr &= SPIRAM_SIZE - 1;
+		offset = ptr & (SPIRAM_CACHE_LINE - 1);
+		chunk = SPIRAM_CACHE_LINE - offset;
+		if(chunk > len) {
+			chunk = len;
+		}
+
+		if((rc = spiram_cache_load(ptr - offset, TRUE, &line)) != 0) {
+			break;
+		}
+
+		memcpy(dst, &line->data[offset], chunk);
+		dst += chunk;
+		ptr += chunk;
+		len -= chunk;
+	}
+	spiram_cache_unlock();
+
+	return rc;
+}
+
+/**
+ * \brief Write to the SPI RAM through the cache.
+ * \param ptr Address of the first byte.
+ * \param buff Data to write.
+ * \param len Amount of bytes to write.
+ * \return Error code.
+ * \retval 0 on success.
+ * \see spiram_cache_flush
+ *
+ * The data is written to the SPI RAM when its line is replaced or flushed. Lines which are
+ * overwritten entirely are not read from the SPI RAM first. Addresses wrap around at
+ * SPIRAM_SIZE.
+ */
+PUBLIC int spiram_ptr_write(spiram_ptr ptr, const void *buff, size_t len)
+{
+	struct spiram_cache_line *line;
+	const uint8_t *src = buff;
+	size_t offset, chunk;
+	int rc = -DEV_OK;
+
+	spiram_cache_lock();
+	while(len) {
+		ptr &= SPIRAM_SIZE - 1;
+		offset = ptr & (SPIRAM_CACHE_LINE - 1);
+		chunk = SPIRAM_CACHE_LINE - offset;
+		if(chunk > len) {
+			chunk = len;
+		}
+
+		rc = spiram_cache_load(ptr - offset, chunk != SPIRAM_CACHE_LINE, &line);
+		if(rc) {
+			break;
+		}
+
+		memcpy(&line->data[offset], (void*)src, chunk);
+		line->flags |= SPIRAM_LINE_DIRTY;
+		src += chunk;
+		ptr += chunk;
+		len -= chunk;
+	}
+	spiram_cache_unlock();
+
+	return rc;
+}
+
+/**
+ * \brief Write all dirty lines to the SPI RAM.
+ * \return Error code.
+ * \retval 0 on success.
+ *
+ * The lines stay valid, only their dirty flag is cleared.
+ */
+PUBLIC int spiram_cache_flush(void)
+{
+	uint8_t set, way;
+	int rc = -DEV_OK, err;
+
+	spiram_cache_lock();
+	for(set = 0; set < SPIRAM_CACHE_SETS; set++) {
+		for(way = 0; way < SPIRAM_CACHE_WAYS; way++) {
+			if((err = spiram_cache_writeback(&spiram_cache[set][way])) != 0) {
+				rc = err;
+			}
+		}
+	}
+	spiram_cache_unlock();
+
+	return rc;
+}
+
+/**
+ * \brief Invalidate the cache.
+ * \warning Dirty lines are discarded, call spiram_cache_flush first to keep them.
+ */
+PUBLIC void spiram_cache_invalidate(void)
+{
+	uint8_t set, way;
+
+	spiram_cache_lock();
+	for(set = 0; set < SPIRAM_CACHE_SETS; set++) {
+		for(way = 0; way < SPIRAM_CACHE_WAYS; way++) {
+			spiram_cache[set][way].flags = 0;
+			spiram_cache[set][way].age = way;
+		}
+	}
+	spiram_cache_unlock();
+}
+
+/**
+ * \brief Get the cache statistics.
+ * \param stats Will be filled with a copy of the statistics.
+ */
+PUBLIC void spiram_cache_get_stats(struct spiram_cache_stats *stats)
+{
+	spiram_cache_lock();
+	*stats = spiram_cache_stats;
+	spiram_cache_unlock();
+}
+
+/**
+ * \brief Find or load a cache line.
+ * \param base Line aligned SPI RAM address.
+ * \param fill Set to FALSE if the caller overwrites the entire line.
+ * \param line Will be set to the line which caches \p base.
+ * \return Error code.
+ * \retval 0 on success.
+ *
+ * On a miss, the least recently used line of the set is written back when it is dirty and
+ * replaced.
+ */
+static int spiram_cache_load(spiram_ptr base, bool fill, struct spiram_cache_line **line)
+{
+	struct spiram_cache_line *set, *victim = NULL, *lru = NULL;
+	uint8_t way;
+	int rc;
+
+	set = spiram_cache[(base / SPIRAM_CACHE_LINE) & (SPIRAM_CACHE_SETS - 1)];
+	for(way = 0; way < SPIRAM_CACHE_WAYS; way++) {
+		if(!(set[way].flags & SPIRAM_LINE_VALID)) {
+			victim = &set[way];
+		} else if(set[way].base == base) {
+			spiram_cache_stats.hits++;
+			spiram_cache_touch(set, &set[way]);
+			*line = &set[way];
+			return -DEV_OK;
+		} else if(set[way].age == SPIRAM_CACHE_WAYS - 1) {
+			lru = &set[way];
+		}
+	}
+
+	if(!victim) {
+		victim = lru;
+	}
+
+	spiram_cache_stats.misses++;
+	if((rc = spiram_cache_writeback(victim)) != 0) {
+		return rc;
+	}
+
+	victim->flags = 0;
+	if(fill && (rc = spiram_read(base, victim->data, SPIRAM_CACHE_LINE)) != 0) {
+		return rc;
+	}
+
+	victim->base = base;
+	victim->flags = SPIRAM_LINE_VALID;
+	spiram_cache_touch(set, victim);
+	*line = victim;
+	return -DEV_OK;
+}
+
+/**
+ * \brief Write a line to the SPI RAM if it is dirty.
+ * \param line Line to write back.
+ * \return Error code.
+ */
+static int spiram_cache_writeback(struct spiram_cache_line *line)
+{
+	int rc;
+
+	if((line->flags & (SPIRAM_LINE_VALID | SPIRAM_LINE_DIRTY)) !=
+		(SPIRAM_LINE_VALID | SPIRAM_LINE_DIRTY)) {
+		return -DEV_OK;
+	}
+
+	if((rc = spiram_write(line->base, line->data, SPIRAM_CACHE_LINE)) == 0) {
+		line->flags &= ~SPIRAM_LINE_DIRTY;
+		spiram_cache_stats.writebacks++;
+	}
+	return rc;
+}
+
+/**
+ * \brief Mark a line as most recently used.
+ * \param set Set containing \p line.
+ * \param line Accessed line.
+ */
+static void spiram_cache_touch(struct spiram_cache_line *set, struct spiram_cache_line *line)
+{
+	uint8_t way;
+
+	for(way = 0; way < SPIRAM_CACHE_WAYS; way++) {
+		if(set[way].age < line->age) {
+			set[way].age++;
+		}
+	}
+	line->age = 0;
+}
+
+// @}
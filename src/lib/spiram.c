@@ -28,13 +28,20 @@
 #include <sys/thread.h>
 
 /**
- * \brief SPIRAM SPI adapter.
+ * \brief SPIRAM SPI handle.
  */
 static struct spi_client *client;
 
-#if 0
-static void BermudaSpiRamSetMode(spiram_t mode);
-#endif
+/**
+ * \brief Current mode of the SPI RAM.
+ * 
+ * The chip starts in byte mode after power up.
+ */
+static spiram_t spiram_mode = SPI_RAM_BYTE;
+
+static int BermudaSpiRamSetMode(spiram_t mode);
+static int spiram_transfer(uint8_t opcode, uint16_t address, const void *tx, void *rx,
+						   size_t len);
 
 /**
  * \brief Initialise the SPI ram.
@@ -43,7 +50,8 @@ static void BermudaSpiRamSetMode(spiram_t mode);
  */
 PUBLIC void spiram_init(struct spi_adapter *adapter, reg8_t port, uint8_t cs)
 {
-	client = spi_alloc_client(adapter, port, cs, SPI_1MHZ);
+	client = spi_open(adapter, port, cs, SPI_1MHZ, _FDEV_SETUP_RW | SPI_MASTER);
+	spiram_mode = SPI_RAM_BYTE;
 }
 
 /**
@@ -56,19 +64,15 @@ PUBLIC void spiram_init(struct spi_adapter *adapter, reg8_t port, uint8_t cs)
  */
 PUBLIC int spiram_write_byte(const uint16_t address, uint8_t byte)
 {
-	int fd, rc = -1;
 	uint8_t write_seq[] = {
 		WRDA, (uint8_t)((address >> 8) & 0xFF), (uint8_t)(address & 0xFF), byte,
 	};
 
-	fd = spidev_socket(client, _FDEV_SETUP_RW | SPI_MASTER);
-	if(fd >= 0) {
-		write(fd, (void*)write_seq, BERMUDA_SPIRAM_WRITE_BYTE_SEQ_LEN);
-		rc = flush(fd);
-		close(fd);
+	if(!client) {
+		return -1;
 	}
 	
-	return rc;
+	return spi_transfer(client, write_seq, NULL, BERMUDA_SPIRAM_WRITE_BYTE_SEQ_LEN);
 }
 
 /**
@@ -80,65 +84,131 @@ PUBLIC int spiram_write_byte(const uint16_t address, uint8_t byte)
  */
 PUBLIC uint8_t spiram_read_byte(unsigned int address)
 {
-	int fd;
+	uint8_t data = 0xFF;
 	uint8_t read_seq[] = {
-		RDDA, (uint8_t)((address >> 8) & 0xFF), (uint8_t)(address & 0xFF), 0xFF,
+		RDDA, (uint8_t)((address >> 8) & 0xFF), (uint8_t)(address & 0xFF),
 	};
+	struct spi_segment seg[2];
+	struct spi_message msg;
+
+	if(client) {
+		spi_segment_set(&seg[0], read_seq, NULL, sizeof(read_seq), FALSE);
+		spi_segment_set(&seg[1], NULL, &data, 1, FALSE);
+		spi_message_init(&msg, seg, 2);
+		spi_flush_message(client, &msg);
+	}
+	
+	return data;
+}
+
+/**
+ * \brief Read a block of data.
+ * \param address Address of the first byte.
+ * \param buff Buffer to store the data in.
+ * \param len Amount of bytes to read.
+ * \return Error code.
+ * \retval 0 on success.
+ * \see SPIRAM_SIZE
+ * 
+ * The chip is switched to sequential mode (once), after which the entire block is read in a
+ * single chip select window.
+ */
+PUBLIC int spiram_read(uint16_t address, void *buff, size_t len)
+{
+	return spiram_transfer(RDDA, address, NULL, buff, len);
+}
+
+/**
+ * \brief Write a block of data.
+ * \param address Address of the first byte.
+ * \param buff Data to write.
+ * \param len Amount of bytes to write.
+ * \return Error code.
+ * \retval 0 on success.
+ * \see SPIRAM_SIZE
+ * 
+ * The chip is switched to sequential mode (once), after which the entire block is written in a
+ * single chip select window.
+ */
+PUBLIC int spiram_write(uint16_t address, const void *buff, size_t len)
+{
+	return spiram_transfer(WRDA, address, buff, NULL, len);
+}
 
-	fd = spidev_socket(client, _FDEV_SETUP_RW | SPI_MASTER);
+/**
+ * \brief Sequential mode transfer.
+ * \param opcode RDDA or WRDA.
+ * \param address Address of the first byte.
+ * \param tx Data to write, <i>NULL</i> for a read.
+ * \param rx Buffer to read into, <i>NULL</i> for a write.
+ * \param len Length of the transfer.
+ * \return Error code.
+ */
+static int spiram_transfer(uint8_t opcode, uint16_t address, const void *tx, void *rx,
+						   size_t len)
+{
+	uint8_t cmd[] = {
+		opcode, (uint8_t)((address >> 8) & 0xFF), (uint8_t)(address & 0xFF),
+	};
+	struct spi_segment seg[2];
+	struct spi_message msg;
+	int rc;
+	
+	if(!len) {
+		return -DEV_NULL;
+	}
 	
-	if(fd >= 0) {
-		read(fd, (void*)read_seq, BERMUDA_SPIRAM_READ_BYTE_SEQ_LEN);
-		flush(fd);
-		close(fd);
+	if(!client) {
+		return -DEV_ERROR;
 	}
 	
-	return read_seq[3];
+	if(spiram_mode != SPI_RAM_BUF) {
+		if((rc = BermudaSpiRamSetMode(SPI_RAM_BUF)) != 0) {
+			return rc;
+		}
+	}
+	
+	spi_segment_set(&seg[0], cmd, NULL, sizeof(cmd), FALSE);
+	spi_segment_set(&seg[1], tx, rx, len, FALSE);
+	spi_message_init(&msg, seg, 2);
+	return spi_flush_message(client, &msg);
 }
 
-#if 0
 /**
  * \brief Change the SPI RAM mode.
  * \param mode New mode.
- * \note Currently only SPI_RAM_BYTE is supported.
+ * \return Error code.
+ * \retval 0 on success.
  * \see spiram_t
+ * 
+ * Single byte transfers work in every mode, so the RAM is left in the last selected mode.
  */
-static void BermudaSpiRamSetMode(spiram_t mode)
+static int BermudaSpiRamSetMode(spiram_t mode)
 {
 	unsigned char buff[2];
-	int fd;
-	if(mode <= SPI_RAM_BUF)
-	{
-		unsigned char status = HOLD;
-			
-		switch(mode)
-		{
-			case SPI_RAM_BYTE:
-				break;
-					
-			case SPI_RAM_PAGE:
-				status |= 0x80;
-				break;
-					
-			case SPI_RAM_BUF:
-				status |= 0x40;
-				break;
-
-			default:
-				status = 0;
-				break;
-		}
-			
-		buff[0] = WRSR; buff[1] = status;
-		fd = spidev_socket(client, _FDEV_SETUP_RW | SPI_MASTER);
+	unsigned char status = HOLD;
+	int rc;
 			
-		if(fd >= 0) {
-			write(fd, buff, 2);
-			read(fd, buff, 2);
-			flush(fd);
-			close(fd);
-		}
+	switch(mode) {
+		case SPI_RAM_BYTE:
+			break;
+				
+		case SPI_RAM_PAGE:
+			status |= 0x80;
+			break;
+				
+		case SPI_RAM_BUF:
+			status |= 0x40;
+			break;
+
+		default:
+			return -DEV_ERROR;
 	}
+		
+	buff[0] = WRSR; buff[1] = status;
+	if((rc = spi_transfer(client, buff, NULL, 2)) == 0) {
+		spiram_mode = mode;
+	}
+	return rc;
 }
-#endif
 
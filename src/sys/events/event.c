@@ -120,7 +120,8 @@ PUBLIC int BermudaEventWait(volatile THREAD **tqpp, unsigned int tmo)
 	if(tmo) {
 		BermudaCurrentThread->th_timer = BermudaTimerCreate(tmo, &BermudaEventTMO,
 		                                                   (void*)tqpp,
-		                                                   BERMUDA_ONE_SHOT
+		                                                   BERMUDA_ONE_SHOT |
+		                                                   BERMUDA_TIMER_INLINE
 		);
 	}
 	else {
@@ -0,0 +1,204 @@
+/*
+ *  BermudaOS - Event flags
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file flags.c */
+
+#include <bermuda.h>
+
+#include <arch/io.h>
+
+#include <sys/sched.h>
+#include <sys/thread.h>
+#include <sys/virt_timer.h>
+#include <sys/events/event.h>
+#include <sys/events/flags.h>
+
+/**
+ * \addtogroup event_flags Event flags
+ * \brief Wait for multiple event sources at once.
+ *
+ * An event flag group holds 8 flags. Flags can be set from thread context using
+ * BermudaEventFlagsSet or from an ISR using BermudaEventFlagsSetFromISR. A
+ * thread waits for any or all of a set of flags with BermudaEventFlagsWait.
+ *
+ * All waiting threads share one event queue. A flag change wakes up every
+ * waiting thread, after which each thread checks its own condition.
+ *
+ * @{
+ */
+
+/**
+ * \brief Initialise an event flag group.
+ * \param ef Flag group to initialise.
+ *
+ * All flags will be cleared.
+ */
+PUBLIC void BermudaEventFlagsInit(EVENT_FLAGS *ef)
+{
+	ef->flags = 0;
+	ef->queue = NULL;
+}
+
+/**
+ * \brief Check the wait condition.
+ * \param flags Current flags.
+ * \param mask Requested flags.
+ * \param options Wait options.
+ * \return The matched flags, 0 if the condition is not met.
+ */
+static unsigned char BermudaEventFlagsMatch(unsigned char flags, unsigned char mask,
+											unsigned char options)
+{
+	flags &= mask;
+	if(options & EVENT_FLAGS_ALL) {
+		return (flags == mask) ? flags : 0;
+	}
+
+	return flags;
+}
+
+/**
+ * \brief Set event flags.
+ * \param ef Flag group.
+ * \param mask Flags to set.
+ * \note Should not be used from interrupt context.
+ * \see BermudaEventFlagsSetFromISR
+ *
+ * All threads waiting on <i>ef</i> are woken up.
+ */
+PUBLIC void BermudaEventFlagsSet(EVENT_FLAGS *ef, unsigned char mask)
+{
+	volatile THREAD *tqp;
+
+	BermudaEnterCritical();
+	ef->flags |= mask;
+	tqp = ef->queue;
+	BermudaExitCritical();
+
+	while(tqp != NULL && tqp != SIGNALED) {
+		BermudaEventSignalRaw((THREAD*volatile*)&ef->queue);
+		BermudaEnterCritical();
+		tqp = ef->queue;
+		BermudaExitCritical();
+	}
+
+	BermudaThreadYield();
+}
+
+/**
+ * \brief Set event flags from an ISR.
+ * \param ef Flag group.
+ * \param mask Flags to set.
+ * \see BermudaEventFlagsSet
+ *
+ * The waiting threads are woken up by the scheduler. The event counter of the
+ * queue head is raised by the amount of waiting threads.
+ */
+PUBLIC void BermudaEventFlagsSetFromISR(EVENT_FLAGS *ef, unsigned char mask)
+{
+	THREAD *tqp = (THREAD*)ef->queue;
+	unsigned char waiting = 0;
+
+	ef->flags |= mask;
+	if(tqp == NULL) {
+		ef->queue = SIGNALED;
+	}
+	else if(tqp != SIGNALED) {
+		for(; tqp; tqp = tqp->next) {
+			waiting++;
+		}
+		tqp = (THREAD*)ef->queue;
+		if((unsigned char)(tqp->ec + waiting) < tqp->ec) {
+			tqp->ec = 0xFF;
+		}
+		else {
+			tqp->ec += waiting;
+		}
+	}
+}
+
+/**
+ * \brief Clear event flags.
+ * \param ef Flag group.
+ * \param mask Flags to clear.
+ */
+PUBLIC void BermudaEventFlagsClear(EVENT_FLAGS *ef, unsigned char mask)
+{
+	BermudaEnterCritical();
+	ef->flags &= ~mask;
+	BermudaExitCritical();
+}
+
+/**
+ * \brief Wait for event flags.
+ * \param ef Flag group.
+ * \param mask Flags to wait for.
+ * \param options EVENT_FLAGS_ANY or EVENT_FLAGS_ALL, optionally or'ed with
+ *                EVENT_FLAGS_CLEAR.
+ * \param tmo Time-out in milli seconds. Use EVENT_WAIT_INFINITE to wait
+ *            forever.
+ * \return The matched flags.
+ * \retval -1 if the wait timed out.
+ *
+ * Returns as soon as the condition described by <i>mask</i> and
+ * <i>options</i> is met. When EVENT_FLAGS_CLEAR is given, the matched flags
+ * are cleared atomically.
+ */
+PUBLIC int BermudaEventFlagsWait(EVENT_FLAGS *ef, unsigned char mask,
+								 unsigned char options, unsigned int tmo)
+{
+	unsigned char match;
+	unsigned long start = BermudaTimerGetSysTick(), elapsed;
+	unsigned int left = tmo;
+
+	while(1) {
+		BermudaEnterCritical();
+		match = BermudaEventFlagsMatch(ef->flags, mask, options);
+		if(match) {
+			if(options & EVENT_FLAGS_CLEAR) {
+				ef->flags &= ~match;
+			}
+			BermudaExitCritical();
+			return match;
+		}
+
+		/*
+		 * Drop a pending signal, it was caused by a flag change which has
+		 * been checked above.
+		 */
+		if(ef->queue == SIGNALED) {
+			ef->queue = NULL;
+		}
+		BermudaExitCritical();
+
+		if(tmo != EVENT_WAIT_INFINITE) {
+			elapsed = (BermudaTimerGetSysTick() - start) * 1000UL /
+														BermudaTimerGetTickFreq();
+			if(elapsed >= tmo) {
+				return -1;
+			}
+			left = tmo - elapsed;
+		}
+
+		if(BermudaEventWait(event(&ef->queue), left) == -1) {
+			return -1;
+		}
+	}
+}
+
+// @}
@@ -0,0 +1,198 @@
+/*
+ *  BermudaOS - Message queues
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file mqueue.c */
+
+#include <bermuda.h>
+
+#include <arch/io.h>
+
+#include <sys/thread.h>
+#include <sys/virt_timer.h>
+#include <sys/events/event.h>
+#include <sys/events/mqueue.h>
+
+/**
+ * \addtogroup mqueues Message queues
+ * \brief Pass messages between threads.
+ *
+ * A message queue passes pointers from a producer to a consumer. The slots are
+ * supplied by the user, so sending or receiving a message does not allocate
+ * any memory and the message itself is never copied. Messages can be posted
+ * from an ISR using BermudaMqueuePostFromISR.
+ *
+ * \code{.c}
+ * static void *log_slots[8];
+ * static MQUEUE log_queue = MQUEUE_INITIALIZER(log_slots, 8);
+ * \endcode
+ *
+ * @{
+ */
+
+/**
+ * \brief Check if threads are waiting in the given queue.
+ * \param tqp Queue head.
+ */
+static inline bool mqueue_waiting(volatile THREAD *tqp)
+{
+	return tqp != NULL && tqp != SIGNALED;
+}
+
+/**
+ * \brief Wait in one of the message queue wait queues.
+ * \param tqpp Queue to wait in.
+ * \param start System tick at which the call started.
+ * \param tmo Total time-out of the call.
+ * \return 0 when woken up, -1 when the time-out expired.
+ */
+static int mqueue_wait(volatile THREAD **tqpp, unsigned long start, unsigned int tmo)
+{
+	unsigned long elapsed;
+
+	if(tmo != EVENT_WAIT_INFINITE) {
+		elapsed = (BermudaTimerGetSysTick() - start) * 1000UL /
+													BermudaTimerGetTickFreq();
+		if(elapsed >= tmo) {
+			return -1;
+		}
+		tmo -= elapsed;
+	}
+
+	return BermudaEventWait(tqpp, tmo);
+}
+
+/**
+ * \brief Initialise a message queue.
+ * \param mq Queue to initialise.
+ * \param slots Array of <i>size</i> void pointers.
+ * \param size Amount of slots.
+ */
+PUBLIC void BermudaMqueueInit(MQUEUE *mq, void **slots, unsigned char size)
+{
+	mq->slots = slots;
+	mq->size = size;
+	mq->count = 0;
+	mq->head = 0;
+	mq->tail = 0;
+	mq->rqueue = NULL;
+	mq->squeue = NULL;
+}
+
+/**
+ * \brief Store a message in the next free slot.
+ * \param mq Message queue.
+ * \param msg Message to store.
+ * \return 0 on success, -1 when the queue is full.
+ */
+static int mqueue_put(MQUEUE *mq, void *msg)
+{
+	int rc = -1;
+
+	BermudaEnterCritical();
+	if(mq->count < mq->size) {
+		mq->slots[mq->head] = msg;
+		if(++mq->head == mq->size) {
+			mq->head = 0;
+		}
+		mq->count++;
+		rc = 0;
+	}
+	BermudaExitCritical();
+
+	return rc;
+}
+
+/**
+ * \brief Send a message.
+ * \param mq Message queue.
+ * \param msg Message to send. The receiver becomes the owner of <i>msg</i>.
+ * \param tmo Time-out in milli seconds, EVENT_WAIT_INFINITE to wait forever.
+ * \return 0 on success, -1 when no slot came available in time.
+ */
+PUBLIC int BermudaMqueueSend(MQUEUE *mq, void *msg, unsigned int tmo)
+{
+	unsigned long start = BermudaTimerGetSysTick();
+
+	while(mqueue_put(mq, msg) == -1) {
+		if(mqueue_wait(event(&mq->squeue), start, tmo) == -1) {
+			return -1;
+		}
+	}
+
+	if(mqueue_waiting(mq->rqueue)) {
+		BermudaEventSignal(event(&mq->rqueue));
+	}
+	return 0;
+}
+
+/**
+ * \brief Post a message from an ISR.
+ * \param mq Message queue.
+ * \param msg Message to post.
+ * \return 0 on success, -1 when the queue is full.
+ */
+PUBLIC int BermudaMqueuePostFromISR(MQUEUE *mq, void *msg)
+{
+	if(mqueue_put(mq, msg) == -1) {
+		return -1;
+	}
+
+	BermudaEventSignalFromISR(event(&mq->rqueue));
+	return 0;
+}
+
+/**
+ * \brief Receive a message.
+ * \param mq Message queue.
+ * \param tmo Time-out in milli seconds, EVENT_WAIT_INFINITE to wait forever.
+ * \return The received message, or NULL on time-out.
+ */
+PUBLIC void *BermudaMqueueReceive(MQUEUE *mq, unsigned int tmo)
+{
+	unsigned long start = BermudaTimerGetSysTick();
+	void *msg;
+
+	while(1) {
+		BermudaEnterCritical();
+		if(mq->count) {
+			msg = mq->slots[mq->tail];
+			if(++mq->tail == mq->size) {
+				mq->tail = 0;
+			}
+			mq->count--;
+			BermudaExitCritical();
+			break;
+		}
+		BermudaExitCritical();
+
+		/*
+		 * A SIGNALED queue means a message was posted while no thread was
+		 * waiting; BermudaEventWait returns immediately in that case.
+		 */
+		if(mqueue_wait(event(&mq->rqueue), start, tmo) == -1) {
+			return NULL;
+		}
+	}
+
+	if(mqueue_waiting(mq->squeue)) {
+		BermudaEventSignal(event(&mq->squeue));
+	}
+	return msg;
+}
+
+// @}
@@ -0,0 +1,110 @@
+/*
+ *  BermudaOS - Mutexes
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file mutex.c */
+
+#include <bermuda.h>
+
+#include <arch/io.h>
+
+#include <sys/thread.h>
+#include <sys/events/event.h>
+#include <sys/events/mutex.h>
+
+/**
+ * \addtogroup mutexes Mutexes
+ * \brief Blocking mutual exclusion locks.
+ *
+ * Unlike BermudaMutexEnter, which spins, a thread trying to take a locked
+ * mutex sleeps in the wait queue of the mutex. On unlock the ownership is
+ * handed to the waiting thread with the highest priority.
+ *
+ * @{
+ */
+
+/**
+ * \brief Initialise a mutex.
+ * \param mutex Mutex to initialise.
+ */
+PUBLIC void BermudaMutexInit(MUTEX *mutex)
+{
+	mutex->owner = NULL;
+	mutex->depth = 0;
+	mutex->queue = NULL;
+}
+
+/**
+ * \brief Slow path of BermudaMutexLock.
+ * \param mutex Mutex to lock.
+ * \param tmo Time-out in milli seconds.
+ * \return 0 when the lock is taken, -1 on time-out or when the recursion depth
+ *         overflows.
+ * \see BermudaMutexLock
+ */
+PUBLIC int BermudaMutexLockSlow(MUTEX *mutex, unsigned int tmo)
+{
+	if(mutex->owner == BermudaCurrentThread) {
+		if(mutex->depth == 0xFF) {
+			return -1;
+		}
+		mutex->depth++;
+		return 0;
+	}
+
+	/*
+	 * The owner will be set to this thread by BermudaMutexUnlockSlow before
+	 * it is woken up.
+	 */
+	return BermudaEventWait(event(&mutex->queue), tmo);
+}
+
+/**
+ * \brief Slow path of BermudaMutexUnlock.
+ * \param mutex Mutex to unlock.
+ * \return 0 on success, -1 if the current thread is not the owner.
+ * \see BermudaMutexUnlock
+ */
+PUBLIC int BermudaMutexUnlockSlow(MUTEX *mutex)
+{
+	THREAD *t;
+
+	if(mutex->owner != BermudaCurrentThread) {
+		return -1;
+	}
+
+	if(mutex->depth) {
+		mutex->depth--;
+		return 0;
+	}
+
+	BermudaEnterCritical();
+	t = (THREAD*)mutex->queue;
+	BermudaExitCritical();
+
+	if(t == NULL || t == SIGNALED) {
+		mutex->queue = NULL;
+		mutex->owner = NULL;
+		return 0;
+	}
+
+	mutex->owner = t;
+	BermudaEventSignal(event(&mutex->queue));
+	return 0;
+}
+
+// @}
@@ -0,0 +1,185 @@
+/*
+ *  BermudaOS - Reader/writer locks
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file rwlock.c */
+
+#include <bermuda.h>
+
+#include <arch/io.h>
+
+#include <sys/thread.h>
+#include <sys/virt_timer.h>
+#include <sys/events/event.h>
+#include <sys/events/rwlock.h>
+
+/**
+ * \addtogroup rwlocks Reader/writer locks
+ * \brief Shared/exclusive locks.
+ *
+ * Any number of readers can hold a reader/writer lock at the same time. A
+ * writer has exclusive access. Readers and writers only touch the lock from
+ * thread context, so the lock state itself needs no critical sections.
+ *
+ * @{
+ */
+
+/**
+ * \brief Check if threads are waiting in the given queue.
+ * \param tqp Queue head.
+ */
+static inline bool rwlock_waiting(volatile THREAD *tqp)
+{
+	return tqp != NULL && tqp != SIGNALED;
+}
+
+/**
+ * \brief Wake up all threads in the given queue.
+ * \param tqpp Queue.
+ */
+static void rwlock_wake_all(volatile THREAD **tqpp)
+{
+	while(rwlock_waiting(*tqpp)) {
+		BermudaEventSignalRaw((THREAD*volatile*)tqpp);
+	}
+}
+
+/**
+ * \brief Wait in one of the lock queues.
+ * \param tqpp Queue to wait in.
+ * \param start System tick at which the lock call started.
+ * \param tmo Total time-out of the lock call.
+ * \return 0 when woken up, -1 when the time-out expired.
+ */
+static int rwlock_wait(volatile THREAD **tqpp, unsigned long start, unsigned int tmo)
+{
+	unsigned long elapsed;
+
+	if(*tqpp == SIGNALED) {
+		*tqpp = NULL;
+	}
+
+	if(tmo != EVENT_WAIT_INFINITE) {
+		elapsed = (BermudaTimerGetSysTick() - start) * 1000UL /
+													BermudaTimerGetTickFreq();
+		if(elapsed >= tmo) {
+			return -1;
+		}
+		tmo -= elapsed;
+	}
+
+	return BermudaEventWait(tqpp, tmo);
+}
+
+/**
+ * \brief Initialise a reader/writer lock.
+ * \param lock Lock to initialise.
+ */
+PUBLIC void BermudaRwLockInit(RWLOCK *lock)
+{
+	lock->readers = 0;
+	lock->writer = NULL;
+	lock->rqueue = NULL;
+	lock->wqueue = NULL;
+}
+
+/**
+ * \brief Take a shared lock.
+ * \param lock Reader/writer lock.
+ * \param tmo Time-out in milli seconds, EVENT_WAIT_INFINITE to wait forever.
+ * \return 0 on success, -1 on time-out.
+ */
+PUBLIC int BermudaRwLockRead(RWLOCK *lock, unsigned int tmo)
+{
+	unsigned long start = BermudaTimerGetSysTick();
+
+	while(lock->writer || rwlock_waiting(lock->wqueue) || lock->readers == 0xFF) {
+		if(rwlock_wait(event(&lock->rqueue), start, tmo) == -1) {
+			return -1;
+		}
+	}
+
+	lock->readers++;
+	return 0;
+}
+
+/**
+ * \brief Take an exclusive lock.
+ * \param lock Reader/writer lock.
+ * \param tmo Time-out in milli seconds, EVENT_WAIT_INFINITE to wait forever.
+ * \return 0 on success, -1 on time-out.
+ */
+PUBLIC int BermudaRwLockWrite(RWLOCK *lock, unsigned int tmo)
+{
+	unsigned long start = BermudaTimerGetSysTick();
+
+	while(lock->writer || lock->readers) {
+		if(rwlock_wait(event(&lock->wqueue), start, tmo) == -1) {
+			/*
+			 * Readers might be held back by this writer only.
+			 */
+			if(!lock->writer && !rwlock_waiting(lock->wqueue)) {
+				rwlock_wake_all(event(&lock->rqueue));
+			}
+			return -1;
+		}
+	}
+
+	lock->writer = BermudaCurrentThread;
+	return 0;
+}
+
+/**
+ * \brief Release a shared lock.
+ * \param lock Reader/writer lock.
+ */
+PUBLIC void BermudaRwUnlockRead(RWLOCK *lock)
+{
+	if(lock->readers == 0) {
+		return;
+	}
+
+	lock->readers--;
+	if(lock->readers == 0 && rwlock_waiting(lock->wqueue)) {
+		BermudaEventSignal(event(&lock->wqueue));
+	}
+}
+
+/**
+ * \brief Release an exclusive lock.
+ * \param lock Reader/writer lock.
+ * \return 0 on success, -1 if the current thread is not the writer.
+ */
+PUBLIC int BermudaRwUnlockWrite(RWLOCK *lock)
+{
+	if(lock->writer != BermudaCurrentThread) {
+		return -1;
+	}
+
+	lock->writer = NULL;
+	if(rwlock_waiting(lock->wqueue)) {
+		BermudaEventSignalRaw((THREAD*volatile*)&lock->wqueue);
+	}
+	else {
+		rwlock_wake_all(event(&lock->rqueue));
+	}
+
+	BermudaThreadYield();
+	return 0;
+}
+
+// @}
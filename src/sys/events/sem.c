@@ -0,0 +1,134 @@
+/*
+ *  BermudaOS - Counting semaphores
+ *  Copyright (C) 2012   Michel Megens
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file sem.c */
+
+#include <bermuda.h>
+
+#include <arch/io.h>
+
+#include <sys/thread.h>
+#include <sys/events/event.h>
+#include <sys/events/sem.h>
+
+/**
+ * \addtogroup semaphores Semaphores
+ * \brief Counting semaphores.
+ *
+ * A semaphore holds a number of tokens. BermudaSemWait takes a token, or
+ * blocks until one is available. When a token is released while threads are
+ * waiting, it is handed directly to the waiting thread with the highest
+ * priority.
+ *
+ * @{
+ */
+
+/**
+ * \brief Initialise a semaphore.
+ * \param sem Semaphore to initialise.
+ * \param count Initial amount of tokens.
+ */
+PUBLIC void BermudaSemInit(SEMAPHORE *sem, unsigned short count)
+{
+	sem->count = count;
+	sem->queue = NULL;
+}
+
+/**
+ * \brief Take a token without blocking.
+ * \param sem Semaphore.
+ * \return 0 when a token was taken, -1 otherwise.
+ */
+PUBLIC int BermudaSemTryWait(SEMAPHORE *sem)
+{
+	int rc = -1;
+
+	BermudaEnterCritical();
+	if(sem->count) {
+		sem->count--;
+		rc = 0;
+	}
+	else if(sem->queue == SIGNALED) {
+		sem->queue = NULL;
+		rc = 0;
+	}
+	BermudaExitCritical();
+
+	return rc;
+}
+
+/**
+ * \brief Take a token.
+ * \param sem Semaphore.
+ * \param tmo Time-out in milli seconds, EVENT_WAIT_INFINITE to wait forever.
+ * \return 0 when a token was taken, -1 on time-out.
+ */
+PUBLIC int BermudaSemWait(SEMAPHORE *sem, unsigned int tmo)
+{
+	BermudaEnterCritical();
+	if(sem->count) {
+		sem->count--;
+		BermudaExitCritical();
+		return 0;
+	}
+	BermudaExitCritical();
+
+	/*
+	 * The token is handed over by BermudaSemSignal. A SIGNALED queue is a
+	 * token which was posted from an ISR to a thread which timed out.
+	 */
+	return BermudaEventWait(event(&sem->queue), tmo);
+}
+
+/**
+ * \brief Release a token.
+ * \param sem Semaphore.
+ * \note Should not be used from interrupt context.
+ * \see BermudaSemSignalFromISR
+ */
+PUBLIC void BermudaSemSignal(SEMAPHORE *sem)
+{
+	volatile THREAD *tqp;
+
+	BermudaEnterCritical();
+	tqp = sem->queue;
+	if(tqp == NULL || tqp == SIGNALED) {
+		sem->count++;
+		BermudaExitCritical();
+		return;
+	}
+	BermudaExitCritical();
+
+	BermudaEventSignal(event(&sem->queue));
+}
+
+/**
+ * \brief Release a token from an ISR.
+ * \param sem Semaphore.
+ */
+PUBLIC void BermudaSemSignalFromISR(SEMAPHORE *sem)
+{
+	if(sem->queue == NULL || sem->queue == SIGNALED) {
+		sem->count++;
+	}
+	else {
+		BermudaEventSignalFromISR(event(&sem->queue));
+	}
+}
+
+// @}
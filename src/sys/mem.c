@@ -28,8 +28,20 @@
 
 #include <arch/io.h>
 
+#ifdef __EVENTS__
+#include <sys/events/mutex.h>
+#endif
+
 PRIVATE WEAK volatile HEAPNODE *BermudaHeapHead = NULL;
+#ifdef __EVENTS__
+PRIVATE WEAK MUTEX             mem_lock        = MUTEX_INITIALIZER;
+#define BermudaHeapLock() BermudaMutexLock(&mem_lock, EVENT_WAIT_INFINITE)
+#define BermudaHeapUnlock() BermudaMutexUnlock(&mem_lock)
+#else
 PRIVATE WEAK mutex_t            mem_lock        = 0;
+#define BermudaHeapLock() BermudaMutexEnter(&mem_lock)
+#define BermudaHeapUnlock() BermudaMutexRelease(&mem_lock)
+#endif
 
 static inline volatile HEAPNODE *BermudaHeapInitHeader(volatile HEAPNODE *node, 
                                               size_t size);
@@ -49,7 +61,7 @@ PUBLIC __attribute__ ((malloc)) void *BermudaHeapAlloc(size_t size)
 		return NULL;
 	}
 
-	BermudaMutexEnter(&mem_lock);
+	BermudaHeapLock();
 	void *ret = NULL;
 	volatile HEAPNODE *c = BermudaHeapHead, *prev = NULL;
 	while(c) {
@@ -71,14 +83,14 @@ PUBLIC __attribute__ ((malloc)) void *BermudaHeapAlloc(size_t size)
 	if(c == NULL) {
 			printf("NM");
 			_exit();
-			BermudaMutexRelease(&mem_lock);
+			BermudaHeapUnlock();
 			return NULL;
 	}
 
 	BermudaHeapUseBlock(c, prev);
 	ret = ((void*)c)+sizeof(*c);
 
-	BermudaMutexRelease(&mem_lock);
+	BermudaHeapUnlock();
 	return ret;
 }
 
@@ -93,18 +105,16 @@ PUBLIC void *realloc(void *ptr, size_t length)
 		return malloc(length);
 	}
 	
-	BermudaMutexEnter(&mem_lock);
+	BermudaHeapLock();
 	node = ptr - sizeof(*node);
 	void *new_block = malloc(length);
 	if(new_block) {
 		memcpy(new_block, ptr, (length > node->size) ? node->size : length);
 		free(ptr);
-		return new_block;
-	} else {
-		return NULL;
 	}
-	
-	return (void*)((void*)node + sizeof(*node));
+	BermudaHeapUnlock();
+
+	return new_block;
 }
 
 /**
@@ -117,11 +127,11 @@ PUBLIC void *realloc(void *ptr, size_t length)
  */
 void BermudaHeapFree(void *ptr)
 {
-        BermudaMutexEnter(&mem_lock);
+        BermudaHeapLock();
         volatile HEAPNODE *node = ((void*)ptr)-sizeof(*node);
         if(node->magic != BERMUDA_MM_ALLOC_MAGIC)
         {
-                BermudaMutexRelease(&mem_lock);
+                BermudaHeapUnlock();
                 return;
         }
 
@@ -143,7 +153,7 @@ void BermudaHeapFree(void *ptr)
                 }
                 c = c->next;
         }
-        BermudaMutexRelease(&mem_lock);
+        BermudaHeapUnlock();
         return;
 }
 
@@ -156,7 +166,7 @@ void BermudaHeapFree(void *ptr)
  */
 size_t BermudaHeapAvailable()
 {
-        BermudaMutexEnter(&mem_lock);
+        BermudaHeapLock();
         volatile HEAPNODE *c = BermudaHeapHead;
         size_t total = 0;
         
@@ -166,14 +176,14 @@ size_t BermudaHeapAvailable()
                 c = c->next;
         }
         
-        BermudaMutexRelease(&mem_lock);
+        BermudaHeapUnlock();
         return total;
 }
 
 #ifdef __MM_DEBUG__
 void BermudaHeapPrint()
 {
-        BermudaMutexEnter(&mem_lock);
+        BermudaHeapLock();
         volatile HEAPNODE *c = BermudaHeapHead;
         unsigned short i = 0;
         while(c)
@@ -182,7 +192,7 @@ void BermudaHeapPrint()
                 i++;
                 c = c->next;
         }
-        BermudaMutexRelease(&mem_lock);
+        BermudaHeapUnlock();
         return;
 }
 #endif
@@ -235,7 +245,7 @@ PRIVATE WEAK void BermudaHeapUseBlock(volatile HEAPNODE *node,
  */
 void BermudaHeapInitBlock(volatile void *start, size_t size)
 {       
-        BermudaMutexEnter(&mem_lock);
+        BermudaHeapLock();
         if(!BermudaHeapHead)
         { // if the MM is not yet initialised
                 BermudaHeapHead = (HEAPNODE*)start;
@@ -249,7 +259,7 @@ void BermudaHeapInitBlock(volatile void *start, size_t size)
                 BermudaHeapFree((void*)start+sizeof(HEAPNODE));
         }
         
-        BermudaMutexRelease(&mem_lock);
+        BermudaHeapUnlock();
         return;
 }
 
@@ -138,7 +138,7 @@ void BermudaThreadSleep(unsigned int ms)
         BermudaCurrentThread->state = THREAD_SLEEPING;
         BermudaThreadQueueRemove(&BermudaRunQueue, BermudaCurrentThread);
         BermudaCurrentThread->th_timer = BermudaTimerCreate(ms, &BermudaThreadTimeout,
-                BermudaCurrentThread, BERMUDA_ONE_SHOT);
+                BermudaCurrentThread, BERMUDA_ONE_SHOT | BERMUDA_TIMER_INLINE);
         if(BermudaCurrentThread->th_timer)
                 BermudaThreadYield();
         else
@@ -22,6 +22,11 @@
 #include <sys/virt_timer.h>
 #include <arch/io.h>
 
+#ifdef __TIMER_THREAD__
+#include <sys/thread.h>
+#include <sys/events/event.h>
+#endif
+
 static unsigned long last_sys_tick;
 
 /**
@@ -55,6 +60,39 @@ PRIVATE WEAK VTIMER *BermudaTimerList = NULL;
  */
 PRIVATE WEAK unsigned long delay_loop_count = 0;
 
+#ifdef __TIMER_THREAD__
+/**
+ * \var BermudaTimerDeferred
+ * \brief Expired timer queue.
+ * \see BermudaTimerThread
+ * \private
+ * 
+ * FIFO list of expired timers of which the call-back still has to be executed
+ * by the timer thread. While a timer is in this list, its <b>ticks_left</b>
+ * member holds the system tick at which it expired.
+ */
+static VTIMER *BermudaTimerDeferred = NULL;
+
+/**
+ * \var BermudaTimerDeferredTail
+ * \brief Tail of the expired timer queue.
+ * \private
+ */
+static VTIMER *BermudaTimerDeferredTail = NULL;
+
+/**
+ * \var BermudaTimerQueue
+ * \brief Timer thread event queue.
+ * \private
+ */
+static volatile THREAD *BermudaTimerQueue = SIGNALED;
+
+static THREAD BermudaTimerThreadInfo;
+static char BermudaTimerThreadStack[TIMER_STACK_SIZE];
+
+THREAD_DEF(BermudaTimerThread, arg);
+#endif
+
 /**
  * \brief Initialise the timer module.
  * \note Called by the BermudaOS initialisation sequence.
@@ -66,6 +104,11 @@ PRIVATE WEAK unsigned long delay_loop_count = 0;
  */
 PUBLIC void BermudaTimerInit()
 {
+        /*
+         * The simulated tick of the host port only advances while a thread
+         * waits, there is nothing to calibrate the delay loop against.
+         */
+#ifndef __HOST__
         unsigned long count = BermudaTimerGetSysTick();
         while(count == BermudaTimerGetSysTick())
                 delay_loop_count++;
@@ -81,12 +124,18 @@ PUBLIC void BermudaTimerInit()
         delay_loop_count *= 137UL;
         delay_loop_count /= 25UL;
 #endif
+#endif
+
+#ifdef __TIMER_THREAD__
+        BermudaThreadCreate(&BermudaTimerThreadInfo, "TIMER", &BermudaTimerThread,
+                            NULL, TIMER_STACK_SIZE, &BermudaTimerThreadStack[0],
+                            TIMER_THREAD_PRIO);
+#endif
 }
 
 /**
  * \brief Delay for given amount of micro seconds.
  * \param us Amount of micro seconds to delay.
- * \todo Create a NOP definition for arch independency.
  * 
  * The CPU will busy wait for the given amount of micro seconds.
  */
@@ -95,7 +144,7 @@ PUBLIC void BermudaDelay_us(unsigned long us)
         register unsigned long count = delay_loop_count * us / 1000;
         
         while(count--)
-                __asm__ __volatile__("mov r0, r0");
+                __asm__ __volatile__("nop");
 }
 
 /**
@@ -114,10 +163,12 @@ PUBLIC void BermudaDelay(unsigned short ms)
  * \param ms Time until it will fire in milli seconds.
  * \param fn Fire function.
  * \param arg Argument passed to <b>fn</b>.
- * \param flags Can be set to either BERMUDA_PERIODIC or BERMUDA_ONE_SHOT
+ * \param flags Can be set to either BERMUDA_PERIODIC or BERMUDA_ONE_SHOT,
+ *              optionally or'ed with BERMUDA_TIMER_INLINE.
  * \return The created timer object.
  * \see BERMUDA_ONE_SHOT
  * \see BERMUDA_PERIODIC
+ * \see BERMUDA_TIMER_INLINE
  * \see BermudaSchedulerExec
  * \note Each time BermudaSchedulerExec is called the timer list is processed.
  *       If threads are not available, they will be handled in the timer interrupt.
@@ -141,6 +192,7 @@ PUBLIC VTIMER *BermudaTimerCreate(unsigned long ms, vtimer_callback fn, void *ar
                 timer->ticks_left = ticks+BermudaTimerGetSysTick()-last_sys_tick;
                 timer->handle = fn;
                 timer->arg = arg;
+                timer->flags = flags & BERMUDA_TIMER_INLINE;
                 timer->next = NULL;
                 BermudaTimerAdd(timer);
         }
@@ -155,7 +207,8 @@ PUBLIC VTIMER *BermudaTimerCreate(unsigned long ms, vtimer_callback fn, void *ar
  * \see BermudaTimerProcess
  * 
  * The handle, ticks and ticks_left will be set to zero. This will cause 
- * BermudaTimerProcess to stop the timer from executing.
+ * BermudaTimerProcess to stop the timer from executing. Timers which are
+ * queued for the timer thread will be freed by the timer thread.
  */
 PUBLIC void BermudaTimerStop(VTIMER *timer)
 {
@@ -163,6 +216,11 @@ PUBLIC void BermudaTimerStop(VTIMER *timer)
         timer->handle = NULL;
         timer->ticks = 0;
 
+#ifdef __TIMER_THREAD__
+        if(timer->flags & BERMUDA_TIMER_DEFERRED)
+                return;
+#endif
+
         if(timer->ticks_left)
         { // if not yet elapsed
                 while(tqp)
@@ -224,12 +282,84 @@ PRIVATE WEAK void BermudaTimerAdd(VTIMER *timer)
                 BermudaTimerList = timer;
 }
 
+#ifdef __TIMER_THREAD__
+/**
+ * \brief Queue an expired timer for the timer thread.
+ * \param timer Expired timer.
+ * \param tick System tick at which <i>timer</i> expired.
+ * \private
+ * 
+ * The timer is appended to the deferred queue and the timer thread is woken
+ * up. This function is called from within the scheduler, so the event is
+ * signaled without yielding.
+ */
+static void BermudaTimerDefer(VTIMER *timer, unsigned long tick)
+{
+        timer->next = NULL;
+        timer->ticks_left = tick;
+        timer->flags |= BERMUDA_TIMER_DEFERRED;
+        
+        if(BermudaTimerDeferredTail)
+                BermudaTimerDeferredTail->next = timer;
+        else
+                BermudaTimerDeferred = timer;
+        BermudaTimerDeferredTail = timer;
+        
+        BermudaEventSignalRaw((THREAD*volatile*)&BermudaTimerQueue);
+}
+
+/**
+ * \brief Timer thread.
+ * \see BermudaTimerDefer
+ * 
+ * Executes the call-backs of expired timers which are not flagged with
+ * BERMUDA_TIMER_INLINE. Periodic timers are re-armed relative to the tick at
+ * which they expired, so a late call-back does not make the timer drift.
+ */
+THREAD(BermudaTimerThread, arg)
+{
+        VTIMER *timer;
+        unsigned long next;
+        
+        while(1)
+        {
+                BermudaEventWait(event(&BermudaTimerQueue), EVENT_WAIT_INFINITE);
+                while((timer = BermudaTimerDeferred) != NULL)
+                {
+                        BermudaTimerDeferred = timer->next;
+                        if(BermudaTimerDeferred == NULL)
+                                BermudaTimerDeferredTail = NULL;
+                        timer->next = NULL;
+                        
+                        if(timer->handle)
+                                timer->handle(timer, timer->arg);
+                        
+                        timer->flags &= ~BERMUDA_TIMER_DEFERRED;
+                        if(timer->ticks == 0)
+                        {
+                                BermudaHeapFree(timer);
+                                continue;
+                        }
+                        
+                        next = timer->ticks_left + timer->ticks;
+                        if((long)(next - last_sys_tick) > 0)
+                                timer->ticks_left = next - last_sys_tick;
+                        else
+                                timer->ticks_left = 1; // overdue, fire asap
+                        BermudaTimerAdd(timer);
+                }
+        }
+}
+#endif
+
 /**
  * \fn BermudaTimerProcess()
  * \brief Process all virtual timers.
  * 
  * Update all virtual timers. This action is done before switching context by
- * default.
+ * default. When the timer thread is enabled, only timers flagged with
+ * BERMUDA_TIMER_INLINE are executed here; all other expired timers are handed
+ * over to the timer thread.
  */
 PUBLIC void BermudaTimerProcess()
 {
@@ -261,6 +391,15 @@ PUBLIC void BermudaTimerProcess()
                 // timer elapsed when ticks_left == 0
                 if(timer->ticks_left == 0)
                 {
+#ifdef __TIMER_THREAD__
+                        if(timer->handle && 
+                                (timer->flags & BERMUDA_TIMER_INLINE) == 0)
+                        {
+                                BermudaTimerList = timer->next;
+                                BermudaTimerDefer(timer, new_ticks - diff);
+                                continue;
+                        }
+#endif
                         if(timer->handle)
                                 timer->handle(timer, timer->arg);
                         
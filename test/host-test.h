@@ -0,0 +1,90 @@
+/*
+ *  BermudaOS - Host test helpers
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file test/host-test.h Host test helpers.
+ *
+ * Test programs are run by <i>make check</i> on the host port. A test program returns the
+ * amount of failed checks from main, so the test fails when any check fails.
+ */
+
+#ifndef __HOST_TEST_H
+#define __HOST_TEST_H
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <arch/io.h>
+
+/**
+ * \brief Amount of failed checks.
+ */
+static int test_failures = 0;
+
+/**
+ * \brief Check a condition.
+ * \param expr Condition which has to be true.
+ */
+#define test_assert(expr) __test_assert((expr) != 0, #expr, __FILE__, __LINE__)
+
+/**
+ * \brief Report a failed check.
+ * \param ok Result of the check.
+ * \param expr Checked expression.
+ * \param file Source file of the check.
+ * \param line Line of the check.
+ */
+static inline void __test_assert(bool ok, const char *expr, const char *file, int line)
+{
+	if(!ok) {
+		printf("%s:%i: check failed: %s\n", file, line, expr);
+		test_failures++;
+	}
+}
+
+/**
+ * \brief Compare two buffers.
+ * \param a First buffer.
+ * \param b Second buffer.
+ * \param len Amount of bytes to compare.
+ * \return TRUE if the buffers are equal.
+ */
+static inline bool test_equal(const void *a, const void *b, size_t len)
+{
+	const uint8_t *pa = a, *pb = b;
+
+	while(len--) {
+		if(*pa++ != *pb++) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * \brief Finish a test program.
+ * \param name Name of the test.
+ * \return Value to return from main.
+ */
+static inline int test_done(const char *name)
+{
+	printf("%s: %s\n", name, test_failures ? "FAIL" : "PASS");
+	return test_failures;
+}
+
+#endif /* __HOST_TEST_H */
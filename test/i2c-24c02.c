@@ -0,0 +1,328 @@
+/*
+ *  BermudaOS - I2C core test
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file test/i2c-24c02.c I2C core test.
+ *
+ * Drives the 24C02 library, the I2C device layer and the I2C core through the simulated I2C bus
+ * and checks the result against the 24C02 model.
+ */
+
+#include "host-test.h"
+
+#include <fs/vfile.h>
+
+#include <dev/i2c/i2c.h>
+#include <dev/i2c/reg.h>
+#include <dev/i2c/i2c-core.h>
+#include <dev/i2c/busses/sim.h>
+
+#include <lib/24c02.h>
+
+/**
+ * \brief Address polls the EEPROM model NACKs after a page write.
+ */
+#define TWR_POLLS 3
+
+/**
+ * \brief Address of the slave which holds SCL low.
+ */
+#define STUCK_SLA 0x30
+
+/**
+ * \brief Slave model which holds SCL low when it is addressed.
+ */
+struct test_stuck
+{
+	struct i2c_sim_slave slave; //!< Bus interface.
+	unsigned int starts; //!< Amount of times the slave was addressed.
+	unsigned int bytes; //!< Amount of bytes written to the slave.
+	bool hold; //!< Hold SCL low at the next address phase.
+};
+
+static struct i2c_adapter sim_adapter;
+static struct i2c_sim_bus sim_bus;
+static struct i2c_sim_24c02 sim_eeprom;
+static struct test_stuck sim_stuck;
+
+static void test_byte(void);
+static void test_block(void);
+static void test_nack(void);
+static void test_async(struct i2c_client *client);
+static void test_stale(struct i2c_client *client);
+static int stale_write(struct i2c_client *client);
+static void test_complete(struct i2c_xfer *xfer);
+static int test_stuck_start(struct i2c_sim_slave *slave, bool read);
+static int test_stuck_write(struct i2c_sim_slave *slave, uint8_t data);
+
+/**
+ * \brief Segments of an asynchronous byte write.
+ */
+static const struct i2c_segment async_write_segs[] = {
+	I2C_SEG_WRITE_STOP(2),
+};
+
+static const struct i2c_transaction async_write = I2C_TRANSACTION(async_write_segs);
+
+/**
+ * \brief Segments of a write to the slave which holds SCL low.
+ */
+static const struct i2c_segment stuck_write_segs[] = {
+	I2C_SEG_WRITE_STOP(1),
+};
+
+static const struct i2c_transaction stuck_write = I2C_TRANSACTION(stuck_write_segs);
+
+int main(void)
+{
+	struct i2c_client *client;
+
+	BermudaHostInit();
+	test_assert(i2c_sim_init(&sim_bus, &sim_adapter, "I2C_SIM") == 0);
+	i2c_sim_24c02_init(&sim_eeprom, BASE_SLA_24C02, TWR_POLLS);
+	i2c_sim_add_slave(&sim_bus, &sim_eeprom.slave);
+
+	client = i2c_alloc_client(&sim_adapter, BASE_SLA_24C02, SCL_FRQ_24C02);
+	test_assert(client != NULL);
+	Bermuda24c02Init(client);
+
+	test_byte();
+	test_block();
+	test_nack();
+	test_async(client);
+	test_stale(client);
+
+	return test_done("i2c-24c02");
+}
+
+/**
+ * \brief Single byte access.
+ *
+ * A byte read right after a byte write is not acknowledged while the write cycle runs.
+ */
+static void test_byte(void)
+{
+	int i;
+
+	test_assert(Bermuda24c02WriteByte(0x10, 0xAB) == 0);
+	test_assert(sim_eeprom.mem[0x10] == 0xAB);
+	test_assert(sim_eeprom.busy == TWR_POLLS);
+
+	for(i = 0; i < TWR_POLLS; i++) {
+		test_assert(Bermuda24c02ReadByte(0x10) == 0);
+	}
+	test_assert(Bermuda24c02ReadByte(0x10) == 0xAB);
+}
+
+/**
+ * \brief Page writes and a sequential read.
+ *
+ * The block crosses two page boundaries. The library polls the address after every page, so
+ * the block can be read back immediately.
+ */
+static void test_block(void)
+{
+	uint8_t tx[20], rx[sizeof(tx)];
+	size_t i;
+
+	for(i = 0; i < sizeof(tx); i++) {
+		tx[i] = i * 7 + 1;
+		rx[i] = 0;
+	}
+
+	i2c_sim_reset_stats(&sim_bus);
+	test_assert(Bermuda24c02Write(0x05, tx, sizeof(tx)) == 0);
+	test_assert(test_equal(&sim_eeprom.mem[0x05], tx, sizeof(tx)));
+	test_assert(sim_eeprom.mem[0x04] == 0xFF);
+	test_assert(sim_eeprom.mem[0x05 + sizeof(tx)] == 0xFF);
+
+	/* 4 pages and the final poll, the address is polled TWR_POLLS times after every page */
+	test_assert(sim_bus.stats.msgs == 5);
+	test_assert(sim_bus.stats.starts == 5 + 4 * TWR_POLLS);
+	test_assert(sim_bus.stats.nacks == 0);
+
+	i2c_sim_reset_stats(&sim_bus);
+	test_assert(Bermuda24c02Read(0x05, rx, sizeof(rx)) == 0);
+	test_assert(test_equal(rx, tx, sizeof(tx)));
+	test_assert(sim_bus.stats.starts == 2);
+	test_assert(sim_bus.stats.bytes == 1 + sizeof(tx));
+
+	test_assert(Bermuda24c02Write(0xFC, tx, 8) == -1);
+	test_assert(Bermuda24c02Read(0xFC, rx, 8) == -1);
+}
+
+/**
+ * \brief Access a device which is not on the bus.
+ */
+static void test_nack(void)
+{
+	i2c_sim_remove_slave(&sim_bus, &sim_eeprom.slave);
+	i2c_sim_reset_stats(&sim_bus);
+
+	test_assert(Bermuda24c02WriteByte(0x40, 0x55) != 0);
+	test_assert(sim_bus.stats.nacks == 1);
+	test_assert(sim_eeprom.mem[0x40] == 0xFF);
+
+	i2c_sim_add_slave(&sim_bus, &sim_eeprom.slave);
+	test_assert(Bermuda24c02WriteByte(0x40, 0x55) == 0);
+	test_assert(sim_eeprom.mem[0x40] == 0x55);
+}
+
+/**
+ * \brief Asynchronous transfers.
+ * \param client EEPROM client.
+ *
+ * The first write ACK polls the EEPROM, which is still busy with the write of test_nack. A
+ * failing asynchronous transfer must not affect the next synchronous transfer.
+ */
+static void test_async(struct i2c_client *client)
+{
+	struct i2c_xfer xfer;
+	uint8_t tx[] = { 0x60, 0x5A }, rx = 0;
+	void *buffs[] = { tx };
+	int calls = 0;
+
+	xfer.complete = &test_complete;
+	xfer.data = &calls;
+	test_assert(i2c_queue_transaction(client, &async_write, buffs, I2C_MSG_ACK_POLL_FLAG) == 0);
+	test_assert(i2c_submit(client, &xfer) == 0);
+	test_assert(i2c_xfer_wait(&xfer, 100) == 0);
+	test_assert(calls == 1);
+	test_assert(sim_eeprom.mem[0x60] == 0x5A);
+
+	test_assert(Bermuda24c02Read(0x60, &rx, 1) == 0);
+	test_assert(rx == 0x5A);
+
+	i2c_sim_remove_slave(&sim_bus, &sim_eeprom.slave);
+	test_assert(i2c_queue_transaction(client, &async_write, buffs, 0) == 0);
+	i2c_submit(client, &xfer);
+	test_assert(i2c_xfer_wait(&xfer, 100) == -1);
+	test_assert(calls == 2);
+
+	i2c_sim_add_slave(&sim_bus, &sim_eeprom.slave);
+	test_assert(Bermuda24c02WriteByte(0x61, 0xA5) == 0);
+	test_assert(sim_eeprom.mem[0x61] == 0xA5);
+}
+
+/**
+ * \brief Asynchronous transfer after a synchronous time-out.
+ * \param client EEPROM client.
+ *
+ * The messages of the timed out transfer stay in the master queue after the bus is recovered.
+ * Their buffer lives on the stack of stale_write, so they must not be sent in front of the next
+ * asynchronous transfer.
+ */
+static void test_stale(struct i2c_client *client)
+{
+	struct i2c_client *stuck;
+	struct i2c_xfer xfer;
+	uint8_t tx[] = { 0x62, 0x3C };
+	void *buffs[] = { tx };
+	unsigned long start;
+	int fd, calls = 0;
+
+	sim_stuck.slave.sla = STUCK_SLA;
+	sim_stuck.slave.data = &sim_stuck;
+	sim_stuck.slave.start = &test_stuck_start;
+	sim_stuck.slave.write = &test_stuck_write;
+	sim_stuck.slave.read = NULL;
+	sim_stuck.slave.stop = NULL;
+	sim_stuck.hold = TRUE;
+	i2c_sim_add_slave(&sim_bus, &sim_stuck.slave);
+
+	stuck = i2c_alloc_client(&sim_adapter, STUCK_SLA, SCL_FRQ_24C02);
+	test_assert(stuck != NULL);
+	fd = i2cdev_socket(stuck, _FDEV_SETUP_RW | I2C_MASTER);
+	test_assert(fd >= 0);
+
+	start = BermudaTimerGetSysTick();
+	test_assert(stale_write(stuck) != 0);
+	test_assert(BermudaTimerGetSysTick() - start == I2C_MASTER_TMO);
+	test_assert(!sim_bus.held && !sim_adapter.busy);
+	test_assert(sim_stuck.starts == 1);
+
+	xfer.complete = &test_complete;
+	xfer.data = &calls;
+	test_assert(i2c_queue_transaction(client, &async_write, buffs, I2C_MSG_ACK_POLL_FLAG) == 0);
+	test_assert(i2c_submit(client, &xfer) == 0);
+	test_assert(i2c_xfer_wait(&xfer, 100) == 0);
+	test_assert(calls == 1);
+	test_assert(sim_eeprom.mem[0x62] == 0x3C);
+	test_assert(sim_stuck.starts == 1 && sim_stuck.bytes == 0);
+
+	close(fd);
+	i2c_sim_remove_slave(&sim_bus, &sim_stuck.slave);
+}
+
+/**
+ * \brief Write a byte to the slave which holds SCL low.
+ * \param client Client of the stuck slave.
+ * \return Error code of i2c_flush_client.
+ */
+static int stale_write(struct i2c_client *client)
+{
+	uint8_t data = 0xEE;
+	void *buffs[] = { &data };
+
+	if(i2c_queue_transaction(client, &stuck_write, buffs, 0)) {
+		return -1;
+	}
+	return i2c_flush_client(client);
+}
+
+/**
+ * \brief Completion call back of the asynchronous transfers.
+ * \param xfer Completed transfer.
+ */
+static void test_complete(struct i2c_xfer *xfer)
+{
+	int *calls = xfer->data;
+
+	(*calls)++;
+}
+
+/**
+ * \brief Address phase of the slave which holds SCL low.
+ * \param slave Stuck slave.
+ * \param read TRUE if the master requested a read.
+ * \return I2C_SIM_HOLD the first time, 0 after that.
+ */
+static int test_stuck_start(struct i2c_sim_slave *slave, bool read)
+{
+	struct test_stuck *stuck = slave->data;
+
+	stuck->starts++;
+	if(stuck->hold) {
+		stuck->hold = FALSE;
+		return I2C_SIM_HOLD;
+	}
+	return 0;
+}
+
+/**
+ * \brief Byte written to the slave which holds SCL low.
+ * \param slave Stuck slave.
+ * \param data Written byte.
+ */
+static int test_stuck_write(struct i2c_sim_slave *slave, uint8_t data)
+{
+	struct test_stuck *stuck = slave->data;
+
+	stuck->bytes++;
+	return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ *  BermudaOS - I2C heap usage test
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file test/i2c-heap.c I2C heap usage test.
+ *
+ * The program is linked with BermudaHeapAlloc and BermudaHeapFree wrapped (see
+ * <i>i2c_heap_LDFLAGS</i>), so every heap call made by the library is counted. Messages and
+ * queue nodes come from the adapter pool, so transfers through the I2C core must not make any
+ * heap call once the client has been set up.
+ */
+
+#include "host-test.h"
+
+#include <fs/vfile.h>
+
+#include <dev/i2c/i2c.h>
+#include <dev/i2c/reg.h>
+#include <dev/i2c/i2c-core.h>
+#include <dev/i2c/busses/sim.h>
+
+#include <lib/24c02.h>
+
+/**
+ * \brief Amount of transfers of each kind.
+ */
+#define ROUNDS 100
+
+extern void *__real_BermudaHeapAlloc(size_t size);
+extern void __real_BermudaHeapFree(void *ptr);
+
+static struct i2c_adapter sim_adapter;
+static struct i2c_sim_bus sim_bus;
+static struct i2c_sim_24c02 sim_eeprom;
+
+/**
+ * \brief Amount of BermudaHeapAlloc calls.
+ */
+static unsigned long heap_allocs = 0;
+
+/**
+ * \brief Amount of BermudaHeapFree calls.
+ */
+static unsigned long heap_frees = 0;
+
+static const struct i2c_segment write_segs[] = {
+	I2C_SEG_WRITE_STOP(3),
+};
+
+static const struct i2c_segment read_segs[] = {
+	I2C_SEG_WRITE(1),
+	I2C_SEG_READ_STOP(2),
+};
+
+static const struct i2c_transaction write_seq = I2C_TRANSACTION(write_segs);
+static const struct i2c_transaction read_seq = I2C_TRANSACTION(read_segs);
+
+static void test_core(struct i2c_client *client);
+static void test_async(struct i2c_client *client);
+static void test_dev(void);
+
+int main(void)
+{
+	struct i2c_client *client;
+
+	BermudaHostInit();
+	test_assert(i2c_sim_init(&sim_bus, &sim_adapter, "I2C_SIM") == 0);
+	i2c_sim_24c02_init(&sim_eeprom, BASE_SLA_24C02, 0);
+	i2c_sim_add_slave(&sim_bus, &sim_eeprom.slave);
+
+	client = i2c_alloc_client(&sim_adapter, BASE_SLA_24C02, SCL_FRQ_24C02);
+	test_assert(client != NULL);
+	Bermuda24c02Init(client);
+
+	test_core(client);
+	test_async(client);
+	test_dev();
+
+	return test_done("i2c-heap");
+}
+
+/**
+ * \brief Counting BermudaHeapAlloc.
+ * \param size Amount of bytes to allocate.
+ */
+void *__wrap_BermudaHeapAlloc(size_t size)
+{
+	heap_allocs++;
+	return __real_BermudaHeapAlloc(size);
+}
+
+/**
+ * \brief Counting BermudaHeapFree.
+ * \param ptr Memory to free.
+ */
+void __wrap_BermudaHeapFree(void *ptr)
+{
+	heap_frees++;
+	__real_BermudaHeapFree(ptr);
+}
+
+/**
+ * \brief Synchronous transfers through the I2C core.
+ * \param client EEPROM client.
+ *
+ * A write followed by a two message random read, which used to cost five heap calls. The core
+ * takes the transfer mode from the socket of the client, which is opened before counting.
+ */
+static void test_core(struct i2c_client *client)
+{
+	uint8_t tx[3], addr, rx[2];
+	void *wbuffs[] = { tx };
+	void *rbuffs[] = { &addr, rx };
+	unsigned long i;
+	bool ok = TRUE;
+	int fd;
+
+	fd = i2cdev_socket(client, _FDEV_SETUP_RW | I2C_MASTER);
+	test_assert(fd >= 0);
+
+	heap_allocs = heap_frees = 0;
+	for(i = 0; i < ROUNDS; i++) {
+		tx[0] = (uint8_t)(i * 2);
+		tx[1] = (uint8_t)i;
+		tx[2] = (uint8_t)~i;
+		addr = tx[0];
+
+		ok = ok && i2c_queue_transaction(client, &write_seq, wbuffs, 0) == 0;
+		ok = ok && i2c_flush_client(client) == 0;
+		ok = ok && i2c_queue_transaction(client, &read_seq, rbuffs, 0) == 0;
+		ok = ok && i2c_flush_client(client) == 0;
+		ok = ok && rx[0] == tx[1] && rx[1] == tx[2];
+	}
+
+	test_assert(ok);
+	test_assert(heap_allocs == 0);
+	test_assert(heap_frees == 0);
+	printf("i2c-heap: core: %u transfers, %u allocs, %u frees\n", 2 * ROUNDS,
+		   (unsigned int)heap_allocs, (unsigned int)heap_frees);
+	close(fd);
+}
+
+/**
+ * \brief Asynchronous transfers through the I2C core.
+ * \param client EEPROM client.
+ */
+static void test_async(struct i2c_client *client)
+{
+	struct i2c_xfer xfer;
+	uint8_t tx[] = { 0x80, 0x11, 0x22 };
+	void *buffs[] = { tx };
+	unsigned long i;
+	bool ok = TRUE;
+
+	xfer.complete = NULL;
+	xfer.data = NULL;
+
+	heap_allocs = heap_frees = 0;
+	for(i = 0; i < ROUNDS; i++) {
+		ok = ok && i2c_queue_transaction(client, &write_seq, buffs, 0) == 0;
+		ok = ok && i2c_submit(client, &xfer) == 0;
+		ok = ok && i2c_xfer_wait(&xfer, 100) == 0;
+	}
+
+	test_assert(ok);
+	test_assert(sim_eeprom.mem[0x80] == 0x11 && sim_eeprom.mem[0x81] == 0x22);
+	test_assert(heap_allocs == 0);
+	test_assert(heap_frees == 0);
+	printf("i2c-heap: async: %u transfers, %u allocs, %u frees\n", ROUNDS,
+		   (unsigned int)heap_allocs, (unsigned int)heap_frees);
+}
+
+/**
+ * \brief Transfers through the I2C device layer.
+ *
+ * The 24C02 library opens a socket for every access. Only that stream may touch the heap, the
+ * messages of the transfer may not.
+ */
+static void test_dev(void)
+{
+	unsigned long i;
+	bool ok = TRUE;
+
+	heap_allocs = heap_frees = 0;
+	for(i = 0; i < ROUNDS; i++) {
+		ok = ok && Bermuda24c02ReadByte(0x80) == 0x11;
+	}
+
+	test_assert(ok);
+	test_assert(heap_allocs == heap_frees);
+	test_assert(heap_allocs == ROUNDS);
+	printf("i2c-heap: 24c02: %u reads, %u allocs, %u frees\n", ROUNDS,
+		   (unsigned int)heap_allocs, (unsigned int)heap_frees);
+}
@@ -0,0 +1,278 @@
+/*
+ *  BermudaOS - I2C message queue benchmark
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file test/i2c-queue-bench.c I2C message queue benchmark.
+ *
+ * Compares the master and slave ring queues of i2c-msg.c with the message vector they replaced.
+ * The vector is reproduced below from the old i2c-msg.c: master messages are kept in front of
+ * the slave messages, so adding a master message shifts the slave messages right, and retiring
+ * a message locates it and shifts the rest left. Its bus driver looked up the first master and
+ * the first slave message on every interrupt.
+ *
+ * Both are driven with the same workload. A slave buffer is listening while a number of master
+ * messages are queued, each message takes ISR_CALLS bus interrupts and is retired when it is
+ * done. The cost of the vector grows with the amount of queued messages, the ring queues take the
+ * same time at every depth. The ring queues also keep the I2C statistics when I2C_STATS is set,
+ * the vector never did.
+ */
+
+#include "host-test.h"
+
+#include <dev/i2c/i2c.h>
+#include <dev/i2c/i2c-core.h>
+#include <dev/i2c/i2c-msg.h>
+
+/**
+ * \brief Highest amount of master messages queued at once.
+ */
+#define QUEUE_DEPTH (I2C_MSG_POOL_SIZE - 1)
+
+/**
+ * \brief Bus interrupts per message (start, address and 4 data bytes).
+ */
+#define ISR_CALLS 6
+
+/**
+ * \brief Amount of messages transfered at every depth.
+ */
+#define MESSAGES 140000UL
+
+/*
+ * Provided by the host C library.
+ */
+extern long clock(void);
+
+/**
+ * \brief Host clock ticks per second (POSIX).
+ */
+#define HOST_CLOCKS_PER_SEC 1000000UL
+
+/**
+ * \brief The old message vector.
+ */
+struct msg_vector
+{
+	size_t length; //!< Length of the vector.
+	struct i2c_message *volatile data[I2C_MSG_POOL_SIZE]; //!< The data array.
+};
+
+static struct i2c_message masters[QUEUE_DEPTH];
+static struct i2c_message slave;
+
+#ifdef I2C_STATS
+/**
+ * \brief Statistics of the ring queues, the core layer points them to the adapter statistics.
+ */
+static struct i2c_stats queue_stats;
+#endif
+
+static unsigned long bench_vector(size_t depth);
+static unsigned long bench_queue(size_t depth);
+static void vector_add(struct msg_vector *vector, struct i2c_message *msg)
+	__attribute__((noinline));
+static inline struct i2c_message *vector_first(struct msg_vector *vector, bool master);
+static void vector_delete(struct msg_vector *vector, struct i2c_message *msg)
+	__attribute__((noinline));
+
+int main(void)
+{
+	unsigned long vector_us, queue_us;
+	size_t i, depth;
+
+	BermudaHostInit();
+	for(i = 0; i < QUEUE_DEPTH; i++) {
+		masters[i].features = I2C_MSG_MASTER_MSG_FLAG | I2C_MSG_TRANSMIT_MSG_FLAG;
+	}
+
+	printf("i2c-queue-bench: %u messages, %u interrupts each\n", (unsigned int)MESSAGES,
+		   ISR_CALLS);
+	for(depth = 1; depth <= QUEUE_DEPTH; depth++) {
+		vector_us = bench_vector(depth);
+		queue_us = bench_queue(depth);
+		printf("i2c-queue-bench: %u queued: vector %u ns/msg, ring queues %u ns/msg\n",
+			   (unsigned int)depth, (unsigned int)(vector_us * 1000 / MESSAGES),
+			   (unsigned int)(queue_us * 1000 / MESSAGES));
+	}
+
+	return test_done("i2c-queue-bench");
+}
+
+/**
+ * \brief Run the workload on the old message vector.
+ * \param depth Amount of master messages queued at once.
+ * \return Host time in micro seconds.
+ */
+static unsigned long bench_vector(size_t depth)
+{
+	struct msg_vector vector;
+	struct i2c_message *master, *listen;
+	unsigned long round;
+	long start;
+	size_t i, isr;
+	bool ok = TRUE;
+
+	vector.length = 0;
+	slave.features = 0;
+	vector_add(&vector, &slave);
+
+	start = clock();
+	for(round = 0; round < MESSAGES / depth; round++) {
+		for(i = 0; i < depth; i++) {
+			masters[i].features &= ~I2C_MSG_DONE_FLAG;
+			vector_add(&vector, &masters[i]);
+		}
+
+		for(i = 0; i < depth; i++) {
+			for(isr = 0; isr < ISR_CALLS; isr++) {
+				master = vector_first(&vector, TRUE);
+				listen = vector_first(&vector, FALSE);
+			}
+			ok = ok && master == &masters[i] && listen == &slave;
+
+			master->features |= I2C_MSG_DONE_FLAG;
+			vector_delete(&vector, master);
+		}
+	}
+	start = clock() - start;
+
+	test_assert(ok);
+	test_assert(vector.length == 1);
+	return (unsigned long)start * (1000000UL / HOST_CLOCKS_PER_SEC);
+}
+
+/**
+ * \brief Run the workload on the ring queues.
+ * \param depth Amount of master messages queued at once.
+ * \return Host time in micro seconds.
+ */
+static unsigned long bench_queue(size_t depth)
+{
+	struct i2c_msg_queue master_msgs, slave_msgs;
+	struct i2c_message *master, *listen;
+	unsigned long round;
+	long start;
+	size_t i, isr;
+	bool ok = TRUE;
+
+	i2c_queue_init(&master_msgs);
+	i2c_queue_init(&slave_msgs);
+#ifdef I2C_STATS
+	master_msgs.stats = slave_msgs.stats = &queue_stats;
+#endif
+	slave.features = 0;
+	i2c_queue_push(&slave_msgs, &slave);
+
+	start = clock();
+	for(round = 0; round < MESSAGES / depth; round++) {
+		for(i = 0; i < depth; i++) {
+			masters[i].features &= ~I2C_MSG_DONE_FLAG;
+			ok = ok && i2c_queue_push(&master_msgs, &masters[i]) == 0;
+		}
+
+		for(i = 0; i < depth; i++) {
+			for(isr = 0; isr < ISR_CALLS; isr++) {
+				master = i2c_queue_pending(&master_msgs);
+				listen = i2c_queue_pending(&slave_msgs);
+			}
+			ok = ok && master == &masters[i] && listen == &slave;
+
+			i2c_queue_complete(&master_msgs);
+			ok = ok && i2c_queue_pop(&master_msgs) == master;
+		}
+	}
+	start = clock() - start;
+
+	test_assert(ok);
+	test_assert(i2c_queue_length(&master_msgs) == 0);
+	return (unsigned long)start * (1000000UL / HOST_CLOCKS_PER_SEC);
+}
+
+/**
+ * \brief Add a message, master messages are inserted in front of the slave messages.
+ * \param vector Message vector.
+ * \param msg Message to add.
+ * \see The old i2c_vector_add, which was not inlined either.
+ */
+static void vector_add(struct msg_vector *vector, struct i2c_message *msg)
+{
+	size_t i, last;
+
+	if(i2c_msg_is_master(msg)) {
+		for(i = 0; i < vector->length; i++) {
+			if(!i2c_msg_is_master(vector->data[i])) {
+				break;
+			}
+		}
+
+		for(last = vector->length; last > i; last--) {
+			vector->data[last] = vector->data[last - 1];
+		}
+		vector->data[i] = msg;
+	} else {
+		vector->data[vector->length] = msg;
+	}
+	vector->length++;
+}
+
+/**
+ * \brief Find the first master or slave message which is not done.
+ * \param vector Message vector.
+ * \param master TRUE to find a master message, FALSE to find a slave message.
+ * \see The old i2c_first_master_msg and i2c_first_slave_msg.
+ */
+static inline struct i2c_message *vector_first(struct msg_vector *vector, bool master)
+{
+	struct i2c_message *msg;
+	size_t i;
+
+	for(i = 0; i < vector->length; i++) {
+		msg = vector->data[i];
+		if(i2c_msg_is_master(msg) == master &&
+			(i2c_msg_features(msg) & I2C_MSG_DONE_FLAG) == 0) {
+			return msg;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * \brief Locate a message and delete it.
+ * \param vector Message vector.
+ * \param msg Message to delete.
+ * \see The old i2c_vector_locate and i2c_vector_delete_at, which were not inlined either.
+ */
+static void vector_delete(struct msg_vector *vector, struct i2c_message *msg)
+{
+	size_t i;
+
+	for(i = 0; i < vector->length; i++) {
+		if(vector->data[i] == msg) {
+			break;
+		}
+	}
+
+	if(i == vector->length) {
+		return;
+	}
+
+	for(; i + 1 < vector->length; i++) {
+		vector->data[i] = vector->data[i + 1];
+	}
+	vector->length--;
+}
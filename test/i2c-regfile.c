@@ -0,0 +1,268 @@
+/*
+ *  BermudaOS - I2C register file test
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file test/i2c-regfile.c I2C register file test.
+ *
+ * Attaches a register file to the simulated adapter and accesses it with a client of the same
+ * bus, which takes the role of the remote master. Checks the write masks, the wrap of the
+ * register pointer and the change notification.
+ */
+
+#include "host-test.h"
+
+#include <fs/vfile.h>
+
+#include <dev/i2c/i2c.h>
+#include <dev/i2c/reg.h>
+#include <dev/i2c/i2c-core.h>
+#include <dev/i2c/i2c-msg.h>
+#include <dev/i2c/busses/sim.h>
+
+/**
+ * \brief Slave address of the adapter.
+ */
+#define REGFILE_SLA 0x60
+
+#define REGFILE_SIZE 8
+
+static struct i2c_adapter sim_adapter;
+static struct i2c_sim_bus sim_bus;
+
+static uint8_t regs[REGFILE_SIZE];
+
+/**
+ * \brief Register 2 has a writable low nibble, register 3 is read-only.
+ */
+static const uint8_t regs_wmask[REGFILE_SIZE] = { 0xFF, 0xFF, 0x0F, 0x00, 0xFF, 0xFF, 0xFF, 0xFF };
+
+static struct i2c_regfile regfile;
+
+/**
+ * \brief Change notifications.
+ */
+static struct
+{
+	unsigned int calls; //!< Amount of notifications.
+	uint8_t first; //!< First changed register of the last notification.
+	uint8_t num; //!< Amount of changed registers of the last notification.
+} changes;
+
+static const struct i2c_segment write_segs[] = {
+	I2C_SEG_WRITE_STOP(0),
+};
+
+static const struct i2c_segment read_segs[] = {
+	I2C_SEG_WRITE(0),
+	I2C_SEG_READ_STOP(0),
+};
+
+static void test_write(struct i2c_client *client);
+static void test_wrap(struct i2c_client *client);
+static void test_read(struct i2c_client *client);
+static void test_rep_start(struct i2c_client *client);
+static void test_detach(struct i2c_client *client);
+static int xfer(struct i2c_client *client, const struct i2c_segment *segs, uint8_t num,
+				const void *tx, size_t txlen, void *rx, size_t rxlen);
+static void regfile_notify(struct i2c_regfile *rf, uint8_t first, uint8_t num);
+
+int main(void)
+{
+	struct i2c_client *client;
+	int fd;
+	uint8_t i;
+
+	BermudaHostInit();
+	test_assert(i2c_sim_init(&sim_bus, &sim_adapter, "I2C_SIM") == 0);
+	sim_bus.sla = REGFILE_SLA;
+
+	for(i = 0; i < REGFILE_SIZE; i++) {
+		regs[i] = 0x10 * i + i;
+	}
+	regfile.regs = regs;
+	regfile.size = REGFILE_SIZE;
+	regfile.wmask = regs_wmask;
+	regfile.notify = &regfile_notify;
+	test_assert(i2c_attach_regfile(&sim_adapter, &regfile) == 0);
+
+	client = i2c_alloc_client(&sim_adapter, REGFILE_SLA, 100000);
+	test_assert(client != NULL);
+	fd = i2cdev_socket(client, _FDEV_SETUP_RW | I2C_MASTER);
+	test_assert(fd >= 0);
+
+	test_write(client);
+	test_wrap(client);
+	test_read(client);
+	test_rep_start(client);
+	test_detach(client);
+
+	close(fd);
+	return test_done("i2c-regfile");
+}
+
+/**
+ * \brief Master write through the write masks.
+ * \param client Remote master.
+ *
+ * The application is notified once, after the stop condition.
+ */
+static void test_write(struct i2c_client *client)
+{
+	uint8_t tx[] = { 1, 0xA1, 0xA2, 0xA3 };
+
+	test_assert(xfer(client, write_segs, 1, tx, sizeof(tx), NULL, 0) == 0);
+	test_assert(regs[1] == 0xA1);
+	test_assert(regs[2] == 0x22);
+	test_assert(regs[3] == 0x33);
+	test_assert(regs[4] == 0x44);
+	test_assert(changes.calls == 1);
+	test_assert(changes.first == 1 && changes.num == 3);
+	test_assert(regfile.ptr == 4);
+}
+
+/**
+ * \brief Register pointer wrap.
+ * \param client Remote master.
+ *
+ * The pointer wraps at the end of the file. A register address beyond the file selects register
+ * 0.
+ */
+static void test_wrap(struct i2c_client *client)
+{
+	uint8_t tx[] = { 6, 0xB6, 0xB7, 0xB0 };
+	uint8_t out[] = { REGFILE_SIZE + 2, 0xC0 };
+
+	test_assert(xfer(client, write_segs, 1, tx, sizeof(tx), NULL, 0) == 0);
+	test_assert(regs[6] == 0xB6 && regs[7] == 0xB7 && regs[0] == 0xB0);
+	test_assert(regs[1] == 0xA1);
+	test_assert(changes.calls == 2);
+	test_assert(changes.first == 6 && changes.num == 3);
+
+	test_assert(xfer(client, write_segs, 1, out, sizeof(out), NULL, 0) == 0);
+	test_assert(regs[0] == 0xC0 && regs[2] == 0x22);
+	test_assert(changes.calls == 3);
+	test_assert(changes.first == 0 && changes.num == 1);
+}
+
+/**
+ * \brief Master reads.
+ * \param client Remote master.
+ *
+ * A read starts at the register pointer, which is set by a preceding write of the register
+ * address. Reads don't notify the application.
+ */
+static void test_read(struct i2c_client *client)
+{
+	uint8_t reg = 5;
+	uint8_t rx[4];
+
+	test_assert(xfer(client, read_segs, 2, &reg, 1, rx, sizeof(rx)) == 0);
+	test_assert(rx[0] == 0x55 && rx[1] == 0xB6 && rx[2] == 0xB7 && rx[3] == 0xC0);
+	test_assert(changes.calls == 3);
+
+	/* a read without a register address continues at the pointer */
+	test_assert(xfer(client, &read_segs[1], 1, NULL, 0, rx, 2) == 0);
+	test_assert(rx[0] == 0xA1 && rx[1] == 0x22);
+	test_assert(regfile.ptr == 3);
+	test_assert(changes.calls == 3);
+}
+
+/**
+ * \brief Write followed by a repeated start.
+ * \param client Remote master.
+ *
+ * The repeated start ends the write, so the application is notified before the read.
+ */
+static void test_rep_start(struct i2c_client *client)
+{
+	uint8_t tx[] = { 4, 0xC4 };
+	uint8_t rx;
+
+	i2c_sim_reset_stats(&sim_bus);
+	test_assert(xfer(client, read_segs, 2, tx, sizeof(tx), &rx, 1) == 0);
+	test_assert(sim_bus.stats.starts == 2 && sim_bus.stats.stops == 1);
+	test_assert(regs[4] == 0xC4);
+	test_assert(rx == 0x55);
+	test_assert(changes.calls == 4);
+	test_assert(changes.first == 4 && changes.num == 1);
+}
+
+/**
+ * \brief A detached register file is no longer served.
+ * \param client Remote master.
+ */
+static void test_detach(struct i2c_client *client)
+{
+	uint8_t tx[] = { 0, 0xEE };
+
+	test_assert(i2c_detach_regfile(&sim_adapter) == 0);
+	i2c_sim_reset_stats(&sim_bus);
+	test_assert(xfer(client, write_segs, 1, tx, sizeof(tx), NULL, 0) != 0);
+	test_assert(sim_bus.stats.nacks == 1);
+	test_assert(regs[0] == 0xC0);
+	test_assert(changes.calls == 4);
+}
+
+/**
+ * \brief Transfer a transaction of the remote master.
+ * \param client Remote master.
+ * \param segs Segments, one write segment (using \p tx) and/or one read segment (using \p rx).
+ * \param num Amount of segments.
+ * \param tx Data of the write segment.
+ * \param txlen Length of \p tx.
+ * \param rx Buffer of the read segment.
+ * \param rxlen Length of \p rx.
+ * \return Error code of i2c_flush_client.
+ */
+static int xfer(struct i2c_client *client, const struct i2c_segment *segs, uint8_t num,
+				const void *tx, size_t txlen, void *rx, size_t rxlen)
+{
+	struct i2c_transaction t;
+	struct i2c_iovec iov[2];
+	uint8_t i;
+
+	for(i = 0; i < num; i++) {
+		if((segs[i].features & I2C_MSG_TRANSMIT_MSG_FLAG) != 0) {
+			iov[i].buff = (void*)tx;
+			iov[i].length = txlen;
+		} else {
+			iov[i].buff = rx;
+			iov[i].length = rxlen;
+		}
+	}
+
+	t.segs = segs;
+	t.num = num;
+	if(i2c_queue_transactionv(client, &t, iov, 1, 0)) {
+		return -1;
+	}
+	return i2c_flush_client(client);
+}
+
+/**
+ * \brief Register file change notification.
+ * \param rf Register file.
+ * \param first First changed register.
+ * \param num Amount of changed registers.
+ */
+static void regfile_notify(struct i2c_regfile *rf, uint8_t first, uint8_t num)
+{
+	changes.calls++;
+	changes.first = first;
+	changes.num = num;
+}
@@ -0,0 +1,293 @@
+/*
+ *  BermudaOS - I2C register map test
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file test/i2c-regmap.c I2C register map test.
+ *
+ * Uses the 24C02 model as a register device and counts the bus traffic of the register cache.
+ * The 24C02 programs its page buffer on a stop condition and drops it on a repeated start, while
+ * a register device latches every written byte. The test slave therefore programs the page at
+ * every start as well. All registers used by a write run are within one 8 byte page, since the
+ * 24C02 wraps its address within the page.
+ */
+
+#include "host-test.h"
+
+#include <dev/i2c/i2c.h>
+#include <dev/i2c/i2c-core.h>
+#include <dev/i2c/i2c-regmap.h>
+#include <dev/i2c/busses/sim.h>
+
+#include <lib/24c02.h>
+
+static struct i2c_adapter sim_adapter;
+static struct i2c_sim_bus sim_bus;
+static struct i2c_sim_24c02 sim_eeprom;
+
+/**
+ * \brief Register device on top of sim_eeprom.
+ */
+static struct i2c_sim_slave reg_slave;
+
+/**
+ * \brief Registers 0x00 and 0x01 are status registers.
+ */
+static const struct i2c_regmap_range reg_volatile[] = { { 0x00, 0x01 } };
+
+static const struct i2c_regmap_config reg_config = {
+	.max_reg = 0x1F,
+	.volatile_ranges = reg_volatile,
+	.num_volatile = 1,
+	.auto_increment = TRUE,
+};
+
+static const struct i2c_regmap_config reg_config_noinc = {
+	.max_reg = 0x1F,
+	.volatile_ranges = reg_volatile,
+	.num_volatile = 1,
+	.auto_increment = FALSE,
+};
+
+static void test_read(struct i2c_regmap *map);
+static void test_write(struct i2c_regmap *map);
+static void test_merge(struct i2c_regmap *map);
+static void test_split(struct i2c_regmap *map);
+static void test_noinc(struct i2c_client *client);
+static void test_failed(struct i2c_regmap *map);
+static int reg_start(struct i2c_sim_slave *slave, bool read);
+
+int main(void)
+{
+	struct i2c_client *client;
+	struct i2c_regmap map;
+
+	BermudaHostInit();
+	test_assert(i2c_sim_init(&sim_bus, &sim_adapter, "I2C_SIM") == 0);
+	i2c_sim_24c02_init(&sim_eeprom, BASE_SLA_24C02, 0);
+	reg_slave = sim_eeprom.slave;
+	reg_slave.start = &reg_start;
+	i2c_sim_add_slave(&sim_bus, &reg_slave);
+
+	client = i2c_alloc_client(&sim_adapter, BASE_SLA_24C02, SCL_FRQ_24C02);
+	test_assert(client != NULL);
+	test_assert(i2c_regmap_init(&map, client, &reg_config) == 0);
+
+	test_read(&map);
+	test_write(&map);
+	test_merge(&map);
+	test_split(&map);
+	test_noinc(client);
+	test_failed(&map);
+
+	i2c_regmap_destroy(&map);
+	return test_done("i2c-regmap");
+}
+
+/**
+ * \brief Register reads.
+ * \param map Register map.
+ *
+ * A cacheable register is read from the device once, a volatile register on every access.
+ */
+static void test_read(struct i2c_regmap *map)
+{
+	uint8_t val = 0;
+
+	sim_eeprom.mem[0x10] = 0x11;
+	sim_eeprom.mem[0x00] = 0x22;
+
+	i2c_sim_reset_stats(&sim_bus);
+	test_assert(i2c_regmap_read(map, 0x10, &val) == 0);
+	test_assert(val == 0x11);
+	test_assert(sim_bus.stats.msgs == 2);
+
+	sim_eeprom.mem[0x10] = 0x33;
+	test_assert(i2c_regmap_read(map, 0x10, &val) == 0);
+	test_assert(val == 0x11);
+	test_assert(sim_bus.stats.msgs == 2);
+
+	test_assert(i2c_regmap_read(map, 0x00, &val) == 0);
+	test_assert(val == 0x22);
+	sim_eeprom.mem[0x00] = 0x44;
+	test_assert(i2c_regmap_read(map, 0x00, &val) == 0);
+	test_assert(val == 0x44);
+	test_assert(sim_bus.stats.msgs == 6);
+
+	/* registers above max_reg are not cached either */
+	test_assert(i2c_regmap_read(map, 0x20, &val) == 0);
+	test_assert(sim_bus.stats.msgs == 8);
+}
+
+/**
+ * \brief Register writes.
+ * \param map Register map.
+ *
+ * Writing the cached value of a register doesn't access the bus, a volatile register is always
+ * written.
+ */
+static void test_write(struct i2c_regmap *map)
+{
+	i2c_sim_reset_stats(&sim_bus);
+	test_assert(i2c_regmap_write(map, 0x10, 0x11) == 0);
+	test_assert(sim_bus.stats.msgs == 0);
+
+	test_assert(i2c_regmap_write(map, 0x10, 0x55) == 0);
+	test_assert(sim_eeprom.mem[0x10] == 0x55);
+	test_assert(sim_bus.stats.msgs == 1);
+	test_assert(sim_bus.stats.bytes == 2);
+
+	test_assert(i2c_regmap_write(map, 0x01, 0x66) == 0);
+	test_assert(i2c_regmap_write(map, 0x01, 0x66) == 0);
+	test_assert(sim_eeprom.mem[0x01] == 0x66);
+	test_assert(sim_bus.stats.msgs == 3);
+
+	/* read-modify-write of a cached register only writes */
+	test_assert(i2c_regmap_update_bits(map, 0x10, 0x0F, 0x0A) == 0);
+	test_assert(sim_eeprom.mem[0x10] == 0x5A);
+	test_assert(sim_bus.stats.msgs == 4);
+}
+
+/**
+ * \brief Dirty run merging.
+ * \param map Register map.
+ *
+ * Consecutive dirty registers are written in one message, all runs in one transaction.
+ */
+static void test_merge(struct i2c_regmap *map)
+{
+	i2c_sim_reset_stats(&sim_bus);
+	i2c_regmap_cache_only(map, TRUE);
+	test_assert(i2c_regmap_write(map, 0x08, 0x80) == 0);
+	test_assert(i2c_regmap_write(map, 0x09, 0x81) == 0);
+	test_assert(i2c_regmap_write(map, 0x0A, 0x82) == 0);
+	test_assert(i2c_regmap_write(map, 0x0C, 0x84) == 0);
+	test_assert(i2c_regmap_write(map, 0x12, 0x92) == 0);
+	test_assert(sim_bus.stats.msgs == 0);
+	test_assert(sim_eeprom.mem[0x08] == 0xFF);
+
+	/* a volatile register bypasses the cache, even in cache only mode */
+	test_assert(i2c_regmap_write(map, 0x00, 0x01) == 0);
+	test_assert(sim_bus.stats.msgs == 1);
+	i2c_regmap_cache_only(map, FALSE);
+
+	i2c_sim_reset_stats(&sim_bus);
+	test_assert(i2c_regmap_sync(map) == 0);
+	test_assert(sim_bus.stats.msgs == 3);
+	test_assert(sim_bus.stats.starts == 3);
+	test_assert(sim_bus.stats.stops == 1);
+	test_assert(sim_bus.stats.bytes == (1 + 3) + (1 + 1) + (1 + 1));
+	test_assert(sim_eeprom.mem[0x08] == 0x80 && sim_eeprom.mem[0x09] == 0x81);
+	test_assert(sim_eeprom.mem[0x0A] == 0x82 && sim_eeprom.mem[0x0B] == 0xFF);
+	test_assert(sim_eeprom.mem[0x0C] == 0x84 && sim_eeprom.mem[0x12] == 0x92);
+
+	i2c_sim_reset_stats(&sim_bus);
+	test_assert(i2c_regmap_sync(map) == 0);
+	test_assert(sim_bus.stats.msgs == 0);
+}
+
+/**
+ * \brief Transactions of at most I2C_REGMAP_SYNC_RUNS runs.
+ * \param map Register map.
+ */
+static void test_split(struct i2c_regmap *map)
+{
+	uint8_t reg;
+
+	i2c_regmap_cache_only(map, TRUE);
+	for(reg = 0x02; reg < 0x02 + 2 * (I2C_REGMAP_SYNC_RUNS + 1); reg += 2) {
+		test_assert(i2c_regmap_write(map, reg, reg) == 0);
+	}
+	i2c_regmap_cache_only(map, FALSE);
+
+	i2c_sim_reset_stats(&sim_bus);
+	test_assert(i2c_regmap_sync(map) == 0);
+	test_assert(sim_bus.stats.msgs == I2C_REGMAP_SYNC_RUNS + 1);
+	test_assert(sim_bus.stats.stops == 2);
+	for(reg = 0x02; reg < 0x02 + 2 * (I2C_REGMAP_SYNC_RUNS + 1); reg += 2) {
+		test_assert(sim_eeprom.mem[reg] == reg);
+	}
+}
+
+/**
+ * \brief Devices without register address auto increment.
+ * \param client Client of the device.
+ *
+ * Every dirty register is a run of its own.
+ */
+static void test_noinc(struct i2c_client *client)
+{
+	struct i2c_regmap map;
+
+	test_assert(i2c_regmap_init(&map, client, &reg_config_noinc) == 0);
+	i2c_regmap_cache_only(&map, TRUE);
+	test_assert(i2c_regmap_write(&map, 0x18, 0xA0) == 0);
+	test_assert(i2c_regmap_write(&map, 0x19, 0xA1) == 0);
+	test_assert(i2c_regmap_write(&map, 0x1A, 0xA2) == 0);
+	i2c_regmap_cache_only(&map, FALSE);
+
+	i2c_sim_reset_stats(&sim_bus);
+	test_assert(i2c_regmap_sync(&map) == 0);
+	test_assert(sim_bus.stats.msgs == 3);
+	test_assert(sim_bus.stats.stops == 1);
+	test_assert(sim_bus.stats.bytes == 6);
+	test_assert(sim_eeprom.mem[0x18] == 0xA0 && sim_eeprom.mem[0x1A] == 0xA2);
+	i2c_regmap_destroy(&map);
+}
+
+/**
+ * \brief Failed writes.
+ * \param map Register map.
+ *
+ * A register which could not be written stays dirty and is written by the next sync. A failed
+ * sync doesn't clear any register.
+ */
+static void test_failed(struct i2c_regmap *map)
+{
+	i2c_sim_remove_slave(&sim_bus, &reg_slave);
+	test_assert(i2c_regmap_write(map, 0x14, 0x77) != 0);
+
+	i2c_regmap_cache_only(map, TRUE);
+	test_assert(i2c_regmap_write(map, 0x15, 0x78) == 0);
+	i2c_regmap_cache_only(map, FALSE);
+	test_assert(i2c_regmap_sync(map) != 0);
+
+	/* the cached value is written again, although it didn't change */
+	i2c_sim_add_slave(&sim_bus, &reg_slave);
+	i2c_sim_reset_stats(&sim_bus);
+	test_assert(i2c_regmap_write(map, 0x14, 0x77) == 0);
+	test_assert(sim_bus.stats.msgs == 1);
+	test_assert(sim_eeprom.mem[0x14] == 0x77);
+
+	i2c_sim_reset_stats(&sim_bus);
+	test_assert(i2c_regmap_sync(map) == 0);
+	test_assert(sim_bus.stats.msgs == 1);
+	test_assert(sim_eeprom.mem[0x15] == 0x78);
+}
+
+/**
+ * \brief Address phase of the register device.
+ * \param slave Register device.
+ * \param read TRUE for a read request.
+ *
+ * Programs the bytes written since the last start, then starts the 24C02.
+ */
+static int reg_start(struct i2c_sim_slave *slave, bool read)
+{
+	sim_eeprom.slave.stop(slave);
+	return sim_eeprom.slave.start(slave, read);
+}
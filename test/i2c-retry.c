@@ -0,0 +1,280 @@
+/*
+ *  BermudaOS - I2C retry test
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file test/i2c-retry.c I2C retry test.
+ *
+ * Checks the retries with backoff of i2c_set_retries and the ACK polling window against the
+ * 24C02 model. After a write the model does not acknowledge its address for a configurable
+ * amount of polls, so a transfer right after a write fails exactly that many times.
+ */
+
+#include "host-test.h"
+
+#include <fs/vfile.h>
+
+#include <dev/i2c/i2c.h>
+#include <dev/i2c/reg.h>
+#include <dev/i2c/i2c-core.h>
+#include <dev/i2c/busses/sim.h>
+
+#include <lib/24c02.h>
+
+/**
+ * \brief Address polls the EEPROM model NACKs after a write.
+ */
+#define TWR_POLLS 3
+
+static struct i2c_adapter sim_adapter;
+static struct i2c_sim_bus sim_bus;
+static struct i2c_sim_24c02 sim_eeprom;
+
+/**
+ * \brief Word address and data of the byte writes.
+ */
+static uint8_t write_data[] = { 0x20, 0x00 };
+
+/**
+ * \brief Word address of the reads.
+ */
+static uint8_t read_addr = 0x20;
+
+/**
+ * \brief Read buffer.
+ */
+static uint8_t read_data;
+
+/**
+ * \brief Amount of call backs.
+ */
+static int callbacks = 0;
+
+static const struct i2c_segment write_segs[] = {
+	I2C_SEG_WRITE_STOP(sizeof(write_data)),
+};
+
+static const struct i2c_segment read_segs[] = {
+	I2C_SEG_WRITE(1),
+	I2C_SEG_READ_STOP(1),
+};
+
+static const struct i2c_transaction write_seq = I2C_TRANSACTION(write_segs);
+static const struct i2c_transaction read_seq = I2C_TRANSACTION(read_segs);
+
+static void test_retry(struct i2c_client *client);
+static void test_give_up(struct i2c_client *client);
+static void test_callback(struct i2c_client *client);
+static void test_ack_poll(struct i2c_client *client);
+static int write_byte(struct i2c_client *client, uint8_t data);
+static int read_byte(struct i2c_client *client, i2c_features_t flags);
+static int read_callback(struct i2c_shared_info *info, struct i2c_message *oldmsg,
+						 struct i2c_message *newmsg);
+
+int main(void)
+{
+	struct i2c_client *client;
+	int fd;
+
+	BermudaHostInit();
+	test_assert(i2c_sim_init(&sim_bus, &sim_adapter, "I2C_SIM") == 0);
+	i2c_sim_24c02_init(&sim_eeprom, BASE_SLA_24C02, TWR_POLLS);
+	i2c_sim_add_slave(&sim_bus, &sim_eeprom.slave);
+
+	client = i2c_alloc_client(&sim_adapter, BASE_SLA_24C02, SCL_FRQ_24C02);
+	test_assert(client != NULL);
+	fd = i2cdev_socket(client, _FDEV_SETUP_RW | I2C_MASTER);
+	test_assert(fd >= 0);
+
+	test_retry(client);
+	test_give_up(client);
+	test_callback(client);
+	test_ack_poll(client);
+
+	close(fd);
+	return test_done("i2c-retry");
+}
+
+/**
+ * \brief A transfer which is not acknowledged TWR_POLLS times succeeds on the next retry.
+ * \param client EEPROM client.
+ *
+ * The delay between the attempts starts at the backoff and doubles after every retry.
+ */
+static void test_retry(struct i2c_client *client)
+{
+	unsigned long start;
+
+	test_assert(i2c_set_retries(client, TWR_POLLS, 2) == 0);
+	test_assert(write_byte(client, 0x5A) == 0);
+	test_assert(sim_eeprom.busy == TWR_POLLS);
+
+	i2c_sim_reset_stats(&sim_bus);
+	start = BermudaTimerGetSysTick();
+	test_assert(read_byte(client, 0) == 0);
+	test_assert(read_data == 0x5A);
+	test_assert(sim_bus.stats.nacks == TWR_POLLS);
+	test_assert(sim_bus.stats.starts == TWR_POLLS + 2);
+	test_assert(BermudaTimerGetSysTick() - start == 2 + 4 + 8);
+}
+
+/**
+ * \brief A transfer is tried <i>retries</i> + 1 times.
+ * \param client EEPROM client.
+ *
+ * After the last attempt the messages of the client are deleted.
+ */
+static void test_give_up(struct i2c_client *client)
+{
+	unsigned long start;
+
+	test_assert(i2c_set_retries(client, TWR_POLLS - 1, 0) == 0);
+	test_assert(write_byte(client, 0xA5) == 0);
+
+	i2c_sim_reset_stats(&sim_bus);
+	start = BermudaTimerGetSysTick();
+	test_assert(read_byte(client, 0) != 0);
+	test_assert(sim_bus.stats.nacks == TWR_POLLS);
+	test_assert(sim_bus.stats.starts == TWR_POLLS);
+	test_assert(sim_bus.stats.msgs == 0);
+	test_assert(BermudaTimerGetSysTick() == start);
+	test_assert(i2c_shinfo(client)->msgs == NULL);
+
+	test_assert(read_byte(client, 0) == 0);
+	test_assert(read_data == 0xA5);
+}
+
+/**
+ * \brief Transfers with a call back message are not retried.
+ * \param client EEPROM client.
+ *
+ * The call back sets up the read message after the word address has been written.
+ */
+static void test_callback(struct i2c_client *client)
+{
+	unsigned long start;
+	i2c_features_t features = I2C_MSG_MASTER_MSG_FLAG | I2C_MSG_TRANSMIT_MSG_FLAG |
+							  I2C_MSG_SENT_REP_START_FLAG | I2C_MSG_CALL_BACK_FLAG;
+
+	test_assert(i2c_set_retries(client, TWR_POLLS, 10) == 0);
+	i2c_set_callback(client, &read_callback);
+	test_assert(write_byte(client, 0x3C) == 0);
+
+	i2c_sim_reset_stats(&sim_bus);
+	start = BermudaTimerGetSysTick();
+	test_assert(i2c_write_client(client, &read_addr, 1, features) == 0);
+	test_assert(i2c_flush_client(client) != 0);
+	test_assert(sim_bus.stats.nacks == 1);
+	test_assert(sim_bus.stats.starts == 1);
+	test_assert(BermudaTimerGetSysTick() == start);
+	test_assert(callbacks == 0);
+
+	sim_eeprom.busy = 0;
+	read_data = 0;
+	test_assert(i2c_write_client(client, &read_addr, 1, features) == 0);
+	test_assert(i2c_flush_client(client) == 0);
+	test_assert(callbacks == 1);
+	test_assert(read_data == 0x3C);
+
+	i2c_set_callback(client, NULL);
+	test_assert(i2c_set_retries(client, 0, 0) == 0);
+}
+
+/**
+ * \brief ACK polling.
+ * \param client EEPROM client.
+ *
+ * The address of a message with I2C_MSG_ACK_POLL_FLAG is repeated until it is acknowledged, for
+ * at most I2C_ACK_POLL_TMO milli seconds of bus time (9 SCL periods per poll).
+ */
+static void test_ack_poll(struct i2c_client *client)
+{
+	unsigned long window = I2C_ACK_POLL_TMO * (SCL_FRQ_24C02 / 1000UL);
+
+	test_assert(write_byte(client, 0x96) == 0);
+	i2c_sim_reset_stats(&sim_bus);
+	test_assert(read_byte(client, I2C_MSG_ACK_POLL_FLAG) == 0);
+	test_assert(read_data == 0x96);
+	test_assert(sim_bus.stats.nacks == 0);
+	test_assert(sim_bus.stats.starts == TWR_POLLS + 2);
+
+	/* a write cycle which takes longer than the window */
+	sim_eeprom.twr_polls = 255;
+	test_assert(write_byte(client, 0x69) == 0);
+	i2c_sim_reset_stats(&sim_bus);
+	test_assert(read_byte(client, I2C_MSG_ACK_POLL_FLAG) != 0);
+	test_assert(sim_bus.stats.nacks == 1);
+	test_assert((sim_bus.stats.starts - 1) * 9 >= window);
+	test_assert((sim_bus.stats.starts - 2) * 9 < window);
+	test_assert(sim_eeprom.busy != 0);
+
+	sim_eeprom.twr_polls = TWR_POLLS;
+	sim_eeprom.busy = 0;
+}
+
+/**
+ * \brief Write a byte to the EEPROM.
+ * \param client EEPROM client.
+ * \param data Byte to write.
+ * \return Error code of i2c_flush_client.
+ */
+static int write_byte(struct i2c_client *client, uint8_t data)
+{
+	void *buffs[] = { write_data };
+
+	write_data[1] = data;
+	if(i2c_queue_transaction(client, &write_seq, buffs, 0)) {
+		return -1;
+	}
+	return i2c_flush_client(client);
+}
+
+/**
+ * \brief Read the byte written by write_byte into read_data.
+ * \param client EEPROM client.
+ * \param flags Flags added to the messages of the transaction.
+ * \return Error code of i2c_flush_client.
+ */
+static int read_byte(struct i2c_client *client, i2c_features_t flags)
+{
+	void *buffs[] = { &read_addr, &read_data };
+
+	read_data = 0;
+	if(i2c_queue_transaction(client, &read_seq, buffs, flags)) {
+		return -1;
+	}
+	return i2c_flush_client(client);
+}
+
+/**
+ * \brief Set up the read after the word address has been written.
+ * \param info Shared info of the client.
+ * \param oldmsg Word address message.
+ * \param newmsg Message to set up.
+ * \return 0, the read is always set up.
+ */
+static int read_callback(struct i2c_shared_info *info, struct i2c_message *oldmsg,
+						 struct i2c_message *newmsg)
+{
+	callbacks++;
+	newmsg->buff = &read_data;
+	newmsg->length = 1;
+	newmsg->iov = NULL;
+	newmsg->iovcnt = 0;
+	i2c_msg_set_features(newmsg, I2C_MSG_MASTER_MSG_FLAG | I2C_MSG_SENT_STOP_FLAG);
+	return 0;
+}
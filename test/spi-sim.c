@@ -0,0 +1,246 @@
+/*
+ *  BermudaOS - SPI core test
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file test/spi-sim.c SPI core test.
+ *
+ * Drives the SPI RAM library and raw flash instructions through the SPI core and the simulated
+ * SPI bus, and checks the result against the 23K256 and flash models.
+ */
+
+#include "host-test.h"
+
+#include <dev/spi.h>
+#include <dev/spi-core.h>
+#include <dev/spi/busses/sim.h>
+
+#include <lib/spiram.h>
+
+#define RAM_CS 1
+#define FLASH_CS 2
+
+/**
+ * \brief Status reads during which the flash model is busy.
+ */
+#define FLASH_BUSY_POLLS 2
+
+/**
+ * \brief Size of the flash model, two sectors.
+ */
+#define FLASH_SIZE (2 * SPI_SIM_FLASH_SECTOR)
+
+#define FLASH_READ 0x03
+#define FLASH_PP 0x02
+#define FLASH_WREN 0x06
+#define FLASH_RDSR 0x05
+#define FLASH_SE 0x20
+#define FLASH_RDID 0x9F
+
+#define FLASH_WIP 0x01
+#define FLASH_WEL 0x02
+
+static struct spi_adapter sim_adapter;
+static struct spi_sim_bus sim_bus;
+static struct spi_sim_23k256 sim_ram;
+static struct spi_sim_flash sim_flash;
+static uint8_t flash_mem[FLASH_SIZE];
+
+/**
+ * \brief Simulated chip select port.
+ */
+static volatile unsigned char sim_port;
+
+static void test_spiram(void);
+static void test_flash(struct spi_client *client);
+static int flash_cmd(struct spi_client *client, uint8_t opcode, uint32_t addr, const void *tx,
+					 void *rx, size_t len);
+static uint8_t flash_status(struct spi_client *client);
+static int flash_wait(struct spi_client *client);
+
+int main(void)
+{
+	struct spi_client *client;
+
+	BermudaHostInit();
+	spi_sim_init(&sim_bus, &sim_adapter, "SPI_SIM");
+	spi_sim_23k256_init(&sim_ram, &sim_port, RAM_CS);
+	spi_sim_flash_init(&sim_flash, &sim_port, FLASH_CS, flash_mem, sizeof(flash_mem),
+					   FLASH_BUSY_POLLS);
+	spi_sim_add_slave(&sim_bus, &sim_ram.slave);
+	spi_sim_add_slave(&sim_bus, &sim_flash.slave);
+
+	spiram_init(&sim_adapter, &sim_port, RAM_CS);
+	test_spiram();
+
+	client = spi_open(&sim_adapter, &sim_port, FLASH_CS, SPI_1MHZ, _FDEV_SETUP_RW | SPI_MASTER);
+	test_assert(client != NULL);
+	test_flash(client);
+	test_assert(spi_close(client) == 0);
+
+	return test_done("spi-sim");
+}
+
+/**
+ * \brief SPI RAM access.
+ *
+ * The first block transfer switches the chip to sequential mode, every block after that takes a
+ * single chip select window.
+ */
+static void test_spiram(void)
+{
+	uint8_t tx[64], rx[64];
+	size_t i;
+
+	for(i = 0; i < sizeof(tx); i++) {
+		tx[i] = (uint8_t)(i * 7 + 1);
+		rx[i] = 0;
+	}
+
+	spi_sim_reset_stats(&sim_bus);
+	test_assert(spiram_write(0x100, tx, sizeof(tx)) == 0);
+	test_assert((sim_ram.status & 0xC0) == 0x40);
+	test_assert(test_equal(&sim_ram.mem[0x100], tx, sizeof(tx)));
+	test_assert(sim_bus.stats.xfers == 2);
+	test_assert(sim_bus.stats.bytes == 2 + 3 + sizeof(tx));
+	test_assert(sim_bus.stats.clocks == 8 * sim_bus.stats.bytes);
+
+	spi_sim_reset_stats(&sim_bus);
+	test_assert(spiram_read(0x100, rx, sizeof(rx)) == 0);
+	test_assert(test_equal(rx, tx, sizeof(rx)));
+	test_assert(sim_bus.stats.xfers == 1);
+	test_assert(sim_bus.stats.bytes == 3 + sizeof(rx));
+	test_assert(spi_sim_bus_time(&sim_bus) != 0);
+
+	/* sequential transfers wrap at the end of the array */
+	test_assert(spiram_write(SPIRAM_SIZE - 16, tx, 32) == 0);
+	test_assert(test_equal(&sim_ram.mem[SPIRAM_SIZE - 16], tx, 16));
+	test_assert(test_equal(&sim_ram.mem[0], &tx[16], 16));
+
+	test_assert(spiram_write_byte(0x200, 0xA5) == 0);
+	test_assert(sim_ram.mem[0x200] == 0xA5);
+	test_assert(spiram_read_byte(0x200) == 0xA5);
+	test_assert(spiram_read(0x200, rx, 0) != 0);
+}
+
+/**
+ * \brief Flash instructions.
+ * \param client Flash client.
+ */
+static void test_flash(struct spi_client *client)
+{
+	uint8_t id[3], tx[32], rx[32];
+	size_t i;
+
+	for(i = 0; i < sizeof(tx); i++) {
+		tx[i] = (uint8_t)(0xF0 - i);
+	}
+
+	test_assert(flash_cmd(client, FLASH_RDID, 0, NULL, id, 0) == 0);
+	test_assert(id[0] == 0xEF && id[1] == 0x40 && id[2] == 13);
+
+	/* a program without the write enable latch is ignored */
+	test_assert(flash_cmd(client, FLASH_PP, 0x10, tx, NULL, 4) == 0);
+	test_assert(flash_mem[0x10] == 0xFF);
+	test_assert(flash_status(client) == 0);
+
+	/* a page program wraps within the page */
+	test_assert(flash_cmd(client, FLASH_WREN, 0, NULL, NULL, 0) == 0);
+	test_assert(flash_status(client) == FLASH_WEL);
+	test_assert(flash_cmd(client, FLASH_PP, 0xF0, tx, NULL, sizeof(tx)) == 0);
+	test_assert(test_equal(&flash_mem[0xF0], tx, 16));
+	test_assert(test_equal(&flash_mem[0], &tx[16], 16));
+
+	/* a busy chip ignores everything except RDSR */
+	test_assert(flash_cmd(client, FLASH_READ, 0xF0, NULL, rx, 16) == 0);
+	test_assert(rx[0] == 0xFF && rx[15] == 0xFF);
+	test_assert(flash_wait(client) == FLASH_BUSY_POLLS);
+	test_assert(flash_cmd(client, FLASH_READ, 0xF0, NULL, rx, 16) == 0);
+	test_assert(test_equal(rx, tx, 16));
+
+	/* a sector erase leaves the other sector alone */
+	test_assert(flash_cmd(client, FLASH_WREN, 0, NULL, NULL, 0) == 0);
+	test_assert(flash_cmd(client, FLASH_PP, SPI_SIM_FLASH_SECTOR, tx, NULL, 8) == 0);
+	test_assert(flash_wait(client) == FLASH_BUSY_POLLS);
+	test_assert(flash_cmd(client, FLASH_WREN, 0, NULL, NULL, 0) == 0);
+	test_assert(flash_cmd(client, FLASH_SE, 0x123, NULL, NULL, 0) == 0);
+	test_assert(flash_wait(client) == FLASH_BUSY_POLLS);
+	test_assert(flash_mem[0] == 0xFF && flash_mem[0xF0] == 0xFF);
+	test_assert(test_equal(&flash_mem[SPI_SIM_FLASH_SECTOR], tx, 8));
+	test_assert(flash_status(client) == 0);
+}
+
+/**
+ * \brief Send a flash instruction.
+ * \param client Flash client.
+ * \param opcode Instruction.
+ * \param addr Address, only sent for READ, PP and SE.
+ * \param tx Data to send, <i>NULL</i> to send 0xFF.
+ * \param rx Buffer for the received data, <i>NULL</i> to discard it.
+ * \param len Length of the data phase, RDID always reads 3 bytes.
+ * \return Error code of spi_flush_message.
+ */
+static int flash_cmd(struct spi_client *client, uint8_t opcode, uint32_t addr, const void *tx,
+					 void *rx, size_t len)
+{
+	uint8_t cmd[] = {
+		opcode, (uint8_t)(addr >> 16), (uint8_t)(addr >> 8), (uint8_t)addr,
+	};
+	struct spi_segment seg[2];
+	struct spi_message msg;
+	size_t cmdlen = 4;
+
+	if(opcode == FLASH_RDID) {
+		len = 3;
+	}
+
+	if(opcode != FLASH_READ && opcode != FLASH_PP && opcode != FLASH_SE) {
+		cmdlen = 1;
+	}
+
+	spi_segment_set(&seg[0], cmd, NULL, cmdlen, FALSE);
+	spi_segment_set(&seg[1], tx, rx, len, FALSE);
+	spi_message_init(&msg, seg, (len) ? 2 : 1);
+	return spi_flush_message(client, &msg);
+}
+
+/**
+ * \brief Read the flash status register.
+ * \param client Flash client.
+ */
+static uint8_t flash_status(struct spi_client *client)
+{
+	uint8_t tx[] = { FLASH_RDSR, 0xFF }, rx[2] = { 0, 0xFF };
+
+	spi_transfer(client, tx, rx, sizeof(tx));
+	return rx[1];
+}
+
+/**
+ * \brief Poll until the program or erase cycle has ended.
+ * \param client Flash client.
+ * \return Amount of status reads which returned WIP.
+ */
+static int flash_wait(struct spi_client *client)
+{
+	int polls = 0;
+
+	while((flash_status(client) & FLASH_WIP) && polls < 100) {
+		polls++;
+	}
+	return polls;
+}
@@ -0,0 +1,215 @@
+/*
+ *  BermudaOS - SPI interrupt driven transfer test
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file test/spi-xfer.c SPI interrupt driven transfer test.
+ *
+ * Checks the double buffered transfers of the SPI core against the interrupt of the simulated
+ * bus, and measures the CPU time they free compared to a polling transfer. The calling thread is
+ * idle while it waits for the simulated interrupt, those ticks are counted by the host port.
+ */
+
+#include "host-test.h"
+
+#include <dev/spi.h>
+#include <dev/spi-core.h>
+#include <dev/spi/busses/sim.h>
+
+#include <lib/spiram.h>
+
+#define RAM_CS 1
+
+/**
+ * \brief Bus clock of the test client, 125 bytes per simulated tick.
+ */
+#define XFER_FREQ 1000000UL
+
+/**
+ * \brief Bus clock at which a buffer of BLOCK_SIZE bytes exceeds SPI_TMO.
+ */
+#define SLOW_FREQ 8000UL
+
+/**
+ * \brief Size of a queued block.
+ */
+#define BLOCK_SIZE 1024
+
+/**
+ * \brief Size of the measured transfer.
+ */
+#define BENCH_SIZE (16 * BLOCK_SIZE)
+
+static struct spi_adapter sim_adapter;
+static struct spi_sim_bus sim_bus;
+static struct spi_sim_23k256 sim_ram;
+static uint8_t block[2][BLOCK_SIZE];
+static uint8_t bench[BENCH_SIZE];
+
+/**
+ * \brief Simulated chip select port.
+ */
+static volatile unsigned char sim_port;
+
+static void test_queue(struct spi_client *client);
+static void test_timeout(struct spi_client *client);
+static void test_freed(struct spi_client *client);
+static unsigned long xfer_read(struct spi_client *client, void *rx, size_t len);
+
+int main(void)
+{
+	struct spi_client *client;
+	uint8_t wrsr[] = { WRSR, 0x40 | HOLD };
+
+	BermudaHostInit();
+	spi_sim_init(&sim_bus, &sim_adapter, "SPI_SIM");
+	spi_sim_23k256_init(&sim_ram, &sim_port, RAM_CS);
+	spi_sim_add_slave(&sim_bus, &sim_ram.slave);
+
+	client = spi_open(&sim_adapter, &sim_port, RAM_CS, XFER_FREQ, _FDEV_SETUP_RW | SPI_MASTER);
+	test_assert(client != NULL);
+	test_assert(spi_transfer(client, wrsr, NULL, sizeof(wrsr)) == 0);
+
+	test_queue(client);
+	test_timeout(client);
+	test_freed(client);
+	test_assert(spi_close(client) == 0);
+
+	return test_done("spi-xfer");
+}
+
+/**
+ * \brief Double buffering.
+ * \param client SPI RAM client.
+ *
+ * spi_xfer_queue returns before the bus has shifted the buffer, and only blocks when a buffer is
+ * queued behind the current one already.
+ */
+static void test_queue(struct spi_client *client)
+{
+	uint8_t cmd[] = { WRDA, 0x10, 0x00 };
+	size_t i;
+
+	for(i = 0; i < BLOCK_SIZE; i++) {
+		block[0][i] = (uint8_t)i;
+		block[1][i] = (uint8_t)~i;
+	}
+
+	spi_sim_reset_stats(&sim_bus);
+	test_assert(spi_xfer_begin(client) == 0);
+	test_assert(spi_xfer_queue(client, cmd, NULL, sizeof(cmd)) == 0);
+	test_assert(spi_xfer_queue(client, block[0], NULL, BLOCK_SIZE) == 0);
+	test_assert(sim_bus.stats.bytes == 0);
+
+	/* waits until the command has been shifted */
+	test_assert(spi_xfer_queue(client, block[1], NULL, BLOCK_SIZE) == 0);
+	test_assert(sim_bus.stats.bytes >= sizeof(cmd));
+	test_assert(sim_bus.stats.bytes < sizeof(cmd) + 2 * BLOCK_SIZE);
+
+	test_assert(spi_xfer_end(client) == 0);
+	test_assert(sim_bus.stats.xfers == 1);
+	test_assert(sim_bus.stats.irqs == sizeof(cmd) + 2 * BLOCK_SIZE);
+	test_assert(sim_bus.timer == NULL);
+	test_assert(test_equal(&sim_ram.mem[0x1000], block[0], BLOCK_SIZE));
+	test_assert(test_equal(&sim_ram.mem[0x1000 + BLOCK_SIZE], block[1], BLOCK_SIZE));
+}
+
+/**
+ * \brief Transfer time-out.
+ * \param client SPI RAM client.
+ *
+ * A transfer which takes longer than SPI_TMO is aborted, the next transfer is not affected.
+ */
+static void test_timeout(struct spi_client *client)
+{
+	struct spi_client *slow;
+
+	slow = spi_open(&sim_adapter, &sim_port, RAM_CS, SLOW_FREQ, _FDEV_SETUP_RW | SPI_MASTER);
+	test_assert(slow != NULL);
+	test_assert(xfer_read(slow, block[0], BLOCK_SIZE) == -1UL);
+	test_assert(sim_bus.timer == NULL);
+	test_assert(sim_bus.active == NULL);
+	test_assert(spi_close(slow) == 0);
+
+	test_assert(xfer_read(client, block[1], 16) != -1UL);
+	test_assert(test_equal(block[1], sim_ram.mem, 16));
+}
+
+/**
+ * \brief Measure the CPU time freed by an interrupt driven transfer.
+ * \param client SPI RAM client.
+ *
+ * A polling transfer keeps the CPU busy for the entire bus time. The interrupt driven transfer
+ * leaves the CPU idle for the same time, apart from the tick in which it completes.
+ */
+static void test_freed(struct spi_client *client)
+{
+	unsigned long idle, bus, irqs;
+	void (*start)(struct spi_adapter*);
+
+	spi_sim_reset_stats(&sim_bus);
+	idle = xfer_read(client, bench, sizeof(bench));
+	bus = spi_sim_bus_time(&sim_bus);
+	irqs = sim_bus.stats.irqs;
+	test_assert(idle != -1UL);
+	test_assert(irqs == 3 + sizeof(bench));
+	test_assert(idle * 1000 + 1000 >= bus && idle * 1000 <= bus + 1000);
+	test_assert(test_equal(bench, sim_ram.mem, sizeof(bench)));
+
+	printf("spi-xfer: interrupt driven: %u bytes, bus %u us, CPU freed %u us/KiB, %u irqs/KiB\n",
+		   (unsigned int)sizeof(bench), (unsigned int)bus,
+		   (unsigned int)(idle * 1000 * 1024 / sizeof(bench)),
+		   (unsigned int)(irqs * 1024 / sizeof(bench)));
+
+	/* the same transfer with the interrupt disabled */
+	start = sim_adapter.start;
+	sim_adapter.start = NULL;
+	spi_sim_reset_stats(&sim_bus);
+	idle = xfer_read(client, bench, sizeof(bench));
+	bus = spi_sim_bus_time(&sim_bus);
+	sim_adapter.start = start;
+	test_assert(idle == 0);
+	test_assert(sim_bus.stats.polls == 3 + sizeof(bench));
+
+	printf("spi-xfer: polling: %u bytes, bus %u us, CPU freed %u us/KiB\n",
+		   (unsigned int)sizeof(bench), (unsigned int)bus,
+		   (unsigned int)(idle * 1000 * 1024 / sizeof(bench)));
+}
+
+/**
+ * \brief Read the SPI RAM from address 0.
+ * \param client SPI RAM client.
+ * \param rx Buffer to read into.
+ * \param len Amount of bytes to read.
+ * \return Simulated ticks the thread was idle, -1 if the transfer failed.
+ */
+static unsigned long xfer_read(struct spi_client *client, void *rx, size_t len)
+{
+	uint8_t cmd[] = { RDDA, 0, 0 };
+	struct spi_segment seg[2];
+	struct spi_message msg;
+	unsigned long idle = BermudaHostIdleTicks();
+
+	spi_segment_set(&seg[0], cmd, NULL, sizeof(cmd), FALSE);
+	spi_segment_set(&seg[1], NULL, rx, len, FALSE);
+	spi_message_init(&msg, seg, 2);
+	if(spi_flush_message(client, &msg)) {
+		return -1UL;
+	}
+
+	return BermudaHostIdleTicks() - idle;
+}
@@ -0,0 +1,178 @@
+/*
+ *  BermudaOS - SPI RAM benchmark
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file test/spiram-bench.c SPI RAM benchmark.
+ *
+ * Copies a block to and from the simulated 23K256 byte by byte (spiram_write_byte and
+ * spiram_read_byte) and in sequential mode (spiram_write and spiram_read), and compares the bus
+ * statistics of both. Every byte mode access takes a chip select window and a 3 byte command,
+ * while a sequential access sends the command once for the entire block.
+ */
+
+#include "host-test.h"
+
+#include <dev/spi.h>
+#include <dev/spi-core.h>
+#include <dev/spi/busses/sim.h>
+
+#include <lib/spiram.h>
+
+#define RAM_CS 1
+
+/**
+ * \brief Size of the copied block.
+ */
+#define BENCH_SIZE 1024
+
+/**
+ * \brief SPI RAM address of the block.
+ */
+#define BENCH_ADDR 0x2000
+
+static struct spi_adapter sim_adapter;
+static struct spi_sim_bus sim_bus;
+static struct spi_sim_23k256 sim_ram;
+static uint8_t tx[BENCH_SIZE], rx[BENCH_SIZE];
+
+/**
+ * \brief Simulated chip select port.
+ */
+static volatile unsigned char sim_port;
+
+/**
+ * \brief Bus statistics of a copy.
+ */
+struct bench_result
+{
+	unsigned long xfers; //!< Chip select windows.
+	unsigned long bytes; //!< Bytes on the bus.
+	unsigned long time; //!< Bus time in micro seconds.
+};
+
+static void bench_byte(struct bench_result *wr, struct bench_result *rd);
+static void bench_seq(struct bench_result *wr, struct bench_result *rd);
+static void bench_save(struct bench_result *result);
+static void bench_print(const char *name, struct bench_result *result);
+
+int main(void)
+{
+	struct bench_result byte_wr, byte_rd, seq_wr, seq_rd;
+	size_t i;
+
+	BermudaHostInit();
+	spi_sim_init(&sim_bus, &sim_adapter, "SPI_SIM");
+	spi_sim_23k256_init(&sim_ram, &sim_port, RAM_CS);
+	spi_sim_add_slave(&sim_bus, &sim_ram.slave);
+	spiram_init(&sim_adapter, &sim_port, RAM_CS);
+
+	for(i = 0; i < BENCH_SIZE; i++) {
+		tx[i] = (uint8_t)(i ^ (i >> 8));
+	}
+
+	bench_byte(&byte_wr, &byte_rd);
+	bench_seq(&seq_wr, &seq_rd);
+
+	bench_print("byte write", &byte_wr);
+	bench_print("byte read", &byte_rd);
+	bench_print("seq write", &seq_wr);
+	bench_print("seq read", &seq_rd);
+
+	test_assert(byte_wr.xfers == BENCH_SIZE && byte_rd.xfers == BENCH_SIZE);
+	test_assert(seq_wr.xfers <= 2 && seq_rd.xfers == 1);
+	test_assert(seq_rd.bytes == 3 + BENCH_SIZE);
+	test_assert(byte_wr.time > 3 * seq_wr.time);
+	test_assert(byte_rd.time > 3 * seq_rd.time);
+
+	return test_done("spiram-bench");
+}
+
+/**
+ * \brief Copy the block in byte mode.
+ * \param wr Statistics of the write.
+ * \param rd Statistics of the read.
+ */
+static void bench_byte(struct bench_result *wr, struct bench_result *rd)
+{
+	size_t i;
+	bool ok = TRUE;
+
+	spi_sim_reset_stats(&sim_bus);
+	for(i = 0; i < BENCH_SIZE; i++) {
+		ok = ok && spiram_write_byte(BENCH_ADDR + i, tx[i]) == 0;
+	}
+	bench_save(wr);
+	test_assert(ok);
+	test_assert(test_equal(&sim_ram.mem[BENCH_ADDR], tx, BENCH_SIZE));
+
+	spi_sim_reset_stats(&sim_bus);
+	for(i = 0; i < BENCH_SIZE; i++) {
+		rx[i] = spiram_read_byte(BENCH_ADDR + i);
+	}
+	bench_save(rd);
+	test_assert(test_equal(rx, tx, BENCH_SIZE));
+}
+
+/**
+ * \brief Copy the block in sequential mode.
+ * \param wr Statistics of the write, including the mode switch.
+ * \param rd Statistics of the read.
+ */
+static void bench_seq(struct bench_result *wr, struct bench_result *rd)
+{
+	size_t i;
+
+	for(i = 0; i < BENCH_SIZE; i++) {
+		sim_ram.mem[BENCH_ADDR + i] = 0;
+		rx[i] = 0;
+	}
+
+	spi_sim_reset_stats(&sim_bus);
+	test_assert(spiram_write(BENCH_ADDR, tx, BENCH_SIZE) == 0);
+	bench_save(wr);
+	test_assert(test_equal(&sim_ram.mem[BENCH_ADDR], tx, BENCH_SIZE));
+
+	spi_sim_reset_stats(&sim_bus);
+	test_assert(spiram_read(BENCH_ADDR, rx, BENCH_SIZE) == 0);
+	bench_save(rd);
+	test_assert(test_equal(rx, tx, BENCH_SIZE));
+}
+
+/**
+ * \brief Save the bus statistics of the last copy.
+ * \param result Result to fill.
+ */
+static void bench_save(struct bench_result *result)
+{
+	result->xfers = sim_bus.stats.xfers;
+	result->bytes = sim_bus.stats.bytes;
+	result->time = spi_sim_bus_time(&sim_bus);
+}
+
+/**
+ * \brief Print a result.
+ * \param name Name of the copy.
+ * \param result Bus statistics of the copy.
+ */
+static void bench_print(const char *name, struct bench_result *result)
+{
+	printf("spiram-bench: %s: %u bytes, %u chip selects, %u bus bytes, %u us, %u KiB/s\n",
+		   name, BENCH_SIZE, (unsigned int)result->xfers, (unsigned int)result->bytes,
+		   (unsigned int)result->time,
+		   (unsigned int)((BENCH_SIZE * 1000000UL / 1024) / result->time));
+}
@@ -0,0 +1,262 @@
+/*
+ *  BermudaOS - SPI RAM cache test
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file test/spiram-cache.c SPI RAM cache test.
+ *
+ * Runs the SPI RAM cache against the simulated 23K256. Every line load and write back is a single
+ * sequential transfer, so the chip selects of the simulated bus show which lines were moved.
+ */
+
+#include "host-test.h"
+
+#include <dev/spi.h>
+#include <dev/spi-core.h>
+#include <dev/spi/busses/sim.h>
+
+#include <lib/spiram.h>
+#include <lib/spiram-cache.h>
+
+#define RAM_CS 1
+
+/**
+ * \brief Distance between two lines of the same set.
+ */
+#define SET_STRIDE (SPIRAM_CACHE_LINE * SPIRAM_CACHE_SETS)
+
+static struct spi_adapter sim_adapter;
+static struct spi_sim_bus sim_bus;
+static struct spi_sim_23k256 sim_ram;
+
+/**
+ * \brief Simulated chip select port.
+ */
+static volatile unsigned char sim_port;
+
+static void test_lru(void);
+static void test_writeback(void);
+static void test_flush(void);
+static void test_whole_line(void);
+static void test_wrap(void);
+static bool cache_stats(unsigned long hits, unsigned long misses, unsigned long writebacks);
+static uint8_t pattern(spiram_ptr ptr);
+
+int main(void)
+{
+	unsigned int i;
+
+	BermudaHostInit();
+	spi_sim_init(&sim_bus, &sim_adapter, "SPI_SIM");
+	spi_sim_23k256_init(&sim_ram, &sim_port, RAM_CS);
+	spi_sim_add_slave(&sim_bus, &sim_ram.slave);
+	spiram_init(&sim_adapter, &sim_port, RAM_CS);
+
+	for(i = 0; i < SPIRAM_SIZE; i++) {
+		sim_ram.mem[i] = pattern(i);
+	}
+
+	test_lru();
+	test_writeback();
+	test_flush();
+	test_whole_line();
+	test_wrap();
+
+	return test_done("spiram-cache");
+}
+
+/**
+ * \brief Replacement of the least recently used line of a set.
+ *
+ * All ways of set 0 are loaded, after which the first line is used again. The next line of the
+ * set replaces the second line, which is then the least recently used one.
+ */
+static void test_lru(void)
+{
+	uint8_t byte;
+	unsigned int way;
+
+	spiram_cache_init();
+	for(way = 0; way < SPIRAM_CACHE_WAYS; way++) {
+		test_assert(spiram_ptr_get(way * SET_STRIDE + 1) == pattern(way * SET_STRIDE + 1));
+	}
+	test_assert(cache_stats(0, SPIRAM_CACHE_WAYS, 0));
+
+	test_assert(spiram_ptr_get(2) == pattern(2));
+	test_assert(spiram_ptr_get(SPIRAM_CACHE_WAYS * SET_STRIDE) ==
+				pattern(SPIRAM_CACHE_WAYS * SET_STRIDE));
+	test_assert(cache_stats(1, SPIRAM_CACHE_WAYS + 1, 0));
+
+	spi_sim_reset_stats(&sim_bus);
+	test_assert(spiram_ptr_read(0, &byte, 1) == 0);
+	test_assert(byte == pattern(0));
+	test_assert(sim_bus.stats.xfers == 0);
+	test_assert(spiram_ptr_read(SET_STRIDE, &byte, 1) == 0);
+	test_assert(byte == pattern(SET_STRIDE));
+	test_assert(sim_bus.stats.xfers == 1);
+	test_assert(sim_bus.stats.bytes == 3 + SPIRAM_CACHE_LINE);
+	test_assert(cache_stats(2, SPIRAM_CACHE_WAYS + 2, 0));
+}
+
+/**
+ * \brief Write back of a dirty line when it is replaced.
+ *
+ * A partial write loads the line first, so the rest of the line is preserved. Nothing is written
+ * to the SPI RAM until the line is replaced.
+ */
+static void test_writeback(void)
+{
+	spiram_ptr base = 0x1000;
+	unsigned int way;
+
+	spiram_cache_init();
+	spi_sim_reset_stats(&sim_bus);
+	test_assert(spiram_ptr_set(base + 5, 0xA5) == 0);
+	test_assert(sim_bus.stats.xfers == 1);
+	test_assert(sim_ram.mem[base + 5] == pattern(base + 5));
+
+	for(way = 1; way < SPIRAM_CACHE_WAYS; way++) {
+		test_assert(spiram_ptr_get(base + way * SET_STRIDE) == pattern(base + way * SET_STRIDE));
+	}
+	test_assert(sim_ram.mem[base + 5] == pattern(base + 5));
+	test_assert(cache_stats(0, SPIRAM_CACHE_WAYS, 0));
+
+	spi_sim_reset_stats(&sim_bus);
+	test_assert(spiram_ptr_get(base + SPIRAM_CACHE_WAYS * SET_STRIDE) ==
+				pattern(base + SPIRAM_CACHE_WAYS * SET_STRIDE));
+	test_assert(sim_bus.stats.xfers == 2);
+	test_assert(cache_stats(0, SPIRAM_CACHE_WAYS + 1, 1));
+	test_assert(sim_ram.mem[base + 5] == 0xA5);
+	test_assert(sim_ram.mem[base + 4] == pattern(base + 4));
+	test_assert(sim_ram.mem[base + 6] == pattern(base + 6));
+
+	/* the write back is done, the line is clean in the SPI RAM */
+	test_assert(spiram_ptr_get(base + 5) == 0xA5);
+	test_assert(cache_stats(0, SPIRAM_CACHE_WAYS + 2, 1));
+}
+
+/**
+ * \brief Write back of all dirty lines by spiram_cache_flush.
+ *
+ * The flushed lines stay cached and are not written again by the next flush.
+ */
+static void test_flush(void)
+{
+	uint8_t data[] = { 0x10, 0x20, 0x30, 0x40 };
+	uint8_t buff[sizeof(data)];
+
+	spiram_cache_init();
+	test_assert(spiram_ptr_write(0x2010, data, sizeof(data)) == 0);
+	test_assert(spiram_ptr_write(0x2090 + SPIRAM_CACHE_LINE, data, sizeof(data)) == 0);
+	test_assert(spiram_ptr_get(0x2100) == pattern(0x2100));
+	test_assert(sim_ram.mem[0x2010] == pattern(0x2010));
+
+	spi_sim_reset_stats(&sim_bus);
+	test_assert(spiram_cache_flush() == 0);
+	test_assert(sim_bus.stats.xfers == 2);
+	test_assert(cache_stats(0, 3, 2));
+	test_assert(test_equal(&sim_ram.mem[0x2010], data, sizeof(data)));
+	test_assert(test_equal(&sim_ram.mem[0x2090 + SPIRAM_CACHE_LINE], data, sizeof(data)));
+
+	spi_sim_reset_stats(&sim_bus);
+	test_assert(spiram_cache_flush() == 0);
+	test_assert(spiram_ptr_read(0x2010, buff, sizeof(buff)) == 0);
+	test_assert(test_equal(buff, data, sizeof(data)));
+	test_assert(sim_bus.stats.xfers == 0);
+	test_assert(cache_stats(1, 3, 2));
+}
+
+/**
+ * \brief Writes covering entire lines.
+ *
+ * A line which is overwritten entirely is not loaded from the SPI RAM. An unaligned write of the
+ * same length covers two lines partially, both of which are loaded.
+ */
+static void test_whole_line(void)
+{
+	uint8_t data[2 * SPIRAM_CACHE_LINE];
+	size_t i;
+
+	for(i = 0; i < sizeof(data); i++) {
+		data[i] = (uint8_t)(0xC0 + i);
+	}
+
+	spiram_cache_init();
+	spi_sim_reset_stats(&sim_bus);
+	test_assert(spiram_ptr_write(0x3000, data, sizeof(data)) == 0);
+	test_assert(sim_bus.stats.xfers == 0);
+	test_assert(cache_stats(0, 2, 0));
+
+	test_assert(spiram_cache_flush() == 0);
+	test_assert(sim_bus.stats.xfers == 2);
+	test_assert(test_equal(&sim_ram.mem[0x3000], data, sizeof(data)));
+
+	spiram_cache_init();
+	spi_sim_reset_stats(&sim_bus);
+	test_assert(spiram_ptr_write(0x3110, data, SPIRAM_CACHE_LINE) == 0);
+	test_assert(sim_bus.stats.xfers == 2);
+	test_assert(cache_stats(0, 2, 0));
+	test_assert(spiram_cache_flush() == 0);
+	test_assert(test_equal(&sim_ram.mem[0x3110], data, SPIRAM_CACHE_LINE));
+	test_assert(sim_ram.mem[0x310F] == pattern(0x310F));
+	test_assert(sim_ram.mem[0x3130] == pattern(0x3130));
+}
+
+/**
+ * \brief Addresses wrap around at SPIRAM_SIZE.
+ */
+static void test_wrap(void)
+{
+	uint8_t data[] = { 0xDE, 0xAD, 0xBE, 0xEF };
+	uint8_t buff[sizeof(data)];
+
+	spiram_cache_init();
+	test_assert(spiram_ptr_write(SPIRAM_SIZE - 2, data, sizeof(data)) == 0);
+	test_assert(spiram_cache_flush() == 0);
+	test_assert(sim_ram.mem[SPIRAM_SIZE - 2] == 0xDE && sim_ram.mem[SPIRAM_SIZE - 1] == 0xAD);
+	test_assert(sim_ram.mem[0] == 0xBE && sim_ram.mem[1] == 0xEF);
+	test_assert(cache_stats(0, 2, 2));
+
+	test_assert(spiram_ptr_read(SPIRAM_SIZE - 2, buff, sizeof(buff)) == 0);
+	test_assert(test_equal(buff, data, sizeof(data)));
+	test_assert(spiram_ptr_get(SPIRAM_SIZE + 1) == 0xEF);
+	test_assert(cache_stats(3, 2, 2));
+}
+
+/**
+ * \brief Compare the cache statistics.
+ * \param hits Expected hits.
+ * \param misses Expected misses.
+ * \param writebacks Expected write backs.
+ * \return TRUE if the statistics match.
+ */
+static bool cache_stats(unsigned long hits, unsigned long misses, unsigned long writebacks)
+{
+	struct spiram_cache_stats stats;
+
+	spiram_cache_get_stats(&stats);
+	return stats.hits == hits && stats.misses == misses && stats.writebacks == writebacks;
+}
+
+/**
+ * \brief Initial content of the SPI RAM.
+ * \param ptr SPI RAM address.
+ */
+static uint8_t pattern(spiram_ptr ptr)
+{
+	return (uint8_t)(ptr ^ (ptr >> 8));
+}
@@ -0,0 +1,133 @@
+/*
+ *  BermudaOS - Timer thread test
+ *  Copyright (C) 2012   Michel Megens <dev@michelmegens.net>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file test/timer-thread.c Timer thread test.
+ *
+ * The program is linked with its own copy of the virtual timers, built with __TIMER_THREAD__
+ * (see <i>timer_thread_CPPFLAGS</i>), so the timer thread is covered whether or not it was
+ * enabled by configure. BermudaTimerInit creates the timer thread, which the host port runs
+ * after every simulated tick.
+ */
+
+#include "host-test.h"
+
+#include <sys/thread.h>
+#include <sys/virt_timer.h>
+
+/**
+ * \brief Call-backs of a timer.
+ */
+struct timer_record
+{
+	unsigned int calls; //!< Amount of call-backs.
+	unsigned long tick; //!< System tick of the last call-back.
+	THREAD *thread; //!< Thread which ran the last call-back.
+};
+
+static void test_deferred(void);
+static void test_inline(void);
+static void test_periodic(void);
+static void timer_record(VTIMER *timer, void *arg);
+
+int main(void)
+{
+	BermudaHostInit();
+	BermudaTimerInit();
+
+	test_deferred();
+	test_inline();
+	test_periodic();
+
+	return test_done("timer-thread");
+}
+
+/**
+ * \brief One-shot timer executed by the timer thread.
+ */
+static void test_deferred(void)
+{
+	struct timer_record rec = { 0, 0, NULL };
+	unsigned long start = BermudaTimerGetSysTick();
+
+	test_assert(BermudaTimerCreate(5, &timer_record, &rec, BERMUDA_ONE_SHOT) != NULL);
+	BermudaThreadSleep(10);
+
+	test_assert(rec.calls == 1);
+	test_assert(rec.tick == start + 5);
+	test_assert(rec.thread != NULL && rec.thread != BermudaCurrentThread);
+	test_assert(rec.thread->name[0] == 'T');
+}
+
+/**
+ * \brief One-shot timer flagged with BERMUDA_TIMER_INLINE.
+ *
+ * The call-back runs in BermudaTimerProcess, which is called by the waiting main thread.
+ */
+static void test_inline(void)
+{
+	struct timer_record rec = { 0, 0, NULL };
+	unsigned long start = BermudaTimerGetSysTick();
+
+	test_assert(BermudaTimerCreate(5, &timer_record, &rec,
+								   BERMUDA_ONE_SHOT | BERMUDA_TIMER_INLINE) != NULL);
+	BermudaThreadSleep(10);
+
+	test_assert(rec.calls == 1);
+	test_assert(rec.tick == start + 5);
+	test_assert(rec.thread == BermudaCurrentThread);
+}
+
+/**
+ * \brief Periodic timer executed by the timer thread.
+ *
+ * The timer is re-armed relative to the tick at which it expired, so it does not drift. A stopped
+ * timer is not called again.
+ */
+static void test_periodic(void)
+{
+	struct timer_record rec = { 0, 0, NULL };
+	unsigned long start = BermudaTimerGetSysTick();
+	VTIMER *timer;
+
+	timer = BermudaTimerCreate(10, &timer_record, &rec, BERMUDA_PERIODIC);
+	test_assert(timer != NULL);
+	BermudaThreadSleep(100);
+
+	test_assert(rec.calls == 10);
+	test_assert(rec.tick == start + 100);
+	test_assert(rec.thread != BermudaCurrentThread);
+
+	BermudaTimerStop(timer);
+	BermudaThreadSleep(30);
+	test_assert(rec.calls == 10);
+}
+
+/**
+ * \brief Timer call-back.
+ * \param timer Expired timer.
+ * \param arg Timer record.
+ */
+static void timer_record(VTIMER *timer, void *arg)
+{
+	struct timer_record *rec = arg;
+
+	rec->calls++;
+	rec->tick = BermudaTimerGetSysTick();
+	rec->thread = BermudaCurrentThread;
+}